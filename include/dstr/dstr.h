@@ -19,6 +19,14 @@
 #define strncasecmp _strnicmp
 #endif
 
+// Text or binary safe build. By default a DSTR holds text: input
+// buffers (*_bl, *_range) end at their first NUL, NUL characters are
+// not appended and slurped files with NUL bytes are rejected. Define
+// DSTR_BINARY_SAFE for the library and everything using it to keep NUL
+// bytes as ordinary bytes everywhere. Searches and comparisons go by
+// length in both builds (the case insensitive compares stay text only)
+//
+
 // Test for 32 vs 64 bit build
 //
 #if UINTPTR_MAX > UINT32_MAX
@@ -165,6 +173,20 @@ int dstr_resize(DSTR dest, size_t len);
 int dstr_reserve(DSTR p, size_t len);
 int dstr_shrink_to_fit(DSTR d);
 
+/*
+ *  Ownership transfer of malloc'd buffers, no copy for heap sized data.
+ *  adopt: BUF (CAP bytes from malloc/realloc, LEN < CAP) replaces the
+ *  contents of P and is freed by the library from then on. Buffers that
+ *  fit the SSO area are copied and freed at once. The capacity kept is
+ *  CAP rounded down to a multiple of DSTR_INITIAL_CAPACITY, BUF is
+ *  realloc'd up to the next one if that drops the room for the NUL. On
+ *  failure (errno EINVAL / ERANGE) BUF still belongs to the caller.
+ *  release: returns the NUL terminated buffer of P for the caller to free()
+ *  and leaves P empty. SSO data is copied into a fresh malloc'd block.
+ */
+int   dstr_adopt_buffer(DSTR p, char* buf, size_t len, size_t cap);
+char* dstr_release_buffer(DSTR p, size_t* len, size_t* cap);
+
 /*
  *  Following operations manipulate data but no allocation / free
  */
@@ -220,17 +242,79 @@ double    dstr_atof(CDSTR src);
 int dstr_itos_ul(DSTR dest, unsigned long long n, unsigned int base);
 int dstr_itos(DSTR dest, long long n);
 
+/* floating point to string, appended to DEST. Locale independent.
+ * _double/_float: shortest representation that round-trips
+ * _fixed: like printf's "%.*f" with PRECISION decimals
+ */
+int dstr_append_double(DSTR dest, double value);
+int dstr_append_float(DSTR dest, float value);
+int dstr_append_double_fixed(DSTR dest, double value, int precision);
+
+/* hex and base64 (RFC 4648) encoding appended to DEST. Decoding is strict,
+ * on invalid input errno is EINVAL and DEST is unchanged. Decoded data
+ * may contain NUL bytes only with DSTR_BINARY_SAFE, a text build fails
+ * with EINVAL instead.
+ */
+#define DSTR_HEX_UPPER      1   /* encode with A-F */
+#define DSTR_BASE64_URL     2   /* '-' and '_' instead of '+' and '/' */
+#define DSTR_BASE64_NOPAD   4   /* no '=' padding (required when decoding) */
+
+int    dstr_append_hex(DSTR dest, const void* buff, size_t len, int flags);
+int    dstr_decode_hex(DSTR dest, const char* src, size_t len);
+int    dstr_append_base64(DSTR dest, const void* buff, size_t len, int flags);
+int    dstr_decode_base64(DSTR dest, const char* src, size_t len, int flags);
+size_t dstr_base64_encoded_length(size_t len, int flags);
+
+/* escaping appended to DEST, one mode at a time:
+ *   DSTR_ESC_JSON  JSON string contents (no surrounding quotes)
+ *   DSTR_ESC_C     C string literal contents, octal for other bytes
+ *   DSTR_ESC_URL   percent encoding of all but RFC 3986 unreserved
+ *   DSTR_ESC_HTML  & < > " '
+ * Unescaping is strict like the decoders above, a NUL byte in the output
+ * (for example \0 or %00) also needs DSTR_BINARY_SAFE.
+ */
+#define DSTR_ESC_JSON   1
+#define DSTR_ESC_C      2
+#define DSTR_ESC_URL    4
+#define DSTR_ESC_HTML   8
+
+int dstr_append_escaped(DSTR dest, CDSTR src, int mode);
+int dstr_append_escaped_bl(DSTR dest, const char* buff, size_t len, int mode);
+int dstr_append_unescaped(DSTR dest, CDSTR src, int mode);
+int dstr_append_unescaped_bl(DSTR dest, const char* buff, size_t len, int mode);
+
+/* UTF-8. Validation is strict (no overlongs, surrogates or values above
+ * U+10FFFF), on failure *ERROR_OFFSET (if not NULL) is set to the offset
+ * of the first invalid sequence. Length and offset_of assume valid input,
+ * offset_of returns the byte offset of code point N or DSTR_NPOS.
+ * to_utf16/to_utf32 return the number of code units needed, writing at
+ * most DESTLEN of them (DEST may be NULL), DSTR_NPOS if SRC is invalid.
+ * append_utf16/append_utf32 fail with EINVAL on invalid input.
+ */
+DSTR_BOOL dstr_utf8_validate(CDSTR p, size_t* error_offset);
+DSTR_BOOL dstr_utf8_validate_bl(const char* buff, size_t len, size_t* error_offset);
+size_t    dstr_utf8_length(CDSTR p);
+size_t    dstr_utf8_offset_of(CDSTR p, size_t n);
+size_t    dstr_utf8_to_utf16(CDSTR src, uint16_t* dest, size_t destlen);
+size_t    dstr_utf8_to_utf32(CDSTR src, uint32_t* dest, size_t destlen);
+int       dstr_append_utf16(DSTR dest, const uint16_t* src, size_t len);
+int       dstr_append_utf32(DSTR dest, const uint32_t* src, size_t len);
+
 /* find s in p. returns index or DSTR_NPOS if not found*/
 size_t dstr_find_c(CDSTR p, size_t pos, char c);
 size_t dstr_find_sz(CDSTR p, size_t pos, const char* s);
+size_t dstr_find_bl(CDSTR p, size_t pos, const char* buff, size_t len);
 size_t dstr_ifind_c(CDSTR p, size_t pos, char c);
 size_t dstr_ifind_sz(CDSTR p, size_t pos, const char* s);
+size_t dstr_ifind_bl(CDSTR p, size_t pos, const char* buff, size_t len);
 
 /* Reverse find s in p. returns index or DSTR_NPOS if not found */
 size_t dstr_rfind_c(CDSTR p, size_t pos, char c);
 size_t dstr_rfind_sz(CDSTR p, size_t pos, const char* s);
+size_t dstr_rfind_bl(CDSTR p, size_t pos, const char* buff, size_t len);
 size_t dstr_irfind_c(CDSTR p, size_t pos, char c);
 size_t dstr_irfind_sz(CDSTR p, size_t pos, const char* s);
+size_t dstr_irfind_bl(CDSTR p, size_t pos, const char* buff, size_t len);
 
 /* count non-overlapping occurrences of s in p */
 size_t dstr_count_sz(CDSTR p, const char* s);
@@ -258,11 +342,15 @@ DSTR_BOOL dstr_isupper(CDSTR p);
 
 /* p has suffix s, 'endswith' */
 DSTR_BOOL dstr_suffix_sz(CDSTR p, const char* s);
+DSTR_BOOL dstr_suffix_bl(CDSTR p, const char* buff, size_t len);
 DSTR_BOOL dstr_isuffix_sz(CDSTR p, const char* s);
+DSTR_BOOL dstr_isuffix_bl(CDSTR p, const char* buff, size_t len);
 
 /* p has prefix s, 'startswith' */
 DSTR_BOOL dstr_prefix_sz(CDSTR p, const char* s);
+DSTR_BOOL dstr_prefix_bl(CDSTR p, const char* buff, size_t len);
 DSTR_BOOL dstr_iprefix_sz(CDSTR p, const char* s);
+DSTR_BOOL dstr_iprefix_bl(CDSTR p, const char* buff, size_t len);
 
 /* ffo = find_first of, ffno = find first not of */
 size_t dstr_ffo_sz(CDSTR p, size_t pos, const char* selectors);
@@ -295,6 +383,90 @@ static inline int dstr_fputs(CDSTR d, FILE* fp) {
 static inline int dstr_puts(CDSTR d) {
     return dstr_fputs(d, stdout); }
 
+/* Block buffered reader of lines or tokens. Records end at any of the
+ * delimiter characters (default "\n"), the last one may be unterminated.
+ * next copies a record into DEST, next_view returns a view into the
+ * reader's buffer that is valid until the next call. The view is not NUL
+ * terminated, so it is not a valid CDSTR argument: use its data and
+ * length (or copy it with dstr_assign_bl). Both return
+ * DSTR_SUCCESS or EOF, after EOF dstr_reader_error() is 0 or an errno.
+ * A reader from dstr_reader_open() owns its file descriptor.
+ */
+#define DSTR_READER_CRLF        1   /* drop '\r' before a '\n' delimiter */
+#define DSTR_READER_SKIP_EMPTY  2   /* skip empty records (token mode) */
+
+typedef struct DSTR_Reader DSTR_Reader;
+
+DSTR_Reader* dstr_reader_open(const char* path);
+DSTR_Reader* dstr_reader_fdopen(int fd);
+DSTR_Reader* dstr_reader_from_stream(FILE* fp);
+void         dstr_reader_close(DSTR_Reader* r);
+void         dstr_reader_set_delims(DSTR_Reader* r, const char* delims, int flags);
+int          dstr_reader_next(DSTR_Reader* r, DSTR dest);
+int          dstr_reader_next_view(DSTR_Reader* r, DSTR_VIEW* view);
+int          dstr_reader_error(const DSTR_Reader* r);
+
+/* Whole file as a read only view: memory mapped with MADV_SEQUENTIAL where
+ * available, else read into one exactly sized buffer. The view is NUL
+ * terminated and may be passed to functions taking a CDSTR (cast its
+ * address). Release with dstr_unmap_file.
+ */
+int  dstr_map_file(const char* path, DSTR_VIEW* view);
+void dstr_unmap_file(DSTR_VIEW* view);
+
+/* Slurp N files into the existing DSTRs OUT[0..N). Opens, sizes and reads
+ * are batched through io_uring on Linux, elsewhere (or if io_uring is not
+ * available) spread over a few threads. Each DSTR is allocated once from
+ * the file size. ERRORS (may be NULL) receives 0 or an errno per file, a
+ * failed file leaves its DSTR empty. Returns the number of files read.
+ */
+size_t dstr_slurp_many(const char* const paths[], size_t n, DSTR out[], int errors[]);
+
+/* Call CB for every line of the file PATH on NTHREADS threads (0: one per
+ * processor). Lines end at '\n' (not part of the view), the last one may
+ * be unterminated. The view points into the mapped file and is not NUL
+ * terminated, it is not a valid CDSTR argument. The file is mapped and
+ * split at line boundaries into chunks that depend only on its contents:
+ * a line starting at byte offset P belongs to chunk P / DSTR_LINE_CHUNK,
+ * and each chunk's lines are passed in order on one thread together with
+ * the chunk number, so results kept per chunk can be merged in file
+ * order. CB returning nonzero stops the run, other threads finish the
+ * chunks they are in. Returns DSTR_SUCCESS or DSTR_FAIL with errno set.
+ */
+#define DSTR_LINE_CHUNK  (4U * 1024U * 1024U)
+
+typedef int (*DSTR_LineCallback)(void* ctx, size_t chunk, const DSTR_VIEW* line);
+
+int dstr_file_foreach_line_parallel(const char* path, size_t nthreads, DSTR_LineCallback cb, void* ctx);
+
+/* Vectored output. dstr_writev writes N strings to FD with writev(2) in
+ * IOV_MAX sized batches (NULL entries are empty). A DSTR_Writer collects
+ * pieces and writes them the same way when its batch fills, on flush and
+ * on close: long pieces from dstr_writer_add are not copied and must stay
+ * valid until then, short ones and those from dstr_writer_add_copy are
+ * packed into an internal block. Interrupted and short writes are
+ * resumed. All return DSTR_SUCCESS or DSTR_FAIL with errno set; after a
+ * failure a writer keeps failing and dstr_writer_error() returns the
+ * errno. A writer from dstr_writer_open() creates (truncates) the file
+ * and owns its descriptor.
+ */
+#define DSTR_WRITE_NEWLINE  1   /* '\n' after each string */
+
+typedef struct DSTR_Writer DSTR_Writer;
+
+int          dstr_writev(int fd, const CDSTR strs[], size_t n, int flags);
+
+DSTR_Writer* dstr_writer_open(const char* path, int flags);
+DSTR_Writer* dstr_writer_fdopen(int fd, int flags);
+int          dstr_writer_add(DSTR_Writer* w, const char* data, size_t len);
+int          dstr_writer_add_copy(DSTR_Writer* w, const char* data, size_t len);
+int          dstr_writer_flush(DSTR_Writer* w);
+int          dstr_writer_close(DSTR_Writer* w);
+int          dstr_writer_error(const DSTR_Writer* w);
+
+static inline int dstr_writer_add_dstr(DSTR_Writer* w, CDSTR d) {
+    return dstr_writer_add(w, d->data, d->length); }
+
 /* translate and squeeze */
 void dstr_translate(DSTR dest, const char* arr1, const char* arr2);
 void dstr_squeeze(DSTR dest, const char* squeeze);
@@ -327,6 +499,36 @@ float              dstr_to_float(CDSTR p, size_t* index);
 double             dstr_to_double(CDSTR p, size_t* index);
 long double        dstr_to_ldouble(CDSTR p, size_t* index);
 
+/*
+ * Integer parsing on a buffer, strtoll/strtoull syntax and index/errno
+ * semantics. dstr_atoll_bl uses the dstr_atoi prefix rules
+ */
+long long          dstr_to_llong_bl(const char* buff, size_t len, size_t* index, int base);
+unsigned long long dstr_to_ullong_bl(const char* buff, size_t len, size_t* index, int base);
+long long          dstr_atoll_bl(const char* buff, size_t len);
+
+/*
+ * Locale independent floating point parsing on a buffer. Same syntax and
+ * index/errno semantics as strtod but the decimal point is always '.'
+ */
+float  dstr_to_float_bl(const char* buff, size_t len, size_t* index);
+double dstr_to_double_bl(const char* buff, size_t len, size_t* index);
+
+/*
+ * Parse up to N numbers separated by SEP into DEST. Returns the number of
+ * values stored. On a bad field errno is EINVAL and *index is its offset
+ */
+size_t dstr_to_double_list(CDSTR p, char sep, double dest[], size_t n, size_t* index);
+size_t dstr_to_float_list(CDSTR p, char sep, float dest[], size_t n, size_t* index);
+size_t dstr_to_double_list_bl(const char* buff, size_t len, char sep,
+                              double dest[], size_t n, size_t* index);
+size_t dstr_to_float_list_bl(const char* buff, size_t len, char sep,
+                             float dest[], size_t n, size_t* index);
+size_t dstr_to_llong_list(CDSTR p, char sep, long long dest[], size_t n,
+                          size_t* index, int base);
+size_t dstr_to_llong_list_bl(const char* buff, size_t len, char sep,
+                             long long dest[], size_t n, size_t* index, int base);
+
 #if !defined(NO_DSTRING_REGEX)
 /*
  *  Regexp functions
@@ -363,15 +565,198 @@ int dstr_regex_match_groups(CDSTR p, const char* pattern, size_t offset,
 
 int dstr_regex_substitute(DSTR p, const char* pattern, size_t offset,
                           const char* replacement, const char* options);
+
+/*
+ *  Compiled patterns are cached per thread. The capacity (default 40)
+ *  applies to the calling thread's cache, the previous one is returned.
+ *  Statistics are those of the calling thread, optionally reset after
+ *  reading.
+ */
+typedef struct DSTR_Regex_Cache_Stats {
+    size_t   hits;
+    size_t   misses;
+    size_t   shared_hits;  // misses served by the process wide cache
+    size_t   evictions;
+    uint64_t compile_ns;   // time spent compiling (and JIT compiling)
+    size_t   size;         // patterns currently cached
+    size_t   capacity;
+} DSTR_Regex_Cache_Stats;
+
+size_t dstr_regex_cache_set_capacity(size_t capacity);
+void   dstr_regex_cache_stats(DSTR_Regex_Cache_Stats* stats, bool reset);
+
+/*
+ *  Optional process wide cache behind the per-thread caches: each pattern
+ *  is compiled once and the compiled code shared by all threads (match
+ *  data, limits and JIT stacks stay per thread). CAPACITY 0, the default,
+ *  turns it off. Returns the previous capacity (rounded up to the shards).
+ */
+size_t dstr_regex_shared_cache(size_t capacity);
+
+/*
+ *  Precompiled patterns: no option parsing or cache lookup per call.
+ *  Compile errors return NULL with *err set (see dstr_regex_strerror).
+ *  A handle may be shared by threads, it is not modified by matching.
+ */
+typedef struct DSTR_Regex DSTR_Regex;
+
+DSTR_Regex* dstr_regex_compile(const char* pattern, const char* options, int* err);
+void        dstr_regex_free(DSTR_Regex* re);
+bool        dstr_regex_exact_re(const DSTR_Regex* re, CDSTR p, size_t offset);
+size_t      dstr_regex_contains_re(const DSTR_Regex* re, CDSTR p, size_t offset);
+
+int dstr_regex_match_re(const DSTR_Regex* re, CDSTR p, size_t offset,
+                        DSTR_Regex_Match* match);
+
+int dstr_regex_match_groups_re(const DSTR_Regex* re, CDSTR p, size_t offset,
+                               DSTR_Match_Vector* matches);
+
+int dstr_regex_substitute_re(const DSTR_Regex* re, DSTR p, size_t offset,
+                             const char* replacement);
+
+/*
+ *  Iterate over all matches without allocating per match. GROUPS holds
+ *  N_GROUPS (capture count + 1) pairs of begin and end offsets, group 0
+ *  being the whole match and DSTR_NPOS marking groups that did not take
+ *  part. They are valid until the next step only.
+ *
+ *  foreach calls CALLBACK per match until it returns non zero and returns
+ *  the number of matches visited, or a negative error code. Compile errors
+ *  come negated too so they cannot pass for a count, dstr_regex_strerror
+ *  takes them either way.
+ */
+typedef int (*DSTR_Regex_Callback)(void* ctx, const size_t* groups, size_t n_groups);
+
+int dstr_regex_foreach(CDSTR p, const char* pattern, size_t offset,
+                       DSTR_Regex_Callback callback, void* ctx, const char* options);
+
+int dstr_regex_foreach_re(const DSTR_Regex* re, CDSTR p, size_t offset,
+                          DSTR_Regex_Callback callback, void* ctx);
+
+typedef struct DSTR_Regex_Iter {
+    const DSTR_Regex* re;
+    CDSTR         subject;
+    size_t        offset;     // where the next search starts
+    const size_t* groups;     // current match, see above
+    size_t        n_groups;   // 0 once iteration is over
+    int           rc;         // negative: error code
+    void*         mdata;      // internal
+} DSTR_Regex_Iter;
+
+void dstr_regex_iter_init(DSTR_Regex_Iter* it, const DSTR_Regex* re,
+                          CDSTR p, size_t offset);
+bool dstr_regex_iter_next(DSTR_Regex_Iter* it);
+void dstr_regex_iter_done(DSTR_Regex_Iter* it);
+
+/*
+ *  Substitution with computed replacements: CALLBACK appends the
+ *  replacement of the match in GROUPS (as above) to OUT, which holds the
+ *  result so far, and returns DSTR_SUCCESS, or DSTR_FAIL to give up with
+ *  PCRE2_ERROR_CALLOUT. Every match is replaced with option 'g', the first
+ *  one otherwise. P is changed only on success. Returns the number of
+ *  replacements or a negative error code, compile errors included.
+ */
+typedef int (*DSTR_Regex_Replace)(void* ctx, DSTR out, CDSTR subject,
+                                  const size_t* groups, size_t n_groups);
+
+int dstr_regex_substitute_cb(DSTR p, const char* pattern, size_t offset,
+                             DSTR_Regex_Replace callback, void* ctx, const char* options);
+
+int dstr_regex_substitute_cb_re(const DSTR_Regex* re, DSTR p, size_t offset,
+                                DSTR_Regex_Replace callback, void* ctx);
+
+/*
+ *  A set of patterns matched together in one scan, e.g. to classify
+ *  lines against many rules. The patterns share OPTIONS. On a compile
+ *  error NULL is returned with *ERR set and *ERR_INDEX the pattern at
+ *  fault (both may be NULL). Like DSTR_Regex, a set may be shared by
+ *  threads.
+ *
+ *  dstr_regex_set_first returns the index of the pattern matching
+ *  leftmost (the lowest index among those matching there) and its match
+ *  in M (may be NULL), -1 (PCRE2_ERROR_NOMATCH) if none does, or another
+ *  negative error code.
+ *
+ *  dstr_regex_set_matches sets bit i of BITS, which has room for
+ *  DSTR_REGEX_SET_WORDS(size) words, for every pattern i that matches
+ *  and returns how many do, or a negative error code.
+ */
+typedef struct DSTR_RegexSet DSTR_RegexSet;
+
+#define DSTR_REGEX_SET_WORDS(n)  (((n) + 63) / 64)
+
+DSTR_RegexSet* dstr_regex_set_compile(const char* const patterns[], size_t n,
+                                      const char* options, int* err, size_t* err_index);
+void   dstr_regex_set_free(DSTR_RegexSet* set);
+size_t dstr_regex_set_size(const DSTR_RegexSet* set);
+int    dstr_regex_set_first(const DSTR_RegexSet* set, CDSTR p, size_t offset,
+                            DSTR_Regex_Match* m);
+int    dstr_regex_set_matches(const DSTR_RegexSet* set, CDSTR p, size_t offset,
+                              uint64_t* bits);
+
+/*
+ *  Streaming search: matches of RE in input read in chunks, e.g. a file
+ *  too large to load, including matches spanning chunks. At most WINDOW
+ *  bytes of input are held (0: DSTR_REGEX_WINDOW), so memory does not
+ *  grow with the input; a match must fit in the window. RE may be freed
+ *  once the stream is created.
+ *
+ *  READ copies up to SIZE bytes to BUF and returns how many, 0 at the end
+ *  of input and -1 on error with errno set. A stream from
+ *  dstr_regex_stream_open() owns its file descriptor. Creation failures
+ *  return NULL with errno set.
+ *
+ *  dstr_regex_stream_next returns DSTR_SUCCESS for each match, 0 at the
+ *  end of input, after which dstr_regex_stream_error() is 0 or an errno,
+ *  or a negative error code: PCRE2_ERROR_NOMEMORY (-48) when a possible
+ *  match fills the window. M->groups are offsets into M->data (as for
+ *  foreach), which holds the input from M->base on; M->offset is where
+ *  the match is in the input. All are valid until the next call. M->text
+ *  points into the window and is not NUL terminated, so it is not a valid
+ *  CDSTR argument: use its data and length.
+ */
+#define DSTR_REGEX_WINDOW  (1024U * 1024U)
+
+typedef struct DSTR_Regex_Stream DSTR_Regex_Stream;
+
+typedef long (*DSTR_Regex_Read)(void* ctx, char* buf, size_t size);
+
+typedef struct DSTR_Regex_Stream_Match {
+    DSTR_VIEW     text;       // the match, not NUL terminated (not a CDSTR)
+    uint64_t      offset;     // of the match in the input
+    const char*   data;
+    uint64_t      base;       // input offset of DATA
+    const size_t* groups;
+    size_t        n_groups;
+} DSTR_Regex_Stream_Match;
+
+DSTR_Regex_Stream* dstr_regex_stream_new(const DSTR_Regex* re, DSTR_Regex_Read read,
+                                         void* ctx, size_t window);
+DSTR_Regex_Stream* dstr_regex_stream_open(const DSTR_Regex* re, const char* path,
+                                          size_t window);
+DSTR_Regex_Stream* dstr_regex_stream_fdopen(const DSTR_Regex* re, int fd, size_t window);
+DSTR_Regex_Stream* dstr_regex_stream_from_stream(const DSTR_Regex* re, FILE* fp,
+                                                 size_t window);
+void dstr_regex_stream_close(DSTR_Regex_Stream* s);
+int  dstr_regex_stream_next(DSTR_Regex_Stream* s, DSTR_Regex_Stream_Match* m);
+int  dstr_regex_stream_error(const DSTR_Regex_Stream* s);
 #endif
 /*-------------------------------------------------------------------------------*/
 
-/* 3way strcmp-like comparison*/
+/* 3way strcmp-like comparison, by length (memcmp) */
+static inline int dstr_compare_bl(CDSTR lhs, const char* buff, size_t len)
+{
+    size_t llen = lhs ? lhs->length : 0;
+    size_t n = (llen < len) ? llen : len;
+    int rc = n ? memcmp(lhs->data, buff, n) : 0;
+    if (rc != 0)
+        return rc;
+    return (llen < len) ? -1 : (llen > len);
+}
+
 static inline int dstr_compare_sz(CDSTR lhs, const char* sz)
 {
-    const char* l = lhs ? lhs->data : "";
-    const char* r = sz ? sz : "";
-    return strcmp(l, r);
+    return sz ? dstr_compare_bl(lhs, sz, strlen(sz)) : dstr_compare_bl(lhs, "", 0);
 }
 
 static inline int dstr_icompare_sz(CDSTR lhs, const char* sz)
@@ -383,9 +768,7 @@ static inline int dstr_icompare_sz(CDSTR lhs, const char* sz)
 
 static inline int dstr_compare_ds(CDSTR lhs, CDSTR rhs)
 {
-    const char* l = lhs ? lhs->data : "";
-    const char* r = rhs ? rhs->data : "";
-    return strcmp(l, r);
+    return rhs ? dstr_compare_bl(lhs, rhs->data, rhs->length) : dstr_compare_bl(lhs, "", 0);
 }
 
 static inline int dstr_icompare_ds(CDSTR lhs, CDSTR rhs)
@@ -395,6 +778,12 @@ static inline int dstr_icompare_ds(CDSTR lhs, CDSTR rhs)
     return strcasecmp(l, r);
 }
 
+static inline DSTR_BOOL dstr_equal_bl(CDSTR lhs, const char* buff, size_t len)
+{
+    size_t llen = lhs ? lhs->length : 0;
+    return llen == len && (len == 0 || memcmp(lhs->data, buff, len) == 0);
+}
+
 static inline DSTR_BOOL dstr_equal_sz(CDSTR lhs, const char* sz)
 {
     return dstr_compare_sz(lhs, sz) == 0;
@@ -409,14 +798,12 @@ static inline DSTR_BOOL dstr_equal_ds(CDSTR lhs, CDSTR rhs)
 {
     if (lhs) {
         if (rhs) {
-            if (lhs->length != rhs->length) {
-                return false; }
-            return strcmp(lhs->data, rhs->data) == 0; }
+            return dstr_equal_bl(lhs, rhs->data, rhs->length); }
         else {
-            return strcmp(lhs->data, "") == 0; } }
+            return lhs->length == 0; } }
     else {
         if (rhs) {
-            return strcmp(rhs->data, "") == 0; }
+            return rhs->length == 0; }
         else  {
             return 0; } }
 }
@@ -513,9 +900,12 @@ static inline void dstr_putchar_safe(DSTR p, long pos, char c)
 
 static inline int dstr_append_char(DSTR p, char c)
 {
+#if !defined(DSTR_BINARY_SAFE)
     if (c == '\0') {
         return DSTR_SUCCESS; }
-    else if (p->length + 1 < p->capacity) {
+    else
+#endif
+    if (p->length + 1 < p->capacity) {
         p->data[p->length] = c;
         p->data[++p->length] = '\0';
         return DSTR_SUCCESS;  }
@@ -9,9 +9,14 @@
 
 #include <iosfwd>
 #include <vector>
+#include <cfloat>
 #include <exception>
 #include <stdexcept>
 
+#if __cplusplus >= 201103L
+  #include <future>
+#endif
+
 #if __cplusplus >= 201703L
   #include <string_view>
   #if __cplusplus >= 202002L
@@ -25,6 +30,13 @@
 //
 class DString;
 class DStringMatchVector;
+class DRegex;
+class DRegexMatch;
+class DRegexMatches;
+class DRegexSet;
+class DRegexStream;
+class DMappedFile;
+class DStringBuf;
 //-----------------------------------------------
 
 // A "View" of a char* and length
@@ -32,6 +44,8 @@ class DStringMatchVector;
 class DStringView {
 public:
     friend class DString;
+    friend class DMappedFile;
+    friend class DRegexMatch;
 
     // Types, constants and typedefs
     //
@@ -82,7 +96,9 @@ public:
         if (!buffer || !len) {
             init_data("", 0); }
         else {
+#if !defined(DSTR_BINARY_SAFE)
             len = strnlen(buffer, len);
+#endif
             init_data(buffer, len); }
     }
 
@@ -231,7 +247,7 @@ public:
 
     size_t find(DStringView sv, size_t pos=0) const
     {
-        return dstr_find_sz(pImp(), pos, sv.data());
+        return dstr_find_bl(pImp(), pos, sv.data(), sv.size());
     }
 
     size_t ifind(char c, size_t pos=0) const
@@ -246,7 +262,7 @@ public:
 
     size_t ifind(DStringView sv, size_t pos=0) const
     {
-        return dstr_ifind_sz(pImp(), pos, sv.data());
+        return dstr_ifind_bl(pImp(), pos, sv.data(), sv.size());
     }
 
     size_t rfind(char c, size_t pos = NPOS) const
@@ -261,7 +277,7 @@ public:
 
     size_t rfind(DStringView sv, size_t pos=0) const
     {
-        return dstr_rfind_sz(pImp(), pos, sv.data());
+        return dstr_rfind_bl(pImp(), pos, sv.data(), sv.size());
     }
 
     size_t irfind(char c, size_t pos = NPOS) const
@@ -276,7 +292,7 @@ public:
 
     size_t irfind(DStringView sv, size_t pos=0) const
     {
-        return dstr_irfind_sz(pImp(), pos, sv.data());
+        return dstr_irfind_bl(pImp(), pos, sv.data(), sv.size());
     }
 
     size_t count(const char* sz) const
@@ -399,9 +415,9 @@ public:
     //
     // Note: NULL C string is considered empty string ""
     //
-    int compare(const char* sz)   const { return strcmp(data(), sz ? sz : ""); }
+    int compare(const char* sz)   const { return dstr_compare_sz(pImp(), sz); }
     int icompare(const char* sz)  const { return strcasecmp(data(), sz ? sz : ""); }
-    int compare(DStringView rhs)  const { return strcmp(data(), rhs.data()); }
+    int compare(DStringView rhs)  const { return dstr_compare_bl(pImp(), rhs.data(), rhs.size()); }
     int icompare(DStringView rhs) const { return strcasecmp(data(), rhs.data()); }
     bool iequal(const char* sz)   const { return (icompare(sz) == 0);  }
     bool iequal(DStringView rhs)  const { return (icompare(rhs) == 0); }
@@ -472,6 +488,51 @@ public:
         return dstr_to_ldouble(pImp(), index);
     }
 
+    // Parse a SEP separated list of numbers, DEST is resized to the number
+    // of values parsed. On a bad field errno is EINVAL and *index its offset
+    //
+    size_t stod_list(std::vector<double>& dest, char sep = ',', size_t* index = nullptr) const
+    {
+        size_t fields = 1;
+        for (char c : *this) {
+            fields += (c == sep); }
+
+        dest.resize(fields);
+        size_t n = dstr_to_double_list(pImp(), sep, dest.data(), dest.size(), index);
+        dest.resize(n);
+        return n;
+    }
+
+    size_t stoll_list(std::vector<long long>& dest, char sep = ',',
+                      size_t* index = nullptr, int base = 10) const
+    {
+        size_t fields = 1;
+        for (char c : *this) {
+            fields += (c == sep); }
+
+        dest.resize(fields);
+        size_t n = dstr_to_llong_list(pImp(), sep, dest.data(), dest.size(), index, base);
+        dest.resize(n);
+        return n;
+    }
+
+    // UTF-8. utf8_length and utf8_offset_of assume valid input
+    //
+    bool utf8_valid(size_t* error_offset = nullptr) const
+    {
+        return dstr_utf8_validate(pImp(), error_offset);
+    }
+
+    size_t utf8_length() const
+    {
+        return dstr_utf8_length(pImp());
+    }
+
+    size_t utf8_offset_of(size_t n) const
+    {
+        return dstr_utf8_offset_of(pImp(), n);
+    }
+
     // C++ algorithms support : functions
     //
     size_type      size()   const { return length(); }
@@ -623,6 +684,49 @@ public:
         return re_split(pattern, 0, strings, options);
     }
 
+    // The same with a precompiled DRegex, options are those it was
+    // compiled with
+    //
+    bool   match(const DRegex& re, size_t offset = 0) const;
+    size_t match_contains(const DRegex& re, size_t offset = 0) const;
+    int    match(const DRegex& re, size_t offset, DSTR_Regex_Match& m) const;
+    int    match_groups(const DRegex& re, size_t offset, DStringMatchVector& matches) const;
+    int    capture(const DRegex& re, size_t offset, DString& result) const;
+    int    capture(const DRegex& re, size_t offset, std::vector<DString>& strings) const;
+    int    re_split(const DRegex& re, size_t offset, std::vector<DString>& strings) const;
+
+    int match(const DRegex& re, DSTR_Regex_Match& m) const
+    {
+        return match(re, 0, m);
+    }
+
+    int match_groups(const DRegex& re, DStringMatchVector& matches) const
+    {
+        return match_groups(re, 0, matches);
+    }
+
+    int capture(const DRegex& re, DString& result) const
+    {
+        return capture(re, 0, result);
+    }
+
+    int capture(const DRegex& re, std::vector<DString>& strings) const
+    {
+        return capture(re, 0, strings);
+    }
+
+    int re_split(const DRegex& re, std::vector<DString>& strings) const
+    {
+        return re_split(re, 0, strings);
+    }
+
+    // All matches as a range, without allocations per match
+    //
+    //     for (const DRegexMatch& m : s.find_all(re))
+    //         ...
+    //
+    DRegexMatches find_all(const DRegex& re, size_t offset = 0) const;
+
 #endif // NO_DSTRING_REGEX
 
 
@@ -645,6 +749,10 @@ private:
 //
 class DString {
 public:
+    // DStringBuf writes directly into the spare capacity
+    //
+    friend class DStringBuf;
+
     // Types, constants and typedefs
     //
     static const size_t NPOS = DSTR_NPOS;
@@ -747,10 +855,12 @@ public:
     //
     DString(const char* buffer, size_t len)
     {
-        if (!buffer || !*buffer) {
+        if (!buffer || !len) {
             dstr_init_data(pImp()); }
         else {
+#if !defined(DSTR_BINARY_SAFE)
             len = strnlen(buffer, len);
+#endif
             init_capacity(len);
             init_data(buffer, len);
             init_length(len); }
@@ -760,11 +870,15 @@ public:
     //
     DString(const char* first, const char* last)
     {
-        if (!first || !*first || last <= first) {
+        if (!first || last <= first) {
             dstr_init_data(pImp());
             return; }
 
+#if defined(DSTR_BINARY_SAFE)
+        size_t len = size_t(last - first);
+#else
         size_t len = strnlen(first, last - first);
+#endif
         init_capacity(len);
         init_data(first, len);
         init_length(len);
@@ -832,9 +946,14 @@ public:
     // 2. slurp from a FILE* ptr
     // 3. printf line
     // 4. std::format (like a python format string, C++ >= 20)
+    // 5. slurp many files concurrently (see dstr_slurp_many). The future
+    //    throws DStringError if any of the files could not be read
     //
     static DString from_file(const char* fname);
     static DString from_cfile(FILE* fp);
+#if __cplusplus >= 201103L
+    static std::future<std::vector<DString>> from_files_async(std::vector<DString> paths);
+#endif
     static DString c_format(const char* fmt, ...);
 #if __cplusplus >= 202002L
     template<typename... Args>
@@ -1192,6 +1311,86 @@ public:
 
     DString& append_sprintf(const char* fmt, ...);
 
+    // Locale independent. Shortest round-trip or fixed decimals ("%.*f")
+    //
+    DString& append_double(double value)
+    {
+        dstr_append_double(pImp(), value);
+        return *this;
+    }
+
+    DString& append_double(double value, int precision)
+    {
+        dstr_append_double_fixed(pImp(), value, precision);
+        return *this;
+    }
+
+    DString& append_float(float value)
+    {
+        dstr_append_float(pImp(), value);
+        return *this;
+    }
+
+    // Hex / base64 (flags: DSTR_HEX_UPPER, DSTR_BASE64_URL, DSTR_BASE64_NOPAD)
+    // decode_* append the decoded bytes, false on invalid input
+    //
+    DString& append_hex(const void* data, size_t len, int flags = 0)
+    {
+        dstr_append_hex(pImp(), data, len, flags);
+        return *this;
+    }
+
+    DString& append_hex(DStringView sv, int flags = 0)
+    {
+        return append_hex(sv.data(), sv.size(), flags);
+    }
+
+    DString& append_base64(const void* data, size_t len, int flags = 0)
+    {
+        dstr_append_base64(pImp(), data, len, flags);
+        return *this;
+    }
+
+    DString& append_base64(DStringView sv, int flags = 0)
+    {
+        return append_base64(sv.data(), sv.size(), flags);
+    }
+
+    bool decode_hex(DStringView src)
+    {
+        return dstr_decode_hex(pImp(), src.data(), src.size()) == DSTR_SUCCESS;
+    }
+
+    bool decode_base64(DStringView src, int flags = 0)
+    {
+        return dstr_decode_base64(pImp(), src.data(), src.size(), flags) == DSTR_SUCCESS;
+    }
+
+    // MODE is one of DSTR_ESC_JSON, DSTR_ESC_C, DSTR_ESC_URL, DSTR_ESC_HTML
+    //
+    DString& append_escaped(DStringView src, int mode)
+    {
+        dstr_append_escaped_bl(pImp(), src.data(), src.size(), mode);
+        return *this;
+    }
+
+    bool append_unescaped(DStringView src, int mode)
+    {
+        return dstr_append_unescaped_bl(pImp(), src.data(), src.size(), mode) == DSTR_SUCCESS;
+    }
+
+    // UTF-16 / UTF-32 -> UTF-8, false on unpaired surrogates or invalid code points
+    //
+    bool append_utf16(const char16_t* src, size_t len)
+    {
+        return dstr_append_utf16(pImp(), reinterpret_cast<const uint16_t*>(src), len) == DSTR_SUCCESS;
+    }
+
+    bool append_utf32(const char32_t* src, size_t len)
+    {
+        return dstr_append_utf32(pImp(), reinterpret_cast<const uint32_t*>(src), len) == DSTR_SUCCESS;
+    }
+
     DString& append_vsprintf(const char* fmt, va_list args)
     {
         dstr_append_vsprintf(pImp(), fmt, args);
@@ -1428,6 +1627,19 @@ public:
         dstr_reserve(pImp(), len);
     }
 
+    // Take ownership of a malloc'd BUF (LEN < CAP) without copying it.
+    // Throws DStringError on bad arguments, BUF then stays with the caller.
+    //
+    DString& adopt(char* buf, size_t len, size_t cap);
+
+    // Hand the NUL terminated buffer to the caller (release with free())
+    // and leave the string empty
+    //
+    char* release(size_t* len = NULL, size_t* cap = NULL)
+    {
+        return dstr_release_buffer(pImp(), len, cap);
+    }
+
     // shrink
     //
     void resize(size_t len)
@@ -1934,9 +2146,9 @@ public:
     //
     // Note: NULL C string is considered empty string ""
     //
-    int compare(const char* sz)      const { return strcmp(data(), sz ? sz : ""); }
+    int compare(const char* sz)      const { return dstr_compare_sz(pImp(), sz); }
     int icompare(const char* sz)     const { return strcasecmp(data(), sz ? sz : ""); }
-    int compare(DStringView rhs)     const { return strcmp(data(), rhs.data()); }
+    int compare(DStringView rhs)     const { return dstr_compare_bl(pImp(), rhs.data(), rhs.size()); }
     int icompare(DStringView rhs)    const { return strcasecmp(data(), rhs.data()); }
 
     bool iequal(const char* sz)      const { return (icompare(sz) == 0);  }
@@ -2030,6 +2242,32 @@ public:
         return dstr_to_ldouble(pImp(), index);
     }
 
+    size_t stod_list(std::vector<double>& dest, char sep = ',', size_t* index = nullptr) const
+    {
+        return view().stod_list(dest, sep, index);
+    }
+
+    size_t stoll_list(std::vector<long long>& dest, char sep = ',',
+                      size_t* index = nullptr, int base = 10) const
+    {
+        return view().stoll_list(dest, sep, index, base);
+    }
+
+    bool utf8_valid(size_t* error_offset = nullptr) const
+    {
+        return view().utf8_valid(error_offset);
+    }
+
+    size_t utf8_length() const
+    {
+        return view().utf8_length();
+    }
+
+    size_t utf8_offset_of(size_t n) const
+    {
+        return view().utf8_offset_of(n);
+    }
+
     // Built in types -> DString
     //
     static DString to_string(int val)
@@ -2074,24 +2312,30 @@ public:
         return r;
     }
 
+    // float and double use the shortest representation that round-trips.
+    // long double values that are not exact doubles fall back to printf
+    //
     static DString to_string(float val)
     {
         DString r;
-        r.append_sprintf("%f", val);
+        r.append_float(val);
         return r;
     }
 
     static DString to_string(double val)
     {
         DString r;
-        r.append_sprintf("%g", val);
+        r.append_double(val);
         return r;
     }
 
     static DString to_string(long double val)
     {
         DString r;
-        r.append_sprintf("%Lf", val);
+        if ((long double)(double) val == val) {
+            r.append_double((double) val); }
+        else {
+            r.append_sprintf("%.*Lg", LDBL_DIG + 3, val); }
         return r;
     }
 
@@ -2242,6 +2486,110 @@ public:
         return re_split(pattern, 0, strings, options);
     }
 
+    // The same with a precompiled DRegex
+    //
+    bool match(const DRegex& re, size_t offset = 0) const
+    {
+        return view().match(re, offset);
+    }
+
+    size_t match_contains(const DRegex& re, size_t offset = 0) const
+    {
+        return view().match_contains(re, offset);
+    }
+
+    int match(const DRegex& re, size_t offset, Match& m) const
+    {
+        return view().match(re, offset, m);
+    }
+
+    int match(const DRegex& re, Match& m) const
+    {
+        return view().match(re, 0, m);
+    }
+
+    int match_groups(const DRegex& re, size_t offset, MatchVector& matches) const
+    {
+        return view().match_groups(re, offset, matches);
+    }
+
+    int match_groups(const DRegex& re, MatchVector& matches) const
+    {
+        return view().match_groups(re, 0, matches);
+    }
+
+    DString capture(const DRegex& re, size_t offset = 0) const
+    {
+        DString result;
+        view().capture(re, offset, result);
+        return result;
+    }
+
+    int capture(const DRegex& re, size_t offset, std::vector<DString>& strings) const
+    {
+        return view().capture(re, offset, strings);
+    }
+
+    int capture(const DRegex& re, std::vector<DString>& strings) const
+    {
+        return view().capture(re, 0, strings);
+    }
+
+    int subst_inplace(const DRegex& re, size_t offset, DStringView replacement);
+
+    int subst_inplace(const DRegex& re, DStringView replacement)
+    {
+        return subst_inplace(re, 0, replacement);
+    }
+
+    DString subst(const DRegex& re, size_t offset, DStringView replacement) const
+    {
+        DString result(*this);
+        result.subst_inplace(re, offset, replacement);
+        return result;
+    }
+
+    DString subst(const DRegex& re, DStringView replacement) const
+    {
+        return subst(re, 0, replacement);
+    }
+
+    // Substitution computed per match by FN, typically a lambda taking a
+    // const DRegexMatch&. What it returns (a DStringView, DString or C
+    // string) is appended to the result, which is built once and swapped
+    // in. Only the first match is replaced unless the regex has option
+    // 'g'. Exceptions thrown by FN propagate, leaving the string unchanged
+    //
+    //     line.subst_inplace_fn(DRegex("\\$(\\w+)", "g"),
+    //                           [&](const DRegexMatch& m) { return env[m[1]]; });
+    //
+    template <class Replacer>
+    int subst_inplace_fn(const DRegex& re, size_t offset, Replacer fn);
+
+    template <class Replacer>
+    int subst_inplace_fn(const DRegex& re, Replacer fn)
+    {
+        return subst_inplace_fn(re, 0, fn);
+    }
+
+    template <class Replacer>
+    int subst_inplace_fn(DStringView pattern, size_t offset, Replacer fn,
+                         const char* opts = nullptr);
+
+    int re_split(const DRegex& re, size_t offset, std::vector<DString>& strings) const
+    {
+        return view().re_split(re, offset, strings);
+    }
+
+    int re_split(const DRegex& re, std::vector<DString>& strings) const
+    {
+        return view().re_split(re, 0, strings);
+    }
+
+    // The range refers to this string and to RE, both must outlive it
+    //
+    DRegexMatches find_all(const DRegex& re, size_t offset = 0) const;
+
     static void on_regex_error(int rc);
 
 #endif // NO_DSTRING_REGEX
@@ -2296,6 +2644,119 @@ private:
 };
 /*-------------------------------------------------------------------------------*/
 
+// Read only view of a whole file, memory mapped where available (see
+// dstr_map_file). The constructor throws DStringError on failure
+//
+class DMappedFile {
+public:
+    explicit DMappedFile(const char* path);
+
+    ~DMappedFile()
+    {
+        dstr_unmap_file(&m_view);
+    }
+
+    DMappedFile(DMappedFile&& rhs) noexcept : m_view(rhs.m_view)
+    {
+        rhs.m_view.data = "";
+        rhs.m_view.length = 0;
+    }
+
+    DMappedFile& operator=(DMappedFile&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            dstr_unmap_file(&m_view);
+            m_view = rhs.m_view;
+            rhs.m_view.data = "";
+            rhs.m_view.length = 0; }
+        return *this;
+    }
+
+    const char* data() const noexcept { return m_view.data;   }
+    size_t      size() const noexcept { return m_view.length; }
+    bool        empty() const noexcept { return size() == 0;  }
+
+    DStringView view() const noexcept
+    {
+        DStringView v;
+        v.init_data(m_view.data, m_view.length);
+        return v;
+    }
+
+    operator DStringView() const noexcept
+    {
+        return view();
+    }
+
+private:
+    DMappedFile(const DMappedFile&);
+    DMappedFile& operator=(const DMappedFile&);
+
+    DSTR_VIEW m_view;
+};
+/*-------------------------------------------------------------------------------*/
+
+// Batched output to a file or descriptor (see dstr_writev). write() does
+// not copy: the string must stay valid until flush(), close() or the
+// destructor. write_copy() is for temporaries. Failures throw DStringError,
+// the destructor flushes and ignores errors
+//
+class DStringWriter {
+public:
+    explicit DStringWriter(const char* path, int flags = 0);
+    explicit DStringWriter(int fd, int flags = 0);
+
+    ~DStringWriter()
+    {
+        dstr_writer_close(m_writer);
+    }
+
+    DStringWriter(DStringWriter&& rhs) noexcept : m_writer(rhs.m_writer)
+    {
+        rhs.m_writer = NULL;
+    }
+
+    DStringWriter& operator=(DStringWriter&& rhs) noexcept
+    {
+        if (this != &rhs) {
+            dstr_writer_close(m_writer);
+            m_writer = rhs.m_writer;
+            rhs.m_writer = NULL; }
+        return *this;
+    }
+
+    DStringWriter& write(DStringView s)
+    {
+        if (!dstr_writer_add(m_writer, s.data(), s.size()))
+            fail("write");
+        return *this;
+    }
+
+    DStringWriter& write_copy(DStringView s)
+    {
+        if (!dstr_writer_add_copy(m_writer, s.data(), s.size()))
+            fail("write");
+        return *this;
+    }
+
+    void flush()
+    {
+        if (!dstr_writer_flush(m_writer))
+            fail("flush");
+    }
+
+    void close();
+
+private:
+    DStringWriter(const DStringWriter&);
+    DStringWriter& operator=(const DStringWriter&);
+
+    void fail(const char* what);
+
+    DSTR_Writer* m_writer;
+};
+/*-------------------------------------------------------------------------------*/
+
 #if !defined(NO_DSTRING_REGEX)
 // STL style, read only wrapper around DSTR_Match_Vector
 //
@@ -2347,6 +2808,273 @@ private:
             throw DStringError("MatchVector::check()");  }
     }
 };
+/*-------------------------------------------------------------------------------*/
+
+// A compiled pattern for hot loops, accepted by the DString and
+// DStringView regex methods in place of a pattern string: no option
+// parsing or cache lookup per call. Throws DStringError on compile
+// errors. May be shared by threads
+//
+class DRegex {
+public:
+    explicit DRegex(DStringView pattern, const char* options = nullptr);
+    ~DRegex() { dstr_regex_free(m_re); }
+
+#if __cplusplus >= 201103L
+    DRegex(DRegex&& rhs) noexcept : m_re(rhs.m_re), m_utf8(rhs.m_utf8) { rhs.m_re = nullptr; }
+
+    DRegex& operator=(DRegex&& rhs) noexcept
+    {
+        std::swap(m_re, rhs.m_re);
+        std::swap(m_utf8, rhs.m_utf8);
+        return *this;
+    }
+#endif
+
+    const DSTR_Regex* get() const { return m_re; }
+
+    // Compiled with option 'u' or 'V': searches step over whole UTF-8
+    // characters after an empty match
+    //
+    bool utf8() const { return m_utf8; }
+
+private:
+    DRegex(const DRegex&);
+    DRegex& operator=(const DRegex&);
+
+    DSTR_Regex* m_re;
+    bool        m_utf8;
+};
+//----------------------------------------------------------------
+
+// One match of a find_all iteration: offsets and views of the whole
+// match (group 0) and of the capture groups. Valid until the iteration
+// moves on; the views are slices of the subject, not NUL terminated.
+//
+class DRegexMatch {
+public:
+    DRegexMatch() : m_data(nullptr), m_groups(nullptr), m_size(0) {}
+
+    DRegexMatch(const char* data, const size_t* groups, size_t n_groups)
+        : m_data(data), m_groups(groups), m_size(n_groups) {}
+
+    // Number of groups, including group 0
+    //
+    size_t size() const { return m_size; }
+
+    bool matched(size_t i = 0) const
+    {
+        return i < m_size && m_groups[2 * i] != DSTR_NPOS;
+    }
+
+    size_t offset(size_t i = 0) const
+    {
+        return matched(i) ? m_groups[2 * i] : DSTR_NPOS;
+    }
+
+    size_t length(size_t i = 0) const
+    {
+        return matched(i) ? m_groups[2 * i + 1] - m_groups[2 * i] : 0;
+    }
+
+    // Empty view for a group that did not take part
+    //
+    DStringView operator[](size_t i) const
+    {
+        DStringView v;
+        if (matched(i)) {
+            v.init_data(m_data + m_groups[2 * i], length(i)); }
+        return v;
+    }
+
+    DStringView str() const { return (*this)[0]; }
+
+private:
+    const char*   m_data;
+    const size_t* m_groups;
+    size_t        m_size;
+};
+//----------------------------------------------------------------
+
+// All matches of a DRegex in a subject as an input range, single pass.
+// One match data block serves the whole iteration. Errors throw
+// DStringError. Both the DRegex and the subject must outlive the range,
+// so no temporaries in a range-for: for (auto& m : s.find_all(DRegex(..)))
+// would use a destroyed regex.
+//
+class DRegexMatches {
+public:
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef DRegexMatch             value_type;
+        typedef ptrdiff_t               difference_type;
+        typedef const DRegexMatch*      pointer;
+        typedef const DRegexMatch&      reference;
+
+        iterator() : m_owner(nullptr) {}
+        explicit iterator(DRegexMatches* owner) : m_owner(owner) {}
+
+        reference operator*() const  { return m_owner->m_match; }
+        pointer   operator->() const { return &m_owner->m_match; }
+
+        iterator& operator++()
+        {
+            if (!m_owner->advance()) {
+                m_owner = nullptr; }
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(const iterator& rhs) const { return m_owner == rhs.m_owner; }
+        bool operator!=(const iterator& rhs) const { return m_owner != rhs.m_owner; }
+
+    private:
+        DRegexMatches* m_owner;
+    };
+
+    DRegexMatches(const DRegex& re, DStringView subject, size_t offset = 0)
+        : m_view()
+    {
+        m_view.data = subject.data();
+        m_view.length = (uint32_t) subject.length();
+        dstr_regex_iter_init(&m_iter, re.get(), (CDSTR) &m_view, offset);
+    }
+
+    ~DRegexMatches() { dstr_regex_iter_done(&m_iter); }
+
+#if __cplusplus >= 201103L
+    DRegexMatches(DRegexMatches&& rhs) noexcept
+        : m_view(rhs.m_view), m_iter(rhs.m_iter), m_match(rhs.m_match)
+    {
+        m_iter.subject = (CDSTR) &m_view;
+        rhs.m_iter.mdata = nullptr;
+    }
+#endif
+
+    // Runs the first search, call it once
+    //
+    iterator begin() { return advance() ? iterator(this) : iterator(); }
+    iterator end()   { return iterator(); }
+
+private:
+    DRegexMatches(const DRegexMatches&);
+    DRegexMatches& operator=(const DRegexMatches&);
+
+    bool advance();
+
+    DSTR_VIEW       m_view;
+    DSTR_Regex_Iter m_iter;
+    DRegexMatch     m_match;
+};
+//----------------------------------------------------------------
+
+// Many patterns matched in one pass, e.g. rules to classify log lines.
+// Pattern i is bit i of the bitset from matches()
+//
+class DRegexSet {
+public:
+    explicit DRegexSet(const std::vector<DString>& patterns, const char* options = nullptr);
+    ~DRegexSet() { dstr_regex_set_free(m_set); }
+
+#if __cplusplus >= 201103L
+    DRegexSet(DRegexSet&& rhs) noexcept : m_set(rhs.m_set) { rhs.m_set = nullptr; }
+
+    DRegexSet& operator=(DRegexSet&& rhs) noexcept
+    {
+        std::swap(m_set, rhs.m_set);
+        return *this;
+    }
+#endif
+
+    size_t size() const { return dstr_regex_set_size(m_set); }
+
+    // Index of the pattern matching leftmost, -1 if none
+    //
+    int first(DStringView s, size_t offset = 0, DSTR_Regex_Match* m = nullptr) const;
+
+    // Number of patterns that match, and which ones in BITS
+    //
+    size_t matches(DStringView s, std::vector<uint64_t>& bits, size_t offset = 0) const;
+
+    static bool test(const std::vector<uint64_t>& bits, size_t i)
+    {
+        return (bits[i / 64] >> (i % 64)) & 1;
+    }
+
+    // Indexes of the patterns that match
+    //
+    std::vector<size_t> which(DStringView s, size_t offset = 0) const;
+
+    const DSTR_RegexSet* get() const { return m_set; }
+
+private:
+    DRegexSet(const DRegexSet&);
+    DRegexSet& operator=(const DRegexSet&);
+
+    DSTR_RegexSet* m_set;
+};
+//----------------------------------------------------------------
+
+// Matches of a DRegex in a file or stream read in chunks, holding at
+// most WINDOW bytes (0: DSTR_REGEX_WINDOW) of it whatever its size, see
+// dstr_regex_stream_new. The DRegex may go once the stream is made.
+// Offsets are those in the input; the views are valid until the next
+// call to next(). Open and regex errors throw DStringError, a read error
+// ends the matches with error() set
+//
+class DRegexStream {
+public:
+    DRegexStream(const DRegex& re, const char* path, size_t window = 0);
+    DRegexStream(const DRegex& re, int fd, size_t window = 0);
+    DRegexStream(const DRegex& re, FILE* fp, size_t window = 0);
+    ~DRegexStream() { dstr_regex_stream_close(m_stream); }
+
+#if __cplusplus >= 201103L
+    DRegexStream(DRegexStream&& rhs) noexcept
+        : m_stream(rhs.m_stream), m_match(rhs.m_match), m_base(rhs.m_base)
+    {
+        rhs.m_stream = nullptr;
+    }
+
+    DRegexStream& operator=(DRegexStream&& rhs) noexcept
+    {
+        std::swap(m_stream, rhs.m_stream);
+        std::swap(m_match, rhs.m_match);
+        std::swap(m_base, rhs.m_base);
+        return *this;
+    }
+#endif
+
+    // Advances to the next match, false at the end of input
+    //
+    bool next();
+
+    size_t size() const { return m_match.size(); }
+    bool matched(size_t i = 0) const { return m_match.matched(i); }
+    size_t length(size_t i = 0) const { return m_match.length(i); }
+
+    // UINT64_MAX for a group that did not take part
+    //
+    uint64_t offset(size_t i = 0) const
+    {
+        return matched(i) ? m_base + m_match.offset(i) : UINT64_MAX;
+    }
+
+    DStringView operator[](size_t i) const { return m_match[i]; }
+    DStringView str() const { return m_match.str(); }
+
+    int error() const { return dstr_regex_stream_error(m_stream); }
+
+private:
+    DRegexStream(const DRegexStream&);
+    DRegexStream& operator=(const DRegexStream&);
+
+    DSTR_Regex_Stream* m_stream;
+    DRegexMatch        m_match;
+    uint64_t           m_base;
+};
 #endif
 /*-------------------------------------------------------------------------------*/
 
@@ -2413,7 +3141,8 @@ inline DString operator+(const char* sz, DStringView rhs)
 //
 std::ostream& operator<<(std::ostream& out, DStringView s);
 std::istream& operator>>(std::istream& in, DString& s);
-std::istream& io_getline(std::istream& in, DString& s);
+std::istream& io_getline(std::istream& in, DString& s, char delim = '\n');
+std::istream& getline(std::istream& in, DString& s, char delim = '\n');
 //----------------------------------------------------------------
 
 //////////////////////////////////////////////////////////
@@ -2422,6 +3151,74 @@ std::istream& io_getline(std::istream& in, DString& s);
 //  only after DString type is fully known.
 //
 //////////////////////////////////////////////////////////
+#if !defined(NO_DSTRING_REGEX)
+// Runs a C++ replacement function as a DSTR_Regex_Replace callback and
+// carries its exceptions across the C code
+//
+template <class Replacer>
+struct DRegexReplacer {
+    Replacer&          fn;
+    std::exception_ptr error;
+
+    static int call(void* ctx, DSTR out, CDSTR subject,
+                    const size_t* groups, size_t n_groups)
+    {
+        DRegexReplacer* self = static_cast<DRegexReplacer*>(ctx);
+        try {
+            const auto& r = self->fn(DRegexMatch(subject->data, groups, n_groups));
+            DStringView v(r);
+            return dstr_append_bl(out, v.data(), v.size());
+        }
+        catch (...) {
+            self->error = std::current_exception();
+            return DSTR_FAIL;
+        }
+    }
+
+    int check(int rc) const
+    {
+        if (error) {
+            std::rethrow_exception(error); }
+        return rc;
+    }
+};
+
+template <class Replacer>
+inline int DString::subst_inplace_fn(const DRegex& re, size_t offset, Replacer fn)
+{
+    DRegexReplacer<Replacer> r = { fn, nullptr };
+    int rc = r.check(dstr_regex_substitute_cb_re(re.get(), pImp(), offset,
+                                                 &DRegexReplacer<Replacer>::call, &r));
+    if (rc < 0) {
+        on_regex_error(rc); }
+
+    return rc;
+}
+
+template <class Replacer>
+inline int DString::subst_inplace_fn(DStringView pattern, size_t offset,
+                                     Replacer fn, const char* opts)
+{
+    DRegexReplacer<Replacer> r = { fn, nullptr };
+    int rc = r.check(dstr_regex_substitute_cb(pImp(), pattern.c_str(), offset,
+                                              &DRegexReplacer<Replacer>::call, &r, opts));
+    if (rc < 0) {
+        on_regex_error(rc); }
+
+    return rc;
+}
+
+inline DRegexMatches DStringView::find_all(const DRegex& re, size_t offset) const
+{
+    return DRegexMatches(re, *this, offset);
+}
+
+inline DRegexMatches DString::find_all(const DRegex& re, size_t offset) const
+{
+    return DRegexMatches(re, view(), offset);
+}
+#endif
+
 inline DString DStringView::substr(size_t pos, size_t len) const
 {
     return DString(*this, pos, len);
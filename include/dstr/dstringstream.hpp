@@ -9,8 +9,13 @@
 
 #include <iostream>
 #include <streambuf>
+#include <climits>
 #include <dstr/dstring.hpp>
 
+#if __cplusplus >= 201103L
+#include <memory>
+#endif
+
 //  DString Buffer (<< operator)
 //
 //  Use this when:
@@ -19,42 +24,85 @@
 //  3. You need to capture output from code that writes to std::ostream
 //
 //  Prefer DString::format() or DString::to_string() for built-in types.
-//  Currently only for output (Unbuffered, slow)
+//
+//  The put area is the spare capacity of the DString, so writes are a
+//  memcpy (or a store for a single char). The length of the DString is
+//  committed when str() is called or the stream is flushed
 //
 
 class DStringBuf : public std::streambuf {
 public:
     explicit DStringBuf() : str_() {
-        setp(nullptr, nullptr);
+        reset_put_area();
     }
 
-    const DString& str() const { return str_; }
+    const DString& str() const {
+        commit();
+        return str_;
+    }
 
     void reset() {
         str_.clear();
+        reset_put_area();
     }
 
 protected:
     int_type overflow(int_type ch) {
         if (traits_type::eq_int_type(ch, traits_type::eof())) {
             return traits_type::not_eof(ch); }
-        str_.push_back((char)ch);
-        return traits_type::not_eof(ch);
+        if (!grow(1)) {
+            return traits_type::eof(); }
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+        return ch;
     }
 
     std::streamsize xsputn(const char* s, std::streamsize n) {
         if (n <= 0) return 0;
-        size_t before = str_.size();
-        str_.append(s, (size_t) n);
-        return (std::streamsize)(str_.size() - before);
+        size_t len = (size_t) n;
+        if (len > (size_t)(epptr() - pptr()) && !grow(len)) {
+            return 0; }
+        memcpy(pptr(), s, len);
+        advance(len);
+        return n;
     }
 
     int sync() {
+        commit();
         return 0;
     }
 
 private:
-    DString str_;
+    mutable DString str_;
+
+    // Write the length (and terminating NUL) of what was put so far
+    //
+    void commit() const {
+        size_t len = (size_t)(pptr() - str_.m_imp.data);
+        str_.m_imp.length = (uint32_t) len;
+        str_.m_imp.data[len] = '\0';
+    }
+
+    // [data + length, data + capacity - 1), one byte kept for the NUL
+    //
+    void reset_put_area() {
+        char* first = str_.m_imp.data;
+        setp(first + str_.m_imp.length, first + str_.m_imp.capacity - 1);
+    }
+
+    bool grow(size_t n) {
+        commit();
+        str_.reserve(str_.size() + n);
+        reset_put_area();
+        return (size_t)(epptr() - pptr()) >= n;
+    }
+
+    void advance(size_t n) {
+        while (n > (size_t) INT_MAX) {
+            pbump(INT_MAX);
+            n -= (size_t) INT_MAX; }
+        pbump((int) n);
+    }
 
     // Prevent copy and assign
     //
@@ -85,15 +133,138 @@ private:
 //----------------------------------------------
 //----------------------------------------------
 
+#if __cplusplus >= 201103L
+//  Per thread pool of DStringOut objects for hot paths. acquire() returns
+//  an empty stream with default state and formatting, the lease puts it
+//  back (keeping its capacity) when destroyed. Nested acquires are fine
+//
+class DStringOutPool {
+public:
+    class Lease {
+    public:
+        explicit Lease(std::unique_ptr<DStringOut> out) : out_(std::move(out)) {}
+        Lease(Lease&& rhs) noexcept : out_(std::move(rhs.out_)) {}
+        ~Lease() { if (out_) DStringOutPool::release(std::move(out_)); }
+
+        DStringOut& operator*()  const { return *out_; }
+        DStringOut* operator->() const { return out_.get(); }
+
+    private:
+        std::unique_ptr<DStringOut> out_;
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+    };
+
+    static Lease acquire() {
+        std::vector<std::unique_ptr<DStringOut>>& pool = free_list();
+        if (pool.empty()) {
+            return Lease(std::unique_ptr<DStringOut>(new DStringOut)); }
+
+        std::unique_ptr<DStringOut> out = std::move(pool.back());
+        pool.pop_back();
+        return Lease(std::move(out));
+    }
+
+private:
+    static const size_t max_pooled = 8;
+
+    static std::vector<std::unique_ptr<DStringOut>>& free_list() {
+        static thread_local std::vector<std::unique_ptr<DStringOut>> pool;
+        return pool;
+    }
+
+    static void release(std::unique_ptr<DStringOut> out) {
+        std::vector<std::unique_ptr<DStringOut>>& pool = free_list();
+        if (pool.size() >= max_pooled) {
+            return; }
+
+        out->reset();
+        out->clear();
+        out->flags(std::ios_base::skipws | std::ios_base::dec);
+        out->precision(6);
+        out->width(0);
+        out->fill(' ');
+        pool.push_back(std::move(out));
+    }
+};
+//----------------------------------------------
+//----------------------------------------------
+#endif
+
+//  Read only, zero copy input stream over a DStringView (the viewed
+//  characters must outlive the stream)
+//
+class DStringInBuf : public std::streambuf {
+public:
+    explicit DStringInBuf(DStringView sv) {
+        char* first = const_cast<char*>(sv.data());
+        setg(first, first, first + sv.size());
+    }
+
+    DStringView view() const {
+        return DStringView(eback(), (size_t)(egptr() - eback()));
+    }
+
+protected:
+    std::streamsize showmanyc() {
+        return (gptr() < egptr()) ? (std::streamsize)(egptr() - gptr()) : -1;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1)); }
+
+        off_type base = (dir == std::ios_base::beg) ? 0 :
+                        (dir == std::ios_base::cur) ? (off_type)(gptr() - eback()) :
+                                                      (off_type)(egptr() - eback());
+        off_type pos = base + off;
+        if (pos < 0 || pos > (off_type)(egptr() - eback())) {
+            return pos_type(off_type(-1)); }
+
+        setg(eback(), eback() + pos, egptr());
+        return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in) {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+
+private:
+    DStringInBuf(const DStringInBuf&);
+    DStringInBuf& operator=(const DStringInBuf&);
+};
+//----------------------------------------------
+//----------------------------------------------
+
+class DStringIn : public std::istream {
+    DStringInBuf buf_;
+public:
+    explicit DStringIn(DStringView sv) : std::istream(&buf_), buf_(sv) {}
+    DStringView view() const { return buf_.view(); }
+private:
+    DStringIn(const DStringIn&);
+    DStringIn& operator=(const DStringIn&);
+};
+//----------------------------------------------
+//----------------------------------------------
+
 // Slower than DString::to_string() but general for all types that
 // have io with std::ostream
 //
 template <typename T>
 inline DString to_dstring(const T& t)
 {
+#if __cplusplus >= 201103L
+    DStringOutPool::Lease out = DStringOutPool::acquire();
+    *out << t;
+    return out->str();
+#else
     DStringOut out;
     out << t;
     return out.str();
+#endif
 }
 //----------------------------------------------
 
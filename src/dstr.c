@@ -4,6 +4,10 @@
  * This file is part of DString C and C++ dynamic string library,
  * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
  */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // memmem
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
@@ -12,10 +16,15 @@
 #include <errno.h>
 #include <stddef.h>
 #include <limits.h>
+#include <sys/stat.h>
 
 #include <dstr/dstr.h>
 #include "dstr_internal.h"
 
+#if defined(__GLIBC__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define DSTR_HAVE_MEMMEM 1
+#endif
+
 // For implementation of dstr_hash
 //
 #define XXH_INLINE_ALL
@@ -27,6 +36,16 @@
 #endif
 #endif
 
+#if defined(_MSC_VER)
+#define dstr_fileno(fp)         _fileno(fp)
+#define dstr_fstat(fd, st)      _fstat((fd), (st))
+typedef struct _stat dstr_stat_t;
+#else
+#define dstr_fileno(fp)         fileno(fp)
+#define dstr_fstat(fd, st)      fstat((fd), (st))
+typedef struct stat dstr_stat_t;
+#endif
+
 /*
  *  For convenience, make code shorter
  */
@@ -45,7 +64,7 @@
         assert((p) != NULL);                                    \
         assert(DBUF(p) != NULL);                                \
         assert(DVAL(p, DLEN(p)) == '\0');                       \
-        assert(DLEN(p) == strlen(DBUF(p)));                     \
+        assert(!DSTR_TEXT_ONLY || DLEN(p) == strlen(DBUF(p)));  \
 } while(0)
 
 // Checks for DSTR type (a.k.s DSTR_TYPE*)
@@ -57,14 +76,17 @@
     } while(0)
 /*--------------------------------------------------------------------------*/
 
-static const char* my_strcasechr(const char* s, int c)
+// Case insensitive memchr
+//
+static const char* mem_casechr(const char* s, size_t n, int c)
 {
-    if (!s) return NULL;
-
     unsigned char uc = (unsigned char) toupper(c);
     unsigned char lc = (unsigned char) tolower(c);
 
-    for (; *s != '\0'; ++s) {
+    if (uc == lc) {
+        return (const char*) memchr(s, c, n); }
+
+    for (const char* end = s + n; s < end; ++s) {
         unsigned char curr = *s;
         if (curr == lc || curr == uc)
             return s; }
@@ -73,21 +95,54 @@ static const char* my_strcasechr(const char* s, int c)
 }
 /*-------------------------------------------------------------------------------*/
 
-static const char* my_strcasestr(const char* haystack, const char* needle)
+// Case insensitive memcmp, returns nonzero if equal
+//
+static int mem_caseeq(const char* s1, const char* s2, size_t n)
 {
-    if (*needle == '\0')
-        return haystack;
+    for (size_t i = 0; i < n; ++i) {
+        if (s1[i] != s2[i] && toupper((unsigned char) s1[i]) != toupper((unsigned char) s2[i]))
+            return 0; }
+
+    return 1;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Find NEEDLE in HAYSTACK by length, NUL bytes are ordinary bytes. Uses
+// the C library's memmem where there is one (two-way, linear time)
+//
+static const char* dstr_memmem(const char* haystack, size_t hlen,
+                               const char* needle, size_t nlen,
+                               int ignore_case)
+{
+    if (nlen == 0) {
+        return haystack; }
 
-    for ( ; *haystack; ++haystack) {
-        const char* s1 = haystack;
-        const char* s2 = needle;
+    if (nlen > hlen) {
+        return NULL; }
 
-        while (*s1 && *s2 && (*s1 == *s2 || toupper(*s1) == toupper(*s2))) {
-            ++s1;
-            ++s2; }
+    if (!ignore_case) {
+        if (nlen == 1) {
+            return (const char*) memchr(haystack, needle[0], hlen); }
+#if defined(DSTR_HAVE_MEMMEM)
+        return (const char*) memmem(haystack, hlen, needle, nlen);
+#endif
+    }
 
-        if (*s2 == '\0')
-            return haystack; }
+    const char* last = haystack + (hlen - nlen);
+    while (haystack <= last) {
+        const char* first = ignore_case ?
+            mem_casechr(haystack, (size_t) (last - haystack) + 1, needle[0]) :
+            (const char*) memchr(haystack, needle[0], (size_t) (last - haystack) + 1);
+
+        if (!first) {
+            return NULL; }
+
+        if (ignore_case ?
+            mem_caseeq(first + 1, needle + 1, nlen - 1) :
+            memcmp(first + 1, needle + 1, nlen - 1) == 0) {
+            return first; }
+
+        haystack = first + 1; }
 
     return NULL;
 }
@@ -326,7 +381,7 @@ static int dstr_insert_cc_imp(DSTR p, size_t index, char c, size_t count)
 
     index = min_2(index, DLEN(p));
 
-    if (c == '\0') {
+    if (DSTR_TEXT_ONLY && c == '\0') {
         dstr_truncate_imp(p, index);
         return DSTR_SUCCESS; }
 
@@ -448,7 +503,7 @@ static DSTR dstr_create_buff_imp(const char* buff, size_t len)
 
     // verify no embedded nulls
     //
-    len = strnlen(buff, len);
+    len = dstr_input_len(buff, len);
 
     // Now allocate
     //
@@ -467,26 +522,18 @@ static DSTR dstr_create_buff_imp(const char* buff, size_t len)
 }
 /*-------------------------------------------------------------------------------*/
 
-static size_t dstr_find_sz_imp(CDSTR p,
-                               size_t pos,
-                               const char* s,
-                               int ignore_case)
+static size_t dstr_find_imp(CDSTR p,
+                            size_t pos,
+                            const char* s,
+                            size_t slen,
+                            int ignore_case)
 {
-    const char* search_loc;
-    const char* found_loc;
-
     dstr_assert_view(p);
 
     if (pos >= DLEN(p)) {
         return DSTR_NPOS; }
 
-    search_loc = DBUF(p) + pos;
-
-    if (ignore_case) {
-        found_loc = my_strcasestr(search_loc, s); }
-    else {
-        found_loc = strstr(search_loc, s); }
-
+    const char* found_loc = dstr_memmem(DBUF(p) + pos, DLEN(p) - pos, s, slen, ignore_case);
     if (found_loc == NULL) {
         return DSTR_NPOS; }
 
@@ -494,16 +541,14 @@ static size_t dstr_find_sz_imp(CDSTR p,
 }
 /*-------------------------------------------------------------------------------*/
 
-static size_t dstr_rfind_sz_imp(CDSTR p,
-                                size_t pos,
-                                const char* s,
-                                int ignore_case)
+static size_t dstr_rfind_imp(CDSTR p,
+                             size_t pos,
+                             const char* s,
+                             size_t slen,
+                             int ignore_case)
 {
-    const char* found_loc = NULL;
-
     dstr_assert_view(p);
 
-    size_t slen = strlen(s);
     if (slen > DLEN(p)) {
         return DSTR_NPOS; }
 
@@ -513,105 +558,69 @@ static size_t dstr_rfind_sz_imp(CDSTR p,
     if (slen == 0) {
         return pos; }
 
+    // a match at i needs slen bytes
+    //
+    pos = min_2(pos, DLEN(p) - slen);
+
     for (size_t i = pos + 1; i-- > 0; )  {
         const char* search_loc = DBUF(p) + i;
-        if (ignore_case) {
-            if (strncasecmp(search_loc, s, slen) == 0) {
-                found_loc = search_loc;
-                break; } }
-        else {
-            if (strncmp(search_loc, s, slen) == 0) {
-                found_loc = search_loc;
-                break; } } }
+        if (*search_loc != *s && !ignore_case) {
+            continue; }
 
-    if (found_loc == NULL) {
-        return DSTR_NPOS; }
+        if (ignore_case ?
+            mem_caseeq(search_loc, s, slen) :
+            memcmp(search_loc, s, slen) == 0) {
+            return i; } }
 
-    return (size_t)(found_loc - DBUF(p));
+    return DSTR_NPOS;
 }
 /*-------------------------------------------------------------------------------*/
 
-static ptrdiff_t dstr_suffix_sz_imp(CDSTR p,
-                                    const char* s,
-                                    int ignore_case)
+// Returns the offset of suffix S in P or -1
+//
+static ptrdiff_t dstr_suffix_imp(CDSTR p,
+                                 const char* s,
+                                 size_t slen,
+                                 int ignore_case)
 {
-    size_t compare_len;
-    const char* compare_addr;
-
     dstr_assert_view(p);
-    assert(s != NULL);
-
-    if (!p || !s) {
-        return -1; }
 
-    // optimize for empty string
-    //
-    if (s[0] == '\0') {
-        return DLEN(p); }
-
-    // optimize for single char
-    //
-    if (s[1] == '\0') {
-        char c1 = dstr_back(p);
-        char c2 = s[0];
-        if (c1 == c2 || (ignore_case && tolower(c1) == tolower(c2))) {
-            return DLEN(p) - 1;  } }
-
-    if ((compare_len = strlen(s)) > DLEN(p)) {
+    if (slen > DLEN(p)) {
         return -1; }
 
-    compare_addr = DBUF(p) + (DLEN(p) - compare_len);
+    const char* compare_addr = DBUF(p) + (DLEN(p) - slen);
 
     if (ignore_case) {
-        if (strcasecmp(compare_addr, s) != 0) {
+        if (!mem_caseeq(compare_addr, s, slen)) {
             return -1; } }
     else {
-        if (strcmp(compare_addr, s) != 0) {
+        if (memcmp(compare_addr, s, slen) != 0) {
             return -1; } }
 
     return (compare_addr - DBUF(p));
 }
 /*-------------------------------------------------------------------------------*/
 
-static ptrdiff_t dstr_prefix_sz_imp(CDSTR p,
-                                    const char* s,
-                                    int ignore_case)
+// Returns the length of prefix S in P or -1
+//
+static ptrdiff_t dstr_prefix_imp(CDSTR p,
+                                 const char* s,
+                                 size_t slen,
+                                 int ignore_case)
 {
-    const char* pbuf;
-
     dstr_assert_view(p);
 
-    // NULL
-    //
-    if (!s) {
-        return  -1; }
-
-    // optimize for empty string
-    //
-    if (s[0] == '\0') {
-        return 0; }
-
-    // optimize for single char
-    //
-    if (s[1] == '\0') {
-        char c1 = DVAL(p, 0);
-        char c2 = s[0];
-        if (c1 == c2 || (ignore_case && tolower(c1) == tolower(c2))) {
-            return 1;  } }
+    if (slen > DLEN(p)) {
+        return -1; }
 
-    // Fallback to default string check
-    //
-    pbuf = DBUF(p);
     if (ignore_case) {
-        while (*s && ((*pbuf == *s) || (toupper(*pbuf) == toupper(*s)))) {
-            ++pbuf;
-            ++s; } }
+        if (!mem_caseeq(DBUF(p), s, slen)) {
+            return -1; } }
     else {
-        while (*s && (*pbuf == *s)) {
-            ++pbuf;
-            ++s; } }
+        if (memcmp(DBUF(p), s, slen) != 0) {
+            return -1; } }
 
-    return (*s == '\0') ? (pbuf - DBUF(p)) : -1;
+    return (ptrdiff_t) slen;
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -620,7 +629,6 @@ static size_t dstr_find_c_imp(CDSTR p,
                               char c,
                               int ignore_case)
 {
-    const char* search_loc;
     const char* found_loc;
 
     dstr_assert_view(p);
@@ -628,12 +636,10 @@ static size_t dstr_find_c_imp(CDSTR p,
     if (pos >= DLEN(p)) {
         return DSTR_NPOS; }
 
-    search_loc = DBUF(p) + pos;
-
     if (ignore_case) {
-        found_loc = my_strcasechr(search_loc, c); }
+        found_loc = mem_casechr(DBUF(p) + pos, DLEN(p) - pos, c); }
     else {
-        found_loc = strchr(search_loc, c); }
+        found_loc = (const char*) memchr(DBUF(p) + pos, c, DLEN(p) - pos); }
 
     if (found_loc == NULL) {
         return DSTR_NPOS; }
@@ -837,7 +843,7 @@ DSTR dstr_create_cc(char ch, size_t count)
 {
     DSTR p;
 
-    if (count == 0 || ch == '\0')
+    if (count == 0 || (DSTR_TEXT_ONLY && ch == '\0'))
         return dstr_alloc_empty();
 
     if ((p = dstr_create_len_imp(count)) == NULL)
@@ -852,6 +858,27 @@ DSTR dstr_create_cc(char ch, size_t count)
 }
 /*-------------------------------------------------------------------------------*/
 
+// Bytes left in a regular file from its current position, 0 if unknown
+//
+static size_t stream_size_hint(FILE* fp)
+{
+    dstr_stat_t st;
+    if (dstr_fstat(dstr_fileno(fp), &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG) {
+        return 0; }
+
+    long pos = ftell(fp);
+    if (pos < 0 || (unsigned long long) pos >= (unsigned long long) st.st_size) {
+        return 0; }
+
+    unsigned long long left = (unsigned long long) st.st_size - (unsigned long long) pos;
+    return (left < UINT32_MAX) ? (size_t) left : 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Regular files are sized with fstat first so the DSTR is allocated once
+// and filled with one large fread. Streams of unknown size grow by
+// doubling
+//
 int dstr_slurp_stream(DSTR p, FILE* fp)
 {
     dstr_assert_valid(p);
@@ -860,26 +887,41 @@ int dstr_slurp_stream(DSTR p, FILE* fp)
         errno = EBADF;
         return DSTR_FAIL; }
 
-    char chunk[4096];
-    for (;;) {
-        size_t len = fread(chunk, sizeof(char), sizeof(chunk), fp);
-        if (len < sizeof(chunk) && ferror(fp)) {
-            dstr_clear(p);
-            return DSTR_FAIL; }
+    size_t hint = stream_size_hint(fp);
+    if (!dstr_grow_by(p, hint ? hint : 4096)) {
+        dstr_clear(p);
+        return DSTR_FAIL; }
 
-        if (len) {
-            // We don't allow null bytes in DSTR
+    for (;;) {
+        size_t room = DCAP(p) - DLEN(p) - 1;
+        if (room == 0) {
+            // full: either at end of file or the file grew
             //
-            if (memchr(chunk, '\0', len)) {
-                errno = EINVAL;
+            int c = getc(fp);
+            if (c == EOF) {
+                break; }
+            ungetc(c, fp);
+            if (!dstr_grow_by(p, DLEN(p))) {
                 dstr_clear(p);
                 return DSTR_FAIL; }
+            continue; }
 
-            if (!dstr_append_no_overlap(p, chunk, len)) {
-                dstr_clear(p);
-                return DSTR_FAIL; } }
+        size_t len = fread(dstr_tail(p), sizeof(char), room, fp);
+        if (len < room && ferror(fp)) {
+            dstr_clear(p);
+            return DSTR_FAIL; }
+
+        // Text builds don't allow null bytes in DSTR
+        //
+        if (DSTR_TEXT_ONLY && len && memchr(dstr_tail(p), '\0', len)) {
+            errno = EINVAL;
+            dstr_clear(p);
+            return DSTR_FAIL; }
+
+        DLEN(p) += len;
+        DVAL(p, DLEN(p)) = '\0';
 
-        if (feof(fp)) {
+        if (len < room) {
             break; } }
 
     dstr_assert_valid(p);
@@ -1026,7 +1068,7 @@ int dstr_assign_bl(DSTR p, const char* buff, size_t len)
         dstr_clear(p);
         return DSTR_SUCCESS; }
 
-    len = strnlen(buff, len);
+    len = dstr_input_len(buff, len);
     return dstr_assign_imp(p, buff, len);
 }
 /*-------------------------------------------------------------------------------*/
@@ -1044,7 +1086,7 @@ int dstr_assign_range(DSTR p, const char* first, const char* last)
         dstr_clear(p);
         return DSTR_SUCCESS; }
 
-    len = strnlen(first, len);
+    len = dstr_input_len(first, len);
     return dstr_assign_imp(p, first, len);
 }
 /*-------------------------------------------------------------------------------*/
@@ -1084,7 +1126,7 @@ int dstr_grow_append_c(DSTR p, char c)
 {
     dstr_assert_valid(p);
 
-    if (c == '\0') return DSTR_SUCCESS;
+    if (DSTR_TEXT_ONLY && c == '\0') return DSTR_SUCCESS;
 
     if (!dstr_grow_by(p, 1)) {
         return DSTR_FAIL; }
@@ -1126,7 +1168,7 @@ int dstr_append_bl(DSTR p, const char* buff, size_t len)
     if (buff == NULL)
         return DSTR_SUCCESS;
 
-    len = strnlen(buff, len);
+    len = dstr_input_len(buff, len);
     return dstr_append_imp(p, buff, len);
 }
 /*-------------------------------------------------------------------------------*/
@@ -1141,20 +1183,32 @@ int dstr_append_range(DSTR p, const char* first, const char* last)
     if (first == NULL)
         return DSTR_SUCCESS;
 
-    size_t len = strnlen(first, (last - first));
+    size_t len = dstr_input_len(first, (size_t) (last - first));
     return dstr_append_imp(p, first, len);
 }
 /*-------------------------------------------------------------------------------*/
 
 size_t dstr_find_sz(CDSTR p, size_t pos, const char* s)
 {
-    return dstr_find_sz_imp(p, pos, s, DSTR_FALSE); /* don't ignore case */
+    return dstr_find_imp(p, pos, s, strlen(s), DSTR_FALSE); /* don't ignore case */
 }
 /*-------------------------------------------------------------------------------*/
 
 size_t dstr_ifind_sz(CDSTR p, size_t pos, const char* s)
 {
-    return dstr_find_sz_imp(p, pos, s, DSTR_TRUE);
+    return dstr_find_imp(p, pos, s, strlen(s), DSTR_TRUE);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_find_bl(CDSTR p, size_t pos, const char* buff, size_t len)
+{
+    return dstr_find_imp(p, pos, buff, len, DSTR_FALSE);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_ifind_bl(CDSTR p, size_t pos, const char* buff, size_t len)
+{
+    return dstr_find_imp(p, pos, buff, len, DSTR_TRUE);
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -1172,13 +1226,25 @@ size_t dstr_ifind_c(CDSTR p, size_t pos, char c)
 
 size_t dstr_rfind_sz(CDSTR p, size_t pos, const char* s)
 {
-    return dstr_rfind_sz_imp(p, pos, s, DSTR_FALSE); /* don't ignore case */
+    return dstr_rfind_imp(p, pos, s, strlen(s), DSTR_FALSE); /* don't ignore case */
 }
 /*-------------------------------------------------------------------------------*/
 
 size_t dstr_irfind_sz(CDSTR p, size_t pos, const char* s)
 {
-    return dstr_rfind_sz_imp(p, pos, s, DSTR_TRUE);
+    return dstr_rfind_imp(p, pos, s, strlen(s), DSTR_TRUE);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_rfind_bl(CDSTR p, size_t pos, const char* buff, size_t len)
+{
+    return dstr_rfind_imp(p, pos, buff, len, DSTR_FALSE);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_irfind_bl(CDSTR p, size_t pos, const char* buff, size_t len)
+{
+    return dstr_rfind_imp(p, pos, buff, len, DSTR_TRUE);
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -1209,26 +1275,50 @@ DSTR_BOOL dstr_icontains_sz(CDSTR p, const char* s)
 DSTR_BOOL dstr_suffix_sz(CDSTR p, const char* s)
 {
     /* don't ignore case */
-    return dstr_suffix_sz_imp(p, s, 0) >= 0;
+    return s && dstr_suffix_imp(p, s, strlen(s), 0) >= 0;
 }
 /*-------------------------------------------------------------------------------*/
 
 DSTR_BOOL dstr_isuffix_sz(CDSTR p, const char* s)
 {
     /* ignore case */
-    return dstr_suffix_sz_imp(p, s, 1) >= 0;
+    return s && dstr_suffix_imp(p, s, strlen(s), 1) >= 0;
 }
 /*-------------------------------------------------------------------------------*/
 
 DSTR_BOOL dstr_prefix_sz(CDSTR p, const char* s)
 {
-    return dstr_prefix_sz_imp(p, s, 0) >= 0;
+    return s && dstr_prefix_imp(p, s, strlen(s), 0) >= 0;
 }
 /*-------------------------------------------------------------------------------*/
 
 DSTR_BOOL dstr_iprefix_sz(CDSTR p, const char* s)
 {
-    return dstr_prefix_sz_imp(p, s, 1) >= 0;
+    return s && dstr_prefix_imp(p, s, strlen(s), 1) >= 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_BOOL dstr_suffix_bl(CDSTR p, const char* buff, size_t len)
+{
+    return dstr_suffix_imp(p, buff, len, 0) >= 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_BOOL dstr_isuffix_bl(CDSTR p, const char* buff, size_t len)
+{
+    return dstr_suffix_imp(p, buff, len, 1) >= 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_BOOL dstr_prefix_bl(CDSTR p, const char* buff, size_t len)
+{
+    return dstr_prefix_imp(p, buff, len, 0) >= 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_BOOL dstr_iprefix_bl(CDSTR p, const char* buff, size_t len)
+{
+    return dstr_prefix_imp(p, buff, len, 1) >= 0;
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -1438,7 +1528,7 @@ int dstr_insert_bl(DSTR p, size_t index, const char* buff, size_t len)
         return DSTR_SUCCESS;
 
     if (len > PTRDIFF_MAX) len = PTRDIFF_MAX;
-    len = strnlen(buff, len);
+    len = dstr_input_len(buff, len);
     return dstr_insert_imp(p, index, buff, len);
 }
 /*-------------------------------------------------------------------------------*/
@@ -1454,7 +1544,7 @@ int dstr_insert_range(DSTR p, size_t index, const char* first, const char* last)
     if (first == NULL || len == 0)
         return DSTR_SUCCESS;
 
-    len = strnlen(first, len);
+    len = dstr_input_len(first, len);
 
     return dstr_insert_imp(p, index, first, len);
 }
@@ -1487,6 +1577,8 @@ int dstr_replace_bl(DSTR p, size_t pos, size_t count, const char* buff, size_t l
     dstr_assert_valid(p);
 
     /* check for null inside */
+    if (buff) {
+        len = dstr_input_len(buff, len); }
     return dstr_replace_imp(p, pos, count, buff, len);
 }
 /*-------------------------------------------------------------------------------*/
@@ -1499,7 +1591,7 @@ int dstr_replace_range(DSTR p, size_t pos, size_t count, const char* first, cons
         return DSTR_FAIL; }
 
     /* check for null inside */
-    return dstr_replace_imp(p, pos, count, first, (last -first));
+    return dstr_replace_imp(p, pos, count, first, dstr_input_len(first, (size_t) (last - first)));
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -1709,21 +1801,122 @@ void dstr_swap(DSTR d1, DSTR d2)
 }
 /*-------------------------------------------------------------------------------*/
 
+int dstr_adopt_buffer(DSTR p, char* buf, size_t len, size_t cap)
+{
+    dstr_assert_valid(p);
+
+    if (!buf || len >= cap) {
+        errno = EINVAL;
+        return DSTR_FAIL; }
+
+    if (len >= UINT32_MAX) {
+        errno = ERANGE;
+        return DSTR_FAIL; }
+
+    len = dstr_input_len(buf, len);
+    if (cap > UINT32_MAX) {
+        cap = UINT32_MAX; }
+
+    // Capacities are kept a multiple of DSTR_INITIAL_CAPACITY. Round CAP
+    // down, or when that leaves no room for the terminator grow BUF to
+    // the next multiple (usually in place)
+    //
+    size_t room = cap - cap % DSTR_INITIAL_CAPACITY;
+    if (room <= len) {
+        room += DSTR_INITIAL_CAPACITY;
+        if (room > UINT32_MAX) {
+            errno = ERANGE;
+            return DSTR_FAIL; }
+
+        char* grown = (char*) realloc(buf, room);
+        if (!grown) {
+            errno = ENOMEM;
+            dstr_out_of_memory();
+            return DSTR_FAIL; }
+        buf = grown; }
+
+    // The C++ wrapper tells SSO from heap storage by capacity, so a
+    // heap buffer must always be reported larger than the SSO area
+    //
+    if (room <= DSTR_INITIAL_CAPACITY) {
+        dstr_clean_data(p);
+        dstr_init_data(p);
+        memcpy(p->data, buf, len);
+        free(buf); }
+    else {
+        dstr_clean_data(p);
+        p->data = buf;
+        p->capacity = (uint32_t) room; }
+
+    p->length = (uint32_t) len;
+    p->data[len] = '\0';
+
+    dstr_assert_valid(p);
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+char* dstr_release_buffer(DSTR p, size_t* len, size_t* cap)
+{
+    dstr_assert_valid(p);
+
+    char* result;
+    size_t result_cap;
+
+    if (D_IS_SSO(p)) {
+        result_cap = DLEN(p) + 1;
+        if ((result = (char*) malloc(result_cap)) == NULL) {
+            errno = ENOMEM;
+            dstr_out_of_memory();
+            return NULL; }
+        memcpy(result, DBUF(p), result_cap); }
+    else {
+        result = p->data;
+        result_cap = DCAP(p); }
+
+    if (len) {
+        *len = DLEN(p); }
+    if (cap) {
+        *cap = result_cap; }
+
+    dstr_init_data(p);
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Character reads without taking the stream lock for every byte. The
+// stream is locked once per call where the platform supports it
+//
+#if defined(_MSC_VER) && (_MSC_VER >= 1400)
+#define dstr_lockfile(fp)     _lock_file(fp)
+#define dstr_unlockfile(fp)   _unlock_file(fp)
+#define dstr_getc(fp)         _getc_nolock(fp)
+#elif defined(__unix__) || defined(__APPLE__)
+#define dstr_lockfile(fp)     flockfile(fp)
+#define dstr_unlockfile(fp)   funlockfile(fp)
+#define dstr_getc(fp)         getc_unlocked(fp)
+#else
+#define dstr_lockfile(fp)     ((void)0)
+#define dstr_unlockfile(fp)   ((void)0)
+#define dstr_getc(fp)         fgetc(fp)
+#endif
+
 int dstr_fgets(DSTR p, FILE* fp)
 {
     int c;
-    char buf[32];
+    char buf[128];
     size_t bindex = 0;
 
     dstr_assert_valid(p);
     assert(fp != NULL);
 
     dstr_clear(p);
+    dstr_lockfile(fp);
 
     /* skip blanks */
     do {
-        if ((c = fgetc(fp)) == EOF)
-            return EOF;
+        if ((c = dstr_getc(fp)) == EOF)
+            goto eof;
     } while (isspace(c) || c == '\0');
 
     /* read until next blank characters */
@@ -1734,7 +1927,7 @@ int dstr_fgets(DSTR p, FILE* fp)
                 goto clear_fail; }
             bindex = 0; }
 
-        if ((c = fgetc(fp)) == EOF)
+        if ((c = dstr_getc(fp)) == EOF)
             break;
 
         if (isspace(c) || c == '\0') {
@@ -1745,44 +1938,72 @@ int dstr_fgets(DSTR p, FILE* fp)
         if (!dstr_append_no_overlap(p, buf, bindex))
             goto clear_fail; }
 
+    dstr_unlockfile(fp);
     return DSTR_SUCCESS;
 
 clear_fail:
     dstr_clear(p);
+eof:
+    dstr_unlockfile(fp);
     return EOF;
 }
 /*-------------------------------------------------------------------------------*/
 
+// Lines are read with fgets() (which scans the stream buffer with memchr)
+// directly into the spare capacity of P. Each chunk is pre-filled with
+// '\n' so the length fgets stored is found without strlen: either a
+// '\n' followed by the terminating NUL (end of line), a '\n' preceded by
+// the NUL (end of file) or no '\n' at all (chunk full)
+//
+#define FGETLINE_CHUNK 512U
+
 int dstr_fgetline(DSTR p, FILE* fp)
 {
-    int c;
-
     dstr_assert_valid(p);
+    assert(fp != NULL);
     dstr_clear(p);
 
-    // We append to DSTR in chunks. In most cases only one chunk will be
-    // needed
-    //
-    char buf[128];
-    size_t bindex = 0;
+    int result = EOF;
+    size_t len = 0;
 
-    while ((c = fgetc(fp)) != EOF && c != '\n' && c != '\0') {
-        buf[bindex] = c;
-        if (++bindex == sizeof(buf)) {
-            if (!dstr_append_no_overlap(p, buf, bindex)) {
+    for (;;) {
+        if (DCAP(p) - len < 64) {
+            if (!dstr_grow(p, len + FGETLINE_CHUNK)) {
                 dstr_clear(p);
-                return EOF; }
-            bindex = 0; } }
+                return EOF; } }
 
-    if (bindex) {
-        if (!dstr_append_no_overlap(p, buf, bindex)) {
-            dstr_clear(p);
-            return EOF; } }
+        size_t chunk = DCAP(p) - len;
+        if (chunk > FGETLINE_CHUNK) {
+            chunk = FGETLINE_CHUNK; }
 
-    if (DLEN(p) > 0 || (c == '\n') || (c == '\0'))
-        return DSTR_SUCCESS;
+        char* dst = DBUF(p) + len;
+        memset(dst, '\n', chunk);
+        if (!fgets(dst, (int) chunk, fp)) {
+            *dst = '\0';
+            break; }
 
-    return EOF;
+        result = DSTR_SUCCESS;
+        const char* nl = (const char*) memchr(dst, '\n', chunk);
+        if (!nl) {
+            len += chunk - 1;
+            DLEN(p) = len;
+            continue; }
+
+        if (nl + 1 < dst + chunk && nl[1] == '\0') {
+            len += (size_t)(nl - dst); }
+        else {
+            len += (size_t)(nl - dst) - 1; }
+        break; }
+
+    // a NUL byte ends the line
+    //
+    const char* nul = (const char*) memchr(DBUF(p), '\0', len);
+    if (nul) {
+        len = (size_t)(nul - DBUF(p)); }
+
+    DLEN(p) = len;
+    DVAL(p, len) = '\0';
+    return result;
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -1857,55 +2078,42 @@ int dstr_itos(DSTR dest, long long n)
 }
 /*-------------------------------------------------------------------------------*/
 
-static const char* _find_atoi_base(const char* p, int* pBase)
-{
-    assert(p != NULL);
-    assert(pBase != NULL);
-
-    if (*p == '\\') {
-        ++p;
-        *pBase = 8; }
-    else if (*p == '0') {
-        if (p[1] == 'b' || p[1] == 'B') {
-            p += 2;
-            *pBase = 2; }
-        else if (p[1] == 'x' || p[1] == 'X') {
-            p += 2;
-            *pBase = 16; }
-        else {
-            /* skip all leading zero's */
-            do { ++p; } while (*p == '0'); } }
-
-    return p;
-}
-/*-------------------------------------------------------------------------------*/
-
 long dstr_atoi(CDSTR src)
 {
     dstr_assert_view(src);
 
-    int base = 10;
-    const char* p = _find_atoi_base(DBUF(src), &base);
+    long long result = dstr_atoll_bl(DBUF(src), DLEN(src));
+
+#if LONG_MAX < LLONG_MAX
+    if (result > LONG_MAX) {
+        errno = ERANGE;
+        return LONG_MAX; }
 
-    return strtol(p, NULL, base);
+    if (result < LONG_MIN) {
+        errno = ERANGE;
+        return LONG_MIN; }
+#endif
+
+    return (long) result;
 }
 /*-------------------------------------------------------------------------------*/
 
 long long dstr_atoll(CDSTR src)
 {
     dstr_assert_view(src);
-
-    int base = 10;
-    const char* p = _find_atoi_base(DBUF(src), &base);
-
-    return strtoll(p, NULL, base);
+    return dstr_atoll_bl(DBUF(src), DLEN(src));
 }
 /*-------------------------------------------------------------------------------*/
 
 double dstr_atof(CDSTR src)
 {
     dstr_assert_view(src);
-    return atof(DBUF(src));
+
+    int errsave = errno;
+    double result = dstr_to_double_bl(DBUF(src), DLEN(src), NULL);
+    errno = errsave;
+
+    return result;
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -2107,169 +2315,85 @@ DSTR_BOOL dstr_islower(CDSTR p)
 
 int dstr_to_int(CDSTR p, size_t* index, int base)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    int result = strtol(str, &endp, base);
 
-    if (endp == str) {
-        errno = EINVAL; }
+    long long result = dstr_to_llong_bl(DBUF(p), DLEN(p), index, base);
 
-    if (index) {
-        *index = endp - str; }
+    if (result > INT_MAX) {
+        errno = ERANGE;
+        return INT_MAX; }
 
-    if (errno == 0) {
-        errno = errsave; }
+    if (result < INT_MIN) {
+        errno = ERANGE;
+        return INT_MIN; }
 
-    return result;
+    return (int) result;
 }
 /*-------------------------------------------------------------------------------*/
 
 long dstr_to_long(CDSTR p, size_t* index, int base)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
 
-    char* endp;
-    long result = strtol(str, &endp, base);
-
-    if (endp == str) {
-        errno = EINVAL; }
+    long long result = dstr_to_llong_bl(DBUF(p), DLEN(p), index, base);
 
-    if (index) {
-        *index = endp - str; }
+#if LONG_MAX < LLONG_MAX
+    if (result > LONG_MAX) {
+        errno = ERANGE;
+        return LONG_MAX; }
 
-    if (errno == 0) {
-        errno = errsave; }
+    if (result < LONG_MIN) {
+        errno = ERANGE;
+        return LONG_MIN; }
+#endif
 
-    return result;
+    return (long) result;
 }
 /*-------------------------------------------------------------------------------*/
 
 unsigned long dstr_to_ulong(CDSTR p, size_t* index, int base)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    unsigned long result = strtoul(str, &endp, base);
 
-    if (endp == str) {
-        errno = EINVAL; }
+    unsigned long long result = dstr_to_ullong_bl(DBUF(p), DLEN(p), index, base);
 
-    if (index) {
-        *index = endp - str; }
-
-    if (errno == 0) {
-        errno = errsave; }
+#if ULONG_MAX < ULLONG_MAX
+    // "-N" is negated in unsigned long arithmetic like strtoul
+    //
+    if (result > ULONG_MAX && (0 - result) > ULONG_MAX) {
+        errno = ERANGE;
+        return ULONG_MAX; }
+#endif
 
-    return result;
+    return (unsigned long) result;
 }
 /*-------------------------------------------------------------------------------*/
 
 long long dstr_to_llong(CDSTR p, size_t* index, int base)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    long long result = strtoll(str, &endp, base);
-
-    if (endp == str) {
-        errno = EINVAL; }
-
-    if (index) {
-        *index = endp - str; }
-
-    if (errno == 0) {
-        errno = errsave; }
-
-    return result;
+    return dstr_to_llong_bl(DBUF(p), DLEN(p), index, base);
 }
 /*-------------------------------------------------------------------------------*/
 
 unsigned long long dstr_to_ullong(CDSTR p, size_t* index, int base)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    unsigned long long result = strtoull(str, &endp, base);
-
-    if (endp == str) {
-        errno = EINVAL; }
-
-    if (index) {
-        *index = endp - str; }
-
-    if (errno == 0) {
-        errno = errsave; }
-
-    return result;
+    return dstr_to_ullong_bl(DBUF(p), DLEN(p), index, base);
 }
 /*-------------------------------------------------------------------------------*/
 
 float dstr_to_float(CDSTR p, size_t* index)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    float result = strtof(str, &endp);
-
-    if (endp == str) {
-        errno = EINVAL; }
-
-    if (index) {
-        *index = endp - str; }
-
-    if (errno == 0) {
-        errno = errsave; }
-
-    return result;
+    return dstr_to_float_bl(DBUF(p), DLEN(p), index);
 }
 /*-------------------------------------------------------------------------------*/
 
 double dstr_to_double(CDSTR p, size_t* index)
 {
-    int errsave = errno;
-    errno = 0;
-
     dstr_assert_view(p);
-    const char* str = dstr_cstr(p);
-
-    char* endp;
-    double result = strtod(str, &endp);
-
-    if (endp == str) {
-        errno = EINVAL; }
-
-    if (index) {
-        *index = endp - str; }
-
-    if (errno == 0) {
-        errno = errsave; }
-
-    return result;
+    return dstr_to_double_bl(DBUF(p), DLEN(p), index);
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -2384,7 +2508,7 @@ static int dstr_replace_all_imp(DSTR dest,
     while (pos < DLEN(dest)) {
         // find next match starting from pos
         //
-        size_t found = dstr_find_sz_imp(dest, pos, oldstr, 0);
+        size_t found = dstr_find_imp(dest, pos, oldstr, oldlen, 0);
 
         // if not found, append remainder and break
         //
@@ -2460,7 +2584,7 @@ static size_t dstr_count_aux(CDSTR p, const char* s, size_t slen, int ignore_cas
     size_t num_found = 0;
 
     for (;;) {
-        pos = dstr_find_sz_imp(p, pos, s, ignore_case);
+        pos = dstr_find_imp(p, pos, s, slen, ignore_case);
         if (pos == DSTR_NPOS) {
             break; }
 
@@ -3108,7 +3232,7 @@ void dstr_remove_any(DSTR p, const char* selectors)
 void dstr_remove_prefix(DSTR p, const char* s)
 {
     if (!s || !*s) return;
-    ptrdiff_t pos = dstr_prefix_sz_imp(p, s, 0);
+    ptrdiff_t pos = dstr_prefix_imp(p, s, strlen(s), 0);
     if (pos > 0)
         dstr_remove_imp(p, 0, pos);
 }
@@ -3117,7 +3241,7 @@ void dstr_remove_prefix(DSTR p, const char* s)
 void dstr_iremove_prefix(DSTR p, const char* s)
 {
     if (!s || !*s) return;
-    ptrdiff_t pos = dstr_prefix_sz_imp(p, s, 1);
+    ptrdiff_t pos = dstr_prefix_imp(p, s, strlen(s), 1);
     if (pos > 0)
         dstr_remove_imp(p, 0, pos);
 }
@@ -3126,7 +3250,7 @@ void dstr_iremove_prefix(DSTR p, const char* s)
 void dstr_remove_suffix(DSTR p, const char* s)
 {
     if (!s || !*s) return;
-    ptrdiff_t pos = dstr_suffix_sz_imp(p, s, 0);
+    ptrdiff_t pos = dstr_suffix_imp(p, s, strlen(s), 0);
     if (pos >= 0) {
         DLEN(p) = pos;
         DVAL(p, pos) = '\0'; }
@@ -3136,7 +3260,7 @@ void dstr_remove_suffix(DSTR p, const char* s)
 void dstr_iremove_suffix(DSTR p, const char* s)
 {
     if (!s || !*s) return;
-    ptrdiff_t pos = dstr_suffix_sz_imp(p, s, 1);
+    ptrdiff_t pos = dstr_suffix_imp(p, s, strlen(s), 1);
     if (pos >= 0) {
         DLEN(p) = pos;
         DVAL(p, pos) = '\0'; }
@@ -0,0 +1,1126 @@
+/*
+ * Copyright (c) 2025 Eyal Ben-David
+ *
+ * This file is part of DString C and C++ dynamic string library,
+ * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <dstr/dstr.h>
+#include "dstr_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+/*
+ *  Hex and base64 encoding/decoding appended into a DSTR, and escaping
+ *  for JSON, C, URL (percent encoding) and HTML.
+ *
+ *  The output size is computed exactly and reserved once. Decoding is
+ *  strict: any invalid character, bad length or bad padding fails with
+ *  errno = EINVAL and leaves the destination unchanged.
+ *
+ *  With AVX2 the bulk of the input is handled 32 bytes at a time, the
+ *  scalar code handles the tail and non AVX2 builds.
+ *
+ *  Decoded data is binary, use dstr_length(). A text build rejects a NUL
+ *  byte in the output with EINVAL, DSTR_BINARY_SAFE builds keep it.
+ */
+
+/*
+ *  For convenience, make code shorter (same as in dstr.c)
+ */
+#define DBUF(p)       ((p)->data)
+#define DLEN(p)       ((p)->length)
+/*-------------------------------------------------------------------------------*/
+
+// Make room for LEN more bytes and return the tail of the buffer
+//
+static inline unsigned char* codec_tail_reserve(DSTR p, size_t len)
+{
+    if (len > UINT32_MAX - DLEN(p)) {
+        errno = ENOMEM;
+        return NULL; }
+
+    if (!dstr_reserve(p, DLEN(p) + len)) {
+        return NULL; }
+
+    return (unsigned char*) DBUF(p) + DLEN(p);
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline void codec_commit(DSTR p, size_t len)
+{
+    DLEN(p) += (uint32_t) len;
+    DBUF(p)[DLEN(p)] = '\0';
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline int codec_invalid(void)
+{
+    errno = EINVAL;
+    return DSTR_FAIL;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Commit decoded output. Text builds don't allow NUL bytes in a DSTR, the
+// output is dropped and DEST stays unchanged
+//
+static inline int codec_commit_decoded(DSTR p, size_t len)
+{
+    if (DSTR_TEXT_ONLY && memchr(DBUF(p) + DLEN(p), '\0', len)) {
+        DBUF(p)[DLEN(p)] = '\0';
+        return codec_invalid(); }
+
+    codec_commit(p, len);
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Source inside DEST's buffer would move when DEST grows
+//
+static inline bool codec_overlaps(CDSTR dest, const void* buff)
+{
+    const char* p = (const char*) buff;
+    return p >= DBUF(dest) && p < DBUF(dest) + dest->capacity;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Private copy of exactly LEN bytes of an overlapping source (it may hold
+// NUL bytes, so dstr_create_bl can't be used). Free with free()
+//
+static void* codec_copy(const void* buff, size_t len)
+{
+    void* copy = malloc(len ? len : 1);
+    if (!copy) {
+        errno = ENOMEM;
+        dstr_out_of_memory();
+        return NULL; }
+
+    return memcpy(copy, buff, len);
+}
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+static inline unsigned first_set_bit(uint32_t mask)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctz(mask);
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    H E X
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+static const char hex_lower[] = "0123456789abcdef";
+static const char hex_upper[] = "0123456789ABCDEF";
+/*-------------------------------------------------------------------------------*/
+
+// Character -> hex digit value, 0xFF if not a hex digit
+//
+static const unsigned char hex_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+
+// 32 input bytes -> 64 hex characters. Returns bytes consumed
+//
+static size_t hex_encode_avx2(unsigned char* out, const unsigned char* in, size_t len,
+                              const char* digits)
+{
+    const __m256i lut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) digits));
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i x  = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, nibble));
+
+        // unpack works per 128 bit lane: a = bytes 0-7 | 16-23, b = 8-15 | 24-31
+        //
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+
+        _mm256_storeu_si256((__m256i*)(out + 2 * i),      _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31)); }
+
+    return i;
+}
+/*-------------------------------------------------------------------------------*/
+
+// 32 hex characters -> 16 bytes. Returns characters consumed, stops at
+// the first block with an invalid character (scalar code reports it)
+//
+static size_t hex_decode_avx2(unsigned char* out, const unsigned char* in, size_t len)
+{
+    const __m256i c0   = _mm256_set1_epi8('0');
+    const __m256i ca   = _mm256_set1_epi8('a');
+    const __m256i c9   = _mm256_set1_epi8(9);
+    const __m256i c5   = _mm256_set1_epi8(5);
+    const __m256i c10  = _mm256_set1_epi8(10);
+    const __m256i lcase = _mm256_set1_epi8(0x20);
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+
+        __m256i d = _mm256_sub_epi8(x, c0);
+        __m256i a = _mm256_sub_epi8(_mm256_or_si256(x, lcase), ca);
+        __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(d, c9), d);
+        __m256i is_alpha = _mm256_cmpeq_epi8(_mm256_min_epu8(a, c5), a);
+
+        if ((uint32_t) _mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha)) != 0xFFFFFFFFU) {
+            break; }
+
+        __m256i v = _mm256_blendv_epi8(_mm256_add_epi8(a, c10), d, is_digit);
+
+        // (hi, lo) byte pairs -> hi * 16 + lo, then pack 16 bit -> 8 bit
+        //
+        __m256i w = _mm256_maddubs_epi16(v, weights);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0xD8);
+
+        _mm_storeu_si128((__m128i*)(out + i / 2), _mm256_castsi256_si128(packed)); }
+
+    return i;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+int dstr_append_hex(DSTR dest, const void* buff, size_t len, int flags)
+{
+    assert(dest != NULL);
+
+    if (codec_overlaps(dest, buff)) {
+        void* tmp = codec_copy(buff, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = dstr_append_hex(dest, tmp, len, flags);
+        free(tmp);
+        return result; }
+
+    if (len > SIZE_MAX / 2) {
+        errno = ENOMEM;
+        return DSTR_FAIL; }
+
+    unsigned char* out = codec_tail_reserve(dest, 2 * len);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    const unsigned char* in = (const unsigned char*) buff;
+    const char* digits = (flags & DSTR_HEX_UPPER) ? hex_upper : hex_lower;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    i = hex_encode_avx2(out, in, len, digits);
+#endif
+
+    for (; i < len; ++i) {
+        out[2 * i]     = (unsigned char) digits[in[i] >> 4];
+        out[2 * i + 1] = (unsigned char) digits[in[i] & 0x0F]; }
+
+    codec_commit(dest, 2 * len);
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_decode_hex(DSTR dest, const char* src, size_t len)
+{
+    assert(dest != NULL);
+
+    if (codec_overlaps(dest, src)) {
+        void* tmp = codec_copy(src, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = dstr_decode_hex(dest, (const char*) tmp, len);
+        free(tmp);
+        return result; }
+
+    if (len % 2) {
+        return codec_invalid(); }
+
+    unsigned char* out = codec_tail_reserve(dest, len / 2);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    const unsigned char* in = (const unsigned char*) src;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    i = hex_decode_avx2(out, in, len);
+#endif
+
+    for (; i < len; i += 2) {
+        unsigned hi = hex_values[in[i]];
+        unsigned lo = hex_values[in[i + 1]];
+        if ((hi | lo) > 0x0F) {
+            DBUF(dest)[DLEN(dest)] = '\0';
+            return codec_invalid(); }
+
+        out[i / 2] = (unsigned char)((hi << 4) | lo); }
+
+    return codec_commit_decoded(dest, len / 2);
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    B A S E 6 4   (RFC 4648)
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+static const char base64_std_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char base64_url_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+/*-------------------------------------------------------------------------------*/
+
+// Character -> 6 bit value, 0xFF if not in the alphabet
+//
+static const unsigned char base64_std_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+/*-------------------------------------------------------------------------------*/
+
+static const unsigned char base64_url_values[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_base64_encoded_length(size_t len, int flags)
+{
+    if (flags & DSTR_BASE64_NOPAD) {
+        return (len / 3) * 4 + ((len % 3) ? (len % 3) + 1 : 0); }
+
+    return ((len + 2) / 3) * 4;
+}
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+
+// 24 input bytes -> 32 characters per step (Wojciech Mula's algorithm).
+// Each 128 bit load reads 16 bytes, so stop 4 bytes before the end
+//
+static size_t base64_encode_avx2(unsigned char* out, const unsigned char* in, size_t len,
+                                 int url_safe)
+{
+    const __m256i shuf = _mm256_setr_epi8(
+        1, 0, 2, 1,  4, 3, 5, 4,  7, 6, 8, 7,  10, 9, 11, 10,
+        1, 0, 2, 1,  4, 3, 5, 4,  7, 6, 8, 7,  10, 9, 11, 10);
+
+    // offsets added to the 6 bit index, selected by its range
+    //
+    const char c62 = url_safe ? '-' : '+';
+    const char c63 = url_safe ? '_' : '/';
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, (char)(c62 - 62), (char)(c63 - 63), 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, (char)(c62 - 62), (char)(c63 - 63), 'A', 0, 0);
+
+    size_t i = 0;
+    size_t o = 0;
+
+    for (; i + 28 <= len; i += 24, o += 32) {
+        __m256i x = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+            _mm_loadu_si128((const __m128i*)(in + i + 12)), 1);
+
+        x = _mm256_shuffle_epi8(x, shuf);
+
+        // split each 3 bytes into 4 x 6 bits
+        //
+        __m256i t0 = _mm256_and_si256(x, _mm256_set1_epi32(0x0fc0fc00));
+        __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+        __m256i t2 = _mm256_and_si256(x, _mm256_set1_epi32(0x003f03f0));
+        __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(t1, t3);
+
+        __m256i r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        __m256i lt26 = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+        r = _mm256_or_si256(r, _mm256_and_si256(lt26, _mm256_set1_epi8(13)));
+        r = _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets, r));
+
+        _mm256_storeu_si256((__m256i*)(out + o), r); }
+
+    return i;
+}
+/*-------------------------------------------------------------------------------*/
+
+// 32 characters -> 24 bytes per step. Stops at a block with a character
+// outside the alphabet (padding or an error, handled by scalar code)
+//
+static size_t base64_decode_avx2(unsigned char* out, const unsigned char* in, size_t len,
+                                 int url_safe)
+{
+    const __m256i c62 = _mm256_set1_epi8(url_safe ? '-' : '+');
+    const __m256i c63 = _mm256_set1_epi8(url_safe ? '_' : '/');
+    const __m256i pack_shuf = _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i pack_perm = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+    size_t i = 0;
+    size_t o = 0;
+
+    for (; i + 32 <= len; i += 32, o += 24) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+
+        __m256i dA = _mm256_sub_epi8(x, _mm256_set1_epi8('A'));
+        __m256i da = _mm256_sub_epi8(x, _mm256_set1_epi8('a'));
+        __m256i d0 = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+
+        __m256i mA  = _mm256_cmpeq_epi8(_mm256_min_epu8(dA, _mm256_set1_epi8(25)), dA);
+        __m256i ma  = _mm256_cmpeq_epi8(_mm256_min_epu8(da, _mm256_set1_epi8(25)), da);
+        __m256i m0  = _mm256_cmpeq_epi8(_mm256_min_epu8(d0, _mm256_set1_epi8(9)), d0);
+        __m256i m62 = _mm256_cmpeq_epi8(x, c62);
+        __m256i m63 = _mm256_cmpeq_epi8(x, c63);
+
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(mA, ma),
+                                        _mm256_or_si256(m0, _mm256_or_si256(m62, m63)));
+        if ((uint32_t) _mm256_movemask_epi8(valid) != 0xFFFFFFFFU) {
+            break; }
+
+        __m256i v = dA;
+        v = _mm256_blendv_epi8(v, _mm256_add_epi8(da, _mm256_set1_epi8(26)), ma);
+        v = _mm256_blendv_epi8(v, _mm256_add_epi8(d0, _mm256_set1_epi8(52)), m0);
+        v = _mm256_blendv_epi8(v, _mm256_set1_epi8(62), m62);
+        v = _mm256_blendv_epi8(v, _mm256_set1_epi8(63), m63);
+
+        // 4 x 6 bits -> 24 bits per 32 bit word, then gather 3 bytes of each
+        //
+        __m256i ab = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        __m256i abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+        __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(abcd, pack_shuf), pack_perm);
+
+        _mm_storeu_si128((__m128i*)(out + o), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64((__m128i*)(out + o + 16), _mm256_extracti128_si256(packed, 1)); }
+
+    return i;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+int dstr_append_base64(DSTR dest, const void* buff, size_t len, int flags)
+{
+    assert(dest != NULL);
+
+    if (codec_overlaps(dest, buff)) {
+        void* tmp = codec_copy(buff, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = dstr_append_base64(dest, tmp, len, flags);
+        free(tmp);
+        return result; }
+
+    if (len > (SIZE_MAX / 4) * 3 - 2) {
+        errno = ENOMEM;
+        return DSTR_FAIL; }
+
+    size_t outlen = dstr_base64_encoded_length(len, flags);
+    unsigned char* out = codec_tail_reserve(dest, outlen);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    const unsigned char* in = (const unsigned char*) buff;
+    const char* chars = (flags & DSTR_BASE64_URL) ? base64_url_chars : base64_std_chars;
+    unsigned char* o = out;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    i = base64_encode_avx2(out, in, len, flags & DSTR_BASE64_URL);
+    o += (i / 3) * 4;
+#endif
+
+    for (; i + 3 <= len; i += 3) {
+        uint32_t n = ((uint32_t) in[i] << 16) | ((uint32_t) in[i + 1] << 8) | in[i + 2];
+        *o++ = (unsigned char) chars[(n >> 18) & 63];
+        *o++ = (unsigned char) chars[(n >> 12) & 63];
+        *o++ = (unsigned char) chars[(n >> 6) & 63];
+        *o++ = (unsigned char) chars[n & 63]; }
+
+    if (i < len) {
+        uint32_t n = (uint32_t) in[i] << 16;
+        if (i + 1 < len) {
+            n |= (uint32_t) in[i + 1] << 8; }
+
+        *o++ = (unsigned char) chars[(n >> 18) & 63];
+        *o++ = (unsigned char) chars[(n >> 12) & 63];
+        if (i + 1 < len) {
+            *o++ = (unsigned char) chars[(n >> 6) & 63]; }
+        else if (!(flags & DSTR_BASE64_NOPAD)) {
+            *o++ = '='; }
+
+        if (!(flags & DSTR_BASE64_NOPAD)) {
+            *o++ = '='; } }
+
+    assert((size_t)(o - out) == outlen);
+    codec_commit(dest, outlen);
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Exact decoded length or DSTR_NPOS if LEN/padding is invalid
+//
+static size_t base64_decoded_length(const char* src, size_t len, int flags)
+{
+    if (flags & DSTR_BASE64_NOPAD) {
+        if (len % 4 == 1) {
+            return DSTR_NPOS; }
+        return (len / 4) * 3 + ((len % 4) ? (len % 4) - 1 : 0); }
+
+    if (len % 4) {
+        return DSTR_NPOS; }
+
+    size_t pad = 0;
+    if (len && src[len - 1] == '=') {
+        pad = (src[len - 2] == '=') ? 2 : 1; }
+
+    return (len / 4) * 3 - pad;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_decode_base64(DSTR dest, const char* src, size_t len, int flags)
+{
+    assert(dest != NULL);
+
+    if (codec_overlaps(dest, src)) {
+        void* tmp = codec_copy(src, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = dstr_decode_base64(dest, (const char*) tmp, len, flags);
+        free(tmp);
+        return result; }
+
+    size_t outlen = base64_decoded_length(src, len, flags);
+    if (outlen == DSTR_NPOS) {
+        return codec_invalid(); }
+
+    unsigned char* out = codec_tail_reserve(dest, outlen);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    const unsigned char* in = (const unsigned char*) src;
+    const unsigned char* values = (flags & DSTR_BASE64_URL) ? base64_url_values : base64_std_values;
+    unsigned char* o = out;
+    size_t i = 0;
+    size_t rest;
+
+    // without padding the length of the last (partial) quantum is known
+    //
+    size_t full = (flags & DSTR_BASE64_NOPAD) ? len - len % 4 : (len ? len - 4 : 0);
+
+#if defined(__AVX2__)
+    i = base64_decode_avx2(out, in, full, flags & DSTR_BASE64_URL);
+    o += (i / 4) * 3;
+#endif
+
+    for (; i < full; i += 4) {
+        unsigned a = values[in[i]];
+        unsigned b = values[in[i + 1]];
+        unsigned c = values[in[i + 2]];
+        unsigned d = values[in[i + 3]];
+        if ((a | b | c | d) > 63) {
+            goto invalid; }
+
+        uint32_t n = (a << 18) | (b << 12) | (c << 6) | d;
+        *o++ = (unsigned char)(n >> 16);
+        *o++ = (unsigned char)(n >> 8);
+        *o++ = (unsigned char) n; }
+
+    // last quantum: 2, 3 or 4 characters after padding is stripped
+    //
+    rest = len - i;
+    if (!(flags & DSTR_BASE64_NOPAD)) {
+        rest -= (len / 4) * 3 - outlen; }
+
+    if (rest) {
+        unsigned v[4] = { 0, 0, 0, 0 };
+        for (size_t k = 0; k < rest; ++k) {
+            v[k] = values[in[i + k]];
+            if (v[k] > 63) {
+                goto invalid; } }
+
+        uint32_t n = (v[0] << 18) | (v[1] << 12) | (v[2] << 6) | v[3];
+
+        // strict: the unused low bits must be zero
+        //
+        if ((rest == 2 && (n & 0xFFFF)) || (rest == 3 && (n & 0xFF))) {
+            goto invalid; }
+
+        *o++ = (unsigned char)(n >> 16);
+        if (rest > 2) {
+            *o++ = (unsigned char)(n >> 8); }
+        if (rest > 3) {
+            *o++ = (unsigned char) n; } }
+
+    assert((size_t)(o - out) == outlen);
+    return codec_commit_decoded(dest, outlen);
+
+invalid:
+    DBUF(dest)[DLEN(dest)] = '\0';
+    return codec_invalid();
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    E S C A P I N G
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+// Bit DSTR_ESC_xxx is set if the character must be escaped in that mode
+//
+static const unsigned char escape_class[256] = {
+    0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7,
+    0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7, 0x7,
+    0x4, 0x4, 0xF, 0x4, 0x4, 0x4, 0xC, 0xC, 0x4, 0x4, 0x4, 0x4, 0x4, 0x0, 0x0, 0x4,
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x4, 0x4, 0xC, 0x4, 0xC, 0x4,
+    0x4, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x4, 0x7, 0x4, 0x4, 0x0,
+    0x4, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+    0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x4, 0x4, 0x4, 0x0, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6,
+    0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6, 0x6
+};
+/*-------------------------------------------------------------------------------*/
+
+static inline bool escape_mode_valid(int mode)
+{
+    return mode == DSTR_ESC_JSON || mode == DSTR_ESC_C ||
+           mode == DSTR_ESC_URL  || mode == DSTR_ESC_HTML;
+}
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+
+// Per byte mask of characters that must be escaped in MODE
+//
+static inline __m256i escape_mask_avx2(__m256i x, int mode)
+{
+    const __m256i quote = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('"'));
+
+    switch (mode) {
+    case DSTR_ESC_JSON:
+    case DSTR_ESC_C: {
+        __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(0x1F)), x);
+        __m256i bsl = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\'));
+        __m256i m = _mm256_or_si256(ctrl, _mm256_or_si256(quote, bsl));
+        if (mode == DSTR_ESC_C) {
+            __m256i high = _mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8(0x7F)), x);
+            m = _mm256_or_si256(m, high); }
+        return m; }
+
+    case DSTR_ESC_HTML: {
+        __m256i m = _mm256_or_si256(quote, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\'')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('&')));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('<')));
+        return _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('>'))); }
+
+    default: {
+        // URL: everything but the RFC 3986 unreserved set
+        //
+        __m256i lower = _mm256_sub_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+        __m256i digit = _mm256_sub_epi8(x, _mm256_set1_epi8('0'));
+        __m256i ok = _mm256_cmpeq_epi8(_mm256_min_epu8(lower, _mm256_set1_epi8(25)), lower);
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('.')));
+        ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~')));
+        return _mm256_xor_si256(ok, _mm256_set1_epi8(-1)); } }
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+// Length of the run of characters that need no escaping
+//
+static size_t escape_clean_run(const unsigned char* p, size_t len, int mode)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+        uint32_t m = (uint32_t) _mm256_movemask_epi8(escape_mask_avx2(x, mode));
+        if (m) {
+            return i + first_set_bit(m); } }
+#endif
+
+    for (; i < len; ++i) {
+        if (escape_class[p[i]] & mode) {
+            break; } }
+
+    return i;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Escape one character, returns the new end. Writes at most 6 characters
+//
+static unsigned char* escape_char(unsigned char* out, unsigned char c, int mode)
+{
+    switch (mode) {
+    case DSTR_ESC_JSON:
+    case DSTR_ESC_C: {
+        const char* simple = NULL;
+        switch (c) {
+        case '"':  simple = "\\\""; break;
+        case '\\': simple = "\\\\"; break;
+        case '\b': simple = "\\b";  break;
+        case '\f': simple = "\\f";  break;
+        case '\n': simple = "\\n";  break;
+        case '\r': simple = "\\r";  break;
+        case '\t': simple = "\\t";  break;
+        case '\a': simple = (mode == DSTR_ESC_C) ? "\\a" : NULL; break;
+        case '\v': simple = (mode == DSTR_ESC_C) ? "\\v" : NULL; break;
+        default: break; }
+
+        if (simple) {
+            *out++ = (unsigned char) simple[0];
+            *out++ = (unsigned char) simple[1]; }
+        else if (mode == DSTR_ESC_JSON) {
+            memcpy(out, "\\u00", 4);
+            out[4] = (unsigned char) hex_lower[c >> 4];
+            out[5] = (unsigned char) hex_lower[c & 0x0F];
+            out += 6; }
+        else {
+            // octal is never continued by a following digit, unlike \x
+            //
+            *out++ = '\\';
+            *out++ = (unsigned char)('0' + (c >> 6));
+            *out++ = (unsigned char)('0' + ((c >> 3) & 7));
+            *out++ = (unsigned char)('0' + (c & 7)); }
+        return out; }
+
+    case DSTR_ESC_URL:
+        *out++ = '%';
+        *out++ = (unsigned char) hex_upper[c >> 4];
+        *out++ = (unsigned char) hex_upper[c & 0x0F];
+        return out;
+
+    default: {
+        const char* entity;
+        switch (c) {
+        case '&':  entity = "&amp;";  break;
+        case '<':  entity = "&lt;";   break;
+        case '>':  entity = "&gt;";   break;
+        case '"':  entity = "&quot;"; break;
+        default:   entity = "&#39;";  break; }
+
+        size_t n = strlen(entity);
+        memcpy(out, entity, n);
+        return out + n; } }
+}
+/*-------------------------------------------------------------------------------*/
+
+// Ensure room for NEED more bytes after OUT, returns OUT in the
+// (possibly moved) buffer
+//
+static inline unsigned char* escape_reserve(DSTR p, unsigned char* out, size_t need)
+{
+    size_t used = (size_t)(out - (unsigned char*) DBUF(p));
+
+    if (used + need >= p->capacity) {
+        // growing copies only LENGTH bytes out of the SSO buffer and
+        // expects them terminated
+        //
+        uint32_t saved = DLEN(p);
+        DLEN(p) = (uint32_t) used;
+        DBUF(p)[used] = '\0';
+        int ok = dstr_reserve(p, used + need);
+        DLEN(p) = saved;
+        if (!ok) {
+            DBUF(p)[saved] = '\0';
+            return NULL; } }
+
+    return (unsigned char*) DBUF(p) + used;
+}
+/*-------------------------------------------------------------------------------*/
+
+static int append_escaped_imp(DSTR dest, const unsigned char* in, size_t len, int mode)
+{
+    unsigned char* out = codec_tail_reserve(dest, len);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = escape_clean_run(in + i, len - i, mode);
+
+        if (!(out = escape_reserve(dest, out, run + 6))) {
+            return DSTR_FAIL; }
+
+        memcpy(out, in + i, run);
+        out += run;
+        i += run;
+
+        if (i < len) {
+            out = escape_char(out, in[i++], mode); } }
+
+    codec_commit(dest, (size_t)(out - (unsigned char*) DBUF(dest)) - DLEN(dest));
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_escaped_bl(DSTR dest, const char* buff, size_t len, int mode)
+{
+    assert(dest != NULL);
+
+    if (!escape_mode_valid(mode)) {
+        return codec_invalid(); }
+
+    if (codec_overlaps(dest, buff)) {
+        void* tmp = codec_copy(buff, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = append_escaped_imp(dest, (const unsigned char*) tmp, len, mode);
+        free(tmp);
+        return result; }
+
+    return append_escaped_imp(dest, (const unsigned char*) buff, len, mode);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_escaped(DSTR dest, CDSTR src, int mode)
+{
+    return dstr_append_escaped_bl(dest, DBUF(src), DLEN(src), mode);
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    U N E S C A P I N G
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+static unsigned char* put_utf8(unsigned char* out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *out++ = (unsigned char) cp; }
+    else if (cp < 0x800) {
+        *out++ = (unsigned char)(0xC0 | (cp >> 6));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+    else if (cp < 0x10000) {
+        *out++ = (unsigned char)(0xE0 | (cp >> 12));
+        *out++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+    else {
+        *out++ = (unsigned char)(0xF0 | (cp >> 18));
+        *out++ = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Read exactly N hex digits, returns false if there are not
+//
+static bool read_hex(const unsigned char* p, const unsigned char* end, int n, uint32_t* value)
+{
+    if (end - p < n) {
+        return false; }
+
+    uint32_t v = 0;
+    for (int k = 0; k < n; ++k) {
+        unsigned d = hex_values[p[k]];
+        if (d > 0x0F) {
+            return false; }
+        v = (v << 4) | d; }
+
+    *value = v;
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Each unescape_xxx decodes the sequence starting at *PP (the escape
+// character) and returns the new output end or NULL if it is invalid
+//
+static unsigned char* unescape_json(unsigned char* out, const unsigned char** pp,
+                                    const unsigned char* end)
+{
+    const unsigned char* p = *pp + 1;
+    if (p == end) {
+        return NULL; }
+
+    unsigned char c = *p++;
+    switch (c) {
+    case '"': case '\\': case '/':
+        *out++ = c; break;
+    case 'b': *out++ = '\b'; break;
+    case 'f': *out++ = '\f'; break;
+    case 'n': *out++ = '\n'; break;
+    case 'r': *out++ = '\r'; break;
+    case 't': *out++ = '\t'; break;
+    case 'u': {
+        uint32_t cp;
+        if (!read_hex(p, end, 4, &cp)) {
+            return NULL; }
+        p += 4;
+
+        if (cp >= 0xDC00 && cp <= 0xDFFF) {
+            return NULL; }
+
+        if (cp >= 0xD800 && cp <= 0xDBFF) {
+            uint32_t lo;
+            if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+                !read_hex(p + 2, end, 4, &lo) || lo < 0xDC00 || lo > 0xDFFF) {
+                return NULL; }
+            p += 6;
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00); }
+
+        out = put_utf8(out, cp);
+        break; }
+    default:
+        return NULL; }
+
+    *pp = p;
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+static unsigned char* unescape_c(unsigned char* out, const unsigned char** pp,
+                                 const unsigned char* end)
+{
+    const unsigned char* p = *pp + 1;
+    if (p == end) {
+        return NULL; }
+
+    unsigned char c = *p++;
+    switch (c) {
+    case '"': case '\\': case '\'': case '?':
+        *out++ = c; break;
+    case 'a': *out++ = '\a'; break;
+    case 'b': *out++ = '\b'; break;
+    case 'f': *out++ = '\f'; break;
+    case 'n': *out++ = '\n'; break;
+    case 'r': *out++ = '\r'; break;
+    case 't': *out++ = '\t'; break;
+    case 'v': *out++ = '\v'; break;
+    case 'x': {
+        // one or two hex digits
+        //
+        unsigned v = 0;
+        int n = 0;
+        for (; n < 2 && p != end && hex_values[*p] <= 0x0F; ++n, ++p) {
+            v = (v << 4) | hex_values[*p]; }
+        if (n == 0) {
+            return NULL; }
+        *out++ = (unsigned char) v;
+        break; }
+    default:
+        if (c >= '0' && c <= '7') {
+            unsigned v = (unsigned)(c - '0');
+            for (int n = 1; n < 3 && p != end && *p >= '0' && *p <= '7'; ++n, ++p) {
+                v = (v << 3) | (unsigned)(*p - '0'); }
+            if (v > 0xFF) {
+                return NULL; }
+            *out++ = (unsigned char) v;
+            break; }
+        return NULL; }
+
+    *pp = p;
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+static unsigned char* unescape_url(unsigned char* out, const unsigned char** pp,
+                                   const unsigned char* end)
+{
+    uint32_t v;
+    if (!read_hex(*pp + 1, end, 2, &v)) {
+        return NULL; }
+
+    *out++ = (unsigned char) v;
+    *pp += 3;
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+static unsigned char* unescape_html(unsigned char* out, const unsigned char** pp,
+                                    const unsigned char* end)
+{
+    static const struct { const char* name; unsigned char c; } entities[] = {
+        { "amp;", '&' }, { "lt;", '<' }, { "gt;", '>' }, { "quot;", '"' }, { "apos;", '\'' }
+    };
+
+    const unsigned char* p = *pp + 1;
+    size_t avail = (size_t)(end - p);
+
+    for (size_t k = 0; k < sizeof entities / sizeof entities[0]; ++k) {
+        size_t n = strlen(entities[k].name);
+        if (avail >= n && memcmp(p, entities[k].name, n) == 0) {
+            *out++ = entities[k].c;
+            *pp = p + n;
+            return out; } }
+
+    // numeric: &#DDD; or &#xHHH;
+    //
+    if (p == end || *p++ != '#') {
+        return NULL; }
+
+    uint32_t cp = 0;
+    int ndigits = 0;
+    if (p != end && (*p | 0x20) == 'x') {
+        for (++p; p != end && hex_values[*p] <= 0x0F && cp <= 0x10FFFF; ++p, ++ndigits) {
+            cp = (cp << 4) | hex_values[*p]; } }
+    else {
+        for (; p != end && *p >= '0' && *p <= '9' && cp <= 0x10FFFF; ++p, ++ndigits) {
+            cp = cp * 10 + (uint32_t)(*p - '0'); } }
+
+    if (ndigits == 0 || p == end || *p != ';' ||
+        cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+        return NULL; }
+
+    *pp = p + 1;
+    return put_utf8(out, cp);
+}
+/*-------------------------------------------------------------------------------*/
+
+static int append_unescaped_imp(DSTR dest, const unsigned char* in, size_t len, int mode)
+{
+    // unescaped output is never longer than the input
+    //
+    unsigned char* first = codec_tail_reserve(dest, len);
+    if (!first) {
+        return DSTR_FAIL; }
+
+    const int lead = (mode == DSTR_ESC_URL) ? '%' : (mode == DSTR_ESC_HTML) ? '&' : '\\';
+    const unsigned char* p = in;
+    const unsigned char* end = in + len;
+    unsigned char* out = first;
+
+    while (p != end) {
+        const unsigned char* esc = (const unsigned char*) memchr(p, lead, (size_t)(end - p));
+        size_t run = esc ? (size_t)(esc - p) : (size_t)(end - p);
+
+        memcpy(out, p, run);
+        out += run;
+        p += run;
+
+        if (!esc) {
+            break; }
+
+        switch (mode) {
+        case DSTR_ESC_JSON: out = unescape_json(out, &p, end); break;
+        case DSTR_ESC_C:    out = unescape_c(out, &p, end);    break;
+        case DSTR_ESC_URL:  out = unescape_url(out, &p, end);  break;
+        default:            out = unescape_html(out, &p, end); break; }
+
+        if (!out) {
+            DBUF(dest)[DLEN(dest)] = '\0';
+            return codec_invalid(); } }
+
+    return codec_commit_decoded(dest, (size_t)(out - first));
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_unescaped_bl(DSTR dest, const char* buff, size_t len, int mode)
+{
+    assert(dest != NULL);
+
+    if (!escape_mode_valid(mode)) {
+        return codec_invalid(); }
+
+    if (codec_overlaps(dest, buff)) {
+        void* tmp = codec_copy(buff, len);
+        if (!tmp) {
+            return DSTR_FAIL; }
+
+        int result = append_unescaped_imp(dest, (const unsigned char*) tmp, len, mode);
+        free(tmp);
+        return result; }
+
+    return append_unescaped_imp(dest, (const unsigned char*) buff, len, mode);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_unescaped(DSTR dest, CDSTR src, int mode)
+{
+    return dstr_append_unescaped_bl(dest, DBUF(src), DLEN(src), mode);
+}
+/*-------------------------------------------------------------------------------*/
@@ -0,0 +1,1874 @@
+/*
+ * Copyright (c) 2025 Eyal Ben-David
+ *
+ * This file is part of DString C and C++ dynamic string library,
+ * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <float.h>
+
+#include <dstr/dstr.h>
+#include "dstr_internal.h"
+#include "dstr_pow5.h"
+
+/*
+ *  Numeric conversions that write straight into the DSTR buffer.
+ *
+ *  Floating point to shortest string uses the Grisu3 algorithm by
+ *  Florian Loitsch ("Printing Floating-Point Numbers Quickly and Accurately
+ *  with Integers", PLDI 2010). The output always round-trips through
+ *  strtod and is the shortest such representation, the closest one if
+ *  there are several: the few values Grisu3 cannot decide go to an exact
+ *  search. No locale is consulted, the decimal point is always '.'
+ *
+ *  String to floating point uses the Eisel-Lemire algorithm and is
+ *  locale independent as well.
+ */
+
+/*
+ *  For convenience, make code shorter (same as in dstr.c)
+ */
+#define DBUF(p)       ((p)->data)
+#define DLEN(p)       ((p)->length)
+/*-------------------------------------------------------------------------------*/
+
+// 64 x 64 => 128 bit multiplication. Portable version since MSVC and
+// Borland do not have unsigned __int128
+//
+typedef struct U128 {
+    uint64_t hi;
+    uint64_t lo;
+} U128;
+/*-------------------------------------------------------------------------------*/
+
+static inline U128 mul_64x64(uint64_t a, uint64_t b)
+{
+    uint64_t a_lo = (uint32_t) a;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t) b;
+    uint64_t b_hi = b >> 32;
+
+    uint64_t p0 = a_lo * b_lo;
+    uint64_t p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo;
+    uint64_t p3 = a_hi * b_hi;
+
+    uint64_t mid = (p0 >> 32) + (uint32_t) p1 + (uint32_t) p2;
+
+    U128 r;
+    r.lo = (mid << 32) | (uint32_t) p0;
+    r.hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+    return r;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Make room for LEN more bytes and return the tail of the buffer
+//
+static inline char* conv_tail_reserve(DSTR p, size_t len)
+{
+    if (!dstr_reserve(p, DLEN(p) + len)) {
+        return NULL; }
+
+    return DBUF(p) + DLEN(p);
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline void conv_commit(DSTR p, const char* last)
+{
+    DLEN(p) = (uint32_t)(last - DBUF(p));
+    DBUF(p)[DLEN(p)] = '\0';
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    G R I S U 3   (double -> shortest)
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+// A "do it yourself floating point" number: f * 2^e
+//
+typedef struct DiyFP {
+    uint64_t f;
+    int      e;
+} DiyFP;
+/*-------------------------------------------------------------------------------*/
+
+static inline DiyFP diyfp_make(uint64_t f, int e)
+{
+    DiyFP r;
+    r.f = f;
+    r.e = e;
+    return r;
+}
+/*-------------------------------------------------------------------------------*/
+
+// x * y rounded to 64 bits, exponent adjusted
+//
+static inline DiyFP diyfp_mul(DiyFP x, DiyFP y)
+{
+    U128 p = mul_64x64(x.f, y.f);
+
+    // round, ties up
+    //
+    uint64_t h = p.hi + (p.lo >> 63);
+    return diyfp_make(h, x.e + y.e + 64);
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline DiyFP diyfp_normalize(DiyFP x)
+{
+    assert(x.f != 0);
+    while ((x.f >> 63) == 0) {
+        x.f <<= 1;
+        x.e--; }
+    return x;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline DiyFP diyfp_normalize_to(DiyFP x, int target_exponent)
+{
+    int delta = x.e - target_exponent;
+    assert(delta >= 0);
+    return diyfp_make(x.f << delta, target_exponent);
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct Boundaries {
+    DiyFP w;
+    DiyFP minus;
+    DiyFP plus;
+} Boundaries;
+/*-------------------------------------------------------------------------------*/
+
+// Compute the (normalized) value V and the boundaries m- and m+ of the
+// rounding interval. SIGNIFICAND_BITS excludes the hidden bit
+// (52 for double, 23 for float)
+//
+static Boundaries compute_boundaries(uint64_t F, int E, int significand_bits, int bias)
+{
+    const uint64_t hidden_bit = (uint64_t)1 << significand_bits;
+    const int      min_exp    = 1 - bias;
+
+    DiyFP v = (E == 0) ?
+        diyfp_make(F, min_exp) :
+        diyfp_make(F + hidden_bit, E - bias);
+
+    // The lower boundary is closer when the significand is a power
+    // of two (except for the smallest normal number)
+    //
+    int lower_is_closer = (F == 0 && E > 1);
+
+    DiyFP m_plus = diyfp_make(2 * v.f + 1, v.e - 1);
+    DiyFP m_minus = lower_is_closer ?
+        diyfp_make(4 * v.f - 1, v.e - 2) :
+        diyfp_make(2 * v.f - 1, v.e - 1);
+
+    Boundaries b;
+    b.plus  = diyfp_normalize(m_plus);
+    b.minus = diyfp_normalize_to(m_minus, b.plus.e);
+    b.w     = diyfp_normalize(v);
+    return b;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Cached powers c_k = 10^k normalized as f * 2^e,
+// for k = -300, -292, ..., 324
+//
+typedef struct CachedPower {
+    uint64_t f;
+    int      e;
+    int      k;
+} CachedPower;
+
+#define GRISU_ALPHA              (-60)
+#define GRISU_GAMMA              (-32)
+#define CACHED_POWERS_MIN_EXP10  (-300)
+#define CACHED_POWERS_STEP       (8)
+
+static const CachedPower cached_powers[] = {
+    { 0xAB70FE17C79AC6CAULL, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4FULL, -1034, -292 },
+    { 0xBE5691EF416BD60CULL, -1007, -284 },
+    { 0x8DD01FAD907FFC3CULL,  -980, -276 },
+    { 0xD3515C2831559A83ULL,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5ULL,  -927, -260 },
+    { 0xEA9C227723EE8BCBULL,  -901, -252 },
+    { 0xAECC49914078536DULL,  -874, -244 },
+    { 0x823C12795DB6CE57ULL,  -847, -236 },
+    { 0xC21094364DFB5637ULL,  -821, -228 },
+    { 0x9096EA6F3848984FULL,  -794, -220 },
+    { 0xD77485CB25823AC7ULL,  -768, -212 },
+    { 0xA086CFCD97BF97F4ULL,  -741, -204 },
+    { 0xEF340A98172AACE5ULL,  -715, -196 },
+    { 0xB23867FB2A35B28EULL,  -688, -188 },
+    { 0x84C8D4DFD2C63F3BULL,  -661, -180 },
+    { 0xC5DD44271AD3CDBAULL,  -635, -172 },
+    { 0x936B9FCEBB25C996ULL,  -608, -164 },
+    { 0xDBAC6C247D62A584ULL,  -582, -156 },
+    { 0xA3AB66580D5FDAF6ULL,  -555, -148 },
+    { 0xF3E2F893DEC3F126ULL,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8ULL,  -502, -132 },
+    { 0x87625F056C7C4A8BULL,  -475, -124 },
+    { 0xC9BCFF6034C13053ULL,  -449, -116 },
+    { 0x964E858C91BA2655ULL,  -422, -108 },
+    { 0xDFF9772470297EBDULL,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88FULL,  -369,  -92 },
+    { 0xF8A95FCF88747D94ULL,  -343,  -84 },
+    { 0xB94470938FA89BCFULL,  -316,  -76 },
+    { 0x8A08F0F8BF0F156BULL,  -289,  -68 },
+    { 0xCDB02555653131B6ULL,  -263,  -60 },
+    { 0x993FE2C6D07B7FACULL,  -236,  -52 },
+    { 0xE45C10C42A2B3B06ULL,  -210,  -44 },
+    { 0xAA242499697392D3ULL,  -183,  -36 },
+    { 0xFD87B5F28300CA0EULL,  -157,  -28 },
+    { 0xBCE5086492111AEBULL,  -130,  -20 },
+    { 0x8CBCCC096F5088CCULL,  -103,  -12 },
+    { 0xD1B71758E219652CULL,   -77,   -4 },
+    { 0x9C40000000000000ULL,   -50,    4 },
+    { 0xE8D4A51000000000ULL,   -24,   12 },
+    { 0xAD78EBC5AC620000ULL,     3,   20 },
+    { 0x813F3978F8940984ULL,    30,   28 },
+    { 0xC097CE7BC90715B3ULL,    56,   36 },
+    { 0x8F7E32CE7BEA5C70ULL,    83,   44 },
+    { 0xD5D238A4ABE98068ULL,   109,   52 },
+    { 0x9F4F2726179A2245ULL,   136,   60 },
+    { 0xED63A231D4C4FB27ULL,   162,   68 },
+    { 0xB0DE65388CC8ADA8ULL,   189,   76 },
+    { 0x83C7088E1AAB65DBULL,   216,   84 },
+    { 0xC45D1DF942711D9AULL,   242,   92 },
+    { 0x924D692CA61BE758ULL,   269,  100 },
+    { 0xDA01EE641A708DEAULL,   295,  108 },
+    { 0xA26DA3999AEF774AULL,   322,  116 },
+    { 0xF209787BB47D6B85ULL,   348,  124 },
+    { 0xB454E4A179DD1877ULL,   375,  132 },
+    { 0x865B86925B9BC5C2ULL,   402,  140 },
+    { 0xC83553C5C8965D3DULL,   428,  148 },
+    { 0x952AB45CFA97A0B3ULL,   455,  156 },
+    { 0xDE469FBD99A05FE3ULL,   481,  164 },
+    { 0xA59BC234DB398C25ULL,   508,  172 },
+    { 0xF6C69A72A3989F5CULL,   534,  180 },
+    { 0xB7DCBF5354E9BECEULL,   561,  188 },
+    { 0x88FCF317F22241E2ULL,   588,  196 },
+    { 0xCC20CE9BD35C78A5ULL,   614,  204 },
+    { 0x98165AF37B2153DFULL,   641,  212 },
+    { 0xE2A0B5DC971F303AULL,   667,  220 },
+    { 0xA8D9D1535CE3B396ULL,   694,  228 },
+    { 0xFB9B7CD9A4A7443CULL,   720,  236 },
+    { 0xBB764C4CA7A44410ULL,   747,  244 },
+    { 0x8BAB8EEFB6409C1AULL,   774,  252 },
+    { 0xD01FEF10A657842CULL,   800,  260 },
+    { 0x9B10A4E5E9913129ULL,   827,  268 },
+    { 0xE7109BFBA19C0C9DULL,   853,  276 },
+    { 0xAC2820D9623BF429ULL,   880,  284 },
+    { 0x80444B5E7AA7CF85ULL,   907,  292 },
+    { 0xBF21E44003ACDD2DULL,   933,  300 },
+    { 0x8E679C2F5E44FF8FULL,   960,  308 },
+    { 0xD433179D9C8CB841ULL,   986,  316 },
+    { 0x9E19DB92B4E31BA9ULL,  1013,  324 }
+};
+/*-------------------------------------------------------------------------------*/
+
+// Find a cached power c such that ALPHA <= c.e + e + 64 <= GAMMA
+//
+static CachedPower get_cached_power(int e)
+{
+    // k = ceil((ALPHA - e - 1) * log10(2))
+    //
+    const int f = GRISU_ALPHA - e - 1;
+    const int k = (f * 78913) / (1 << 18) + (f > 0);
+
+    const int index =
+        (-CACHED_POWERS_MIN_EXP10 + k + (CACHED_POWERS_STEP - 1)) / CACHED_POWERS_STEP;
+
+    assert(index >= 0);
+    assert((size_t) index < sizeof(cached_powers) / sizeof(cached_powers[0]));
+
+    CachedPower cached = cached_powers[index];
+    assert(GRISU_ALPHA <= cached.e + e + 64);
+    assert(GRISU_GAMMA >= cached.e + e + 64);
+    return cached;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Largest power of ten <= n, returns the number of digits of n
+//
+static int find_largest_pow10(uint32_t n, uint32_t* pow10)
+{
+    static const uint32_t powers[] = {
+        1, 10, 100, 1000, 10000, 100000, 1000000,
+        10000000, 100000000, 1000000000 };
+
+    int digits = 10;
+    while (digits > 1 && n < powers[digits - 1]) {
+        --digits; }
+
+    *pow10 = powers[digits - 1];
+    return digits;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Round the last digit down towards W while that is certainly closer to
+// it, see Loitsch's Grisu3 paper. UNIT is the error of the scaled values.
+// Returns false when the result may not be the closest or not inside the
+// rounding interval: the caller then falls back to an exact method
+//
+static bool grisu3_round_weed(char* buf, int len, uint64_t dist_high_w,
+                              uint64_t unsafe_interval, uint64_t rest,
+                              uint64_t ten_k, uint64_t unit)
+{
+    const uint64_t small_dist = dist_high_w - unit;
+    const uint64_t big_dist = dist_high_w + unit;
+
+    while (rest < small_dist &&
+           unsafe_interval - rest >= ten_k &&
+           (rest + ten_k < small_dist ||
+            small_dist - rest >= rest + ten_k - small_dist)) {
+        buf[len - 1]--;
+        rest += ten_k; }
+
+    // rounding down once more might be closer to the real W
+    //
+    if (rest < big_dist &&
+        unsafe_interval - rest >= ten_k &&
+        (rest + ten_k < big_dist ||
+         big_dist - rest > rest + ten_k - big_dist)) {
+        return false; }
+
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Digits of the shortest number in the unsafe interval (LOW, HIGH) widened
+// by one unit each side, the scaling error. Returns the number of digits,
+// negated if the result cannot be proven shortest and closest. No number
+// in the exact interval is shorter even then
+//
+static int grisu3_digit_gen(char* buffer, int* decimal_exponent,
+                            DiyFP low, DiyFP w, DiyFP high)
+{
+    assert(high.e >= GRISU_ALPHA);
+    assert(high.e <= GRISU_GAMMA);
+
+    uint64_t unit = 1;
+    const uint64_t too_high = high.f + unit;
+    uint64_t unsafe_interval = too_high - (low.f - unit);
+
+    const DiyFP one = diyfp_make((uint64_t)1 << -high.e, high.e);
+
+    uint32_t p1 = (uint32_t)(too_high >> -one.e);
+    uint64_t p2 = too_high & (one.f - 1);
+
+    int len = 0;
+
+    // Integral part
+    //
+    uint32_t pow10;
+    int n = find_largest_pow10(p1, &pow10);
+
+    while (n > 0) {
+        buffer[len++] = (char)('0' + p1 / pow10);
+        p1 %= pow10;
+        n--;
+
+        uint64_t rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest < unsafe_interval) {
+            *decimal_exponent += n;
+            return grisu3_round_weed(buffer, len, too_high - w.f, unsafe_interval, rest,
+                                     (uint64_t) pow10 << -one.e, unit) ? len : -len; }
+
+        pow10 /= 10; }
+
+    // Fractional part
+    //
+    for (;;) {
+        p2 *= 10;
+        unit *= 10;
+        unsafe_interval *= 10;
+        buffer[len++] = (char)('0' + (p2 >> -one.e));
+        p2 &= one.f - 1;
+        --*decimal_exponent;
+
+        if (p2 < unsafe_interval) {
+            return grisu3_round_weed(buffer, len, (too_high - w.f) * unit, unsafe_interval,
+                                     p2, one.f, unit) ? len : -len; } }
+}
+/*-------------------------------------------------------------------------------*/
+
+// Generate the shortest digits of a positive finite value. Returns number
+// of digits written to BUFFER, value = digits * 10^decimal_exponent, or
+// minus a lower bound for the few values (about 0.5%) Grisu3 cannot decide
+//
+static int grisu3(char* buffer, int* decimal_exponent, Boundaries b)
+{
+    CachedPower cached = get_cached_power(b.plus.e);
+    DiyFP c_minus_k = diyfp_make(cached.f, cached.e);
+
+    DiyFP w       = diyfp_mul(b.w,     c_minus_k);
+    DiyFP w_minus = diyfp_mul(b.minus, c_minus_k);
+    DiyFP w_plus  = diyfp_mul(b.plus,  c_minus_k);
+
+    *decimal_exponent = -cached.k;
+    return grisu3_digit_gen(buffer, decimal_exponent, w_minus, w, w_plus);
+}
+/*-------------------------------------------------------------------------------*/
+
+static size_t parse_floating(const char* buff, size_t len, bool want_float, double* result);
+
+// DIGITS * 10^EXP read back as a double or float
+//
+static double read_back(const char* digits, int len, int exp, bool is_float)
+{
+    char text[40];
+    memcpy(text, digits, len);
+    int n = len + snprintf(text + len, sizeof(text) - len, "e%d", exp);
+
+    double back;
+    parse_floating(text, (size_t) n, is_float, &back);
+    return back;
+}
+/*-------------------------------------------------------------------------------*/
+
+// The DIGITS digit decimal closest to VALUE that reads back as VALUE, if
+// there is one: the value correctly rounded by printf, or its neighbour on
+// the other side of VALUE, which may be inside the rounding interval when
+// that is asymmetric
+//
+static bool exact_digits(int digits, double value, bool is_float,
+                         char* buffer, int* len, int* decimal_exponent)
+{
+    char text[40];
+    snprintf(text, sizeof(text), "%.*e", digits - 1, value);
+
+    // digits, skipping the (locale's) decimal point, then the exponent
+    //
+    const char* p = text;
+    uint64_t d = 0;
+    int n = 0;
+    for (; *p && *p != 'e' && *p != 'E'; ++p) {
+        if (*p >= '0' && *p <= '9') {
+            buffer[n++] = *p;
+            d = 10 * d + (uint64_t)(*p - '0'); } }
+
+    int exp = (*p ? atoi(p + 1) : 0) - (n - 1);
+    *len = n;
+    *decimal_exponent = exp;
+
+    double back = read_back(buffer, n, exp, is_float);
+    if (back == value) {
+        return true; }
+
+    // rounding is monotonic, so BACK tells the side of VALUE
+    //
+    char other[24];
+    d = (back < value) ? d + 1 : d - 1;
+    int m = snprintf(other, sizeof(other), "%llu", (unsigned long long) d);
+    if (m == n - 1) {
+        // 10..0 - 1: the neighbour is 99..9 one place lower
+        //
+        other[m++] = '9';
+        --exp; }
+
+    if (m != n || read_back(other, n, exp, is_float) != value) {
+        return false; }
+
+    memcpy(buffer, other, n);
+    *decimal_exponent = exp;
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Exact fallback: the fewest digits, MIN_DIGITS or more, that read back
+// as VALUE (positive, finite). 17 digits (9 for a float) always do, and
+// the answer is rarely more than one above MIN_DIGITS
+//
+static int shortest_exact(char* buffer, int* decimal_exponent, double value, bool is_float,
+                          int min_digits)
+{
+    const int saved_errno = errno;
+    const int max_digits = is_float ? 9 : 17;
+
+    int len = 0;
+    for (int digits = min_digits; digits <= max_digits; ++digits) {
+        if (exact_digits(digits, value, is_float, buffer, &len, decimal_exponent)) {
+            break; } }
+
+    // trailing zeros belong to the exponent
+    //
+    while (len > 1 && buffer[len - 1] == '0') {
+        --len;
+        ++*decimal_exponent; }
+
+    errno = saved_errno;
+    return len;
+}
+/*-------------------------------------------------------------------------------*/
+
+static char* append_exponent(char* out, int e)
+{
+    if (e < 0) {
+        e = -e;
+        *out++ = '-'; }
+    else {
+        *out++ = '+'; }
+
+    // at least two digits, like printf
+    //
+    if (e < 10) {
+        *out++ = '0';
+        *out++ = (char)('0' + e); }
+    else if (e < 100) {
+        *out++ = (char)('0' + e / 10);
+        *out++ = (char)('0' + e % 10); }
+    else {
+        *out++ = (char)('0' + e / 100);
+        e %= 100;
+        *out++ = (char)('0' + e / 10);
+        *out++ = (char)('0' + e % 10); }
+
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Notation similar to printf's %g: plain decimal when the decimal exponent
+// X satisfies -4 <= X < 15, otherwise scientific notation.
+// BUF holds LEN digits, value = 0.DIGITS * 10^N (N = LEN + decimal_exponent)
+//
+#define SHORTEST_MIN_EXP (-4)
+#define SHORTEST_MAX_EXP (15)
+
+static char* format_digits(char* out, const char* buf, int len, int decimal_exponent)
+{
+    const int n = len + decimal_exponent;
+
+    if (len <= n && n <= SHORTEST_MAX_EXP) {
+        // digits[000]
+        //
+        memcpy(out, buf, len);
+        memset(out + len, '0', n - len);
+        return out + n; }
+
+    if (0 < n && n <= SHORTEST_MAX_EXP) {
+        // dig.its
+        //
+        memcpy(out, buf, n);
+        out[n] = '.';
+        memcpy(out + n + 1, buf + n, len - n);
+        return out + len + 1; }
+
+    if (SHORTEST_MIN_EXP < n && n <= 0) {
+        // 0.[000]digits
+        //
+        *out++ = '0';
+        *out++ = '.';
+        memset(out, '0', -n);
+        memcpy(out - n, buf, len);
+        return out - n + len; }
+
+    // d.igitsE+123
+    //
+    *out++ = buf[0];
+    if (len > 1) {
+        *out++ = '.';
+        memcpy(out, buf + 1, len - 1);
+        out += len - 1; }
+
+    *out++ = 'e';
+    return append_exponent(out, n - 1);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Special values. Returns NULL if value is finite and non zero
+//
+static char* format_special(char* out, int negative, int is_zero, int is_inf, int is_nan)
+{
+    if (is_nan) {
+        memcpy(out, "nan", 3);
+        return out + 3; }
+
+    if (negative) {
+        *out++ = '-'; }
+
+    if (is_inf) {
+        memcpy(out, "inf", 3);
+        return out + 3; }
+
+    if (is_zero) {
+        *out++ = '0';
+        return out; }
+
+    return NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Longest output: "-1.2345678901234567e-308" = 24 chars
+//
+#define SHORTEST_BUFSIZE 32
+
+static char* shortest_double(char* out, double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+
+    const int      negative = (int)(bits >> 63);
+    const int      E = (int)((bits >> 52) & 0x7FF);
+    const uint64_t F = bits & (((uint64_t)1 << 52) - 1);
+
+    char* special = format_special(out, negative,
+                                   (E == 0 && F == 0),
+                                   (E == 0x7FF && F == 0),
+                                   (E == 0x7FF && F != 0));
+    if (special) {
+        return special; }
+
+    if (negative) {
+        *out++ = '-'; }
+
+    char digits[20];
+    int decimal_exponent;
+    Boundaries b = compute_boundaries(F, E, 52, 1023 + 52);
+    int len = grisu3(digits, &decimal_exponent, b);
+    if (len < 0) {
+        len = shortest_exact(digits, &decimal_exponent, negative ? -value : value, false, -len); }
+
+    return format_digits(out, digits, len, decimal_exponent);
+}
+/*-------------------------------------------------------------------------------*/
+
+static char* shortest_float(char* out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof bits);
+
+    const int      negative = (int)(bits >> 31);
+    const int      E = (int)((bits >> 23) & 0xFF);
+    const uint64_t F = bits & ((1U << 23) - 1);
+
+    char* special = format_special(out, negative,
+                                   (E == 0 && F == 0),
+                                   (E == 0xFF && F == 0),
+                                   (E == 0xFF && F != 0));
+    if (special) {
+        return special; }
+
+    if (negative) {
+        *out++ = '-'; }
+
+    // Boundaries computed with float precision give the shortest
+    // representation that round trips as float
+    //
+    char digits[20];
+    int decimal_exponent;
+    Boundaries b = compute_boundaries(F, E, 23, 127 + 23);
+    int len = grisu3(digits, &decimal_exponent, b);
+    if (len < 0) {
+        len = shortest_exact(digits, &decimal_exponent, negative ? -value : value, true, -len); }
+
+    return format_digits(out, digits, len, decimal_exponent);
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    F I X E D   P R E C I S I O N
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+static const uint64_t pow10_u64[20] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL
+};
+/*-------------------------------------------------------------------------------*/
+
+static char* write_u64(char* out, uint64_t n)
+{
+    char buf[24];
+    char* last = buf + sizeof buf;
+    char* first = last;
+    do {
+        *--first = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+
+    size_t len = (size_t)(last - first);
+    memcpy(out, first, len);
+    return out + len;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Exact "%.*f" for the common case: returns false if the value is out
+// of range for 64 bit integer arithmetic (caller falls back to snprintf)
+//
+static bool fixed_double_exact(char** pout, double value, int precision)
+{
+    if (precision > 19) {
+        return false; }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+
+    const int negative = (int)(bits >> 63);
+    const int E = (int)((bits >> 52) & 0x7FF);
+    uint64_t  m = bits & (((uint64_t)1 << 52) - 1);
+
+    if (E == 0x7FF) {
+        return false; }
+
+    int e;
+    if (E == 0) {
+        e = 1 - 1075; }
+    else {
+        m |= (uint64_t)1 << 52;
+        e = E - 1075; }
+
+    // N = round_half_even(m * 2^e * 10^precision)
+    //
+    uint64_t N;
+    const uint64_t scale = pow10_u64[precision];
+
+    if (m == 0) {
+        N = 0; }
+    else if (e >= 0) {
+        if (e > 11) {
+            return false; }
+        uint64_t v = m << e;
+        U128 p = mul_64x64(v, scale);
+        if (p.hi) {
+            return false; }
+        N = p.lo; }
+    else {
+        const int s = -e;
+        U128 p = mul_64x64(m, scale);
+
+        // p is at most 117 bits so p / 2^s < 1/2 when s >= 118
+        //
+        if (s >= 118) {
+            N = 0; }
+        else if (s >= 64) {
+            // quotient = p.hi >> (s-64), remainder in p.hi low bits + p.lo
+            //
+            const int t = s - 64;
+            uint64_t q   = (t == 0) ? p.hi : (p.hi >> t);
+            uint64_t rhi = (t == 0) ? 0 : (p.hi & (((uint64_t)1 << t) - 1));
+            uint64_t rlo = p.lo;
+
+            // compare remainder with half = 2^(s-1)
+            //
+            int cmp;
+            if (t == 0) {
+                cmp = (rlo > ((uint64_t)1 << 63)) ? 1 :
+                      (rlo == ((uint64_t)1 << 63)) ? 0 : -1; }
+            else {
+                uint64_t half_hi = (uint64_t)1 << (t - 1);
+                cmp = (rhi > half_hi) ? 1 :
+                      (rhi < half_hi) ? -1 :
+                      (rlo > 0) ? 1 : 0; }
+
+            N = q;
+            if (cmp > 0 || (cmp == 0 && (q & 1))) {
+                ++N; } }
+        else {
+            if (s > 0 && (p.hi >> s) != 0) {
+                return false; }
+
+            uint64_t q = (p.lo >> s) | (p.hi << (64 - s));
+            uint64_t r = p.lo & (((uint64_t)1 << s) - 1);
+            uint64_t half = (uint64_t)1 << (s - 1);
+
+            N = q;
+            if (r > half || (r == half && (q & 1))) {
+                ++N;
+                if (N == 0) {
+                    return false; } } } }
+
+    char* out = *pout;
+    if (negative) {
+        *out++ = '-'; }
+
+    out = write_u64(out, N / scale);
+
+    if (precision > 0) {
+        *out++ = '.';
+        uint64_t frac = N % scale;
+        for (int i = precision - 1; i >= 0; --i) {
+            out[i] = (char)('0' + frac % 10);
+            frac /= 10; }
+        out += precision; }
+
+    *pout = out;
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+// snprintf fallback for huge values / precision. Locale may use another
+// decimal point which we replace with '.'
+//
+static int fixed_double_printf(DSTR dest, double value, int precision)
+{
+    size_t oldlen = DLEN(dest);
+
+    if (!dstr_append_sprintf(dest, "%.*f", precision, value)) {
+        return DSTR_FAIL; }
+
+    const struct lconv* lc = localeconv();
+    const char* dp = (lc && lc->decimal_point) ? lc->decimal_point : ".";
+
+    if (dp[0] == '.' && dp[1] == '\0') {
+        return DSTR_SUCCESS; }
+
+    size_t dplen = strlen(dp);
+    char* first = DBUF(dest) + oldlen;
+    char* found = strstr(first, dp);
+    if (found) {
+        *found = '.';
+        if (dplen > 1) {
+            dstr_remove(dest, (size_t)(found - DBUF(dest)) + 1, dplen - 1); } }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    S T R I N G  ->  F L O A T I N G   P O I N T
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+// Decimal input is converted with the Clinger fast path when exact and
+// with the Eisel-Lemire algorithm otherwise (Daniel Lemire, "Number
+// Parsing at a Gigabyte per Second", 2021). Both work on (ptr, len) and
+// never look at the locale. Hex floats and the rare decimal input that
+// can not be decided from the first 19 significant digits fall back to
+// strtod/strtof on a copy that uses the locale decimal point.
+//
+typedef struct FloatFormat {
+    int mantissa_bits;          // explicit mantissa bits
+    int min_exponent;           // -bias
+    int infinite_power;         // biased exponent of inf
+    int min_round_to_even;      // range of q where ties are possible
+    int max_round_to_even;
+    int smallest_pow10;         // below: always zero
+    int largest_pow10;          // above: always inf
+} FloatFormat;
+
+static const FloatFormat binary64_format = { 52, -1023, 0x7FF, -4, 23, -342, 308 };
+static const FloatFormat binary32_format = { 23, -127,  0xFF, -17, 10, -65,  38 };
+/*-------------------------------------------------------------------------------*/
+
+// Result of decimal -> binary: biased exponent and mantissa without the
+// hidden bit. power2 < 0 means the result could not be decided
+//
+typedef struct AdjustedMantissa {
+    uint64_t mantissa;
+    int      power2;
+} AdjustedMantissa;
+/*-------------------------------------------------------------------------------*/
+
+static inline int leading_zeros64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    if (!(x >> 32)) { n += 32; x <<= 32; }
+    if (!(x >> 48)) { n += 16; x <<= 16; }
+    if (!(x >> 56)) { n += 8;  x <<= 8; }
+    if (!(x >> 60)) { n += 4;  x <<= 4; }
+    if (!(x >> 62)) { n += 2;  x <<= 2; }
+    if (!(x >> 63)) { n += 1; }
+    return n;
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+
+// floor(log2(10^q)) + 63, exact for q in [-342, 308]
+//
+static inline int pow10_to_pow2(int q)
+{
+    return (((152170 + 65536) * q) >> 16) + 63;
+}
+/*-------------------------------------------------------------------------------*/
+
+// w * 5^q truncated to 128 bits. Only the upper BIT_PRECISION bits must
+// be exact so the second multiplication is usually not needed
+//
+static inline U128 product_approximation(int q, uint64_t w, int bit_precision)
+{
+    int index = q - POW5_MIN_EXP10;
+    U128 first = mul_64x64(w, pow5_128[index].hi);
+
+    uint64_t mask = UINT64_MAX >> bit_precision;
+    if ((first.hi & mask) == mask) {
+        U128 second = mul_64x64(w, pow5_128[index].lo);
+        first.lo += second.hi;
+        if (second.hi > first.lo) {
+            first.hi++; } }
+
+    return first;
+}
+/*-------------------------------------------------------------------------------*/
+
+static AdjustedMantissa eisel_lemire(const FloatFormat* fmt, int64_t q, uint64_t w)
+{
+    AdjustedMantissa answer;
+
+    if (w == 0 || q < fmt->smallest_pow10) {
+        answer.mantissa = 0;
+        answer.power2 = 0;
+        return answer; }
+
+    if (q > fmt->largest_pow10) {
+        answer.mantissa = 0;
+        answer.power2 = fmt->infinite_power;
+        return answer; }
+
+    int lz = leading_zeros64(w);
+    w <<= lz;
+
+    U128 product = product_approximation((int) q, w, fmt->mantissa_bits + 3);
+
+    int upperbit = (int)(product.hi >> 63);
+    int shift = upperbit + 64 - fmt->mantissa_bits - 3;
+
+    answer.mantissa = product.hi >> shift;
+    answer.power2 = pow10_to_pow2((int) q) + upperbit - lz - fmt->min_exponent;
+
+    if (answer.power2 <= 0) {
+        // subnormal
+        //
+        if (-answer.power2 + 1 >= 64) {
+            answer.mantissa = 0;
+            answer.power2 = 0;
+            return answer; }
+
+        answer.mantissa >>= -answer.power2 + 1;
+        answer.mantissa += (answer.mantissa & 1);
+        answer.mantissa >>= 1;
+        answer.power2 = (answer.mantissa < ((uint64_t) 1 << fmt->mantissa_bits)) ? 0 : 1;
+        return answer; }
+
+    // exactly halfway between two floats: round to even
+    //
+    if (product.lo <= 1 &&
+        q >= fmt->min_round_to_even && q <= fmt->max_round_to_even &&
+        (answer.mantissa & 3) == 1) {
+        if ((answer.mantissa << shift) == product.hi) {
+            answer.mantissa &= ~(uint64_t) 1; } }
+
+    answer.mantissa += (answer.mantissa & 1);
+    answer.mantissa >>= 1;
+
+    if (answer.mantissa >= ((uint64_t) 2 << fmt->mantissa_bits)) {
+        answer.mantissa = (uint64_t) 1 << fmt->mantissa_bits;
+        answer.power2++; }
+
+    answer.mantissa &= ~((uint64_t) 1 << fmt->mantissa_bits);
+
+    if (answer.power2 >= fmt->infinite_power) {
+        answer.power2 = fmt->infinite_power;
+        answer.mantissa = 0; }
+
+    return answer;
+}
+/*-------------------------------------------------------------------------------*/
+
+enum {
+    PARSED_DECIMAL,
+    PARSED_INF,
+    PARSED_NAN,
+    PARSED_HEX
+};
+
+typedef struct ParsedNumber {
+    uint64_t    mantissa;       // first 19 significant digits
+    int64_t     exponent;       // value = mantissa * 10^exponent
+    const char* token;          // number start (after white space)
+    const char* last;           // one past the number, NULL if no number
+    int         kind;
+    bool        negative;
+    bool        inexact;        // nonzero digits beyond the 19th
+} ParsedNumber;
+/*-------------------------------------------------------------------------------*/
+
+static inline bool is_digit(char c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline bool is_xdigit(char c)
+{
+    return is_digit(c) || (unsigned)((c | 0x20) - 'a') < 6;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline bool match_nocase(const char* p, const char* end, const char* word)
+{
+    for (; *word; ++p, ++word) {
+        if (p == end || (*p | 0x20) != *word) {
+            return false; } }
+
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Length of a hex float after "0x" or 0 if no hex digits follow,
+// same as strtod which then only consumes the leading '0'
+//
+static size_t scan_hex_float(const char* p, const char* end)
+{
+    const char* first = p;
+    bool any = false;
+
+    for (; p != end && is_xdigit(*p); ++p) {
+        any = true; }
+
+    if (p != end && *p == '.') {
+        for (++p; p != end && is_xdigit(*p); ++p) {
+            any = true; } }
+
+    if (!any) {
+        return 0; }
+
+    if (p != end && (*p | 0x20) == 'p') {
+        const char* e = p + 1;
+        if (e != end && (*e == '+' || *e == '-')) {
+            ++e; }
+        if (e != end && is_digit(*e)) {
+            for (p = e; p != end && is_digit(*p); ++p) {} } }
+
+    return (size_t)(p - first);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Recompute mantissa/exponent from the first 19 significant digits when
+// the number has more digits than fit in 64 bits
+//
+static void truncate_digits(ParsedNumber* pn,
+                            const char* int_first, const char* int_last,
+                            const char* frac_first, const char* frac_last,
+                            int64_t exp10)
+{
+    uint64_t m = 0;
+    int taken = 0;
+    bool inexact = false;
+
+    for (const char* s = int_first; s != int_last; ++s) {
+        if (taken == 0 && *s == '0') {
+            continue; }
+        if (taken < 19) {
+            m = m * 10 + (uint64_t)(*s - '0');
+            ++taken; }
+        else {
+            inexact |= (*s != '0');
+            ++exp10; } }
+
+    for (const char* s = frac_first; s != frac_last; ++s) {
+        if (taken == 0 && *s == '0') {
+            --exp10;
+            continue; }
+        if (taken < 19) {
+            m = m * 10 + (uint64_t)(*s - '0');
+            ++taken;
+            --exp10; }
+        else {
+            inexact |= (*s != '0'); } }
+
+    pn->mantissa = m;
+    pn->exponent = exp10;
+    pn->inexact = inexact;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Scan a number with the syntax of strtod in the "C" locale
+//
+static void scan_number(const char* buff, size_t len, ParsedNumber* pn)
+{
+    const char* p = buff;
+    const char* end = buff + len;
+
+    memset(pn, 0, sizeof *pn);
+
+    while (p != end && isspace((unsigned char) *p)) {
+        ++p; }
+
+    pn->token = p;
+
+    if (p != end && (*p == '-' || *p == '+')) {
+        pn->negative = (*p++ == '-'); }
+
+    if (p != end && ((*p | 0x20) == 'i' || (*p | 0x20) == 'n')) {
+        if (match_nocase(p, end, "infinity")) {
+            pn->kind = PARSED_INF;
+            pn->last = p + 8; }
+        else if (match_nocase(p, end, "inf")) {
+            pn->kind = PARSED_INF;
+            pn->last = p + 3; }
+        else if (match_nocase(p, end, "nan")) {
+            pn->kind = PARSED_NAN;
+            p += 3;
+            if (p != end && *p == '(') {
+                const char* q = p + 1;
+                while (q != end && (isalnum((unsigned char) *q) || *q == '_')) {
+                    ++q; }
+                if (q != end && *q == ')') {
+                    p = q + 1; } }
+            pn->last = p; }
+        return; }
+
+    if (end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x') {
+        size_t n = scan_hex_float(p + 2, end);
+        if (n) {
+            pn->kind = PARSED_HEX;
+            pn->last = p + 2 + n;
+            return; } }
+
+    const char* int_first = p;
+    uint64_t m = 0;
+
+    for (; p != end && is_digit(*p); ++p) {
+        m = m * 10 + (uint64_t)(*p - '0'); }
+
+    const char* int_last = p;
+    const char* frac_first = p;
+    const char* frac_last = p;
+
+    if (p != end && *p == '.') {
+        frac_first = ++p;
+        for (; p != end && is_digit(*p); ++p) {
+            m = m * 10 + (uint64_t)(*p - '0'); }
+        frac_last = p; }
+
+    size_t ndigits = (size_t)(int_last - int_first) + (size_t)(frac_last - frac_first);
+    if (ndigits == 0) {
+        return; }
+
+    int64_t exp10 = 0;
+    if (p != end && (*p | 0x20) == 'e') {
+        const char* e = p + 1;
+        bool eneg = false;
+        if (e != end && (*e == '+' || *e == '-')) {
+            eneg = (*e++ == '-'); }
+
+        if (e != end && is_digit(*e)) {
+            for (; e != end && is_digit(*e); ++e) {
+                if (exp10 < 0x10000000) {
+                    exp10 = exp10 * 10 + (*e - '0'); } }
+            if (eneg) {
+                exp10 = -exp10; }
+            p = e; } }
+
+    pn->kind = PARSED_DECIMAL;
+    pn->last = p;
+    pn->mantissa = m;
+    pn->exponent = exp10 - (int64_t)(frac_last - frac_first);
+
+    if (ndigits > 19) {
+        truncate_digits(pn, int_first, int_last, frac_first, frac_last, exp10); }
+}
+/*-------------------------------------------------------------------------------*/
+
+// strtod / strtof on a copy of the token with '.' replaced by the locale
+// decimal point
+//
+static double slow_strtod(const ParsedNumber* pn, bool want_float)
+{
+    const struct lconv* lc = localeconv();
+    const char* dp = (lc && lc->decimal_point && *lc->decimal_point) ? lc->decimal_point : ".";
+    size_t dplen = strlen(dp);
+    size_t bufsize = (size_t)(pn->last - pn->token) + dplen + 1;
+
+    char  stackbuf[128];
+    char* tmp = stackbuf;
+    if (bufsize > sizeof stackbuf) {
+        tmp = (char*) malloc(bufsize);
+        if (!tmp) {
+            dstr_out_of_memory(); } }
+
+    char* out = tmp;
+    for (const char* s = pn->token; s != pn->last; ++s) {
+        if (*s == '.') {
+            memcpy(out, dp, dplen);
+            out += dplen; }
+        else {
+            *out++ = *s; } }
+    *out = '\0';
+
+    double result = want_float ? strtof(tmp, NULL) : strtod(tmp, NULL);
+
+    if (tmp != stackbuf) {
+        free(tmp); }
+
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Exact when both the mantissa and the power of ten are exactly
+// representable: one correctly rounded multiplication or division.
+// Requires that floating point expressions are evaluated in their type
+//
+static bool clinger_fast_path(const ParsedNumber* pn, bool want_float, double* result)
+{
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    static const double pow10_dbl[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    static const float pow10_flt[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    int64_t q = pn->exponent;
+
+    if (want_float) {
+        if (q < -10 || q > 10 || pn->mantissa > ((uint64_t) 1 << 24)) {
+            return false; }
+
+        float f = (float) pn->mantissa;
+        f = (q < 0) ? f / pow10_flt[-q] : f * pow10_flt[q];
+        *result = pn->negative ? -f : f;
+        return true; }
+
+    if (q < -22 || q > 22 || pn->mantissa > ((uint64_t) 1 << 53)) {
+        return false; }
+
+    double d = (double) pn->mantissa;
+    d = (q < 0) ? d / pow10_dbl[-q] : d * pow10_dbl[q];
+    *result = pn->negative ? -d : d;
+    return true;
+#else
+    (void) pn;
+    (void) want_float;
+    (void) result;
+    return false;
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+
+static double make_double(uint64_t mantissa, int power2, bool negative)
+{
+    uint64_t bits = mantissa | ((uint64_t) power2 << 52) | ((uint64_t) negative << 63);
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+/*-------------------------------------------------------------------------------*/
+
+static float make_float(uint64_t mantissa, int power2, bool negative)
+{
+    uint32_t bits = (uint32_t) mantissa | ((uint32_t) power2 << 23) | ((uint32_t) negative << 31);
+    float f;
+    memcpy(&f, &bits, sizeof f);
+    return f;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Parse a double (or a float, returned widened) from BUFF. Returns the
+// number of characters consumed, 0 if there is no number. Sets errno to
+// ERANGE on overflow and underflow (subnormal or zero result)
+//
+static size_t parse_floating(const char* buff, size_t len, bool want_float, double* result)
+{
+    ParsedNumber pn;
+    scan_number(buff, len, &pn);
+
+    *result = 0;
+    if (!pn.last) {
+        return 0; }
+
+    size_t consumed = (size_t)(pn.last - buff);
+
+    switch (pn.kind) {
+    case PARSED_INF:
+        *result = make_double(0, 0x7FF, pn.negative);
+        return consumed;
+
+    case PARSED_NAN:
+        *result = make_double((uint64_t) 1 << 51, 0x7FF, pn.negative);
+        return consumed;
+
+    case PARSED_HEX:
+        *result = slow_strtod(&pn, want_float);
+        return consumed;
+
+    default:
+        break; }
+
+    if (clinger_fast_path(&pn, want_float, result)) {
+        return consumed; }
+
+    const FloatFormat* fmt = want_float ? &binary32_format : &binary64_format;
+    AdjustedMantissa am = eisel_lemire(fmt, pn.exponent, pn.mantissa);
+
+    // Digits were dropped: the value lies in [m, m+1) * 10^q. If both
+    // ends round to the same float we are done
+    //
+    if (pn.inexact) {
+        AdjustedMantissa am1 = eisel_lemire(fmt, pn.exponent, pn.mantissa + 1);
+        if (am.mantissa != am1.mantissa || am.power2 != am1.power2) {
+            *result = slow_strtod(&pn, want_float);
+            return consumed; } }
+
+    // Like strtod: ERANGE on overflow and on a subnormal or zero result
+    // of a nonzero number (a short decimal is never exactly subnormal)
+    //
+    if (am.power2 == fmt->infinite_power || (am.power2 == 0 && pn.mantissa != 0)) {
+        errno = ERANGE; }
+
+    *result = want_float ? (double) make_float(am.mantissa, am.power2, pn.negative)
+                         : make_double(am.mantissa, am.power2, pn.negative);
+    return consumed;
+}
+/*-------------------------------------------------------------------------------*/
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *    S T R I N G  ->  I N T E G E R
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+
+// Decimal, hex and binary digits are consumed 8 at a time with SWAR
+// (SIMD within a register) tricks on a 64 bit word, other bases and the
+// tail one digit at a time. The input is length bounded, no NUL needed.
+//
+static inline uint64_t load_le64(const char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof v);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Per byte test that 0 <= x < 0x80 is in [lo, hi]. Result has 0x80 set
+// in each matching byte
+//
+#define SWAR_ONES     0x0101010101010101ULL
+#define SWAR_HIGHS    0x8080808080808080ULL
+#define SWAR_IN_RANGE(x, lo, hi) \
+    (((x) + SWAR_ONES * (0x80 - (lo))) & ~((x) + SWAR_ONES * (0x7F - (hi))) & SWAR_HIGHS)
+/*-------------------------------------------------------------------------------*/
+
+static inline bool swar_eight_digits(uint64_t w)
+{
+    return (((w & 0xF0F0F0F0F0F0F0F0ULL) |
+             (((w + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+            0x3333333333333333ULL);
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline uint32_t swar_parse_eight_digits(uint64_t w)
+{
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 0x000F424000000064ULL;    // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ULL;    // 1 + (10000 << 32)
+
+    w -= 0x3030303030303030ULL;
+    w = (w * 10) + (w >> 8);
+    w = (((w & mask) * mul1) + (((w >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t) w;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Returns false if one of the 8 bytes is not a hex digit
+//
+static inline bool swar_parse_eight_xdigits(uint64_t w, uint32_t* value)
+{
+    if (w & SWAR_HIGHS) {
+        return false; }
+
+    uint64_t digit = SWAR_IN_RANGE(w, 0x30, 0x39);
+    uint64_t alpha = SWAR_IN_RANGE(w | (SWAR_ONES * 0x20), 0x61, 0x66);
+
+    if ((digit | alpha) != SWAR_HIGHS) {
+        return false; }
+
+    // nibble values, first character in the lowest byte
+    //
+    uint64_t n = (w & (SWAR_ONES * 0x0F)) + (alpha >> 7) * 9;
+
+    n = ((n << 4) | (n >> 8))  & 0x00FF00FF00FF00FFULL;
+    n = ((n << 8) | (n >> 16)) & 0x0000FFFF0000FFFFULL;
+    n = ((n << 16) | (n >> 32)) & 0x00000000FFFFFFFFULL;
+
+    *value = (uint32_t) n;
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Returns false if one of the 8 bytes is not '0' or '1'
+//
+static inline bool swar_parse_eight_bits(uint64_t w, uint32_t* value)
+{
+    if ((w & ~SWAR_ONES) != SWAR_ONES * 0x30) {
+        return false; }
+
+    *value = (uint32_t)(((w & SWAR_ONES) * 0x8040201008040201ULL) >> 56);
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline unsigned digit_value(char c)
+{
+    unsigned d = (unsigned)(c - '0');
+    if (d < 10) {
+        return d; }
+
+    d = (unsigned)((c | 0x20) - 'a');
+    return (d < 26) ? d + 10 : 99;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Accumulate digits of BASE into *PVALUE. On overflow *POVERFLOW is set
+// and the remaining digits are still consumed (as strtoull does)
+//
+static const char* parse_digits_generic(const char* p, const char* end, unsigned base,
+                                        uint64_t* pvalue, bool* poverflow)
+{
+    const uint64_t limit = UINT64_MAX / base;
+    const unsigned limit_digit = (unsigned)(UINT64_MAX % base);
+    uint64_t v = *pvalue;
+
+    for (; p != end; ++p) {
+        unsigned d = digit_value(*p);
+        if (d >= base) {
+            break; }
+
+        if (v > limit || (v == limit && d > limit_digit)) {
+            *poverflow = true; }
+        else {
+            v = v * base + d; } }
+
+    *pvalue = v;
+    return p;
+}
+/*-------------------------------------------------------------------------------*/
+
+static const char* parse_digits(const char* p, const char* end, unsigned base,
+                                uint64_t* pvalue, bool* poverflow)
+{
+    uint64_t v = 0;
+    uint32_t chunk;
+
+    switch (base) {
+    case 10:
+        while (end - p >= 8) {
+            uint64_t w = load_le64(p);
+            if (!swar_eight_digits(w) || v > (UINT64_MAX - 99999999) / 100000000) {
+                break; }
+            v = v * 100000000 + swar_parse_eight_digits(w);
+            p += 8; }
+        break;
+
+    case 16:
+        while (end - p >= 8 && (v >> 32) == 0 && swar_parse_eight_xdigits(load_le64(p), &chunk)) {
+            v = (v << 32) | chunk;
+            p += 8; }
+        break;
+
+    case 2:
+        while (end - p >= 8 && (v >> 56) == 0 && swar_parse_eight_bits(load_le64(p), &chunk)) {
+            v = (v << 8) | chunk;
+            p += 8; }
+        break;
+
+    default:
+        break; }
+
+    *pvalue = v;
+    return parse_digits_generic(p, end, base, pvalue, poverflow);
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct ParsedInteger {
+    uint64_t magnitude;
+    bool     negative;
+    bool     overflow;      // magnitude does not fit in 64 bits
+} ParsedInteger;
+/*-------------------------------------------------------------------------------*/
+
+// strtoull syntax: white space, sign, optional 0x for base 16 and base
+// detection for base 0. Returns characters consumed, 0 if no number
+//
+static size_t scan_integer(const char* buff, size_t len, int base, ParsedInteger* pi)
+{
+    const char* p = buff;
+    const char* end = buff + len;
+
+    memset(pi, 0, sizeof *pi);
+
+    if (base < 0 || base == 1 || base > 36) {
+        return 0; }
+
+    while (p != end && isspace((unsigned char) *p)) {
+        ++p; }
+
+    if (p != end && (*p == '-' || *p == '+')) {
+        pi->negative = (*p++ == '-'); }
+
+    if ((base == 0 || base == 16) &&
+        end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && is_xdigit(p[2])) {
+        p += 2;
+        base = 16; }
+    else if (base == 0) {
+        base = (p != end && *p == '0') ? 8 : 10; }
+
+    const char* first = p;
+    p = parse_digits(p, end, (unsigned) base, &pi->magnitude, &pi->overflow);
+
+    return (p == first) ? 0 : (size_t)(p - buff);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Same as strtoll: clamp to the range and set ERANGE
+//
+static long long integer_to_llong(const ParsedInteger* pi)
+{
+    const uint64_t max = (uint64_t) LLONG_MAX;
+
+    if (!pi->negative) {
+        if (pi->overflow || pi->magnitude > max) {
+            errno = ERANGE;
+            return LLONG_MAX; }
+        return (long long) pi->magnitude; }
+
+    if (pi->overflow || pi->magnitude > max + 1) {
+        errno = ERANGE;
+        return LLONG_MIN; }
+
+    return (pi->magnitude == max + 1) ? LLONG_MIN : -(long long) pi->magnitude;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Same as strtoull: a negative number is negated in unsigned arithmetic
+//
+static unsigned long long integer_to_ullong(const ParsedInteger* pi)
+{
+    if (pi->overflow) {
+        errno = ERANGE;
+        return ULLONG_MAX; }
+
+    return pi->negative ? 0 - pi->magnitude : pi->magnitude;
+}
+/*-------------------------------------------------------------------------------*/
+
+// The dstr_atoi() prefix rules: "\" octal, "0b" binary, "0x" hex,
+// otherwise decimal with leading zeros skipped (no octal)
+//
+static size_t find_atoi_base(const char* p, size_t len, int* pBase)
+{
+    size_t skip = 0;
+
+    if (len && *p == '\\') {
+        skip = 1;
+        *pBase = 8; }
+    else if (len && *p == '0') {
+        if (len > 1 && (p[1] | 0x20) == 'b') {
+            skip = 2;
+            *pBase = 2; }
+        else if (len > 1 && (p[1] | 0x20) == 'x') {
+            skip = 2;
+            *pBase = 16; }
+        else {
+            // skip all leading zero's
+            //
+            do { ++skip; } while (skip < len && p[skip] == '0'); } }
+
+    return skip;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Parse one list field into DEST[I], returns characters consumed
+//
+typedef size_t (*ListFieldParser)(const char* buff, size_t len, void* dest, size_t i, int base);
+
+static size_t double_field(const char* buff, size_t len, void* dest, size_t i, int base)
+{
+    (void) base;
+    return parse_floating(buff, len, false, (double*) dest + i);
+}
+
+static size_t float_field(const char* buff, size_t len, void* dest, size_t i, int base)
+{
+    (void) base;
+    double value;
+    size_t consumed = parse_floating(buff, len, true, &value);
+    ((float*) dest)[i] = (float) value;
+    return consumed;
+}
+
+static size_t llong_field(const char* buff, size_t len, void* dest, size_t i, int base)
+{
+    ParsedInteger pi;
+    size_t consumed = scan_integer(buff, len, base, &pi);
+    ((long long*) dest)[i] = integer_to_llong(&pi);
+    return consumed;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Parse a list of numbers separated by SEP. White space around the fields
+// is ignored. Stops at the first field that is not a number, empty fields
+// included (errno is set to EINVAL) or when DEST is full. *INDEX is where parsing stopped: the
+// start of the bad field or of the first field that was not stored.
+//
+static size_t parse_list(const char* buff, size_t len, char sep,
+                         void* dest, size_t n, size_t* index,
+                         ListFieldParser parse_field, int base)
+{
+    int errsave = errno;
+    errno = 0;
+
+    size_t pos = 0;
+    size_t count = 0;
+
+    while (pos < len && count < n) {
+        size_t consumed = parse_field(buff + pos, len - pos, dest, count, base);
+        if (consumed == 0) {
+            errno = EINVAL;
+            break; }
+
+        size_t next = pos + consumed;
+        while (next < len && buff[next] != sep && isspace((unsigned char) buff[next])) {
+            ++next; }
+
+        if (next < len && buff[next] != sep) {
+            errno = EINVAL;
+            break; }
+
+        ++count;
+        pos = (next < len) ? next + 1 : len;
+
+        // a separator at the end leaves an empty field, as bad as "1,,2"
+        //
+        if (next < len && pos == len && count < n) {
+            errno = EINVAL; } }
+
+    if (index) {
+        *index = pos; }
+
+    if (errno == 0) {
+        errno = errsave; }
+
+    return count;
+}
+/*-------------------------------------------------------------------------------*/
+
+
+/*
+ * * * * * * * * * * * * * * * * * *
+ *
+ *       P U B L I C    A P I
+ *
+ * * * * * * * * * * * * * * * * * *
+ */
+int dstr_append_double(DSTR dest, double value)
+{
+    char* out = conv_tail_reserve(dest, SHORTEST_BUFSIZE);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    conv_commit(dest, shortest_double(out, value));
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_float(DSTR dest, float value)
+{
+    char* out = conv_tail_reserve(dest, SHORTEST_BUFSIZE);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    conv_commit(dest, shortest_float(out, value));
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_double_fixed(DSTR dest, double value, int precision)
+{
+    if (precision < 0) {
+        precision = 6; }
+
+    // sign + 20 integer digits + '.' + up to 19 decimals
+    //
+    char* out = conv_tail_reserve(dest, 48);
+    if (!out) {
+        return DSTR_FAIL; }
+
+    if (fixed_double_exact(&out, value, precision)) {
+        conv_commit(dest, out);
+        return DSTR_SUCCESS; }
+
+    return fixed_double_printf(dest, value, precision);
+}
+/*-------------------------------------------------------------------------------*/
+
+double dstr_to_double_bl(const char* buff, size_t len, size_t* index)
+{
+    int errsave = errno;
+    errno = 0;
+
+    double result;
+    size_t consumed = parse_floating(buff, len, false, &result);
+
+    if (consumed == 0) {
+        errno = EINVAL; }
+
+    if (index) {
+        *index = consumed; }
+
+    if (errno == 0) {
+        errno = errsave; }
+
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+float dstr_to_float_bl(const char* buff, size_t len, size_t* index)
+{
+    int errsave = errno;
+    errno = 0;
+
+    double result;
+    size_t consumed = parse_floating(buff, len, true, &result);
+
+    if (consumed == 0) {
+        errno = EINVAL; }
+
+    if (index) {
+        *index = consumed; }
+
+    if (errno == 0) {
+        errno = errsave; }
+
+    return (float) result;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_double_list_bl(const char* buff, size_t len, char sep,
+                              double dest[], size_t n, size_t* index)
+{
+    return parse_list(buff, len, sep, dest, n, index, double_field, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_float_list_bl(const char* buff, size_t len, char sep,
+                             float dest[], size_t n, size_t* index)
+{
+    return parse_list(buff, len, sep, dest, n, index, float_field, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_double_list(CDSTR p, char sep, double dest[], size_t n, size_t* index)
+{
+    return parse_list(DBUF(p), DLEN(p), sep, dest, n, index, double_field, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_float_list(CDSTR p, char sep, float dest[], size_t n, size_t* index)
+{
+    return parse_list(DBUF(p), DLEN(p), sep, dest, n, index, float_field, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+long long dstr_to_llong_bl(const char* buff, size_t len, size_t* index, int base)
+{
+    int errsave = errno;
+    errno = 0;
+
+    ParsedInteger pi;
+    size_t consumed = scan_integer(buff, len, base, &pi);
+    long long result = integer_to_llong(&pi);
+
+    if (consumed == 0) {
+        errno = EINVAL; }
+
+    if (index) {
+        *index = consumed; }
+
+    if (errno == 0) {
+        errno = errsave; }
+
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+unsigned long long dstr_to_ullong_bl(const char* buff, size_t len, size_t* index, int base)
+{
+    int errsave = errno;
+    errno = 0;
+
+    ParsedInteger pi;
+    size_t consumed = scan_integer(buff, len, base, &pi);
+    unsigned long long result = integer_to_ullong(&pi);
+
+    if (consumed == 0) {
+        errno = EINVAL; }
+
+    if (index) {
+        *index = consumed; }
+
+    if (errno == 0) {
+        errno = errsave; }
+
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+long long dstr_atoll_bl(const char* buff, size_t len)
+{
+    int base = 10;
+    size_t skip = find_atoi_base(buff, len, &base);
+
+    ParsedInteger pi;
+    scan_integer(buff + skip, len - skip, base, &pi);
+    return integer_to_llong(&pi);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_llong_list_bl(const char* buff, size_t len, char sep,
+                             long long dest[], size_t n, size_t* index, int base)
+{
+    return parse_list(buff, len, sep, dest, n, index, llong_field, base);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_to_llong_list(CDSTR p, char sep, long long dest[], size_t n, size_t* index, int base)
+{
+    return parse_list(DBUF(p), DLEN(p), sep, dest, n, index, llong_field, base);
+}
+/*-------------------------------------------------------------------------------*/
@@ -3,6 +3,17 @@
 
 #define REGEX_COMPILE_ERROR_BASE 10000
 
+// Binary safe builds (DSTR_BINARY_SAFE, see dstr.h) keep every byte of
+// input buffers, text builds stop at the first NUL
+//
+#if defined(DSTR_BINARY_SAFE)
+#define DSTR_TEXT_ONLY 0
+#define dstr_input_len(buff, len)  (len)
+#else
+#define DSTR_TEXT_ONLY 1
+#define dstr_input_len(buff, len)  strnlen((buff), (len))
+#endif
+
 // This function is not part of public C API but exported since it is
 // needed in the C++ wrapper.  we must force C name and linkage
 //
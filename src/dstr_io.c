@@ -0,0 +1,1515 @@
+/*
+ * Copyright (c) 2025 Eyal Ben-David
+ *
+ * This file is part of DString C and C++ dynamic string library,
+ * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // statx
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#endif
+
+#include <dstr/dstr.h>
+#include "dstr_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Batched slurping submits open/statx/read/close through io_uring on
+// Linux (raw system calls, no liburing) and otherwise uses a few threads
+//
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(STATX_SIZE) && defined(__NR_io_uring_setup)
+#define DSTR_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#if defined(__GNUC__) && (defined(__MINGW32__) || defined(__MINGW64__))
+#include <pthread.h>
+#define DSTR_IO_PTHREAD 1
+#else
+#include <threads.h>
+#endif
+#define DSTR_IO_THREADS 1
+#endif
+
+#if defined(DSTR_IO_THREADS) && defined(DSTR_IO_PTHREAD)
+typedef pthread_mutex_t dstr_mutex_t;
+#define dstr_mutex_init(m)       (pthread_mutex_init((m), NULL) == 0)
+#define dstr_mutex_lock(m)       pthread_mutex_lock(m)
+#define dstr_mutex_unlock(m)     pthread_mutex_unlock(m)
+#define dstr_mutex_destroy(m)    pthread_mutex_destroy(m)
+#elif defined(DSTR_IO_THREADS)
+typedef mtx_t dstr_mutex_t;
+#define dstr_mutex_init(m)       (mtx_init((m), mtx_plain) == thrd_success)
+#define dstr_mutex_lock(m)       mtx_lock(m)
+#define dstr_mutex_unlock(m)     mtx_unlock(m)
+#define dstr_mutex_destroy(m)    mtx_destroy(m)
+#endif
+
+/*
+ *  Block buffered file I/O
+ */
+
+#if defined(_WIN32)
+#define dstr_open_read(path)     _open((path), _O_RDONLY | _O_BINARY)
+#define dstr_open_write(path)    _open((path), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+#define dstr_read(fd, buf, n)    _read((fd), (buf), (unsigned)(n))
+#define dstr_write(fd, buf, n)   _write((fd), (buf), (unsigned)(n))
+#define dstr_close(fd)           _close(fd)
+#define dstr_fstat(fd, st)       _fstat((fd), (st))
+typedef struct _stat dstr_stat_t;
+#else
+#define dstr_open_read(path)     open((path), O_RDONLY)
+#define dstr_open_write(path)    open((path), O_WRONLY | O_CREAT | O_TRUNC, 0666)
+#define dstr_read(fd, buf, n)    read((fd), (buf), (n))
+#define dstr_write(fd, buf, n)   write((fd), (buf), (n))
+#define dstr_close(fd)           close(fd)
+#define dstr_fstat(fd, st)       fstat((fd), (st))
+typedef struct stat dstr_stat_t;
+#endif
+
+// largest single read(2) or write(2) request, fits in Windows' unsigned and int
+//
+#define DSTR_READ_CHUNK  (1U << 30)
+
+/*
+ *  For convenience, make code shorter (same as in dstr.c)
+ */
+#define DBUF(p)       ((p)->data)
+#define DLEN(p)       ((p)->length)
+#define DCAP(p)       ((p)->capacity)
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    B L O C K   R E A D E R
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define DSTR_READER_BLOCK  (64U * 1024U)
+
+struct DSTR_Reader {
+    // buff[begin, end) holds data not returned yet, delimiter search
+    // resumes at scan
+    //
+    char*   buff;
+    size_t  capacity;
+    size_t  begin;
+    size_t  end;
+    size_t  scan;
+
+    // source: file descriptor or stdio stream
+    //
+    int     fd;
+    FILE*   fp;
+    int     owns_fd;
+    int     eof;
+    int     error;
+
+    int     flags;
+    size_t  ndelims;
+    char    delims[4];
+    unsigned char delim_map[256];
+};
+/*-------------------------------------------------------------------------------*/
+
+static DSTR_Reader* reader_new(int fd, FILE* fp, int owns_fd)
+{
+    DSTR_Reader* r = (DSTR_Reader*) calloc(1, sizeof(DSTR_Reader));
+    if (!r) {
+        errno = ENOMEM;
+        return NULL; }
+
+    if ((r->buff = (char*) malloc(DSTR_READER_BLOCK)) == NULL) {
+        free(r);
+        errno = ENOMEM;
+        return NULL; }
+
+    r->capacity = DSTR_READER_BLOCK;
+    r->fd = fd;
+    r->fp = fp;
+    r->owns_fd = owns_fd;
+    dstr_reader_set_delims(r, "\n", 0);
+    return r;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Reader* dstr_reader_open(const char* path)
+{
+    assert(path != NULL);
+
+    int fd = dstr_open_read(path);
+    if (fd < 0) {
+        return NULL; }
+
+    DSTR_Reader* r = reader_new(fd, NULL, 1);
+    if (!r) {
+        dstr_close(fd); }
+
+    return r;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Reader* dstr_reader_fdopen(int fd)
+{
+    return reader_new(fd, NULL, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Reader* dstr_reader_from_stream(FILE* fp)
+{
+    assert(fp != NULL);
+    return reader_new(-1, fp, 0);
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_reader_close(DSTR_Reader* r)
+{
+    if (!r) {
+        return; }
+
+    if (r->owns_fd) {
+        dstr_close(r->fd); }
+
+    free(r->buff);
+    free(r);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_reader_error(const DSTR_Reader* r)
+{
+    return r->error;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_reader_set_delims(DSTR_Reader* r, const char* delims, int flags)
+{
+    assert(r != NULL);
+    assert(delims != NULL && *delims != '\0');
+
+    memset(r->delim_map, 0, sizeof(r->delim_map));
+    r->ndelims = 0;
+
+    for (; *delims; ++delims) {
+        unsigned char c = (unsigned char) *delims;
+        if (r->delim_map[c]) {
+            continue; }
+
+        r->delim_map[c] = 1;
+        if (r->ndelims < sizeof(r->delims)) {
+            r->delims[r->ndelims] = (char) c; }
+        ++r->ndelims; }
+
+    r->flags = flags;
+    r->scan = r->begin;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Find the first delimiter in [first, last) or NULL
+//
+static const char* reader_find_delim(const DSTR_Reader* r, const char* first, const char* last)
+{
+    if (r->ndelims == 1) {
+        return (const char*) memchr(first, r->delims[0], (size_t)(last - first)); }
+
+#if defined(__AVX2__)
+    // up to 4 delimiters (e.g. " \t\r\n") compared 32 bytes at a time
+    //
+    if (r->ndelims <= 4) {
+        const __m256i d0 = _mm256_set1_epi8(r->delims[0]);
+        const __m256i d1 = _mm256_set1_epi8(r->delims[1]);
+        const __m256i d2 = _mm256_set1_epi8(r->delims[r->ndelims > 2 ? 2 : 0]);
+        const __m256i d3 = _mm256_set1_epi8(r->delims[r->ndelims > 3 ? 3 : 0]);
+
+        for (; last - first >= 32; first += 32) {
+            __m256i x = _mm256_loadu_si256((const __m256i*) first);
+            __m256i m = _mm256_or_si256(
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, d0), _mm256_cmpeq_epi8(x, d1)),
+                _mm256_or_si256(_mm256_cmpeq_epi8(x, d2), _mm256_cmpeq_epi8(x, d3)));
+            unsigned mask = (unsigned) _mm256_movemask_epi8(m);
+            if (mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+                unsigned long bit;
+                _BitScanForward(&bit, mask);
+                return first + bit;
+#else
+                return first + __builtin_ctz(mask);
+#endif
+            } } }
+#endif
+
+    for (; first != last; ++first) {
+        if (r->delim_map[(unsigned char) *first]) {
+            return first; } }
+
+    return NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Move pending data to the front of the buffer (doubling it when full)
+// and read the next block. Returns bytes read, 0 at end of file and -1 on
+// error
+//
+static long reader_fill(DSTR_Reader* r)
+{
+    if (r->begin > 0) {
+        memmove(r->buff, r->buff + r->begin, r->end - r->begin);
+        r->end -= r->begin;
+        r->scan -= r->begin;
+        r->begin = 0; }
+
+    if (r->end == r->capacity) {
+        // a record must fit in a DSTR_VIEW
+        //
+        if (r->capacity > UINT32_MAX / 2) {
+            r->error = errno = ENOMEM;
+            return -1; }
+
+        char* newbuff = (char*) realloc(r->buff, 2 * r->capacity);
+        if (!newbuff) {
+            r->error = errno = ENOMEM;
+            return -1; }
+
+        r->buff = newbuff;
+        r->capacity *= 2; }
+
+    size_t room = r->capacity - r->end;
+    if (room > DSTR_READ_CHUNK) {
+        room = DSTR_READ_CHUNK; }
+
+    if (r->fp) {
+        size_t n = fread(r->buff + r->end, 1, room, r->fp);
+        if (n == 0 && ferror(r->fp)) {
+            r->error = errno ? errno : EIO;
+            return -1; }
+        r->end += n;
+        return (long) n; }
+
+    for (;;) {
+        long n = (long) dstr_read(r->fd, r->buff + r->end, room);
+        if (n >= 0) {
+            r->end += (size_t) n;
+            return n; }
+        if (errno != EINTR) {
+            r->error = errno;
+            return -1; } }
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_reader_next_view(DSTR_Reader* r, DSTR_VIEW* view)
+{
+    assert(r != NULL);
+    assert(view != NULL);
+
+    for (;;) {
+        const char* d = reader_find_delim(r, r->buff + r->scan, r->buff + r->end);
+
+        size_t first = r->begin;
+        size_t last;
+
+        if (d) {
+            last = (size_t)(d - r->buff);
+            r->begin = r->scan = last + 1;
+
+            if ((r->flags & DSTR_READER_CRLF) && *d == '\n' && last > first &&
+                r->buff[last - 1] == '\r') {
+                --last; } }
+        else if (r->eof) {
+            if (r->begin == r->end) {
+                return EOF; }
+            last = r->end;
+            r->begin = r->scan = r->end; }
+        else {
+            r->scan = r->end;
+            long n = reader_fill(r);
+            if (n < 0) {
+                return EOF; }
+            r->eof = (n == 0);
+            continue; }
+
+        if (last == first && (r->flags & DSTR_READER_SKIP_EMPTY)) {
+            continue; }
+
+        view->data = r->buff + first;
+        view->length = (uint32_t)(last - first);
+        return DSTR_SUCCESS; }
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_reader_next(DSTR_Reader* r, DSTR dest)
+{
+    DSTR_VIEW view;
+
+    if (dstr_reader_next_view(r, &view) == EOF) {
+        dstr_clear(dest);
+        return EOF; }
+
+    if (!dstr_assign_bl(dest, view.data, view.length)) {
+        r->error = ENOMEM;
+        return EOF; }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    M A P P E D   F I L E S
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if defined(_WIN32)
+// Read exactly LEN bytes, retrying short reads
+//
+static int read_full(int fd, char* buff, size_t len)
+{
+    while (len > 0) {
+        size_t n = (len > DSTR_READ_CHUNK) ? DSTR_READ_CHUNK : len;
+        long rc = (long) dstr_read(fd, buff, n);
+        if (rc < 0 && errno == EINTR) {
+            continue; }
+        if (rc <= 0) {
+            if (rc == 0) {
+                errno = EIO; }  // file shrank under us
+            return DSTR_FAIL; }
+        buff += rc;
+        len -= (size_t) rc; }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+#else
+// Map LEN bytes of FD followed by at least one zero byte. When LEN is a
+// multiple of the page size the file mapping is placed over a larger
+// anonymous one, so the byte after the data is always a readable NUL
+//
+static char* map_terminated(int fd, size_t len)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    if (len % page != 0) {
+        void* addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        return (addr == MAP_FAILED) ? NULL : (char*) addr; }
+
+    void* base = mmap(NULL, len + page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL; }
+
+    void* addr = mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+    if (addr == MAP_FAILED) {
+        int err = errno;
+        munmap(base, len + page);
+        errno = err;
+        return NULL; }
+
+    return (char*) addr;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void unmap_terminated(const char* data, size_t len)
+{
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    if (len % page == 0) {
+        len += page; }
+
+    munmap((void*) data, len);
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+// Map (or read) the whole regular file PATH into *DATA, at most MAX_LEN
+// bytes (EFBIG otherwise). The data is NUL terminated, an empty file
+// gives ""
+//
+static int map_path(const char* path, const char** data, size_t* len, unsigned long long max_len)
+{
+    dstr_stat_t st;
+    char* buff;
+    size_t size;
+
+    *data = "";
+    *len = 0;
+
+    int fd = dstr_open_read(path);
+    if (fd < 0) {
+        return DSTR_FAIL; }
+
+    if (dstr_fstat(fd, &st) != 0) {
+        goto fail; }
+
+    if ((st.st_mode & S_IFMT) != S_IFREG) {
+        errno = EINVAL;
+        goto fail; }
+
+    if ((unsigned long long) st.st_size > max_len ||
+        (unsigned long long) st.st_size >= (unsigned long long) SIZE_MAX) {
+        errno = EFBIG;
+        goto fail; }
+
+    size = (size_t) st.st_size;
+    if (size == 0) {
+        dstr_close(fd);
+        return DSTR_SUCCESS; }
+
+#if defined(_WIN32)
+    // no mmap: one exactly sized buffer and one read
+    //
+    if ((buff = (char*) malloc(size + 1)) == NULL) {
+        errno = ENOMEM;
+        goto fail; }
+
+    if (!read_full(fd, buff, size)) {
+        free(buff);
+        goto fail; }
+    buff[size] = '\0';
+#else
+    if ((buff = map_terminated(fd, size)) == NULL) {
+        goto fail; }
+#if defined(MADV_SEQUENTIAL)
+    madvise(buff, size, MADV_SEQUENTIAL);
+#endif
+#endif
+
+    dstr_close(fd);
+    *data = buff;
+    *len = size;
+    return DSTR_SUCCESS;
+
+fail:
+    {
+        int err = errno;
+        dstr_close(fd);
+        errno = err;
+    }
+    return DSTR_FAIL;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void unmap_path(const char* data, size_t len)
+{
+    if (len == 0) {
+        return; }
+
+#if defined(_WIN32)
+    free((void*) data);
+#else
+    unmap_terminated(data, len);
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_map_file(const char* path, DSTR_VIEW* view)
+{
+    assert(path != NULL);
+    assert(view != NULL);
+
+    // a view's length is 32 bit
+    //
+    size_t len;
+    int rc = map_path(path, &view->data, &len, UINT32_MAX - 1);
+    view->length = (uint32_t) len;
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_unmap_file(DSTR_VIEW* view)
+{
+    if (!view) {
+        return; }
+
+    unmap_path(view->data, view->length);
+    view->data = "";
+    view->length = 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    W O R K E R   T H R E A D S
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#if defined(DSTR_IO_THREADS)
+
+#define DSTR_IO_MAX_THREADS  64
+
+typedef struct {
+    void  (*fn)(void*);
+    void*   arg;
+} WorkerStart;
+
+#if defined(DSTR_IO_PTHREAD)
+static void* worker_main(void* p)
+{
+    ((WorkerStart*) p)->fn(((WorkerStart*) p)->arg);
+    return NULL;
+}
+#else
+static int worker_main(void* p)
+{
+    ((WorkerStart*) p)->fn(((WorkerStart*) p)->arg);
+    return 0;
+}
+#endif
+/*-------------------------------------------------------------------------------*/
+
+// Run FN(ARG) on up to NTHREADS new threads and on the calling thread,
+// return when all are done. FN pulls its work from ARG, so threads that
+// could not be started only make the others busier
+//
+static void run_workers(void (*fn)(void*), void* arg, size_t nthreads)
+{
+#if defined(DSTR_IO_PTHREAD)
+    pthread_t threads[DSTR_IO_MAX_THREADS];
+#else
+    thrd_t threads[DSTR_IO_MAX_THREADS];
+#endif
+    WorkerStart start = { fn, arg };
+
+    if (nthreads > DSTR_IO_MAX_THREADS) {
+        nthreads = DSTR_IO_MAX_THREADS; }
+
+    size_t started = 0;
+    for (; started < nthreads; ++started) {
+#if defined(DSTR_IO_PTHREAD)
+        if (pthread_create(&threads[started], NULL, worker_main, &start) != 0) {
+            break; }
+#else
+        if (thrd_create(&threads[started], worker_main, &start) != thrd_success) {
+            break; }
+#endif
+    }
+
+    fn(arg);
+
+    for (size_t t = 0; t < started; ++t) {
+#if defined(DSTR_IO_PTHREAD)
+        pthread_join(threads[t], NULL);
+#else
+        thrd_join(threads[t], NULL);
+#endif
+    }
+}
+/*-------------------------------------------------------------------------------*/
+
+// Number of online processors, at least 1
+//
+static size_t cpu_count(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? (size_t) info.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (size_t) n : 1;
+#else
+    return 1;
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    B A T C H E D   S L U R P I N G
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// Append bytes read to OUT, rejecting NUL bytes like dstr_slurp_stream
+// (text builds only)
+//
+static int slurp_commit(DSTR out, size_t n)
+{
+    if (DSTR_TEXT_ONLY && memchr(DBUF(out) + DLEN(out), '\0', n)) {
+        dstr_clear(out);
+        errno = EINVAL;
+        return DSTR_FAIL; }
+
+    DLEN(out) += (uint32_t) n;
+    DBUF(out)[DLEN(out)] = '\0';
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Read FD to its end into OUT, allocated once from the size fstat reports.
+// Returns 0 or an errno value
+//
+static int slurp_fd(int fd, DSTR out)
+{
+    dstr_stat_t st;
+    size_t hint = 4096;
+
+    if (dstr_fstat(fd, &st) == 0 && (st.st_mode & S_IFMT) == S_IFREG &&
+        st.st_size > 0 && (unsigned long long) st.st_size < UINT32_MAX / 2) {
+        hint = (size_t) st.st_size; }
+
+    dstr_clear(out);
+    if (!dstr_reserve(out, hint)) {
+        return ENOMEM; }
+
+    for (;;) {
+        size_t room = DCAP(out) - DLEN(out) - 1;
+        if (room == 0) {
+            // full: probe for end of file before growing
+            //
+            char c;
+            long n = (long) dstr_read(fd, &c, 1);
+            if (n < 0 && errno == EINTR) {
+                continue; }
+            if (n == 0) {
+                return 0; }
+            if (n < 0) {
+                int err = errno;
+                dstr_clear(out);
+                return err; }
+            if (!dstr_reserve(out, 2 * (size_t) DLEN(out))) {
+                dstr_clear(out);
+                return ENOMEM; }
+            DBUF(out)[DLEN(out)] = c;
+            if (!slurp_commit(out, 1)) {
+                return EINVAL; }
+            continue; }
+
+        if (room > DSTR_READ_CHUNK) {
+            room = DSTR_READ_CHUNK; }
+
+        long n = (long) dstr_read(fd, DBUF(out) + DLEN(out), room);
+        if (n < 0 && errno == EINTR) {
+            continue; }
+        if (n < 0) {
+            int err = errno;
+            dstr_clear(out);
+            return err; }
+        if (n == 0) {
+            return 0; }
+        if (!slurp_commit(out, (size_t) n)) {
+            return EINVAL; } }
+}
+/*-------------------------------------------------------------------------------*/
+
+static int slurp_path(const char* path, DSTR out)
+{
+    int fd = dstr_open_read(path);
+    if (fd < 0) {
+        dstr_clear(out);
+        return errno; }
+
+    int err = slurp_fd(fd, out);
+    dstr_close(fd);
+    return err;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct SlurpJob {
+    const char* const* paths;
+    DSTR*   out;
+    int*    errors;
+    size_t  n;
+    size_t  next;       // next file for the thread pool
+#if defined(DSTR_IO_THREADS)
+    dstr_mutex_t lock;
+#endif
+} SlurpJob;
+/*-------------------------------------------------------------------------------*/
+
+#if defined(DSTR_HAVE_IO_URING)
+
+// Minimal io_uring: one submission and one completion ring, mapped as
+// described in io_uring_setup(2)
+//
+typedef struct URing {
+    int       fd;
+    unsigned  entries;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void*     sq_ptr;
+    size_t    sq_len;
+    void*     cq_ptr;
+    size_t    cq_len;
+} URing;
+/*-------------------------------------------------------------------------------*/
+
+#define URING_ENTRIES 128U
+
+static void uring_exit(URing* r)
+{
+    if (r->sqes) {
+        munmap(r->sqes, r->entries * sizeof(struct io_uring_sqe)); }
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_len); }
+    if (r->sq_ptr) {
+        munmap(r->sq_ptr, r->sq_len); }
+    close(r->fd);
+}
+/*-------------------------------------------------------------------------------*/
+
+static int uring_init(URing* r)
+{
+    struct io_uring_params p;
+    char* sq;
+    char* cq;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+
+    r->fd = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (r->fd < 0) {
+        return DSTR_FAIL; }
+
+    r->entries = p.sq_entries;
+    r->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_len > r->sq_len) {
+            r->sq_len = r->cq_len; }
+        r->cq_len = r->sq_len; }
+
+    r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        goto fail; }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr; }
+    else {
+        r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            r->cq_ptr = NULL;
+            goto fail; } }
+
+    r->sqes = (struct io_uring_sqe*) mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                          r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail; }
+
+    sq = (char*) r->sq_ptr;
+    cq = (char*) r->cq_ptr;
+    r->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+    r->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return DSTR_SUCCESS;
+
+fail:
+    uring_exit(r);
+    return DSTR_FAIL;
+}
+/*-------------------------------------------------------------------------------*/
+
+static struct io_uring_sqe* uring_sqe(URing* r, unsigned k, uint8_t opcode, uint64_t user_data)
+{
+    unsigned tail = *r->sq_tail + k;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = user_data;
+    r->sq_array[index] = index;
+    return sqe;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef void (*URingOnCqe)(void* ctx, uint64_t user_data, int res);
+
+// Pass the completions posted so far to ON_CQE, returns how many
+//
+static unsigned uring_reap(URing* r, URingOnCqe on_cqe, void* ctx)
+{
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned n = tail - head;
+
+    for (; head != tail; ++head) {
+        struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+        on_cqe(ctx, cqe->user_data, cqe->res); }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Publish COUNT prepared entries, wait for all of them and pass each
+// completion to ON_CQE. COUNT is at most the ring size. On failure the
+// entries already submitted have completed too: they may write into
+// buffers the caller reuses
+//
+static int uring_run(URing* r, unsigned count, URingOnCqe on_cqe, void* ctx)
+{
+    if (count == 0) {
+        return DSTR_SUCCESS; }
+
+    __atomic_store_n(r->sq_tail, *r->sq_tail + count, __ATOMIC_RELEASE);
+
+    unsigned submitted = 0;
+    unsigned completed = 0;
+    while (completed < count) {
+        unsigned to_submit = count - submitted;
+        long rc = syscall(__NR_io_uring_enter, r->fd, to_submit, 1U,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue; }
+
+            // completions are posted without io_uring_enter, a yield
+            // lets pending task work run
+            //
+            while ((completed += uring_reap(r, on_cqe, ctx)) < submitted) {
+                sched_yield(); }
+            return DSTR_FAIL; }
+
+        submitted += (unsigned) rc;
+        completed += uring_reap(r, on_cqe, ctx); }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct URingFile {
+    int          fd;
+    int          result;    // 0 done, else needs the synchronous path
+    struct statx stx;
+} URingFile;
+/*-------------------------------------------------------------------------------*/
+
+static void on_open(void* ctx, uint64_t i, int res)
+{
+    URingFile* f = (URingFile*) ctx + i;
+    f->fd = res;
+    f->result = (res < 0) ? -1 : 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void on_statx(void* ctx, uint64_t i, int res)
+{
+    URingFile* f = (URingFile*) ctx + i;
+    if (res < 0 || !S_ISREG(f->stx.stx_mode) || f->stx.stx_size == 0 ||
+        f->stx.stx_size >= UINT32_MAX / 2) {
+        f->result = -1; }
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct URingRead {
+    URingFile* files;
+    DSTR*      out;
+} URingRead;
+/*-------------------------------------------------------------------------------*/
+
+static void on_read(void* ctx, uint64_t i, int res)
+{
+    URingRead* rd = (URingRead*) ctx;
+    URingFile* f = &rd->files[i];
+
+    // short reads (a file that shrank or grew) are redone synchronously
+    //
+    if (res < 0 || (uint64_t) res != f->stx.stx_size || !slurp_commit(rd->out[i], (size_t) res)) {
+        dstr_clear(rd->out[i]);
+        f->result = -1; }
+}
+/*-------------------------------------------------------------------------------*/
+
+// The descriptor is gone once the close completes, whatever RES says
+//
+static void on_close(void* ctx, uint64_t i, int res)
+{
+    URingFile* f = (URingFile*) ctx + i;
+    (void) res;
+    f->fd = -1;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Slurp JOB in batches of the ring size: open all, statx all, read all,
+// close all. Any file that does not complete cleanly goes through
+// slurp_path which also reports the proper errno
+//
+static int slurp_uring(SlurpJob* job)
+{
+    URing ring;
+    if (!uring_init(&ring)) {
+        return DSTR_FAIL; }
+
+    URingFile files[URING_ENTRIES];
+    URingRead rd;
+    rd.files = files;
+    unsigned count = 0;
+    unsigned k, m;
+
+    for (size_t base = 0; base < job->n; base += ring.entries) {
+        const char* const* paths = job->paths + base;
+        DSTR* out = job->out + base;
+
+        count = (unsigned)((job->n - base < ring.entries) ? job->n - base : ring.entries);
+        for (k = 0; k < count; ++k) {
+            files[k].fd = -1; }
+
+        for (k = 0; k < count; ++k) {
+            struct io_uring_sqe* sqe = uring_sqe(&ring, k, IORING_OP_OPENAT, k);
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uint64_t)(uintptr_t) paths[k];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC; }
+        if (!uring_run(&ring, count, on_open, files)) {
+            goto fail; }
+
+        for (k = 0, m = 0; k < count; ++k) {
+            if (files[k].result == 0) {
+                struct io_uring_sqe* sqe = uring_sqe(&ring, m++, IORING_OP_STATX, k);
+                sqe->fd = files[k].fd;
+                sqe->addr = (uint64_t)(uintptr_t) "";
+                sqe->statx_flags = AT_EMPTY_PATH;
+                sqe->len = STATX_TYPE | STATX_SIZE;
+                sqe->off = (uint64_t)(uintptr_t) &files[k].stx; } }
+        if (!uring_run(&ring, m, on_statx, files)) {
+            goto fail; }
+
+        for (k = 0, m = 0; k < count; ++k) {
+            if (files[k].result == 0) {
+                dstr_clear(out[k]);
+                if (!dstr_reserve(out[k], (size_t) files[k].stx.stx_size)) {
+                    files[k].result = -1;
+                    continue; }
+                struct io_uring_sqe* sqe = uring_sqe(&ring, m++, IORING_OP_READ, k);
+                sqe->fd = files[k].fd;
+                sqe->addr = (uint64_t)(uintptr_t) DBUF(out[k]);
+                sqe->len = (uint32_t) files[k].stx.stx_size;
+                sqe->off = 0; } }
+        rd.out = out;
+        if (!uring_run(&ring, m, on_read, &rd)) {
+            goto fail; }
+
+        for (k = 0, m = 0; k < count; ++k) {
+            if (files[k].fd >= 0) {
+                struct io_uring_sqe* sqe = uring_sqe(&ring, m++, IORING_OP_CLOSE, k);
+                sqe->fd = files[k].fd; } }
+        if (!uring_run(&ring, m, on_close, files)) {
+            goto fail; }
+
+        for (k = 0; k < count; ++k) {
+            job->errors[base + k] = (files[k].result == 0) ? 0 : slurp_path(paths[k], out[k]); } }
+
+    uring_exit(&ring);
+    return DSTR_SUCCESS;
+
+fail:
+    // the ring itself failed, let the caller redo everything. Nothing is
+    // in flight any more, descriptors not closed by the ring are closed
+    // here
+    //
+    for (k = 0; k < count; ++k) {
+        if (files[k].fd >= 0) {
+            close(files[k].fd); } }
+    uring_exit(&ring);
+    return DSTR_FAIL;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+#if defined(DSTR_IO_THREADS)
+
+#define SLURP_MAX_THREADS  8
+#define SLURP_MIN_PER_THREAD 4
+
+static void slurp_worker(void* arg)
+{
+    SlurpJob* job = (SlurpJob*) arg;
+    for (;;) {
+        dstr_mutex_lock(&job->lock);
+        size_t i = job->next++;
+        dstr_mutex_unlock(&job->lock);
+        if (i >= job->n) {
+            break; }
+        job->errors[i] = slurp_path(job->paths[i], job->out[i]); }
+}
+/*-------------------------------------------------------------------------------*/
+
+// Blocking opens and reads overlap on a few threads, the calling thread
+// works too. Returns DSTR_FAIL if no lock could be created
+//
+static int slurp_threads(SlurpJob* job)
+{
+    if (!dstr_mutex_init(&job->lock)) {
+        return DSTR_FAIL; }
+
+    size_t nthreads = job->n / SLURP_MIN_PER_THREAD;
+    if (nthreads > SLURP_MAX_THREADS) {
+        nthreads = SLURP_MAX_THREADS; }
+
+    run_workers(slurp_worker, job, nthreads);
+    dstr_mutex_destroy(&job->lock);
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+size_t dstr_slurp_many(const char* const paths[], size_t n, DSTR out[], int errors[])
+{
+    assert(n == 0 || (paths != NULL && out != NULL));
+
+    int* errs = errors;
+    if (!errs && n > 0) {
+        if ((errs = (int*) malloc(n * sizeof(int))) == NULL) {
+            errno = ENOMEM;
+            return 0; } }
+
+    SlurpJob job;
+    job.paths = paths;
+    job.out = out;
+    job.errors = errs;
+    job.n = n;
+    job.next = 0;
+
+    int done = 0;
+#if defined(DSTR_HAVE_IO_URING)
+    done = slurp_uring(&job);
+#endif
+#if defined(DSTR_IO_THREADS)
+    if (!done) {
+        done = slurp_threads(&job); }
+#endif
+    if (!done) {
+        for (size_t i = 0; i < n; ++i) {
+            errs[i] = slurp_path(paths[i], out[i]); } }
+
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        count += (errs[i] == 0); }
+
+    if (errs != errors) {
+        free(errs); }
+
+    return count;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    P A R A L L E L   L I N E S
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+typedef struct LineJob {
+    const char* data;
+    size_t  size;
+    size_t  nchunks;
+    size_t  next;       // next chunk to hand out
+    int     stop;
+    int     error;
+    DSTR_LineCallback cb;
+    void*   ctx;
+#if defined(DSTR_IO_THREADS)
+    dstr_mutex_t lock;
+#endif
+} LineJob;
+/*-------------------------------------------------------------------------------*/
+
+// Chunk K holds the lines starting in [K * DSTR_LINE_CHUNK, (K + 1) *
+// DSTR_LINE_CHUNK), it begins after the first '\n' at or after the byte
+// before its nominal start. Depends only on the data, not on the threads
+//
+static size_t line_chunk_begin(const LineJob* job, size_t k)
+{
+    if (k == 0) {
+        return 0; }
+
+    size_t pos = k * (size_t) DSTR_LINE_CHUNK - 1;
+    if (pos >= job->size) {
+        return job->size; }
+
+    const char* nl = (const char*) memchr(job->data + pos, '\n', job->size - pos);
+    return nl ? (size_t) (nl - job->data) + 1 : job->size;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Pass the lines of chunk K to the callback. Returns DSTR_FAIL when the
+// run should stop
+//
+static int line_chunk_run(LineJob* job, size_t k)
+{
+    const char* p = job->data + line_chunk_begin(job, k);
+    const char* last = job->data + line_chunk_begin(job, k + 1);
+
+    while (p < last) {
+        const char* nl = (const char*) memchr(p, '\n', (size_t) (last - p));
+        const char* eol = nl ? nl : last;
+
+        if ((size_t) (eol - p) >= UINT32_MAX) {
+            job->error = EFBIG;
+            return DSTR_FAIL; }
+
+        DSTR_VIEW line;
+        line.data = p;
+        line.length = (uint32_t) (eol - p);
+        if (job->cb(job->ctx, k, &line) != 0) {
+            return DSTR_FAIL; }
+
+        if (!nl) {
+            break; }
+        p = nl + 1; }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+#if defined(DSTR_IO_THREADS)
+static void line_worker(void* arg)
+{
+    LineJob* job = (LineJob*) arg;
+    for (;;) {
+        dstr_mutex_lock(&job->lock);
+        size_t k = job->next++;
+        int stop = job->stop;
+        dstr_mutex_unlock(&job->lock);
+        if (stop || k >= job->nchunks) {
+            break; }
+
+        if (!line_chunk_run(job, k)) {
+            dstr_mutex_lock(&job->lock);
+            job->stop = 1;
+            dstr_mutex_unlock(&job->lock);
+            break; } }
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+int dstr_file_foreach_line_parallel(const char* path, size_t nthreads, DSTR_LineCallback cb, void* ctx)
+{
+    assert(path != NULL);
+    assert(cb != NULL);
+
+    LineJob job;
+    memset(&job, 0, sizeof(job));
+    job.cb = cb;
+    job.ctx = ctx;
+
+    if (!map_path(path, &job.data, &job.size, ~0ULL)) {
+        return DSTR_FAIL; }
+
+    job.nchunks = (job.size + DSTR_LINE_CHUNK - 1) / DSTR_LINE_CHUNK;
+
+    int threaded = 0;
+#if defined(DSTR_IO_THREADS)
+    if (nthreads == 0) {
+        nthreads = cpu_count(); }
+    if (nthreads > job.nchunks) {
+        nthreads = job.nchunks; }
+
+    if (nthreads > 1 && dstr_mutex_init(&job.lock)) {
+        run_workers(line_worker, &job, nthreads - 1);
+        dstr_mutex_destroy(&job.lock);
+        threaded = 1; }
+#else
+    (void) nthreads;
+#endif
+
+    if (!threaded) {
+        for (size_t k = 0; k < job.nchunks; ++k) {
+            if (!line_chunk_run(&job, k)) {
+                break; } } }
+
+    unmap_path(job.data, job.size);
+
+    if (job.error) {
+        errno = job.error;
+        return DSTR_FAIL; }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    V E C T O R E D   O U T P U T
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// Entries per writev(2) call, never more than the system's IOV_MAX
+//
+#if defined(IOV_MAX) && (IOV_MAX < 1024)
+#define DSTR_IOV_BATCH  IOV_MAX
+#else
+#define DSTR_IOV_BATCH  1024
+#endif
+
+// Copies are packed into a block this size. Pieces up to DSTR_WRITER_SMALL
+// bytes are always copied, the kernel's cost per iovec entry is higher
+// than a short memcpy
+//
+#define DSTR_WRITER_BLOCK  (64U * 1024U)
+#define DSTR_WRITER_SMALL  256U
+
+#if defined(_WIN32)
+typedef struct {
+    void*  iov_base;
+    size_t iov_len;
+} dstr_iovec;
+#else
+typedef struct iovec dstr_iovec;
+#endif
+
+static char g_newline[] = "\n";
+/*-------------------------------------------------------------------------------*/
+
+// Write all CNT entries of IOV, retrying on EINTR and resuming after
+// short writes. IOV is consumed (advanced in place)
+//
+static int write_iov(int fd, dstr_iovec* iov, size_t cnt)
+{
+    for (;;) {
+        while (cnt > 0 && iov->iov_len == 0) {
+            ++iov;
+            --cnt; }
+
+        if (cnt == 0) {
+            return DSTR_SUCCESS; }
+
+#if defined(_WIN32)
+        size_t n = (iov->iov_len > DSTR_READ_CHUNK) ? DSTR_READ_CHUNK : iov->iov_len;
+        long rc = (long) dstr_write(fd, iov->iov_base, n);
+#else
+        long rc = (long) writev(fd, iov, (int) cnt);
+#endif
+        if (rc < 0 && errno == EINTR) {
+            continue; }
+        if (rc <= 0) {
+            if (rc == 0) {
+                errno = EIO; }
+            return DSTR_FAIL; }
+
+        size_t done = (size_t) rc;
+        while (done >= iov->iov_len) {
+            done -= iov->iov_len;
+            ++iov;
+            if (--cnt == 0) {
+                return DSTR_SUCCESS; } }
+
+        iov->iov_base = (char*) iov->iov_base + done;
+        iov->iov_len -= done; }
+}
+/*-------------------------------------------------------------------------------*/
+
+struct DSTR_Writer {
+    int     fd;
+    int     owns_fd;
+    int     flags;
+    int     error;
+
+    // copies live in block[0, used), pending output in iov[0, niov)
+    //
+    char*   block;
+    size_t  used;
+    size_t  niov;
+    dstr_iovec iov[DSTR_IOV_BATCH];
+};
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Writer* dstr_writer_fdopen(int fd, int flags)
+{
+    DSTR_Writer* w = (DSTR_Writer*) calloc(1, sizeof(DSTR_Writer));
+    if (!w) {
+        errno = ENOMEM;
+        return NULL; }
+
+    w->fd = fd;
+    w->flags = flags;
+    return w;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Writer* dstr_writer_open(const char* path, int flags)
+{
+    int fd = dstr_open_write(path);
+    if (fd < 0) {
+        return NULL; }
+
+    DSTR_Writer* w = dstr_writer_fdopen(fd, flags);
+    if (!w) {
+        dstr_close(fd);
+        errno = ENOMEM;
+        return NULL; }
+
+    w->owns_fd = 1;
+    return w;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writer_flush(DSTR_Writer* w)
+{
+    if (w->error) {
+        errno = w->error;
+        return DSTR_FAIL; }
+
+    int rc = write_iov(w->fd, w->iov, w->niov);
+    if (!rc) {
+        w->error = errno; }
+
+    w->niov = 0;
+    w->used = 0;
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writer_close(DSTR_Writer* w)
+{
+    if (!w) {
+        return DSTR_SUCCESS; }
+
+    int rc = dstr_writer_flush(w);
+    int err = errno;
+
+    if (w->owns_fd && dstr_close(w->fd) != 0 && rc) {
+        rc = DSTR_FAIL;
+        err = errno; }
+
+    free(w->block);
+    free(w);
+
+    errno = err;
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writer_error(const DSTR_Writer* w)
+{
+    return w->error;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Append an entry, merged into the previous one when the two are adjacent
+// in memory (consecutive copies, neighbouring views of one buffer)
+//
+static void writer_push(DSTR_Writer* w, const char* data, size_t len)
+{
+    if (w->niov > 0) {
+        dstr_iovec* last = &w->iov[w->niov - 1];
+        if ((const char*) last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return; } }
+
+    w->iov[w->niov].iov_base = (void*) data;
+    w->iov[w->niov].iov_len = len;
+    ++w->niov;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writer_add(DSTR_Writer* w, const char* data, size_t len)
+{
+    if (len <= DSTR_WRITER_SMALL) {
+        return dstr_writer_add_copy(w, data, len); }
+
+    if (w->error) {
+        errno = w->error;
+        return DSTR_FAIL; }
+
+    if (w->niov + 2 > DSTR_IOV_BATCH) {
+        if (!dstr_writer_flush(w)) {
+            return DSTR_FAIL; } }
+
+    if (len > 0) {
+        writer_push(w, data, len); }
+
+    if (w->flags & DSTR_WRITE_NEWLINE) {
+        writer_push(w, g_newline, 1); }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writer_add_copy(DSTR_Writer* w, const char* data, size_t len)
+{
+    if (w->error) {
+        errno = w->error;
+        return DSTR_FAIL; }
+
+    size_t total = len + ((w->flags & DSTR_WRITE_NEWLINE) ? 1 : 0);
+
+    // large pieces are not worth copying, send them right away
+    //
+    if (len > DSTR_WRITER_BLOCK / 2) {
+        if (!dstr_writer_add(w, data, len)) {
+            return DSTR_FAIL; }
+        return dstr_writer_flush(w); }
+
+    if (!w->block) {
+        if ((w->block = (char*) malloc(DSTR_WRITER_BLOCK)) == NULL) {
+            errno = ENOMEM;
+            return DSTR_FAIL; } }
+
+    if (w->used + total > DSTR_WRITER_BLOCK || w->niov + 1 > DSTR_IOV_BATCH) {
+        if (!dstr_writer_flush(w)) {
+            return DSTR_FAIL; } }
+
+    char* dest = w->block + w->used;
+    memcpy(dest, data, len);
+    if (total > len) {
+        dest[len] = '\n'; }
+
+    w->used += total;
+    if (total > 0) {
+        writer_push(w, dest, total); }
+
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_writev(int fd, const CDSTR strs[], size_t n, int flags)
+{
+    assert(n == 0 || strs != NULL);
+
+    DSTR_Writer w;
+    memset(&w, 0, offsetof(DSTR_Writer, iov));
+    w.fd = fd;
+    w.flags = flags;
+
+    int rc = DSTR_SUCCESS;
+    for (size_t i = 0; i < n && rc; ++i) {
+        if (strs[i]) {
+            rc = dstr_writer_add(&w, DBUF(strs[i]), DLEN(strs[i])); }
+        else if (flags & DSTR_WRITE_NEWLINE) {
+            rc = dstr_writer_add(&w, "", 0); } }
+
+    if (rc) {
+        rc = dstr_writer_flush(&w); }
+
+    free(w.block);
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
@@ -11,7 +11,27 @@
  * text.
  */
 #include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdint.h>
+#include <time.h>
+
+#if defined(_WIN32)
+   #include <io.h>
+   #define stream_open(path)        _open((path), _O_RDONLY | _O_BINARY)
+   #define stream_read(fd, buf, n)  _read((fd), (buf), (unsigned)(n))
+   #define stream_close(fd)         _close(fd)
+#else
+   #include <unistd.h>
+   #define stream_open(path)        open((path), O_RDONLY)
+   #define stream_read(fd, buf, n)  read((fd), (buf), (n))
+   #define stream_close(fd)         close(fd)
+#endif
+
+// largest single read(2) request, fits in Windows' unsigned and int
+//
+#define STREAM_READ_MAX  (1U << 30)
 
 // Regular expression cache uses thread local storage using ISO-C11 tss* functions
 // or pthread equivalent if not available
@@ -32,6 +52,24 @@
    #error "Needs C11 threads.h or C++17 with threads.h support"
 #endif
 
+// Reference counts of compiled patterns, shared by threads when the
+// process wide cache is on
+//
+#if defined(_MSC_VER) && !defined(__clang__)
+   #include <intrin.h>
+   typedef volatile long re_refcount_t;
+   #define refs_inc(p)      _InterlockedIncrement(p)
+   #define refs_dec(p)      _InterlockedDecrement(p)
+   #define flag_load(p)     _InterlockedOr((p), 0)
+   #define flag_store(p, v) _InterlockedExchange((p), (v))
+#else
+   typedef long re_refcount_t;
+   #define refs_inc(p)      __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+   #define refs_dec(p)      __atomic_sub_fetch((p), 1, __ATOMIC_ACQ_REL)
+   #define flag_load(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+   #define flag_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
 #define PCRE2_CODE_UNIT_WIDTH 8
 #include <pcre2.h>
 
@@ -111,7 +149,10 @@ enum {
     REGEX_GLOBAL = 0x10000000,
 
     // treat dollar in replacement string as ordinary character [subst]
-    REGEX_NO_VARS = 0x20000000
+    REGEX_NO_VARS = 0x20000000,
+
+    // do not JIT compile, always run the interpreter [ctor]
+    REGEX_NO_JIT = 0x40000000
 };
 /*-------------------------------------------------------------------------------*/
 
@@ -234,7 +275,10 @@ static int parse_regex_options(const char* str)
         case 'F' : opts |= REGEX_FIRSTLINE;       break;
         case 'A' : opts |= REGEX_ANCHORED;        break;
         case 't' : opts |= REGEX_DUPNAMES;        break;
+        case 'u' : opts |= REGEX_UTF8;            break;
+        case 'V' : opts |= REGEX_UTF8 | REGEX_NO_UTF8_CHECK; break;
         case '$' : opts |= REGEX_NO_VARS;         break;
+        case 'J' : opts |= REGEX_NO_JIT;          break;
         case '\n': opts |= REGEX_NEWLINE_LF;      break;
         case '\r': opts |= REGEX_NEWLINE_CR;      break;
         default: break; } }
@@ -248,23 +292,36 @@ typedef struct GroupInfo {
 } GroupInfo;
 /*-------------------------------------------------------------------------------*/
 
-typedef struct Compiled_Regex {
+#define DSTR_LITERAL_MAX 64
+
+// The public DSTR_Regex handle is a Compiled_Regex outside the cache
+//
+typedef struct DSTR_Regex {
     // compiled pcre regex
     pcre2_code* _pRE;
-    pcre2_match_context* _mCtx;
 
     // array of name groups
     GroupInfo*  p_groups;
     size_t      n_groups;
 
-    // for caching and LRU
-    uint64_t    tick_count;
+    // ovector pairs needed by a match (capture count + 1)
+    uint32_t    n_pairs;
+
+    // cache key and the number of cache entries holding the pattern
     DSTR        pattern;
     int         options;
+    re_refcount_t refs;
+
+    // literal every match contains, lit_prefix if matches start with it
+    // (see required_literal)
+    uint32_t    lit_len;
+    uint32_t    lit_rare;      // its least common byte
+    bool        lit_prefix;
+    char        literal[DSTR_LITERAL_MAX];
 } Compiled_Regex;
 /*-------------------------------------------------------------------------------*/
 
-static const char* find_group_name(Compiled_Regex* cr, int n)
+static const char* find_group_name(const Compiled_Regex* cr, int n)
 {
     if (!cr->p_groups)
         return NULL;
@@ -303,6 +360,413 @@ static GroupInfo* make_group_info(pcre2_code* _pRE, unsigned int* p_name_count)
 }
 /*-------------------------------------------------------------------------------*/
 
+static void jit_compile(pcre2_code* _pRE, int options)
+{
+    if (options & REGEX_NO_JIT) {
+        return; }
+
+    // Fails with PCRE2_ERROR_JIT_BADOPTION when the library was built
+    // without JIT or the platform lacks it: the interpreter is used then
+    //
+    pcre2_jit_compile(_pRE, PCRE2_JIT_COMPLETE);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Compiled patterns are read only while matching, so one pattern (e.g.
+// a DSTR_Regex handle) may be used by several threads. The mutable parts
+// are per thread: a match context with the resource limits and a JIT
+// stack (without it PCRE2 uses 32K of machine stack, which deep patterns
+// exceed). Both are released when the thread exits
+//
+#define DSTR_JIT_STACK_START  (32 * 1024)
+#define DSTR_JIT_STACK_MAX    (1024 * 1024)
+
+static _Thread_local pcre2_jit_stack* jit_stack = NULL;
+static _Thread_local pcre2_match_context* match_ctx = NULL;
+
+static inline void registr_automatic_exit_cleanup(void);
+/*-------------------------------------------------------------------------------*/
+
+static pcre2_match_context* create_match_context(void)
+{
+    registr_automatic_exit_cleanup();
+
+    if ((match_ctx = pcre2_match_context_create(NULL)) == NULL) {
+        return NULL; }
+
+    // set limits to resources against malicious Regexp
+    //
+    pcre2_set_match_limit(match_ctx, 1000000);
+    pcre2_set_depth_limit(match_ctx, 10000);
+
+    jit_stack = pcre2_jit_stack_create(DSTR_JIT_STACK_START,
+                                       DSTR_JIT_STACK_MAX, NULL);
+    if (jit_stack) {
+        pcre2_jit_stack_assign(match_ctx, NULL, jit_stack); }
+
+    return match_ctx;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline pcre2_match_context* thread_match_context(void)
+{
+    return match_ctx ? match_ctx : create_match_context();
+}
+/*-------------------------------------------------------------------------------*/
+
+// Matching borrows a per-thread match data block, grown to the largest
+// capture count seen, instead of allocating one per call. The block is
+// detached while in use, so a nested match on the same thread gets (and
+// may keep) a block of its own
+//
+#define DSTR_MDATA_MIN_PAIRS 16
+
+static _Thread_local pcre2_match_data* spare_mdata = NULL;
+/*-------------------------------------------------------------------------------*/
+
+static pcre2_match_data* mdata_acquire(const Compiled_Regex* cr)
+{
+    pcre2_match_data* mdata = spare_mdata;
+    if (mdata && pcre2_get_ovector_count(mdata) >= cr->n_pairs) {
+        spare_mdata = NULL;
+        return mdata; }
+
+    uint32_t pairs = cr->n_pairs;
+    if (pairs < DSTR_MDATA_MIN_PAIRS) {
+        pairs = DSTR_MDATA_MIN_PAIRS; }
+
+    if ((mdata = pcre2_match_data_create(pairs, NULL)) == NULL) {
+        dstr_out_of_memory();
+        return NULL; }
+
+    return mdata;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void mdata_release(pcre2_match_data* mdata)
+{
+    if (!spare_mdata) {
+        spare_mdata = mdata; }
+    else if (pcre2_get_ovector_count(mdata) > pcre2_get_ovector_count(spare_mdata)) {
+        pcre2_match_data_free(spare_mdata);
+        spare_mdata = mdata; }
+    else {
+        pcre2_match_data_free(mdata); }
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    R E Q U I R E D   L I T E R A L S
+ *
+ *    A run of literal bytes every match of a pattern contains, e.g.
+ *    "user_id=" in \buser_id=(\d+), preferably long and with a rare byte
+ *    to search for. Only the top level sequence is looked at: groups,
+ *    classes, escapes like \d and optional items end a run. Anything
+ *    unusual (alternation at the top, option settings, case folding,
+ *    extended syntax, escapes with arguments) gives no literal, which is
+ *    always safe.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+// Length of the quantifier at P, 0 if none; *OPTIONAL tells whether it
+// allows zero repetitions
+//
+static size_t quantifier_at(const char* p, bool* optional)
+{
+    const char* q = p;
+
+    if (*q == '?' || *q == '*' || *q == '+') {
+        *optional = (*q != '+');
+        ++q; }
+    else if (*q == '{') {
+        const char* d = ++q;
+        while (*q >= '0' && *q <= '9') ++q;
+        bool min_zero = (q == d) || (q == d + 1 && *d == '0');
+        if (*q == ',') {
+            ++q;
+            while (*q >= '0' && *q <= '9') ++q; }
+        else if (q == d) {
+            return 0; }
+        if (*q != '}') {
+            return 0; }
+        ++q;
+        *optional = min_zero; }
+    else {
+        return 0; }
+
+    if (*q == '?' || *q == '+') {
+        ++q; }
+
+    return (size_t) (q - p);
+}
+/*-------------------------------------------------------------------------------*/
+
+// End of the class or group starting at P, NULL if it does not close
+//
+static const char* skip_class(const char* p)
+{
+    ++p;
+    if (*p == '^') ++p;
+    if (*p == ']') ++p;
+
+    for (; *p && *p != ']'; ++p) {
+        if (p[0] == '\\' && p[1]) {
+            ++p; }
+        else if (p[0] == '[' && p[1] == ':') {
+            const char* e = strstr(p + 2, ":]");
+            if (!e) return NULL;
+            p = e + 1; } }
+
+    return *p ? p + 1 : NULL;
+}
+
+static const char* skip_group(const char* p)
+{
+    int depth = 0;
+    while (*p) {
+        if (p[0] == '\\') {
+            if (p[1] == 'Q' || !p[1]) return NULL;
+            p += 2; }
+        else if (p[0] == '[') {
+            if ((p = skip_class(p)) == NULL) return NULL; }
+        else if (p[0] == '(') {
+            ++depth; ++p; }
+        else if (p[0] == ')') {
+            ++p;
+            if (--depth == 0) return p; }
+        else {
+            ++p; } }
+
+    return NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Groups that cannot change how the rest of the pattern is read
+//
+static bool plain_group(const char* p)
+{
+    if (p[1] != '?') {
+        return p[1] != '*'; }
+
+    switch (p[2]) {
+    case ':': case '=': case '!': case '>': case '|': case '#':
+        return true;
+    case '<':
+        return true;       // lookbehind or named group
+    case 'P':
+        return p[3] == '<';
+    default:
+        return false; }
+}
+/*-------------------------------------------------------------------------------*/
+
+// How common a byte is in text and logs, higher is more common. The
+// literal is searched for by its least common byte
+//
+static int byte_rank(unsigned char c)
+{
+    static const char by_frequency[] = "etaoinsrhldcumfpgwybvkxjqz";
+
+    if (c == ' ') {
+        return 255; }
+    if (c >= 'a' && c <= 'z') {
+        return 240 - 4 * (int) (strchr(by_frequency, c) - by_frequency); }
+    if (c >= '0' && c <= '9') {
+        return 200; }
+    if (strchr(".:/-=,\t\n", c) && c) {
+        return 170; }
+    if (c >= 'A' && c <= 'Z') {
+        return 100; }
+    return (c >= 0x80) ? 60 : 120;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Index of the least common byte of LIT
+//
+static size_t rarest_byte(const char* lit, size_t n)
+{
+    size_t best = 0;
+    for (size_t i = 1; i < n; ++i) {
+        if (byte_rank((unsigned char) lit[i]) < byte_rank((unsigned char) lit[best])) {
+            best = i; } }
+    return best;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Of two runs the one with three bytes or more (regex sets index those),
+// then the one with the rarer byte, then the longer
+//
+static bool better_literal(const char* a, size_t na, const char* b, size_t nb)
+{
+    if (nb == 0) {
+        return na > 0; }
+    if ((na >= 3) != (nb >= 3)) {
+        return na >= 3; }
+
+    int ra = byte_rank((unsigned char) a[rarest_byte(a, na)]);
+    int rb = byte_rank((unsigned char) b[rarest_byte(b, nb)]);
+    return ra != rb ? ra < rb : na > nb;
+}
+/*-------------------------------------------------------------------------------*/
+
+static bool lookaround(const char* p)
+{
+    return p[1] == '?' &&
+        (p[2] == '=' || p[2] == '!' ||
+         (p[2] == '<' && (p[3] == '=' || p[3] == '!')));
+}
+/*-------------------------------------------------------------------------------*/
+
+// Stores the literal in BEST (DSTR_LITERAL_MAX bytes) and returns its
+// length. *PREFIX tells whether every match starts with it, i.e. only
+// assertions come before it
+//
+static size_t required_literal(const char* p, int options, char* best, bool* prefix)
+{
+    *prefix = false;
+    if (options & (REGEX_CASELESS | REGEX_EXTENDED)) {
+        return 0; }
+
+    char run[DSTR_LITERAL_MAX];
+    size_t n_run = 0;
+    size_t n_best = 0;
+    bool consumed = false;         // by the items before the run
+    bool run_prefix = true;
+
+    for (;;) {
+        int lit = -1;              // literal byte at P, -1 for other items
+        bool zero_width = false;
+        const char* next = p + 1;
+
+        switch (*p) {
+        case '\0':
+            next = NULL;
+            break;
+        case '\\':
+            if (!p[1]) {
+                return 0; }
+            if (!isalnum((unsigned char) p[1])) {
+                lit = (unsigned char) p[1]; }
+            else if (strchr("bBAzZ", p[1])) {
+                zero_width = true; }
+            else if (!strchr("dDwWsShHvV", p[1])) {
+                return 0; }
+            next = p + 2;
+            break;
+        case '^': case '$':
+            zero_width = true;
+            break;
+        case '.':
+            break;
+        case '[':
+            if ((next = skip_class(p)) == NULL) {
+                return 0; }
+            break;
+        case '(':
+            if (!plain_group(p) || (next = skip_group(p)) == NULL) {
+                return 0; }
+            zero_width = lookaround(p);
+            break;
+        case '|': case ')':
+            return 0;
+        case '*': case '+': case '?':
+            break;
+        default:
+            lit = (unsigned char) *p;
+            break; }
+
+        bool optional = false;
+        size_t qlen = next ? quantifier_at(next, &optional) : 0;
+
+        if (lit >= 0 && !optional && n_run < sizeof(run)) {
+            if (n_run == 0) {
+                run_prefix = !consumed; }
+            run[n_run++] = (char) lit; }
+        else if (lit >= 0 && optional && (options & REGEX_UTF8) && (lit & 0xC0) == 0x80) {
+            // an optional multibyte character: none of its bytes count
+            //
+            while (n_run > 0 && ((unsigned char) run[n_run - 1] & 0xC0) == 0x80) {
+                --n_run; }
+            if (n_run > 0 && ((unsigned char) run[n_run - 1] & 0xC0) == 0xC0) {
+                --n_run; } }
+
+        if ((lit < 0 && !zero_width) || qlen > 0 || !next) {
+            if (better_literal(run, n_run, best, n_best)) {
+                memcpy(best, run, n_run);
+                n_best = n_run;
+                *prefix = run_prefix; }
+            n_run = 0; }
+
+        if (!zero_width) {
+            consumed = true; }
+
+        if (!next) {
+            break; }
+        p = next + qlen;
+    }
+
+    return n_best;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Rejects a subject without the required literal of CR from OFFSET on,
+// before PCRE2 is entered. Returns DSTR_NPOS then, else where the search
+// starts: at the literal if matches start with it, else at OFFSET.
+// Partial matching may stop short of the literal and is let through
+//
+static size_t prefilter(const Compiled_Regex* cr, CDSTR subject, size_t offset,
+                        uint32_t match_opts)
+{
+    if (cr->lit_len == 0 || (match_opts & (PCRE2_PARTIAL_SOFT | PCRE2_PARTIAL_HARD))) {
+        return offset; }
+
+    const char* text = dstr_cstr(subject);
+    const size_t len = dstr_length(subject);
+    const char* lit = cr->literal;
+    const size_t n = cr->lit_len;
+    const size_t r = cr->lit_rare;
+
+    if (offset > len) {
+        return offset; }        // PCRE2 reports the bad offset
+    if ((cr->options & REGEX_UTF8) && offset < len && (text[offset] & 0xC0) == 0x80) {
+        return offset; }        // and one inside a character in UTF-8 mode
+    if (len - offset < n) {
+        return DSTR_NPOS; }
+
+    // P runs over the places of the rare byte, the literal starting R
+    // bytes before
+    //
+    const char* p = text + offset + r;
+    const char* last = text + len - n + r;
+    for (; p <= last; ++p) {
+        if ((p = (const char*) memchr(p, lit[r], (size_t) (last - p) + 1)) == NULL) {
+            break; }
+
+        if (memcmp(p - r, lit, n) == 0) {
+            // FIRSTLINE counts from the start offset, so it must stay
+            //
+            bool fixed = (match_opts & PCRE2_ANCHORED) ||
+                         (cr->options & (REGEX_ANCHORED | REGEX_FIRSTLINE));
+            return (cr->lit_prefix && !fixed) ? (size_t) (p - r - text) : offset; } }
+
+    return DSTR_NPOS;
+}
+/*-------------------------------------------------------------------------------*/
+
+static int regex_exec(const Compiled_Regex* cr, CDSTR subject, size_t offset,
+                      uint32_t match_opts, pcre2_match_data* mdata,
+                      pcre2_match_context* mctx)
+{
+    size_t start = prefilter(cr, subject, offset, match_opts);
+    if (start == DSTR_NPOS) {
+        return PCRE2_ERROR_NOMATCH; }
+
+    return pcre2_match(cr->_pRE, dstr_u8ptr(subject), dstr_length(subject),
+                       start, match_opts, mdata, mctx);
+}
+/*-------------------------------------------------------------------------------*/
+
 static
 Compiled_Regex* dstr_compile_regex(const char* pattern, int options, int* err)
 {
@@ -338,7 +802,6 @@ Compiled_Regex* dstr_compile_regex(const char* pattern, int options, int* err)
 
     if (!_pRE) {
         if (err) *err = (REGEX_COMPILE_ERROR_BASE + error_code);
-        dstr_regex_perror(error_code);
         return NULL; }
 
     unsigned int name_count = 0;
@@ -347,31 +810,26 @@ Compiled_Regex* dstr_compile_regex(const char* pattern, int options, int* err)
         pcre2_code_free(_pRE);
         return NULL; }
 
-    pcre2_match_context* mctx = pcre2_match_context_create(NULL);
-    if (!mctx) {
-        pcre2_code_free(_pRE);
-        if (gInfo) free(gInfo);
-        return NULL; }
-
-    // set limits to resources against malicious Regexp
-    //
-    pcre2_set_match_limit(mctx, 1000000);
-    pcre2_set_depth_limit(mctx, 10000);
+    jit_compile(_pRE, options);
 
     Compiled_Regex* result = RE_MALLOC(Compiled_Regex, 1);
     if (!result) {
-        pcre2_match_context_free(mctx);
         if (gInfo) free(gInfo);
         pcre2_code_free(_pRE);
         return NULL; }
 
     result->_pRE = _pRE;
-    result->_mCtx = mctx;
     result->p_groups = gInfo;
     result->n_groups = name_count;
+    result->n_pairs = 1;
+    if (pcre2_pattern_info(_pRE, PCRE2_INFO_CAPTURECOUNT, &result->n_pairs) == 0) {
+        result->n_pairs += 1; }
     result->pattern = dstr_create_sz(pattern);
     result->options = options;
-    result->tick_count = 0;
+    result->refs = 1;
+    result->lit_len = (uint32_t) required_literal(pattern, options, result->literal,
+                                                  &result->lit_prefix);
+    result->lit_rare = (uint32_t) rarest_byte(result->literal, result->lit_len);
     return result;
 }
 /*-------------------------------------------------------------------------------*/
@@ -387,9 +845,6 @@ static void destroy_compiled_regex(Compiled_Regex* cr)
     if (cr->p_groups) {
         free(cr->p_groups); }
 
-    if (cr->_mCtx) {
-        pcre2_match_context_free(cr->_mCtx); }
-
     if (cr->_pRE) {
         pcre2_code_free(cr->_pRE); }
 
@@ -402,7 +857,7 @@ static void destroy_compiled_regex(Compiled_Regex* cr)
 // matching function, therefore we set the DSTR field `name`
 // to NULL.
 //
-static int dstr_regex_match_aux(Compiled_Regex* cr,
+static int dstr_regex_match_aux(const Compiled_Regex* cr,
                                 CDSTR subject, size_t offset,
                                 DSTR_Regex_Match* mtch, int options)
 {
@@ -413,27 +868,19 @@ static int dstr_regex_match_aux(Compiled_Regex* cr,
     if (offset > dstr_length(subject)) {
         return 0; }
 
-    pcre2_match_data* mdata =
-        pcre2_match_data_create_from_pattern(cr->_pRE, NULL);
-
+    pcre2_match_data* mdata = mdata_acquire(cr);
     if (!mdata) {
-        dstr_out_of_memory();
         return PCRE2_ERROR_NOMEMORY; }
 
-    int rc = pcre2_match(cr->_pRE,
-                         dstr_u8ptr(subject),
-                         dstr_length(subject),
-                         offset,
-                         match_options(options),
-                         mdata,
-                         NULL);
+    int rc = regex_exec(cr, subject, offset, match_options(options),
+                        mdata, thread_match_context());
 
     if (rc == PCRE2_ERROR_NOMATCH) {
-        pcre2_match_data_free(mdata);
+        mdata_release(mdata);
         return 0; }
 
     if (rc <= 0) {
-        pcre2_match_data_free(mdata);
+        mdata_release(mdata);
         return rc; }
 
     // Success
@@ -444,12 +891,12 @@ static int dstr_regex_match_aux(Compiled_Regex* cr,
         mtch->offset = ovec[0];
         mtch->length = ovec[1] - mtch->offset; }
 
-    pcre2_match_data_free(mdata);
+    mdata_release(mdata);
     return rc;
 }
 /*-------------------------------------------------------------------------------*/
 
-static bool dstr_regex_exact_aux(Compiled_Regex* cr,
+static bool dstr_regex_exact_aux(const Compiled_Regex* cr,
                                  CDSTR subject, size_t offset,
                                  int options)
 {
@@ -462,7 +909,7 @@ static bool dstr_regex_exact_aux(Compiled_Regex* cr,
 /*-------------------------------------------------------------------------------*/
 
 static int
-dstr_regex_match_groups_aux(Compiled_Regex* cr,
+dstr_regex_match_groups_aux(const Compiled_Regex* cr,
                             CDSTR subject, size_t offset,
                             DSTR_Match_Vector* vec,
                             int options)
@@ -470,23 +917,15 @@ dstr_regex_match_groups_aux(Compiled_Regex* cr,
     if (offset > dstr_length(subject)) {
         return 0; }
 
-    pcre2_match_data* mdata =
-        pcre2_match_data_create_from_pattern(cr->_pRE, NULL);
-
+    pcre2_match_data* mdata = mdata_acquire(cr);
     if (!mdata) {
-        dstr_out_of_memory();
         return PCRE2_ERROR_NOMEMORY; }
 
-    int rc = pcre2_match(cr->_pRE,
-                         dstr_u8ptr(subject),
-                         dstr_length(subject),
-                         offset,
-                         match_options(options),
-                         mdata,
-                         NULL);
+    int rc = regex_exec(cr, subject, offset, match_options(options),
+                        mdata, thread_match_context());
 
     if (rc <= 0 || vec == NULL) {
-        pcre2_match_data_free(mdata);
+        mdata_release(mdata);
         if (rc == PCRE2_ERROR_NOMATCH) {
             return 0; }
         else {
@@ -497,7 +936,7 @@ dstr_regex_match_groups_aux(Compiled_Regex* cr,
     // Allocate enough space in the match vector
     //
     if (!dstr_regex_mvector_alloc(vec, (size_t) rc)) {
-        pcre2_match_data_free(mdata);
+        mdata_release(mdata);
         return rc; }
 
     for (int i = 0; i < rc; ++i) {
@@ -515,95 +954,310 @@ dstr_regex_match_groups_aux(Compiled_Regex* cr,
         if (name) {
             pM->name = dstrnew(name); } }
 
-    pcre2_match_data_free(mdata);
+    mdata_release(mdata);
     return rc;
 }
 /*-------------------------------------------------------------------------------*/
 
-static int dstr_regex_subst_aux(Compiled_Regex* cr,
-                                DSTR subject, size_t offset,
-                                const char* replacement, int options)
+// Where to search after an empty match at POS: the next character,
+// not the next byte in UTF-8 mode
+//
+static size_t skip_char(const Compiled_Regex* cr, CDSTR subject, size_t pos)
 {
-    if (offset > dstr_length(subject))
-        return 0;
+    const char* text = dstr_cstr(subject);
+    size_t len = dstr_length(subject);
 
-    // we try substitution on a stack buffer first
-    //
-    uint8_t stbuff[512];
-    uint8_t* outbuf = stbuff;
-    PCRE2_SIZE outlen = sizeof(stbuff);
-    uint32_t pcre_opts = PCRE2_SUBSTITUTE_EXTENDED;
+    ++pos;
+    if (cr->options & REGEX_UTF8) {
+        while (pos < len && (text[pos] & 0xC0) == 0x80) {
+            ++pos; } }
 
-    if (options & REGEX_GLOBAL) {
-        pcre_opts |= PCRE2_SUBSTITUTE_GLOBAL; }
+    return pos;
+}
+/*-------------------------------------------------------------------------------*/
 
-    if (options & REGEX_NO_VARS) {
-        pcre_opts |= PCRE2_SUBSTITUTE_LITERAL; }
+// Substitution. Matches are walked one at a time and the result built in
+// a DSTR reserved for about the subject's length: the text between matches
+// is appended as is, and STEP appends the replacement of each match. The
+// result is swapped into the subject at the end, which is left untouched
+// without a match or on error. As in pcre2_substitute, after an empty
+// match a non empty one is tried at the same place before moving on.
+//
+typedef int (*Subst_Step)(void* ctx, DSTR out, CDSTR subject,
+                          pcre2_match_data* mdata, size_t n_pairs);
 
-    // First call - try with local stack buffer
-    //
-    int rc = pcre2_substitute(cr->_pRE,
-                              dstr_u8ptr(subject),
-                              dstr_length(subject),
-                              offset,
-                              pcre_opts | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH,
-                              NULL, NULL, (PCRE2_SPTR)(replacement),
-                              strlen(replacement), outbuf, &outlen);
+static int subst_engine(const Compiled_Regex* cr, DSTR subject, size_t offset,
+                        int options, Subst_Step step, void* ctx)
+{
+    const size_t len = dstr_length(subject);
+    if (offset > len) {
+        return 0; }
 
-    if (rc == 0) {
-        // none replaced
-        return rc; }
-    else if (rc > 0) {
-        dstr_assign_bl(subject, (char*) outbuf, outlen);
+    pcre2_match_data* mdata = mdata_acquire(cr);
+    if (!mdata) {
+        return PCRE2_ERROR_NOMEMORY; }
+
+    DSTR_TYPE out;
+    dstr_init_data(&out);
+
+    const char* text = dstr_cstr(subject);
+    const int mopts = match_options(options);
+    uint32_t retry = 0;     // anchored non empty retry after an empty match
+    size_t start = offset;
+    size_t last = 0;        // end of the subject part already in OUT
+    int count = 0;
+    int rc;
+
+    for (;;) {
+        rc = regex_exec(cr, subject, start, mopts | retry, mdata, thread_match_context());
+
+        if (rc == PCRE2_ERROR_NOMATCH && retry) {
+            retry = 0;
+            if (start >= len) {
+                break; }
+            start = skip_char(cr, subject, start);
+            continue; }
+
+        if (rc < 0) {
+            break; }
+
+        const PCRE2_SIZE* ovec = pcre2_get_ovector_pointer(mdata);
+        if (ovec[0] < last || ovec[1] < ovec[0]) {
+            rc = PCRE2_ERROR_BADSUBSPATTERN;
+            break; }
+
+        if (count == 0 && !dstr_reserve(&out, len + len / 8)) {
+            rc = PCRE2_ERROR_NOMEMORY;
+            break; }
+
+        if (!dstr_append_bl(&out, text + last, ovec[0] - last)) {
+            rc = PCRE2_ERROR_NOMEMORY;
+            break; }
+
+        if ((rc = step(ctx, &out, subject, mdata, cr->n_pairs)) < 0) {
+            break; }
+
+        last = ovec[1];
+        ++count;
+
+        if (!(options & REGEX_GLOBAL)) {
+            break; }
+
+        start = ovec[1];
+        retry = (ovec[0] == ovec[1]) ? (PCRE2_NOTEMPTY_ATSTART | PCRE2_ANCHORED) : 0;
+    }
+
+    mdata_release(mdata);
+
+    if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
+        dstr_clean_data(&out);
         return rc; }
-    else if (rc == PCRE2_ERROR_NOMEMORY) {
-        if (outlen == PCRE2_UNSET || outlen > UINT32_MAX) {
+
+    if (count > 0) {
+        if (!dstr_append_bl(&out, text + last, len - last)) {
+            dstr_clean_data(&out);
             return PCRE2_ERROR_NOMEMORY; }
+        dstr_swap(subject, &out); }
+
+    dstr_clean_data(&out);
+    return count;
+}
+/*-------------------------------------------------------------------------------*/
 
-        // increase memory to needed and retry
+// Replacement by a PCRE2 template, expanded by pcre2_substitute for the
+// match at hand right into the spare capacity of OUT
+//
+typedef struct Template_Step {
+    const Compiled_Regex* cr;
+    PCRE2_SPTR            text;
+    size_t                len;
+    uint32_t              opts;
+} Template_Step;
+
+#if defined(PCRE2_SUBSTITUTE_REPLACEMENT_ONLY)
+static int template_step(void* ctx, DSTR out, CDSTR subject,
+                         pcre2_match_data* mdata, size_t n_pairs)
+{
+    const Template_Step* t = (const Template_Step*) ctx;
+    (void) n_pairs;
+
+    for (;;) {
+        PCRE2_SIZE room = out->capacity - out->length;
+        int rc = pcre2_substitute(t->cr->_pRE,
+                                  dstr_u8ptr(subject),
+                                  dstr_length(subject), 0,
+                                  t->opts,
+                                  mdata, thread_match_context(),
+                                  t->text, t->len,
+                                  (PCRE2_UCHAR*) out->data + out->length,
+                                  &room);
+        if (rc >= 0) {
+            out->length += (uint32_t) room;
+            return rc; }
+
+        // a failed substitute may have written past the end of OUT
         //
-        uint8_t* buffer = RE_MALLOC(uint8_t, outlen);
-        if (!buffer) return rc;
-        rc = pcre2_substitute(cr->_pRE,
-                              dstr_u8ptr(subject),
-                              dstr_length(subject),
-                              offset, pcre_opts, NULL, NULL,
-                              (PCRE2_SPTR)(replacement),
-                              strlen(replacement),
-                              buffer,
-                              &outlen);
+        out->data[out->length] = '\0';
+
+        if (rc != PCRE2_ERROR_NOMEMORY || room == PCRE2_UNSET) {
+            return rc; }
+
+        // PCRE2_SUBSTITUTE_OVERFLOW_LENGTH: ROOM is now what it needs,
+        // trailing zero included
+        //
+        if (!dstr_reserve(out, out->length + room)) {
+            return PCRE2_ERROR_NOMEMORY; } }
+}
+#endif
+/*-------------------------------------------------------------------------------*/
+
+static int literal_step(void* ctx, DSTR out, CDSTR subject,
+                        pcre2_match_data* mdata, size_t n_pairs)
+{
+    const Template_Step* t = (const Template_Step*) ctx;
+    (void) subject; (void) mdata; (void) n_pairs;
+
+    return dstr_append_bl(out, (const char*) t->text, t->len) ? 0 : PCRE2_ERROR_NOMEMORY;
+}
+/*-------------------------------------------------------------------------------*/
 
-        if (rc > 0) {
-            dstr_assign_bl(subject, (char*)buffer, outlen); }
+// Replacement by a user callback
+//
+typedef struct Callback_Step {
+    DSTR_Regex_Replace fn;
+    void*              ctx;
+} Callback_Step;
+
+static int callback_step(void* ctx, DSTR out, CDSTR subject,
+                         pcre2_match_data* mdata, size_t n_pairs)
+{
+    const Callback_Step* c = (const Callback_Step*) ctx;
+    const size_t* groups = pcre2_get_ovector_pointer(mdata);
+
+    return c->fn(c->ctx, out, subject, groups, n_pairs) ? 0 : PCRE2_ERROR_CALLOUT;
+}
+/*-------------------------------------------------------------------------------*/
+
+static int dstr_regex_subst_aux(const Compiled_Regex* cr,
+                                DSTR subject, size_t offset,
+                                const char* replacement, int options)
+{
+    Template_Step t;
+    t.cr = cr;
+    t.text = (PCRE2_SPTR) replacement;
+    t.len = strlen(replacement);
+    t.opts = PCRE2_SUBSTITUTE_EXTENDED | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+
+    if (options & REGEX_NO_VARS) {
+        return subst_engine(cr, subject, offset, options, literal_step, &t); }
+
+#if defined(PCRE2_SUBSTITUTE_REPLACEMENT_ONLY)
+    t.opts |= PCRE2_SUBSTITUTE_MATCHED | PCRE2_SUBSTITUTE_REPLACEMENT_ONLY;
+    return subst_engine(cr, subject, offset, options, template_step, &t);
+#else
+    // PCRE2 before 10.38 cannot expand a single replacement, let it do
+    // the whole substitution: a stack buffer first, then the exact size
+    //
+    pcre2_match_data* mdata = mdata_acquire(cr);
+    if (!mdata) {
+        return PCRE2_ERROR_NOMEMORY; }
 
-        free(buffer);  }
+    uint8_t stbuff[512];
+    PCRE2_SIZE outlen = sizeof(stbuff);
+    if (options & REGEX_GLOBAL) {
+        t.opts |= PCRE2_SUBSTITUTE_GLOBAL; }
 
+    int rc = pcre2_substitute(cr->_pRE,
+                              dstr_u8ptr(subject),
+                              dstr_length(subject),
+                              offset, t.opts,
+                              mdata, thread_match_context(),
+                              t.text, t.len, stbuff, &outlen);
+
+    if (rc > 0) {
+        dstr_assign_bl(subject, (char*) stbuff, outlen); }
+    else if (rc == PCRE2_ERROR_NOMEMORY &&
+             outlen != PCRE2_UNSET && outlen <= UINT32_MAX) {
+        uint8_t* buffer = RE_MALLOC(uint8_t, outlen);
+        if (buffer) {
+            rc = pcre2_substitute(cr->_pRE,
+                                  dstr_u8ptr(subject),
+                                  dstr_length(subject),
+                                  offset, t.opts,
+                                  mdata, thread_match_context(),
+                                  t.text, t.len, buffer, &outlen);
+            if (rc > 0) {
+                dstr_assign_bl(subject, (char*) buffer, outlen); }
+            free(buffer); } }
+
+    mdata_release(mdata);
     return rc;
+#endif
 }
 /*-------------------------------------------------------------------------------*/
 
-// We store at most DSTR_CACHE_SIZE compiled RE patterns for reuse.
-// Once the cache is full, the oldest used pattern is discarded
+// Compiled patterns are kept per thread for reuse, indexed by a hash of
+// (pattern, options) and linked in order of last use. Once the cache
+// holds its capacity (DSTR_CACHE_SIZE unless changed with
+// dstr_regex_cache_set_capacity) the least recently used one is discarded.
+//
+// Optionally a process wide cache, split in DSTR_SHARED_SHARDS locked
+// shards, sits behind the per-thread caches: a pattern is compiled once
+// and its code shared by every thread. Entries reference a pattern and
+// the last reference frees it, so an eviction from one cache never pulls
+// a pattern from under another thread
 //
+#ifndef DSTR_CACHE_SIZE
 #define DSTR_CACHE_SIZE 40
+#endif
+#define DSTR_CACHE_MIN_BUCKETS 64
+#define DSTR_SHARED_SHARDS     16
 
 #if defined(RE_CACHE_USE_PTHREAD)
    typedef pthread_key_t    tss_t;
    typedef pthread_once_t   once_flag;
+   typedef pthread_mutex_t  mtx_t;
    #define ONCE_FLAG_INIT   PTHREAD_ONCE_INIT
    #define tss_create       pthread_key_create
    #define tss_get          pthread_getspecific
    #define tss_set          pthread_setspecific
    #define call_once        pthread_once
    #define thrd_success     0
+   #define mtx_plain        0
+   #define mtx_init(m, t)   pthread_mutex_init((m), NULL)
+   #define mtx_lock         pthread_mutex_lock
+   #define mtx_unlock       pthread_mutex_unlock
 #endif
 
-// Since this is unsigned 64 bit type no danger of overflow
-// e.g. for a million calls per sec, overflow would occur in
-// half a million years...
-//
-static _Thread_local uint64_t global_tick_count = 0;
-static _Thread_local Compiled_Regex* re_cache[DSTR_CACHE_SIZE] = { 0 };
+typedef struct RE_Entry {
+    Compiled_Regex*  cr;
+    size_t           hash;
+    struct RE_Entry* hnext;      // next in hash bucket
+    struct RE_Entry* lru_prev;   // more recently used
+    struct RE_Entry* lru_next;   // less recently used
+} RE_Entry;
+
+typedef struct RE_Cache {
+    RE_Entry**       buckets;    // n_buckets chains, power of two
+    size_t           n_buckets;
+    size_t           size;
+    size_t           capacity;
+    RE_Entry*        mru;        // most recently used, head of LRU list
+    RE_Entry*        lru;        // least recently used, tail
+    DSTR_Regex_Cache_Stats stats;
+} RE_Cache;
+
+typedef struct RE_Shard {
+    mtx_t            lock;
+    RE_Cache         cache;
+} RE_Shard;
+
+static _Thread_local RE_Cache re_cache = {
+    NULL, 0, 0, DSTR_CACHE_SIZE, NULL, NULL, { 0, 0, 0, 0, 0, 0, 0 } };
+
+static RE_Shard  shared_cache[DSTR_SHARED_SHARDS];
+static once_flag shared_once = ONCE_FLAG_INIT;
+static re_refcount_t shared_on = 0;
 
 // Code below for cleanup the cache at exit of thread
 //
@@ -611,37 +1265,207 @@ static tss_t     tss_cache_key;
 static once_flag tss_cache_once = ONCE_FLAG_INIT;
 /*-------------------------------------------------------------------------------*/
 
-static void cache_cleanup(void* unused)
+static uint64_t now_ns(void)
 {
-    ((void)unused);
+    struct timespec ts;
+    if (timespec_get(&ts, TIME_UTC) != TIME_UTC) {
+        return 0; }
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+/*-------------------------------------------------------------------------------*/
 
-    for (size_t i = 0; i < DSTR_CACHE_SIZE; ++i) {
-        if (re_cache[i]) {
-            destroy_compiled_regex(re_cache[i]);
-            re_cache[i] = NULL; } }
+static size_t pattern_hash(const char* pattern, size_t len, int options)
+{
+    DSTR_VIEW v;
+    v.data = pattern;
+    v.length = (uint32_t) len;
+    return dstr_hash((CDSTR) &v, (size_t) options);
 }
 /*-------------------------------------------------------------------------------*/
 
-static void cache_cleanup_at_exit(void)
+static inline void regex_release(Compiled_Regex* cr)
 {
-    // Argument to cache cleanup is unused (see above)
-    // so NULL is OK
-    //
-    cache_cleanup(NULL);
+    if (refs_dec(&cr->refs) == 0) {
+        destroy_compiled_regex(cr); }
 }
 /*-------------------------------------------------------------------------------*/
 
-static void create_cache_key(void)
+static void lru_unlink(RE_Cache* c, RE_Entry* e)
 {
-    if (tss_create(&tss_cache_key, cache_cleanup) != thrd_success) {
-        fprintf(stderr, "Error: Failed to create TSS key.\n");
-        abort(); }
+    if (e->lru_prev) {
+        e->lru_prev->lru_next = e->lru_next; }
+    else {
+        c->mru = e->lru_next; }
 
-    atexit(cache_cleanup_at_exit);
+    if (e->lru_next) {
+        e->lru_next->lru_prev = e->lru_prev; }
+    else {
+        c->lru = e->lru_prev; }
+
+    e->lru_prev = e->lru_next = NULL;
 }
 /*-------------------------------------------------------------------------------*/
 
-static inline void registr_automatic_exit_cleanup(void)
+static void lru_push_front(RE_Cache* c, RE_Entry* e)
+{
+    e->lru_prev = NULL;
+    e->lru_next = c->mru;
+    if (c->mru) {
+        c->mru->lru_prev = e; }
+    else {
+        c->lru = e; }
+    c->mru = e;
+}
+/*-------------------------------------------------------------------------------*/
+
+static Compiled_Regex* cache_find(RE_Cache* c, size_t hash,
+                                  const char* pattern, size_t len, int options)
+{
+    if (!c->buckets) {
+        return NULL; }
+
+    RE_Entry* e = c->buckets[hash & (c->n_buckets - 1)];
+    for (; e; e = e->hnext) {
+        Compiled_Regex* cr = e->cr;
+        if (e->hash == hash && cr->options == options &&
+            dstr_length(cr->pattern) == len &&
+            memcmp(dstrdata(cr->pattern), pattern, len) == 0) {
+            c->stats.hits++;
+            if (e != c->mru) {
+                lru_unlink(c, e);
+                lru_push_front(c, e); }
+            return cr; } }
+
+    return NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void cache_remove(RE_Cache* c, RE_Entry* e)
+{
+    RE_Entry** pp = &c->buckets[e->hash & (c->n_buckets - 1)];
+    while (*pp != e) {
+        pp = &(*pp)->hnext; }
+    *pp = e->hnext;
+
+    lru_unlink(c, e);
+    c->size--;
+    regex_release(e->cr);
+    free(e);
+}
+/*-------------------------------------------------------------------------------*/
+
+static void cache_evict(RE_Cache* c, size_t keep)
+{
+    while (c->size > keep && c->lru) {
+        cache_remove(c, c->lru);
+        c->stats.evictions++; }
+}
+/*-------------------------------------------------------------------------------*/
+
+// Keep the load factor at most one. If the larger table cannot be
+// allocated the chains just get longer
+//
+static void cache_rehash(RE_Cache* c)
+{
+    size_t n = c->n_buckets ? c->n_buckets * 2 : DSTR_CACHE_MIN_BUCKETS;
+    RE_Entry** buckets = (RE_Entry**) calloc(n, sizeof(RE_Entry*));
+    if (!buckets) {
+        return; }
+
+    for (RE_Entry* e = c->mru; e; e = e->lru_next) {
+        RE_Entry** head = &buckets[e->hash & (n - 1)];
+        e->hnext = *head;
+        *head = e; }
+
+    free(c->buckets);
+    c->buckets = buckets;
+    c->n_buckets = n;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Takes over the caller's reference to CR, also on failure
+//
+static int cache_insert(RE_Cache* c, Compiled_Regex* cr, size_t hash)
+{
+    cache_evict(c, c->capacity - 1);
+
+    if (c->size >= c->n_buckets) {
+        cache_rehash(c); }
+
+    RE_Entry* e = RE_MALLOC(RE_Entry, 1);
+    if (!e || !c->buckets) {
+        free(e);
+        regex_release(cr);
+        return DSTR_FAIL; }
+
+    e->cr = cr;
+    e->hash = hash;
+
+    RE_Entry** head = &c->buckets[hash & (c->n_buckets - 1)];
+    e->hnext = *head;
+    *head = e;
+    lru_push_front(c, e);
+    c->size++;
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void cache_clear(RE_Cache* c)
+{
+    while (c->mru) {
+        RE_Entry* e = c->mru;
+        c->mru = e->lru_next;
+        regex_release(e->cr);
+        free(e); }
+
+    free(c->buckets);
+    c->buckets = NULL;
+    c->n_buckets = 0;
+    c->size = 0;
+    c->lru = NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+static void cache_cleanup(void* unused)
+{
+    ((void)unused);
+
+    cache_clear(&re_cache);
+
+    if (match_ctx) {
+        pcre2_match_context_free(match_ctx);
+        match_ctx = NULL; }
+
+    if (jit_stack) {
+        pcre2_jit_stack_free(jit_stack);
+        jit_stack = NULL; }
+
+    if (spare_mdata) {
+        pcre2_match_data_free(spare_mdata);
+        spare_mdata = NULL; }
+}
+/*-------------------------------------------------------------------------------*/
+
+static void cache_cleanup_at_exit(void)
+{
+    // Argument to cache cleanup is unused (see above)
+    // so NULL is OK
+    //
+    cache_cleanup(NULL);
+}
+/*-------------------------------------------------------------------------------*/
+
+static void create_cache_key(void)
+{
+    if (tss_create(&tss_cache_key, cache_cleanup) != thrd_success) {
+        fprintf(stderr, "Error: Failed to create TSS key.\n");
+        abort(); }
+
+    atexit(cache_cleanup_at_exit);
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline void registr_automatic_exit_cleanup(void)
 {
     call_once(&tss_cache_once, create_cache_key);
     if (tss_get(tss_cache_key) == NULL)
@@ -649,6 +1473,70 @@ static inline void registr_automatic_exit_cleanup(void)
 }
 /*-------------------------------------------------------------------------------*/
 
+static void shared_cleanup_at_exit(void)
+{
+    for (size_t i = 0; i < DSTR_SHARED_SHARDS; ++i) {
+        mtx_lock(&shared_cache[i].lock);
+        cache_clear(&shared_cache[i].cache);
+        mtx_unlock(&shared_cache[i].lock); }
+}
+/*-------------------------------------------------------------------------------*/
+
+static void create_shared_cache(void)
+{
+    for (size_t i = 0; i < DSTR_SHARED_SHARDS; ++i) {
+        if (mtx_init(&shared_cache[i].lock, mtx_plain) != thrd_success) {
+            fprintf(stderr, "Error: Failed to create regex cache mutex.\n");
+            abort(); }
+        memset(&shared_cache[i].cache, 0, sizeof(RE_Cache)); }
+
+    atexit(shared_cleanup_at_exit);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Returns the shared pattern with a reference for the caller or NULL
+//
+static Compiled_Regex* shared_find(size_t hash, const char* pattern, size_t len, int options)
+{
+    RE_Shard* shard = &shared_cache[hash % DSTR_SHARED_SHARDS];
+
+    mtx_lock(&shard->lock);
+    Compiled_Regex* cr = cache_find(&shard->cache, hash, pattern, len, options);
+    if (cr) {
+        refs_inc(&cr->refs); }
+    mtx_unlock(&shard->lock);
+
+    return cr;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Publishes a newly compiled CR. If another thread was faster its pattern
+// is returned instead and CR released. Either way the caller owns one
+// reference to the result
+//
+static Compiled_Regex* shared_insert(Compiled_Regex* cr, size_t hash)
+{
+    RE_Shard* shard = &shared_cache[hash % DSTR_SHARED_SHARDS];
+    const char* pattern = dstrdata(cr->pattern);
+    size_t len = dstr_length(cr->pattern);
+
+    mtx_lock(&shard->lock);
+    Compiled_Regex* found = cache_find(&shard->cache, hash, pattern, len, cr->options);
+    if (found) {
+        refs_inc(&found->refs); }
+    else if (shard->cache.capacity) {
+        refs_inc(&cr->refs);
+        cache_insert(&shard->cache, cr, hash); }
+    mtx_unlock(&shard->lock);
+
+    if (found) {
+        regex_release(cr);
+        return found; }
+
+    return cr;
+}
+/*-------------------------------------------------------------------------------*/
+
 #ifdef DEBUG_DISPLAY_CACHE
 static void debug_display_cache(void)
 {
@@ -659,12 +1547,11 @@ static void debug_display_cache(void)
     if (!print)
         return;
 
-    for (size_t i = 0; i < DSTR_CACHE_SIZE; ++i) {
-        if (re_cache[i]) {
-            printf("Index:%02zu, T:%3zu, \"%s\", %d\n",
-                   i, re_cache[i]->tick_count,
-                   dstrdata(re_cache[i]->pattern),
-                   re_cache[i]->options); } }
+    size_t i = 0;
+    for (RE_Entry* e = re_cache.mru; e; e = e->lru_next) {
+        printf("LRU:%03zu, H:%016zx, R:%ld, \"%s\", %d\n",
+               i++, e->hash, (long) e->cr->refs,
+               dstrdata(e->cr->pattern), e->cr->options); }
     putchar('\n');
 }
 /*-------------------------------------------------------------------------------*/
@@ -672,54 +1559,1092 @@ static void debug_display_cache(void)
 
 static Compiled_Regex* get_RE(const char* pattern, int options, int* errcode)
 {
-    registr_automatic_exit_cleanup();
-    global_tick_count++;
+    RE_Cache* c = &re_cache;
 
 #ifdef DEBUG_DISPLAY_CACHE
     debug_display_cache();
 #endif
 
-    Compiled_Regex* pRes = NULL;
-    size_t first_empty_slot = DSTR_NPOS;
-    size_t oldest_index = DSTR_NPOS;
-    uint64_t oldest_so_far = UINT64_MAX;
+    if (!pattern || !*pattern) {
+        return NULL; }
+
+    size_t len = strlen(pattern);
+    size_t hash = pattern_hash(pattern, len, options);
 
     // Lookup in cache
     //
-    for (size_t i = 0; i < DSTR_CACHE_SIZE; ++i) {
-        if ((pRes = re_cache[i]) == NULL) {
-            first_empty_slot = i;
-            break; }
+    Compiled_Regex* pRes = cache_find(c, hash, pattern, len, options);
+    if (pRes) {
+        return pRes; }
+
+    // Not found. Take it from the shared cache or compile a new one
+    //
+    registr_automatic_exit_cleanup();
+    c->stats.misses++;
 
-        if (pRes->options == options && dstreq(pRes->pattern, pattern)) {
-            pRes->tick_count = global_tick_count;
-            return pRes; }
+    bool shared = flag_load(&shared_on) != 0;
+    if (shared && (pRes = shared_find(hash, pattern, len, options)) != NULL) {
+        c->stats.shared_hits++; }
+    else {
+        int code = 0;
+        uint64_t start = now_ns();
+        pRes = dstr_compile_regex(pattern, options, &code);
+        c->stats.compile_ns += now_ns() - start;
+
+        if (!pRes) {
+            if (code) {
+                dstr_regex_perror(code); }
+            if (errcode) {
+                *errcode = code; }
+            return NULL; }
+
+        if (shared) {
+            pRes = shared_insert(pRes, hash); } }
+
+    // If the cache is full, the least recently used is discarded
+    //
+    if (!cache_insert(c, pRes, hash)) {
+        dstr_out_of_memory();
+        return NULL; }
 
-        if (pRes->tick_count < oldest_so_far) {
-            oldest_index = i;
-            oldest_so_far = pRes->tick_count; } }
+    return pRes;
+}
+/*-------------------------------------------------------------------------------*/
 
-    // Not found. Compile and create a new one and store in cache
+size_t dstr_regex_cache_set_capacity(size_t capacity)
+{
+    size_t previous = re_cache.capacity;
+    re_cache.capacity = capacity ? capacity : 1;
+    cache_evict(&re_cache, re_cache.capacity);
+    return previous;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_regex_cache_stats(DSTR_Regex_Cache_Stats* stats, bool reset)
+{
+    if (stats) {
+        *stats = re_cache.stats;
+        stats->size = re_cache.size;
+        stats->capacity = re_cache.capacity; }
+
+    if (reset) {
+        memset(&re_cache.stats, 0, sizeof(re_cache.stats)); }
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_regex_shared_cache(size_t capacity)
+{
+    call_once(&shared_once, create_shared_cache);
+
+    // spread over the shards, rounded up
     //
-    if ((pRes = dstr_compile_regex(pattern, options, errcode)) == NULL)
-        return NULL;
+    size_t per_shard = (capacity + DSTR_SHARED_SHARDS - 1) / DSTR_SHARED_SHARDS;
+    size_t previous = 0;
+
+    flag_store(&shared_on, capacity ? 1 : 0);
+
+    for (size_t i = 0; i < DSTR_SHARED_SHARDS; ++i) {
+        RE_Shard* shard = &shared_cache[i];
+        mtx_lock(&shard->lock);
+        previous += shard->cache.capacity;
+        shard->cache.capacity = per_shard;
+        cache_evict(&shard->cache, per_shard);
+        mtx_unlock(&shard->lock); }
+
+    return previous;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    P R E C O M P I L E D   H A N D L E S
+ *
+ *    Owned by the caller, not cached. Options are parsed once and
+ *    apply to every match made with the handle.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+DSTR_Regex* dstr_regex_compile(const char* pattern, const char* options, int* err)
+{
+    int code = 0;
+    DSTR_Regex* re = dstr_compile_regex(pattern, parse_regex_options(options), &code);
+    if (err) {
+        *err = re ? 0 : code; }
+    return re;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_regex_free(DSTR_Regex* re)
+{
+    destroy_compiled_regex(re);
+}
+/*-------------------------------------------------------------------------------*/
+
+bool dstr_regex_exact_re(const DSTR_Regex* re, CDSTR subject, size_t offset)
+{
+    return re ? dstr_regex_exact_aux(re, subject, offset, re->options) : false;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_regex_contains_re(const DSTR_Regex* re, CDSTR subject, size_t offset)
+{
+    if (!re) {
+        return DSTR_NPOS; }
+
+    DSTR_Regex_Match mtch;
+    dstr_regex_match_aux(re, subject, offset, &mtch, re->options);
+    return mtch.offset;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_match_re(const DSTR_Regex* re, CDSTR subject, size_t offset,
+                        DSTR_Regex_Match* c_match)
+{
+    if (!re) {
+        return PCRE2_ERROR_NULL; }
+
+    DSTR_Regex_Match m;
+    return dstr_regex_match_aux(re, subject, offset, c_match ? c_match : &m, re->options);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_match_groups_re(const DSTR_Regex* re, CDSTR subject, size_t offset,
+                               DSTR_Match_Vector* matches)
+{
+    if (!re) {
+        return PCRE2_ERROR_NULL; }
+
+    return dstr_regex_match_groups_aux(re, subject, offset, matches, re->options);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_substitute_re(const DSTR_Regex* re, DSTR subject, size_t offset,
+                             const char* replacement)
+{
+    if (!re) {
+        return PCRE2_ERROR_NULL; }
+
+    return dstr_regex_subst_aux(re, subject, offset, replacement, re->options);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_substitute_cb_re(const DSTR_Regex* re, DSTR subject, size_t offset,
+                                DSTR_Regex_Replace callback, void* ctx)
+{
+    if (!re) {
+        return PCRE2_ERROR_NULL; }
+
+    Callback_Step c = { callback, ctx };
+    return subst_engine(re, subject, offset, re->options, callback_step, &c);
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    M A T C H   I T E R A T I O N
+ *
+ *    All matches of a subject with one match data block: the groups
+ *    handed out are the block's ovector, PCRE2_UNSET being DSTR_NPOS.
+ *    After an empty match the search resumes one character further, as
+ *    in DStringView::re_split.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+void dstr_regex_iter_init(DSTR_Regex_Iter* it, const DSTR_Regex* re,
+                          CDSTR subject, size_t offset)
+{
+    it->re = re;
+    it->subject = subject;
+    it->offset = offset;
+    it->groups = NULL;
+    it->n_groups = 0;
+    it->rc = re ? 0 : PCRE2_ERROR_NULL;
+    it->mdata = NULL;
+}
+/*-------------------------------------------------------------------------------*/
+
+bool dstr_regex_iter_next(DSTR_Regex_Iter* it)
+{
+    const Compiled_Regex* cr = it->re;
+
+    it->groups = NULL;
+    it->n_groups = 0;
+
+    if (it->rc < 0) {
+        return false; }
+
+    if (it->offset > dstr_length(it->subject)) {
+        it->rc = 0;
+        return false; }
+
+    if (!it->mdata && (it->mdata = mdata_acquire(cr)) == NULL) {
+        it->rc = PCRE2_ERROR_NOMEMORY;
+        return false; }
+
+    pcre2_match_data* mdata = (pcre2_match_data*) it->mdata;
+    int rc = regex_exec(cr, it->subject, it->offset, match_options(cr->options),
+                        mdata, thread_match_context());
+
+    if (rc < 0) {
+        it->rc = (rc == PCRE2_ERROR_NOMATCH) ? 0 : rc;
+        it->offset = DSTR_NPOS;
+        return false; }
+
+    const PCRE2_SIZE* ovec = pcre2_get_ovector_pointer(mdata);
+    it->rc = rc;
+    it->groups = ovec;
+    it->n_groups = cr->n_pairs;
+    it->offset = (ovec[1] > ovec[0]) ? ovec[1] : skip_char(cr, it->subject, ovec[0]);
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_regex_iter_done(DSTR_Regex_Iter* it)
+{
+    if (it->mdata) {
+        mdata_release((pcre2_match_data*) it->mdata);
+        it->mdata = NULL; }
+
+    it->groups = NULL;
+    it->n_groups = 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_foreach_re(const DSTR_Regex* re, CDSTR subject, size_t offset,
+                          DSTR_Regex_Callback callback, void* ctx)
+{
+    DSTR_Regex_Iter it;
+    dstr_regex_iter_init(&it, re, subject, offset);
+
+    int count = 0;
+    while (dstr_regex_iter_next(&it)) {
+        ++count;
+        if (callback(ctx, it.groups, it.n_groups)) {
+            break; } }
+
+    int rc = it.rc;
+    dstr_regex_iter_done(&it);
+    return (rc < 0) ? rc : count;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_foreach(CDSTR subject, const char* pattern, size_t offset,
+                       DSTR_Regex_Callback callback, void* ctx, const char* opts)
+{
+    int errcode = 0;
+    Compiled_Regex* cr = get_RE(pattern, parse_regex_options(opts), &errcode);
+    if (!cr)
+        return -errcode;
+
+    // The callback may use other patterns and push this one out of the
+    // cache, hold on to it meanwhile
+    //
+    refs_inc(&cr->refs);
+    int rc = dstr_regex_foreach_re(cr, subject, offset, callback, ctx);
+    regex_release(cr);
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    R E G E X   S E T S
+ *
+ *    Patterns with a required literal of three bytes or more are indexed
+ *    by its last three bytes: one pass over the subject looks every
+ *    three byte window up and finds the candidates, whose literal is
+ *    there, so only those are matched. The cost of a line depends on the
+ *    candidates, not on the size of the set.
+ *
+ *    The other patterns are compiled into one alternation, branch K being
+ *    (?>pattern K)(*MARK:K)(?C{K}), so one scan tries them all: the mark
+ *    names the pattern that matched leftmost. To find every pattern that
+ *    matches, the callout records K and fails, and the scan goes on to
+ *    the other branches and positions; the atomic group keeps a pattern
+ *    from backtracking into itself after a failed callout.
+ *
+ *    Patterns that would change meaning inside the alternation (numbered
+ *    back references and \1 to \9 escapes that become ones, recursion and
+ *    subroutine calls, verbs, callouts, \K) are matched on their own.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define SET_KEY_LEN      3
+#define SET_MIN_BUCKETS  64
+
+typedef struct Set_Entry {
+    Compiled_Regex* cr;
+    size_t          index;     // of the pattern in the set
+    size_t          lit;       // literal at lit_text + lit, indexed patterns
+    size_t          lit_len;
+    uint32_t        key;
+    int32_t         next;      // in the bucket, -1 ends
+} Set_Entry;
+
+struct DSTR_RegexSet {
+    Compiled_Regex* combined;  // merged patterns, NULL if none
+    Set_Entry*      entries;   // indexed ones first, then those alone
+    size_t          n_indexed;
+    size_t          n_entries;
+    int32_t*        buckets;   // heads of indexed entries by key
+    size_t          n_buckets;
+    char*           lit_text;
+    size_t          size;
+};
+/*-------------------------------------------------------------------------------*/
+
+static inline uint32_t set_key(const unsigned char* s)
+{
+    return ((uint32_t) s[0] << 16) | ((uint32_t) s[1] << 8) | s[2];
+}
+
+static inline size_t set_bucket(const DSTR_RegexSet* set, uint32_t key)
+{
+    return (size_t) ((key * 2654435761u) >> 7) & (set->n_buckets - 1);
+}
+/*-------------------------------------------------------------------------------*/
+
+static bool mergeable(const Compiled_Regex* cr)
+{
+    uint32_t backref_max = 0;
+    pcre2_pattern_info(cr->_pRE, PCRE2_INFO_BACKREFMAX, &backref_max);
+    if (backref_max > 0) {
+        return false; }
+
+    const char* p = dstr_cstr(cr->pattern);
+    for (; *p; ++p) {
+        if (p[0] == '\\') {
+            // \1 to \9... are octal or back references depending on the
+            // number of groups before them
+            //
+            if (p[1] == 'K' || p[1] == 'g' || (p[1] >= '1' && p[1] <= '9')) {
+                return false; }
+            if (p[1]) {
+                ++p; }
+            continue; }
+
+        if (p[0] != '(') {
+            continue; }
+
+        if (p[1] == '*') {
+            return false; }
+
+        if (p[1] == '?') {
+            char c = p[2];
+            if (c == 'R' || c == '&' || c == 'C' || (c >= '0' && c <= '9') ||
+                (c == 'P' && p[3] == '>') ||
+                ((c == '+' || c == '-') && p[3] >= '0' && p[3] <= '9')) {
+                return false; } } }
+
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+static size_t mark_index(PCRE2_SPTR s)
+{
+    size_t k = 0;
+    for (; *s >= '0' && *s <= '9'; ++s) {
+        k = 10 * k + (*s - '0'); }
+    return k;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct Set_Result {
+    uint64_t* bits;
+    int       count;
+} Set_Result;
 
-    // That's the newest member for now
+static void set_result_add(Set_Result* r, size_t k)
+{
+    uint64_t bit = (uint64_t) 1 << (k % 64);
+    if (!(r->bits[k / 64] & bit)) {
+        r->bits[k / 64] |= bit;
+        ++r->count; }
+}
+/*-------------------------------------------------------------------------------*/
+
+static int set_collect(pcre2_callout_block* cb, void* data)
+{
+    set_result_add((Set_Result*) data, mark_index(cb->callout_string));
+    return 1;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_regex_set_free(DSTR_RegexSet* set)
+{
+    if (!set) {
+        return; }
+
+    destroy_compiled_regex(set->combined);
+    for (size_t i = 0; i < set->n_entries; ++i) {
+        destroy_compiled_regex(set->entries[i].cr); }
+
+    free(set->entries);
+    free(set->buckets);
+    free(set->lit_text);
+    free(set);
+}
+/*-------------------------------------------------------------------------------*/
+
+static bool set_build_index(DSTR_RegexSet* set, DSTR lits)
+{
+    size_t n_buckets = SET_MIN_BUCKETS;
+    while (n_buckets < 2 * set->n_indexed) {
+        n_buckets *= 2; }
+
+    set->buckets = RE_MALLOC(int32_t, n_buckets);
+    set->lit_text = RE_MALLOC(char, dstr_length(lits) + 1);
+    if (!set->buckets || !set->lit_text) {
+        return false; }
+
+    set->n_buckets = n_buckets;
+    memcpy(set->lit_text, dstr_cstr(lits), dstr_length(lits) + 1);
+    for (size_t b = 0; b < n_buckets; ++b) {
+        set->buckets[b] = -1; }
+
+    // Chained in reverse, so each bucket lists its patterns in order
     //
-    pRes->tick_count = global_tick_count;
+    for (size_t i = set->n_indexed; i-- > 0; ) {
+        Set_Entry* e = &set->entries[i];
+        size_t b = set_bucket(set, e->key);
+        e->next = set->buckets[b];
+        set->buckets[b] = (int32_t) i; }
 
-    // If we have an empty slot, store in it
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_RegexSet* dstr_regex_set_compile(const char* const patterns[], size_t n,
+                                      const char* opts, int* err, size_t* err_index)
+{
+    int options = parse_regex_options(opts);
+    int code = 0;
+
+    if (err) {
+        *err = 0; }
+
+    if (n >= INT32_MAX) {
+        return NULL; }
+
+    DSTR_RegexSet* set = RE_MALLOC(DSTR_RegexSet, 1);
+    if (!set) {
+        return NULL; }
+
+    memset(set, 0, sizeof(*set));
+    set->size = n;
+    set->entries = (Set_Entry*) calloc(n ? n : 1, sizeof(Set_Entry));
+    size_t* merged = RE_MALLOC(size_t, n ? n : 1);
+    size_t n_merged = 0;
+    DSTR lits = dstr_create_empty();
+    DSTR text = dstr_create_reserve(64 * n);
+    bool ok = set->entries && merged && lits && text;
+
+    // Each pattern is compiled alone first, which reports errors against
+    // the pattern at fault and tells which ones can be merged. Entries
+    // are indexed ones, then those alone
     //
-    if (first_empty_slot < DSTR_CACHE_SIZE) {
-        re_cache[first_empty_slot] = pRes;
-        return pRes; }
+    for (size_t i = 0; ok && i < n; ++i) {
+        Compiled_Regex* cr = dstr_compile_regex(patterns[i], options, &code);
+        if (!cr) {
+            if (err) *err = code;
+            if (err_index) *err_index = i;
+            ok = false;
+            break; }
 
-    // Otherwise cache is full - replace with oldest (LRU)
+        Set_Entry* e = NULL;
+
+        if (cr->lit_len >= SET_KEY_LEN) {
+            e = &set->entries[set->n_indexed++];
+            e->lit = dstr_length(lits);
+            e->lit_len = cr->lit_len;
+            e->key = set_key((const unsigned char*) cr->literal + cr->lit_len - SET_KEY_LEN);
+            dstr_append_bl(lits, cr->literal, cr->lit_len); }
+        else if (!mergeable(cr)) {
+            e = &set->entries[n - 1 - (set->n_entries - set->n_indexed)]; }
+
+        if (e) {
+            e->cr = cr;
+            e->index = i;
+            ++set->n_entries;
+            continue; }
+
+        destroy_compiled_regex(cr);
+        merged[n_merged++] = i;
+        dstr_append_sprintf(text, "%s(?>%s\\E%s)(*MARK:%zu)(?C{%zu})",
+                            n_merged > 1 ? "|" : "", patterns[i],
+                            (options & REGEX_EXTENDED) ? "\n" : "", i, i);
+    }
+
+    // Entries alone move up behind the indexed ones, also on error so
+    // dstr_regex_set_free finds them
     //
-    assert(oldest_index < DSTR_CACHE_SIZE);
-    destroy_compiled_regex(re_cache[oldest_index]);
-    re_cache[oldest_index] = pRes;
-    return pRes;
+    size_t n_alone = set->n_entries - set->n_indexed;
+    if (n_alone > 0) {
+        memmove(&set->entries[set->n_indexed], &set->entries[n - n_alone],
+                n_alone * sizeof(Set_Entry)); }
+
+    if (ok && n_merged > 0) {
+        set->combined = dstr_compile_regex(dstr_cstr(text), options | REGEX_DUPNAMES, &code);
+
+        // Too large for PCRE2, or patterns that clash after all: they
+        // are matched one by one then
+        //
+        for (size_t k = 0; !set->combined && k < n_merged; ++k) {
+            Set_Entry* e = &set->entries[set->n_entries];
+            e->index = merged[k];
+            if ((e->cr = dstr_compile_regex(patterns[e->index], options, &code)) == NULL) {
+                ok = false;
+                break; }
+            ++set->n_entries; } }
+
+    if (ok) {
+        ok = set_build_index(set, lits); }
+
+    free(merged);
+    dstr_destroy(lits);
+    dstr_destroy(text);
+
+    if (!ok) {
+        dstr_regex_set_free(set);
+        return NULL; }
+
+    return set;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_regex_set_size(const DSTR_RegexSet* set)
+{
+    return set ? set->size : 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Calls VISIT for every indexed pattern whose literal occurs in the
+// subject from OFFSET on, once per pattern, until it returns non zero.
+// TRIED has a bit per indexed entry
+//
+typedef int (*Set_Visit)(void* ctx, const Set_Entry* e);
+
+static int set_candidates(const DSTR_RegexSet* set, CDSTR subject, size_t offset,
+                          uint64_t* tried, Set_Visit visit, void* ctx)
+{
+    const unsigned char* text = (const unsigned char*) dstr_cstr(subject);
+    const size_t len = dstr_length(subject);
+
+    if (set->n_indexed == 0 || len < offset + SET_KEY_LEN) {
+        return 0; }
+
+    uint32_t key = set_key(text + offset) >> 8;
+    for (size_t end = offset + SET_KEY_LEN - 1; end < len; ++end) {
+        key = ((key << 8) | text[end]) & 0xFFFFFF;
+
+        for (int32_t i = set->buckets[set_bucket(set, key)]; i >= 0; i = set->entries[i].next) {
+            const Set_Entry* e = &set->entries[i];
+            uint64_t bit = (uint64_t) 1 << (i % 64);
+
+            if (e->key != key || (tried[i / 64] & bit) ||
+                end + 1 < offset + e->lit_len ||
+                memcmp(text + end + 1 - e->lit_len, set->lit_text + e->lit, e->lit_len) != 0) {
+                continue; }
+
+            tried[i / 64] |= bit;
+            int rc = visit(ctx, e);
+            if (rc) {
+                return rc; } } }
+
+    return 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Scratch bits for set_candidates, on the stack for most sets
+//
+#define SET_STACK_WORDS 64
+
+static uint64_t* set_tried_bits(const DSTR_RegexSet* set, uint64_t* local)
+{
+    size_t words = DSTR_REGEX_SET_WORDS(set->n_indexed);
+    uint64_t* bits = (words <= SET_STACK_WORDS) ? local : (uint64_t*) calloc(words, sizeof(uint64_t));
+    if (bits == local) {
+        memset(local, 0, words * sizeof(uint64_t)); }
+    return bits;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct Set_First {
+    CDSTR            subject;
+    size_t           offset;
+    DSTR_Regex_Match best;
+    int              index;
+} Set_First;
+
+// Leftmost wins, the lower index at the same place
+//
+static int set_first_try(void* ctx, const Set_Entry* e)
+{
+    Set_First* f = (Set_First*) ctx;
+    DSTR_Regex_Match m;
+    int rc = dstr_regex_match_aux(e->cr, f->subject, f->offset, &m, e->cr->options);
+    if (rc < 0) {
+        return rc; }
+
+    if (rc > 0 && (m.offset < f->best.offset ||
+                   (m.offset == f->best.offset && (int) e->index < f->index))) {
+        f->best = m;
+        f->index = (int) e->index; }
+
+    return 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_set_first(const DSTR_RegexSet* set, CDSTR subject, size_t offset,
+                         DSTR_Regex_Match* mtch)
+{
+    Set_First f = { subject, offset, { DSTR_NPOS, 0, NULL }, PCRE2_ERROR_NOMATCH };
+
+    if (mtch) {
+        *mtch = f.best; }
+
+    if (!set) {
+        return PCRE2_ERROR_NULL; }
+
+    if (offset > dstr_length(subject)) {
+        return PCRE2_ERROR_NOMATCH; }
+
+    if (set->combined) {
+        const Compiled_Regex* cr = set->combined;
+        pcre2_match_data* mdata = mdata_acquire(cr);
+        if (!mdata) {
+            return PCRE2_ERROR_NOMEMORY; }
+
+        int rc = pcre2_match(cr->_pRE,
+                             dstr_u8ptr(subject),
+                             dstr_length(subject),
+                             offset,
+                             match_options(cr->options),
+                             mdata,
+                             thread_match_context());
+        if (rc >= 0) {
+            const PCRE2_SIZE* ovec = pcre2_get_ovector_pointer(mdata);
+            f.index = (int) mark_index(pcre2_get_mark(mdata));
+            f.best.offset = ovec[0];
+            f.best.length = ovec[1] - ovec[0]; }
+
+        mdata_release(mdata);
+        if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
+            return rc; } }
+
+    uint64_t local[SET_STACK_WORDS];
+    uint64_t* tried = set_tried_bits(set, local);
+    if (!tried) {
+        return PCRE2_ERROR_NOMEMORY; }
+
+    int rc = set_candidates(set, subject, offset, tried, set_first_try, &f);
+    if (tried != local) {
+        free(tried); }
+
+    for (size_t i = set->n_indexed; rc == 0 && i < set->n_entries; ++i) {
+        rc = set_first_try(&f, &set->entries[i]); }
+
+    if (rc < 0) {
+        return rc; }
+
+    if (mtch) {
+        *mtch = f.best; }
+
+    return f.index;
+}
+/*-------------------------------------------------------------------------------*/
+
+typedef struct Set_All {
+    CDSTR      subject;
+    size_t     offset;
+    Set_Result result;
+} Set_All;
+
+static int set_all_try(void* ctx, const Set_Entry* e)
+{
+    Set_All* a = (Set_All*) ctx;
+    DSTR_Regex_Match m;
+    int rc = dstr_regex_match_aux(e->cr, a->subject, a->offset, &m, e->cr->options);
+    if (rc > 0) {
+        set_result_add(&a->result, e->index); }
+
+    return rc < 0 ? rc : 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_set_matches(const DSTR_RegexSet* set, CDSTR subject, size_t offset,
+                           uint64_t* bits)
+{
+    if (!set) {
+        return PCRE2_ERROR_NULL; }
+
+    Set_All a = { subject, offset, { bits, 0 } };
+    memset(bits, 0, DSTR_REGEX_SET_WORDS(set->size) * sizeof(uint64_t));
+
+    if (offset > dstr_length(subject)) {
+        return 0; }
+
+    if (set->combined) {
+        const Compiled_Regex* cr = set->combined;
+        pcre2_match_data* mdata = mdata_acquire(cr);
+        if (!mdata) {
+            return PCRE2_ERROR_NOMEMORY; }
+
+        // The callout is set for this one call on the thread's context
+        //
+        pcre2_match_context* ctx = thread_match_context();
+        pcre2_set_callout(ctx, set_collect, &a.result);
+        int rc = pcre2_match(cr->_pRE,
+                             dstr_u8ptr(subject),
+                             dstr_length(subject),
+                             offset,
+                             match_options(cr->options),
+                             mdata,
+                             ctx);
+        pcre2_set_callout(ctx, NULL, NULL);
+        mdata_release(mdata);
+
+        if (rc < 0 && rc != PCRE2_ERROR_NOMATCH) {
+            return rc; } }
+
+    uint64_t local[SET_STACK_WORDS];
+    uint64_t* tried = set_tried_bits(set, local);
+    if (!tried) {
+        return PCRE2_ERROR_NOMEMORY; }
+
+    int rc = set_candidates(set, subject, offset, tried, set_all_try, &a);
+    if (tried != local) {
+        free(tried); }
+
+    for (size_t i = set->n_indexed; rc == 0 && i < set->n_entries; ++i) {
+        rc = set_all_try(&a, &set->entries[i]); }
+
+    return rc < 0 ? rc : a.result.count;
+}
+/*-------------------------------------------------------------------------------*/
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *
+ *    S T R E A M I N G   S E A R C H
+ *
+ *    Input is read into a buffer of WINDOW bytes and matched with
+ *    PCRE2_PARTIAL_HARD until the end of input, after which a plain match
+ *    finishes. A full match is final: an earlier match reaching the end of
+ *    the buffer would have been reported as partial. On a partial match
+ *    the input from its start on is kept and more is read; on no match
+ *    only the last few bytes are kept. Either way the bytes lookbehinds
+ *    (and \b) may inspect stay before the search start, so the buffer
+ *    never starts a search at its first byte once input was dropped and
+ *    ^ and \A cannot match there.
+ *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#define STREAM_SKIP_CHAR  1        // an empty match: step over its character
+#define STREAM_SKIP_CONT  2        // and the rest of a UTF-8 sequence
+
+struct DSTR_Regex_Stream {
+    pcre2_code*       code;        // own copy, JIT compiled for partial matching
+    pcre2_match_data* mdata;
+    int               options;
+    uint32_t          match_opts;
+    size_t            n_pairs;
+    size_t            behind;      // bytes kept before the search start
+
+    // buff[0, len) is the input from BASE on, the search resumes at START
+    //
+    char*             buff;
+    size_t            capacity;
+    size_t            len;
+    size_t            start;
+    uint64_t          base;
+    int               skip;
+    bool              eof;
+    int               error;
+
+    // source: callback, file descriptor or stdio stream
+    //
+    DSTR_Regex_Read   read;
+    void*             ctx;
+    int               fd;
+    FILE*             fp;
+    bool              owns_fd;
+};
+/*-------------------------------------------------------------------------------*/
+
+static long stream_read_fd(void* ctx, char* buf, size_t size)
+{
+    const DSTR_Regex_Stream* s = (const DSTR_Regex_Stream*) ctx;
+    if (size > STREAM_READ_MAX) {
+        size = STREAM_READ_MAX; }
+
+    for (;;) {
+        long n = (long) stream_read(s->fd, buf, size);
+        if (n >= 0 || errno != EINTR) {
+            return n; } }
+}
+/*-------------------------------------------------------------------------------*/
+
+static long stream_read_fp(void* ctx, char* buf, size_t size)
+{
+    const DSTR_Regex_Stream* s = (const DSTR_Regex_Stream*) ctx;
+    size_t n = fread(buf, 1, size, s->fp);
+    if (n == 0 && ferror(s->fp)) {
+        if (!errno) {
+            errno = EIO; }
+        return -1; }
+    return (long) n;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Regex_Stream* dstr_regex_stream_new(const DSTR_Regex* re, DSTR_Regex_Read read,
+                                         void* ctx, size_t window)
+{
+    if (!re || !read) {
+        errno = EINVAL;
+        return NULL; }
+
+    DSTR_Regex_Stream* s = (DSTR_Regex_Stream*) calloc(1, sizeof(DSTR_Regex_Stream));
+    if (!s) {
+        errno = ENOMEM;
+        return NULL; }
+
+    s->options = re->options;
+    s->match_opts = (uint32_t) match_options(re->options);
+    s->n_pairs = re->n_pairs;
+    s->read = read;
+    s->ctx = ctx;
+    s->fd = -1;
+
+    uint32_t lookbehind = 0;
+    pcre2_pattern_info(re->_pRE, PCRE2_INFO_MAXLOOKBEHIND, &lookbehind);
+    s->behind = ((re->options & REGEX_UTF8) ? 4 * (size_t) lookbehind : lookbehind) + 1;
+
+    // a match must fit in a DSTR_VIEW, and room is left to read into
+    //
+    if (window == 0) {
+        window = DSTR_REGEX_WINDOW; }
+    if (window > UINT32_MAX - 1) {
+        window = UINT32_MAX - 1; }
+    if (window < s->behind + 64) {
+        window = s->behind + 64; }
+
+    s->capacity = window;
+    s->buff = (char*) malloc(window + 1);
+    s->code = pcre2_code_copy(re->_pRE);
+    s->mdata = s->code ? pcre2_match_data_create_from_pattern(s->code, NULL) : NULL;
+
+    if (!s->buff || !s->mdata) {
+        dstr_regex_stream_close(s);
+        errno = ENOMEM;
+        return NULL; }
+
+    if (!(re->options & REGEX_NO_JIT)) {
+        pcre2_jit_compile(s->code, PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD); }
+
+    s->buff[0] = '\0';
+    return s;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Regex_Stream* dstr_regex_stream_open(const DSTR_Regex* re, const char* path,
+                                          size_t window)
+{
+    assert(path != NULL);
+
+    int fd = stream_open(path);
+    if (fd < 0) {
+        return NULL; }
+
+    DSTR_Regex_Stream* s = dstr_regex_stream_fdopen(re, fd, window);
+    if (!s) {
+        int saved = errno;
+        stream_close(fd);
+        errno = saved;
+        return NULL; }
+
+    s->owns_fd = true;
+    return s;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Regex_Stream* dstr_regex_stream_fdopen(const DSTR_Regex* re, int fd, size_t window)
+{
+    DSTR_Regex_Stream* s = dstr_regex_stream_new(re, stream_read_fd, NULL, window);
+    if (s) {
+        s->ctx = s;
+        s->fd = fd; }
+    return s;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_Regex_Stream* dstr_regex_stream_from_stream(const DSTR_Regex* re, FILE* fp,
+                                                 size_t window)
+{
+    assert(fp != NULL);
+
+    DSTR_Regex_Stream* s = dstr_regex_stream_new(re, stream_read_fp, NULL, window);
+    if (s) {
+        s->ctx = s;
+        s->fp = fp; }
+    return s;
+}
+/*-------------------------------------------------------------------------------*/
+
+void dstr_regex_stream_close(DSTR_Regex_Stream* s)
+{
+    if (!s) {
+        return; }
+
+    if (s->owns_fd) {
+        stream_close(s->fd); }
+
+    pcre2_match_data_free(s->mdata);
+    pcre2_code_free(s->code);
+    free(s->buff);
+    free(s);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_stream_error(const DSTR_Regex_Stream* s)
+{
+    return s->error;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Drops the input before FROM, except the bytes lookbehinds need, and
+// reads until WANT more bytes are there, the buffer is full or the input
+// ends. Returns 0, PCRE2_ERROR_NOMEMORY when a partial match fills the
+// whole window, or -1 on a read error (the errno is kept)
+//
+static int stream_fill(DSTR_Regex_Stream* s, size_t from, size_t want)
+{
+    size_t drop = (from > s->behind) ? from - s->behind : 0;
+    if (drop > 0) {
+        memmove(s->buff, s->buff + drop, s->len - drop);
+        s->len -= drop;
+        s->start -= drop;
+        s->base += drop; }
+
+    if (s->len == s->capacity) {
+        return PCRE2_ERROR_NOMEMORY; }
+
+    size_t got = 0;
+    while (got < want && s->len < s->capacity) {
+        errno = 0;
+        long n = s->read(s->ctx, s->buff + s->len, s->capacity - s->len);
+        if (n < 0) {
+            s->error = errno ? errno : EIO;
+            s->eof = true;
+            return -1; }
+        if (n == 0) {
+            s->eof = true;
+            break; }
+
+        s->len += (size_t) n;
+        got += (size_t) n; }
+
+    s->buff[s->len] = '\0';
+    return 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Moves START past the character of an empty match as far as the input
+// goes. False if more input is needed to finish
+//
+static bool stream_skip(DSTR_Regex_Stream* s)
+{
+    if (s->skip == STREAM_SKIP_CHAR) {
+        if (s->start == s->len) {
+            return false; }
+        ++s->start;
+        s->skip = (s->options & REGEX_UTF8) ? STREAM_SKIP_CONT : 0; }
+
+    if (s->skip == STREAM_SKIP_CONT) {
+        while (s->start < s->len && (s->buff[s->start] & 0xC0) == 0x80) {
+            ++s->start; }
+        if (s->start < s->len || s->eof) {
+            s->skip = 0; } }
+
+    return s->skip == 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Length of the input PCRE2 may see: before the input ends, a UTF-8
+// sequence cut at the end of the buffer waits for its remaining bytes
+//
+static size_t stream_avail(const DSTR_Regex_Stream* s)
+{
+    if (s->eof || !(s->options & REGEX_UTF8)) {
+        return s->len; }
+
+    size_t i = s->len;
+    while (i > 0 && s->len - i < 4 && (s->buff[i - 1] & 0xC0) == 0x80) {
+        --i; }
+
+    if (i == 0 || (s->buff[i - 1] & 0xC0) != 0xC0) {
+        return s->len; }
+
+    unsigned char lead = (unsigned char) s->buff[i - 1];
+    size_t need = (lead >= 0xF0) ? 4 : (lead >= 0xE0) ? 3 : 2;
+    return (s->len - (i - 1) < need) ? i - 1 : s->len;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_regex_stream_next(DSTR_Regex_Stream* s, DSTR_Regex_Stream_Match* m)
+{
+    assert(s != NULL);
+    assert(m != NULL);
+
+    memset(m, 0, sizeof(*m));
+
+    for (;;) {
+        size_t keep = s->start;
+        size_t want = 1;
+
+        if (s->error) {
+            return 0; }
+
+        if (s->skip && !stream_skip(s)) {
+            if (s->eof) {
+                return 0; } }
+        else {
+            size_t avail = stream_avail(s);
+            uint32_t opts = s->match_opts | (s->eof ? 0 : PCRE2_PARTIAL_HARD);
+            int rc = pcre2_match(s->code, (PCRE2_SPTR) s->buff, avail, s->start, opts,
+                                 s->mdata, thread_match_context());
+
+            const PCRE2_SIZE* ovec = pcre2_get_ovector_pointer(s->mdata);
+
+            if (rc >= 0) {
+                m->data = s->buff;
+                m->base = s->base;
+                m->groups = ovec;
+                m->n_groups = s->n_pairs;
+                m->offset = s->base + ovec[0];
+                m->text.data = s->buff + ovec[0];
+                m->text.length = (uint32_t) (ovec[1] - ovec[0]);
+
+                s->start = ovec[1];
+                if (ovec[1] == ovec[0]) {
+                    s->skip = STREAM_SKIP_CHAR; }
+                return DSTR_SUCCESS; }
+
+            if (rc == PCRE2_ERROR_PARTIAL) {
+                // read at least as much again as is held, so a long match
+                // arriving in small reads is not rescanned for each
+                //
+                keep = s->start = ovec[0];
+                if (s->len - keep > want) {
+                    want = s->len - keep; } }
+            else if (rc == PCRE2_ERROR_NOMATCH && !s->eof) {
+                keep = s->start = avail; }
+            else {
+                return (rc == PCRE2_ERROR_NOMATCH) ? 0 : rc; } }
+
+        int rc = stream_fill(s, keep, want);
+        if (rc < -1) {
+            return rc; }
+    }
 }
 /*-------------------------------------------------------------------------------*/
 
@@ -778,7 +2703,7 @@ size_t dstr_regex_contains(CDSTR subject, const char* pattern, size_t offset)
 int dstr_regex_match(CDSTR subject, const char* pattern, size_t offset,
                      DSTR_Regex_Match* c_match, const char* opts)
 {
-    int errcode;
+    int errcode = 0;
     int options = parse_regex_options(opts);
     Compiled_Regex* cr = get_RE(pattern, options, &errcode);
     if (!cr)
@@ -822,12 +2747,33 @@ int dstr_regex_substitute(DSTR subject, const char* pattern, size_t offset,
 }
 /*-------------------------------------------------------------------------------*/
 
+int dstr_regex_substitute_cb(DSTR subject, const char* pattern, size_t offset,
+                             DSTR_Regex_Replace callback, void* ctx, const char* opts)
+{
+    int errcode = 0;
+    int options = parse_regex_options(opts);
+    Compiled_Regex* cr = get_RE(pattern, options, &errcode);
+    if (!cr)
+        return -errcode;
+
+    // as in dstr_regex_foreach, callbacks may push CR out of the cache
+    //
+    Callback_Step c = { callback, ctx };
+    refs_inc(&cr->refs);
+    int rc = subst_engine(cr, subject, offset, options, callback_step, &c);
+    regex_release(cr);
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
 static void dstr_regex_perror_aux(int rc, DSTR p)
 {
     char buffer[512];
 
     if (rc > REGEX_COMPILE_ERROR_BASE)
         rc -= REGEX_COMPILE_ERROR_BASE;
+    else if (rc < -REGEX_COMPILE_ERROR_BASE)
+        rc = -rc - REGEX_COMPILE_ERROR_BASE;
 
     pcre2_get_error_message(rc, (PCRE2_UCHAR*) buffer, sizeof(buffer));
 
@@ -0,0 +1,545 @@
+/*
+ * Copyright (c) 2025 Eyal Ben-David
+ *
+ * This file is part of DString C and C++ dynamic string library,
+ * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
+ */
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+#include <dstr/dstr.h>
+#include "dstr_internal.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+ *  UTF-8 validation, code point counting/indexing and transcoding
+ *  to and from UTF-16 and UTF-32.
+ *
+ *  Validation is strict (RFC 3629): no overlong forms, no surrogates,
+ *  nothing above U+10FFFF. With AVX2 it uses the lookup algorithm of
+ *  John Keiser and Daniel Lemire ("Validating UTF-8 In Less Than One
+ *  Instruction Per Byte", 2021) on 32 byte blocks. All other functions
+ *  skip ASCII runs 32 bytes at a time and decode the rest one code point
+ *  at a time.
+ */
+
+/*
+ *  For convenience, make code shorter (same as in dstr.c)
+ */
+#define DBUF(p)       ((p)->data)
+#define DLEN(p)       ((p)->length)
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+static inline unsigned popcount32(uint32_t x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return (unsigned) __popcnt(x);
+#else
+    return (unsigned) __builtin_popcount(x);
+#endif
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline bool is_ascii32(const unsigned char* p)
+{
+    __m256i x = _mm256_loadu_si256((const __m256i*) p);
+    return _mm256_movemask_epi8(x) == 0;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+// Decode one code point at P (P < END). Returns its length in bytes and
+// stores the code point, or 0 if the sequence is invalid
+//
+static inline size_t decode_utf8(const unsigned char* p, const unsigned char* end, uint32_t* cp)
+{
+    unsigned char c = p[0];
+    size_t avail = (size_t)(end - p);
+
+    if (c < 0x80) {
+        *cp = c;
+        return 1; }
+
+    if (c < 0xC2) {
+        return 0; }     // continuation or overlong 2 byte lead
+
+    if (c < 0xE0) {
+        if (avail < 2 || (p[1] & 0xC0) != 0x80) {
+            return 0; }
+        *cp = ((uint32_t)(c & 0x1F) << 6) | (p[1] & 0x3F);
+        return 2; }
+
+    if (c < 0xF0) {
+        if (avail < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80) {
+            return 0; }
+        if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] > 0x9F)) {
+            return 0; } // overlong or surrogate
+        *cp = ((uint32_t)(c & 0x0F) << 12) | ((uint32_t)(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        return 3; }
+
+    if (c < 0xF5) {
+        if (avail < 4 || (p[1] & 0xC0) != 0x80 ||
+            (p[2] & 0xC0) != 0x80 || (p[3] & 0xC0) != 0x80) {
+            return 0; }
+        if ((c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] > 0x8F)) {
+            return 0; } // overlong or above U+10FFFF
+        *cp = ((uint32_t)(c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3F) << 12) |
+              ((uint32_t)(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        return 4; }
+
+    return 0;
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline unsigned char* encode_utf8(unsigned char* out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *out++ = (unsigned char) cp; }
+    else if (cp < 0x800) {
+        *out++ = (unsigned char)(0xC0 | (cp >> 6));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+    else if (cp < 0x10000) {
+        *out++ = (unsigned char)(0xE0 | (cp >> 12));
+        *out++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+    else {
+        *out++ = (unsigned char)(0xF0 | (cp >> 18));
+        *out++ = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+        *out++ = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+        *out++ = (unsigned char)(0x80 | (cp & 0x3F)); }
+
+    return out;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Scalar validation from P, returns the offset of the first invalid
+// sequence or DSTR_NPOS
+//
+static size_t validate_scalar(const unsigned char* first, const unsigned char* p,
+                              const unsigned char* end)
+{
+    while (p != end) {
+        if (*p < 0x80) {
+            ++p;
+            continue; }
+
+        uint32_t cp;
+        size_t n = decode_utf8(p, end, &cp);
+        if (n == 0) {
+            return (size_t)(p - first); }
+        p += n; }
+
+    return DSTR_NPOS;
+}
+/*-------------------------------------------------------------------------------*/
+
+#if defined(__AVX2__)
+
+// Error classes of a byte pair (previous byte, current byte)
+//
+#define U8_TOO_SHORT      (1 << 0)  // 11______ 0_______ or 11______ 11______
+#define U8_TOO_LONG       (1 << 1)  // 0_______ 10______
+#define U8_OVERLONG_3     (1 << 2)  // 11100000 100_____
+#define U8_TOO_LARGE      (1 << 3)  // 11110100 1001____ and up
+#define U8_SURROGATE      (1 << 4)  // 11101101 101_____
+#define U8_OVERLONG_2     (1 << 5)  // 1100000_ 10______
+#define U8_TOO_LARGE_1000 (1 << 6)  // 11110101 1000____ and up
+#define U8_OVERLONG_4     (1 << 6)  // 11110000 1000____
+#define U8_TWO_CONTS      (1 << 7)  // 10______ 10______
+#define U8_CARRY          (U8_TOO_SHORT | U8_TOO_LONG | U8_TWO_CONTS)
+
+#define U8_LUT(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+static inline __m256i u8_prev(__m256i input, __m256i prev_input, int n)
+{
+    __m256i t = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (n) {
+    case 1:  return _mm256_alignr_epi8(input, t, 15);
+    case 2:  return _mm256_alignr_epi8(input, t, 14);
+    default: return _mm256_alignr_epi8(input, t, 13); }
+}
+/*-------------------------------------------------------------------------------*/
+
+static inline __m256i u8_special_cases(__m256i input, __m256i prev1)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    const __m256i byte_1_high = _mm256_shuffle_epi8(U8_LUT(
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG, U8_TOO_LONG,
+        U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS, U8_TWO_CONTS,
+        U8_TOO_SHORT | U8_OVERLONG_2,
+        U8_TOO_SHORT,
+        U8_TOO_SHORT | U8_OVERLONG_3 | U8_SURROGATE,
+        U8_TOO_SHORT | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_OVERLONG_4),
+        _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+
+    const __m256i byte_1_low = _mm256_shuffle_epi8(U8_LUT(
+        U8_CARRY | U8_OVERLONG_3 | U8_OVERLONG_2 | U8_OVERLONG_4,
+        U8_CARRY | U8_OVERLONG_2,
+        U8_CARRY,
+        U8_CARRY,
+        U8_CARRY | U8_TOO_LARGE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000 | U8_SURROGATE,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000,
+        U8_CARRY | U8_TOO_LARGE | U8_TOO_LARGE_1000),
+        _mm256_and_si256(prev1, nibble));
+
+    const __m256i byte_2_high = _mm256_shuffle_epi8(U8_LUT(
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE_1000 | U8_OVERLONG_4,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_OVERLONG_3 | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_LONG | U8_OVERLONG_2 | U8_TWO_CONTS | U8_SURROGATE | U8_TOO_LARGE,
+        U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT, U8_TOO_SHORT),
+        _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+
+    return _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Non zero if INPUT (following PREV_INPUT) has an error
+//
+static inline __m256i u8_check_block(__m256i input, __m256i prev_input)
+{
+    __m256i prev1 = u8_prev(input, prev_input, 1);
+    __m256i sc = u8_special_cases(input, prev1);
+
+    // 3rd and 4th bytes of a sequence must be continuations
+    //
+    __m256i prev2 = u8_prev(input, prev_input, 2);
+    __m256i prev3 = u8_prev(input, prev_input, 3);
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+
+    return _mm256_xor_si256(must23, sc);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Non zero if the last 3 bytes of INPUT start a sequence longer than
+// what is left of the block
+//
+static inline __m256i u8_incomplete(__m256i input)
+{
+    const __m256i max_value = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+
+    return _mm256_subs_epu8(input, max_value);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Returns the offset of the first error or DSTR_NPOS
+//
+static size_t validate_avx2(const unsigned char* buff, size_t len)
+{
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (;; i += 32) {
+        __m256i input;
+        if (i + 32 <= len) {
+            input = _mm256_loadu_si256((const __m256i*)(buff + i)); }
+        else {
+            // zero padded tail, then one all zero block to catch a
+            // sequence cut at the end of the input
+            //
+            unsigned char tail[32] = { 0 };
+            if (i < len) {
+                memcpy(tail, buff + i, len - i); }
+            input = _mm256_loadu_si256((const __m256i*) tail); }
+
+        __m256i error;
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = prev_incomplete;
+            prev_incomplete = _mm256_setzero_si256(); }
+        else {
+            error = u8_check_block(input, prev_input);
+            prev_incomplete = u8_incomplete(input); }
+
+        if (!_mm256_testz_si256(error, error)) {
+            // rescan from a code point boundary for the exact offset
+            //
+            size_t from = (i >= 4) ? i - 4 : 0;
+            while (from > 0 && (buff[from] & 0xC0) == 0x80) {
+                --from; }
+            size_t offset = validate_scalar(buff, buff + from, buff + len);
+            return (offset != DSTR_NPOS) ? offset : len; }
+
+        prev_input = input;
+        if (i >= len) {
+            break; } }
+
+    return DSTR_NPOS;
+}
+/*-------------------------------------------------------------------------------*/
+#endif
+
+DSTR_BOOL dstr_utf8_validate_bl(const char* buff, size_t len, size_t* error_offset)
+{
+    const unsigned char* p = (const unsigned char*) buff;
+
+#if defined(__AVX2__)
+    size_t offset = validate_avx2(p, len);
+#else
+    size_t offset = validate_scalar(p, p, p + len);
+#endif
+
+    if (error_offset) {
+        *error_offset = offset; }
+
+    return offset == DSTR_NPOS;
+}
+/*-------------------------------------------------------------------------------*/
+
+DSTR_BOOL dstr_utf8_validate(CDSTR p, size_t* error_offset)
+{
+    return dstr_utf8_validate_bl(DBUF(p), DLEN(p), error_offset);
+}
+/*-------------------------------------------------------------------------------*/
+
+// Code points are counted as bytes that are not continuation bytes
+//
+static size_t count_leads(const unsigned char* p, size_t len)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i limit = _mm256_set1_epi8((char) 0xBF);    // -65
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+        count += popcount32((uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(x, limit))); }
+#endif
+
+    for (; i < len; ++i) {
+        count += ((p[i] & 0xC0) != 0x80); }
+
+    return count;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_utf8_length(CDSTR p)
+{
+    return count_leads((const unsigned char*) DBUF(p), DLEN(p));
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_utf8_offset_of(CDSTR p, size_t n)
+{
+    const unsigned char* s = (const unsigned char*) DBUF(p);
+    size_t len = DLEN(p);
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i limit = _mm256_set1_epi8((char) 0xBF);
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + i));
+        size_t leads = popcount32((uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(x, limit)));
+        if (leads > n) {
+            break; }
+        n -= leads; }
+#endif
+
+    for (; i < len; ++i) {
+        if ((s[i] & 0xC0) != 0x80) {
+            if (n == 0) {
+                return i; }
+            --n; } }
+
+    return (n == 0) ? len : DSTR_NPOS;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_utf8_to_utf16(CDSTR src, uint16_t* dest, size_t destlen)
+{
+    const unsigned char* p = (const unsigned char*) DBUF(src);
+    const unsigned char* end = p + DLEN(src);
+    size_t n = 0;
+
+    if (!dest) {
+        destlen = 0; }
+
+    while (p != end) {
+#if defined(__AVX2__)
+        if (end - p >= 32 && n + 32 <= destlen && is_ascii32(p)) {
+            __m256i x = _mm256_loadu_si256((const __m256i*) p);
+            _mm256_storeu_si256((__m256i*)(dest + n),      _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x)));
+            _mm256_storeu_si256((__m256i*)(dest + n + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1)));
+            p += 32;
+            n += 32;
+            continue; }
+#endif
+        uint32_t cp;
+        size_t k = decode_utf8(p, end, &cp);
+        if (k == 0) {
+            errno = EINVAL;
+            return DSTR_NPOS; }
+        p += k;
+
+        if (cp < 0x10000) {
+            if (n < destlen) {
+                dest[n] = (uint16_t) cp; }
+            n += 1; }
+        else {
+            cp -= 0x10000;
+            if (n + 1 < destlen) {
+                dest[n]     = (uint16_t)(0xD800 | (cp >> 10));
+                dest[n + 1] = (uint16_t)(0xDC00 | (cp & 0x3FF)); }
+            n += 2; } }
+
+    return n;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t dstr_utf8_to_utf32(CDSTR src, uint32_t* dest, size_t destlen)
+{
+    const unsigned char* p = (const unsigned char*) DBUF(src);
+    const unsigned char* end = p + DLEN(src);
+    size_t n = 0;
+
+    if (!dest) {
+        destlen = 0; }
+
+    while (p != end) {
+#if defined(__AVX2__)
+        if (end - p >= 32 && n + 32 <= destlen && is_ascii32(p)) {
+            for (int k = 0; k < 32; k += 8) {
+                __m128i x = _mm_loadl_epi64((const __m128i*)(p + k));
+                _mm256_storeu_si256((__m256i*)(dest + n + k), _mm256_cvtepu8_epi32(x)); }
+            p += 32;
+            n += 32;
+            continue; }
+#endif
+        uint32_t cp;
+        size_t k = decode_utf8(p, end, &cp);
+        if (k == 0) {
+            errno = EINVAL;
+            return DSTR_NPOS; }
+        p += k;
+
+        if (n < destlen) {
+            dest[n] = cp; }
+        n += 1; }
+
+    return n;
+}
+/*-------------------------------------------------------------------------------*/
+
+// Make room for LEN more bytes and return the tail of the buffer
+//
+static inline unsigned char* utf8_tail_reserve(DSTR p, size_t len)
+{
+    if (len > UINT32_MAX - DLEN(p)) {
+        errno = ENOMEM;
+        return NULL; }
+
+    if (!dstr_reserve(p, DLEN(p) + len)) {
+        return NULL; }
+
+    return (unsigned char*) DBUF(p) + DLEN(p);
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_utf16(DSTR dest, const uint16_t* src, size_t len)
+{
+    assert(dest != NULL);
+
+    // each UTF-16 unit is at most 3 bytes of UTF-8
+    //
+    if (len > UINT32_MAX / 3) {
+        errno = ENOMEM;
+        return DSTR_FAIL; }
+
+    unsigned char* first = utf8_tail_reserve(dest, 3 * len);
+    if (!first) {
+        return DSTR_FAIL; }
+
+    unsigned char* out = first;
+    size_t i = 0;
+
+    while (i < len) {
+#if defined(__AVX2__)
+        if (len - i >= 16) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+            if (_mm256_testz_si256(x, _mm256_set1_epi16((short) 0xFF80))) {
+                __m128i bytes = _mm_packus_epi16(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+                _mm_storeu_si128((__m128i*) out, bytes);
+                out += 16;
+                i += 16;
+                continue; } }
+#endif
+        uint32_t cp = src[i++];
+
+        if (cp >= 0xD800 && cp <= 0xDFFF) {
+            if (cp > 0xDBFF || i == len || src[i] < 0xDC00 || src[i] > 0xDFFF) {
+                DBUF(dest)[DLEN(dest)] = '\0';
+                errno = EINVAL;
+                return DSTR_FAIL; }
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (uint32_t)(src[i++] - 0xDC00); }
+
+        out = encode_utf8(out, cp); }
+
+    DLEN(dest) += (uint32_t)(out - first);
+    DBUF(dest)[DLEN(dest)] = '\0';
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
+
+int dstr_append_utf32(DSTR dest, const uint32_t* src, size_t len)
+{
+    assert(dest != NULL);
+
+    if (len > UINT32_MAX / 4) {
+        errno = ENOMEM;
+        return DSTR_FAIL; }
+
+    unsigned char* first = utf8_tail_reserve(dest, 4 * len);
+    if (!first) {
+        return DSTR_FAIL; }
+
+    unsigned char* out = first;
+    size_t i = 0;
+
+    while (i < len) {
+#if defined(__AVX2__)
+        if (len - i >= 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)(src + i));
+            if (_mm256_testz_si256(x, _mm256_set1_epi32((int) 0xFFFFFF80))) {
+                __m128i w = _mm_packus_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+                _mm_storel_epi64((__m128i*) out, _mm_packus_epi16(w, w));
+                out += 8;
+                i += 8;
+                continue; } }
+#endif
+        uint32_t cp = src[i++];
+
+        if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            DBUF(dest)[DLEN(dest)] = '\0';
+            errno = EINVAL;
+            return DSTR_FAIL; }
+
+        out = encode_utf8(out, cp); }
+
+    DLEN(dest) += (uint32_t)(out - first);
+    DBUF(dest)[DLEN(dest)] = '\0';
+    return DSTR_SUCCESS;
+}
+/*-------------------------------------------------------------------------------*/
@@ -8,6 +8,7 @@
 #include <random>
 #include <cctype>
 #include <cerrno>
+#include <cstring>
 #include <dstr/dstring.hpp>
 #include "dstr_internal.h"
 
@@ -169,6 +170,14 @@ void DString::grow_ctor(size_t len)
 }
 //-----------------------------------------------------------
 
+DString& DString::adopt(char* buf, size_t len, size_t cap)
+{
+    if (!dstr_adopt_buffer(pImp(), buf, len, cap)) {
+        throw DStringError("DString::adopt: invalid buffer"); }
+    return *this;
+}
+//-----------------------------------------------------------
+
 /*static*/
 DString DString::from_file(const char* fname)
 {
@@ -194,6 +203,82 @@ DString DString::from_cfile(FILE* fp)
 }
 //-----------------------------------------------------------
 
+DMappedFile::DMappedFile(const char* path)
+{
+    if (!dstr_map_file(path, &m_view)) {
+        DString msg = DString::c_format("Could not map file: %s: %s\n",
+                                        path,
+                                        strerror(errno));
+        throw DStringError(STD_MOVE(msg)); }
+}
+//-----------------------------------------------------------
+
+DStringWriter::DStringWriter(const char* path, int flags)
+{
+    if ((m_writer = dstr_writer_open(path, flags)) == NULL) {
+        DString msg = DString::c_format("Could not open file: %s: %s\n",
+                                        path,
+                                        strerror(errno));
+        throw DStringError(STD_MOVE(msg)); }
+}
+//-----------------------------------------------------------
+
+DStringWriter::DStringWriter(int fd, int flags)
+{
+    if ((m_writer = dstr_writer_fdopen(fd, flags)) == NULL) {
+        throw DStringError("Could not create writer: out of memory\n"); }
+}
+//-----------------------------------------------------------
+
+void DStringWriter::close()
+{
+    DSTR_Writer* w = m_writer;
+    m_writer = NULL;
+    if (!dstr_writer_close(w)) {
+        DString msg = DString::c_format("Could not close: %s\n",
+                                        strerror(errno));
+        throw DStringError(STD_MOVE(msg)); }
+}
+//-----------------------------------------------------------
+
+void DStringWriter::fail(const char* what)
+{
+    DString msg = DString::c_format("Could not %s: %s\n",
+                                    what,
+                                    strerror(errno));
+    throw DStringError(STD_MOVE(msg));
+}
+//-----------------------------------------------------------
+
+#if __cplusplus >= 201103L
+/*static*/
+std::future<std::vector<DString>> DString::from_files_async(std::vector<DString> paths)
+{
+    auto slurp_all = [](const std::vector<DString>& files) {
+        std::vector<DString> result(files.size());
+        std::vector<const char*> names(files.size());
+        std::vector<DSTR> out(files.size());
+        std::vector<int> errors(files.size());
+
+        for (size_t i = 0; i < files.size(); ++i) {
+            names[i] = files[i].c_str();
+            out[i] = result[i].pImp(); }
+
+        if (dstr_slurp_many(names.data(), names.size(), out.data(), errors.data()) != files.size()) {
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (errors[i] != 0) {
+                    DString msg = DString::c_format("Could not read file: %s: %s\n",
+                                                    names[i],
+                                                    strerror(errors[i]));
+                    throw DStringError(STD_MOVE(msg)); } } }
+        return result;
+    };
+
+    return std::async(std::launch::async, slurp_all, std::move(paths));
+}
+//-----------------------------------------------------------
+#endif
+
 /*static*/
 DString DString::c_format(const char* fmt, ...)
 {
@@ -226,53 +311,164 @@ DString& DString::append_sprintf(const char* fmt, ...)
 }
 //-----------------------------------------------------------
 
-std::istream& operator>>(std::istream& in, DString& s)
-{
-    char c;
+// Access to the get area of any streambuf. The protected members are
+// reached through pointers-to-member taken in a derived class, which is
+// legal and lets the extractors below scan the buffered bytes in place
+// instead of pulling characters one at a time through istream::get
+//
+namespace {
+struct StreambufAccess : std::streambuf {
+    static const char* get_begin(std::streambuf* sb) {
+        return (sb->*(&StreambufAccess::gptr))(); }
 
-    /* skip blanks */
-    while (in.get(c) && isspace(c))
-        ;
+    static const char* get_end(std::streambuf* sb) {
+        return (sb->*(&StreambufAccess::egptr))(); }
 
-    if (in) {
-        char buf[32];
-        size_t bindex = 0;
+    static void get_advance(std::streambuf* sb, size_t n) {
+        (sb->*(&StreambufAccess::gbump))(static_cast<int>(n)); }
+};
 
-        s.clear();
-        do {
-            buf[bindex] = c;
-            if (++bindex == sizeof(buf)) {
-                s.append(buf, bindex);
-                bindex = 0; }
-        } while (in.get(c) && !isspace(c));
+// isspace() as a table, the word scan below is hot enough for the
+// per character call to dominate
+//
+struct SpaceTable {
+    bool map[256];
+    SpaceTable() {
+        for (int c = 0; c < 256; ++c)
+            map[c] = isspace(c) != 0; }
+};
+
+inline bool is_space(char c)
+{
+    static const SpaceTable table;
+    return table.map[static_cast<unsigned char>(c)];
+}
+}
+//-----------------------------------------------------------
+
+std::istream& operator>>(std::istream& in, DString& s)
+{
+    typedef std::char_traits<char> traits;
+    std::ios_base::iostate state = std::ios_base::goodbit;
+    size_t extracted = 0;
 
-        if (bindex)
-            s.append(buf, bindex); }
+    std::istream::sentry se(in, false);
+    if (se) {
+        std::streambuf* sb = in.rdbuf();
+        std::streamsize width = in.width();
+        size_t limit = (width > 0) ? size_t(width) : size_t(DString::NPOS);
 
-    if (in)
-        in.putback(c);
+        s.clear();
+        try {
+            for (;;) {
+                if (sb->in_avail() <= 0 && sb->sgetc() == traits::eof()) {
+                    state |= std::ios_base::eofbit;
+                    break; }
+
+                const char* beg = StreambufAccess::get_begin(sb);
+                const char* end = StreambufAccess::get_end(sb);
+
+                if (beg == end) {
+                    // unbuffered streambuf, one character at a time
+                    //
+                    int c = sb->sgetc();
+                    if (is_space(char(c)))
+                        break;
+                    s.append(char(c));
+                    sb->sbumpc();
+                    if (++extracted == limit)
+                        break;
+                    continue; }
+
+                if (size_t(end - beg) > limit - extracted)
+                    end = beg + (limit - extracted);
+
+                const char* p = beg;
+                while (p < end && !is_space(*p))
+                    ++p;
+
+                size_t n = size_t(p - beg);
+                if (n) {
+                    s.append(beg, n);
+                    StreambufAccess::get_advance(sb, n);
+                    extracted += n; }
+
+                if (p < end || extracted == limit)
+                    break; }
+        }
+        catch (...) {
+            in.setstate(std::ios_base::badbit); }
+
+        in.width(0); }
+
+    if (extracted == 0)
+        state |= std::ios_base::failbit;
+
+    if (state)
+        in.setstate(state);
 
     return in;
 }
 //-----------------------------------------------------------
 
-std::istream& io_getline(std::istream& in, DString& s)
+std::istream& io_getline(std::istream& in, DString& s, char delim)
 {
-    char buf[128];
-    size_t bindex = 0;
-
-    s.clear();
+    typedef std::char_traits<char> traits;
+    std::ios_base::iostate state = std::ios_base::goodbit;
+    size_t extracted = 0;
 
-    char c;
-    while (in.get(c) && c != '\n') {
-        buf[bindex] = c;
-        if (++bindex == sizeof(buf)) {
-            s.append(buf, bindex);
-            bindex = 0; } }
+    std::istream::sentry se(in, true);
+    if (se) {
+        std::streambuf* sb = in.rdbuf();
 
-    if (bindex)
-        s.append(buf, bindex);
+        s.clear();
+        try {
+            for (;;) {
+                if (sb->in_avail() <= 0 && sb->sgetc() == traits::eof()) {
+                    state |= std::ios_base::eofbit;
+                    break; }
+
+                const char* beg = StreambufAccess::get_begin(sb);
+                const char* end = StreambufAccess::get_end(sb);
+
+                if (beg == end) {
+                    // unbuffered streambuf, one character at a time
+                    //
+                    char c = traits::to_char_type(sb->sbumpc());
+                    ++extracted;
+                    if (c == delim)
+                        break;
+                    s.append(c);
+                    continue; }
+
+                const char* p = (const char*) memchr(beg, delim, size_t(end - beg));
+                if (p) {
+                    size_t n = size_t(p - beg);
+                    s.append(beg, n);
+                    StreambufAccess::get_advance(sb, n + 1);
+                    extracted += n + 1;
+                    break; }
+
+                size_t n = size_t(end - beg);
+                s.append(beg, n);
+                StreambufAccess::get_advance(sb, n);
+                extracted += n; }
+        }
+        catch (...) {
+            in.setstate(std::ios_base::badbit); } }
+
+    if (extracted == 0)
+        state |= std::ios_base::failbit;
+
+    if (state)
+        in.setstate(state);
 
     return in;
 }
 //-----------------------------------------------------------
+
+std::istream& getline(std::istream& in, DString& s, char delim)
+{
+    return io_getline(in, s, delim);
+}
+//-----------------------------------------------------------
@@ -4,7 +4,10 @@
  * This file is part of DString C and C++ dynamic string library,
  * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
  */
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <exception>
 #include <dstr/dstring.hpp>
 #include "dstr_internal.h"
 
@@ -79,65 +82,367 @@ int DStringView::capture(DStringView pattern, size_t offset, DString& result,
 }
 /*-------------------------------------------------------------------------------*/
 
-int DStringView::capture(DStringView pattern,
-                         size_t offset,
-                         std::vector<DString>& vec,
-                         const char* opts) const
+// Options 'u' and 'V' turn on UTF-8 mode
+//
+static bool utf8_options(const char* opts)
+{
+    return opts && strpbrk(opts, "uV");
+}
+/*-------------------------------------------------------------------------------*/
+
+// Group matching by pattern string or by DRegex, for the shared
+// capture and split code below
+//
+namespace {
+struct PatternGroups {
+    DStringView pattern;
+    const char* opts;
+
+    int operator()(const DStringView& s, size_t offset, DString::MatchVector& m) const {
+        return s.match_groups(pattern, offset, m, opts); }
+
+    int each(CDSTR p, size_t offset, DSTR_Regex_Callback cb, void* ctx) const {
+        return dstr_regex_foreach(p, pattern.c_str(), offset, cb, ctx, opts); }
+
+    bool utf8() const { return utf8_options(opts); }
+};
+
+struct RegexGroups {
+    const DRegex& re;
+
+    int operator()(const DStringView& s, size_t offset, DString::MatchVector& m) const {
+        return s.match_groups(re, offset, m); }
+
+    int each(CDSTR p, size_t offset, DSTR_Regex_Callback cb, void* ctx) const {
+        return dstr_regex_foreach_re(re.get(), p, offset, cb, ctx); }
+
+    bool utf8() const { return re.utf8(); }
+};
+//-----------------------------------------------------------
+
+template <class Groups>
+int capture_imp(const DStringView& s, const Groups& match_groups,
+                size_t offset, std::vector<DString>& vec)
 {
     DString::MatchVector matches;
-    int rc = match_groups(pattern, offset, matches, opts);
+    int rc = match_groups(s, offset, matches);
 
     std::vector<DString> tmp;
     for (const auto& m: matches) {
         if (m.offset != DString::NPOS) {
-            tmp.push_back({*this, m.offset, m.length}); }
+            tmp.push_back({s, m.offset, m.length}); }
         else {
             tmp.push_back(""); } }
 
     vec.swap(tmp);
     return rc;
 }
+//-----------------------------------------------------------
+
+// Split pieces are appended straight from the match offsets, an
+// exception from push_back is carried over the C callback
+//
+struct SplitState {
+    const DStringView*    s;
+    size_t                offset;   // start of the next piece
+    std::vector<DString>* pieces;
+    std::exception_ptr    error;
+    bool                  utf8;     // step over characters, not bytes
+};
+
+extern "C" int split_on_match(void* ctx, const size_t* groups, size_t n_groups)
+{
+    SplitState* st = static_cast<SplitState*>(ctx);
+    try {
+        const DStringView& s = *st->s;
+        st->pieces->push_back({s, st->offset, groups[0] - st->offset});
+
+        // If have sub groups include them
+        //
+        for (size_t i = 1; i < n_groups; ++i) {
+            if (groups[2 * i] != DString::NPOS) {
+                st->pieces->push_back({s, groups[2 * i], groups[2 * i + 1] - groups[2 * i]}); }
+            else {
+                st->pieces->push_back(""); } }
+
+        // After an empty match the next piece starts past the character
+        // the search skipped, as dstr_regex_foreach does
+        //
+        if (groups[1] > groups[0]) {
+            st->offset = groups[1]; }
+        else {
+            st->offset = groups[0] + 1;
+            if (st->utf8) {
+                while (st->offset < s.size() && (s[st->offset] & 0xC0) == 0x80) {
+                    ++st->offset; } } }
+        return 0;
+    }
+    catch (...) {
+        st->error = std::current_exception();
+        return 1;
+    }
+}
+
+template <class Groups>
+int re_split_imp(const DStringView& s, CDSTR p, const Groups& groups,
+                 size_t offset, std::vector<DString>& strings)
+{
+    std::vector<DString> tmp;
+    SplitState st = { &s, offset, &tmp, nullptr, groups.utf8() };
+
+    int rc = groups.each(p, offset, split_on_match, &st);
+    if (st.error) {
+        std::rethrow_exception(st.error); }
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
+
+    tmp.push_back({s, st.offset, s.size() - st.offset});
+
+    tmp.swap(strings);
+    return 0;
+}
+} // namespace
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::capture(DStringView pattern,
+                         size_t offset,
+                         std::vector<DString>& vec,
+                         const char* opts) const
+{
+    PatternGroups groups = { pattern, opts };
+    return capture_imp(*this, groups, offset, vec);
+}
 /*-------------------------------------------------------------------------------*/
 
 int DStringView::re_split(DStringView pattern, size_t offset,
                           std::vector<DString>& strings,
                           const char* options) const
 {
-    std::vector<DString> tmp;
-
     // Spliting on empty pattern = split on each char
     //
     if (pattern.size() == 0) {
+        std::vector<DString> tmp;
         for (char ch : *this) {
             tmp.push_back(DString(ch, 1)); }
         tmp.swap(strings);
         return (int) strings.size(); }
 
-    DString::MatchVector matches;
-    int rc;
-    while ((rc = match_groups(pattern, offset, matches, options)) > 0) {
-        tmp.push_back({*this, offset, matches[0].offset - offset});
+    PatternGroups groups = { pattern, options };
+    return re_split_imp(*this, pImp(), groups, offset, strings);
+}
+/*-------------------------------------------------------------------------------*/
 
-        // If have sub groups include them
-        //
-        for (size_t i = 1; i < matches.size(); ++i) {
-            const auto& m = matches[i];
-            if (m.offset != DString::NPOS) {
-                tmp.push_back({*this, m.offset, m.length}); }
-            else {
-                tmp.push_back(""); } }
+//////////////////////////////////////////////////////////
+//
+//   DStringView Regex with a precompiled DRegex
+//
+//////////////////////////////////////////////////////////
 
-        if (matches[0].length == 0) {
-            offset = matches[0].offset + 1; }
-        else {
-            offset = matches[0].offset + matches[0].length; }
-    }
+DRegex::DRegex(DStringView pattern, const char* options)
+{
+    int rc = 0;
+    m_re = dstr_regex_compile(pattern.c_str(), options, &rc);
+    m_utf8 = utf8_options(options);
+    if (!m_re) {
+        if (rc) {
+            DString::on_regex_error(rc); }
+        throw DStringError("DRegex: empty pattern"); }
+}
+/*-------------------------------------------------------------------------------*/
 
-    tmp.push_back({*this, offset, size() - offset});
+bool DStringView::match(const DRegex& re, size_t offset) const
+{
+    return dstr_regex_exact_re(re.get(), pImp(), offset);
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t DStringView::match_contains(const DRegex& re, size_t offset) const
+{
+    return dstr_regex_contains_re(re.get(), pImp(), offset);
+}
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::match(const DRegex& re, size_t offset, DString::Match& m) const
+{
+    int rc = dstr_regex_match_re(re.get(), pImp(), offset, &m);
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
 
-    tmp.swap(strings);
     return rc;
 }
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::match_groups(const DRegex& re, size_t offset,
+                              DString::MatchVector& vec) const
+{
+    int rc = dstr_regex_match_groups_re(re.get(), pImp(), offset, vec.self());
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
+
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::capture(const DRegex& re, size_t offset, DString& result) const
+{
+    DString::Match mtch;
+    int rc = match(re, offset, mtch);
+
+    if (rc > 0 && mtch.offset != DString::NPOS) {
+        result = substr(mtch.offset, mtch.length); }
+
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::capture(const DRegex& re, size_t offset,
+                         std::vector<DString>& vec) const
+{
+    RegexGroups groups = { re };
+    return capture_imp(*this, groups, offset, vec);
+}
+/*-------------------------------------------------------------------------------*/
+
+int DStringView::re_split(const DRegex& re, size_t offset,
+                          std::vector<DString>& strings) const
+{
+    RegexGroups groups = { re };
+    return re_split_imp(*this, pImp(), groups, offset, strings);
+}
+/*-------------------------------------------------------------------------------*/
+
+bool DRegexMatches::advance()
+{
+    if (dstr_regex_iter_next(&m_iter)) {
+        m_match = DRegexMatch(m_view.data, m_iter.groups, m_iter.n_groups);
+        return true; }
+
+    if (m_iter.rc < 0) {
+        DString::on_regex_error(m_iter.rc); }
+
+    m_match = DRegexMatch();
+    return false;
+}
+/*-------------------------------------------------------------------------------*/
+
+namespace {
+DSTR_VIEW as_view(DStringView s)
+{
+    DSTR_VIEW v = DSTR_VIEW();
+    v.data = s.data();
+    v.length = (uint32_t) s.size();
+    return v;
+}
+} // namespace
+/*-------------------------------------------------------------------------------*/
+
+DRegexSet::DRegexSet(const std::vector<DString>& patterns, const char* options)
+{
+    std::vector<const char*> ptrs;
+    for (const auto& p : patterns) {
+        ptrs.push_back(p.c_str()); }
+
+    int rc = 0;
+    size_t at = 0;
+    m_set = dstr_regex_set_compile(ptrs.data(), ptrs.size(), options, &rc, &at);
+    if (!m_set) {
+        DSTR_TYPE err;
+        dstr_init_data(&err);
+        if (rc) {
+            dstr_regex_strerror(&err, rc); }
+
+        DString msg;
+        msg.sprintf("DRegexSet: pattern %zu: %s", at, rc ? dstr_cstr(&err) : "empty pattern");
+        dstr_clean_data(&err);
+        throw DStringError(std::move(msg)); }
+}
+/*-------------------------------------------------------------------------------*/
+
+int DRegexSet::first(DStringView s, size_t offset, DSTR_Regex_Match* m) const
+{
+    DSTR_VIEW v = as_view(s);
+    int rc = dstr_regex_set_first(m_set, (CDSTR) &v, offset, m);
+    if (rc < -1) {
+        DString::on_regex_error(rc); }
+
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+size_t DRegexSet::matches(DStringView s, std::vector<uint64_t>& bits, size_t offset) const
+{
+    DSTR_VIEW v = as_view(s);
+    size_t words = DSTR_REGEX_SET_WORDS(size());
+    bits.resize(words ? words : 1);
+    int rc = dstr_regex_set_matches(m_set, (CDSTR) &v, offset, bits.data());
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
+
+    return (size_t) rc;
+}
+/*-------------------------------------------------------------------------------*/
+
+std::vector<size_t> DRegexSet::which(DStringView s, size_t offset) const
+{
+    std::vector<uint64_t> bits;
+    std::vector<size_t> result;
+    if (matches(s, bits, offset) > 0) {
+        for (size_t i = 0; i < size(); ++i) {
+            if (test(bits, i)) {
+                result.push_back(i); } } }
+
+    return result;
+}
+/*-------------------------------------------------------------------------------*/
+
+namespace {
+DSTR_Regex_Stream* stream_check(DSTR_Regex_Stream* s, const char* source)
+{
+    if (!s) {
+        DString msg = DString::c_format("DRegexStream: %s: %s\n", source, strerror(errno));
+        throw DStringError(std::move(msg)); }
+    return s;
+}
+} // namespace
+/*-------------------------------------------------------------------------------*/
+
+DRegexStream::DRegexStream(const DRegex& re, const char* path, size_t window)
+    : m_stream(stream_check(dstr_regex_stream_open(re.get(), path, window), path)),
+      m_base(0)
+{
+}
+/*-------------------------------------------------------------------------------*/
+
+DRegexStream::DRegexStream(const DRegex& re, int fd, size_t window)
+    : m_stream(stream_check(dstr_regex_stream_fdopen(re.get(), fd, window), "descriptor")),
+      m_base(0)
+{
+}
+/*-------------------------------------------------------------------------------*/
+
+DRegexStream::DRegexStream(const DRegex& re, FILE* fp, size_t window)
+    : m_stream(stream_check(dstr_regex_stream_from_stream(re.get(), fp, window), "stream")),
+      m_base(0)
+{
+}
+/*-------------------------------------------------------------------------------*/
+
+bool DRegexStream::next()
+{
+    DSTR_Regex_Stream_Match m;
+    int rc = dstr_regex_stream_next(m_stream, &m);
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
+
+    if (rc == 0) {
+        m_match = DRegexMatch();
+        return false; }
+
+    m_match = DRegexMatch(m.data, m.groups, m.n_groups);
+    m_base = m.base;
+    return true;
+}
+/*-------------------------------------------------------------------------------*/
 
 ////////////////////////////////////////////////////////////
 //
@@ -158,4 +463,14 @@ int DString::subst_inplace(DStringView pattern, size_t offset,
 }
 /*-------------------------------------------------------------------------------*/
 
+int DString::subst_inplace(const DRegex& re, size_t offset, DStringView replacement)
+{
+    int rc = dstr_regex_substitute_re(re.get(), pImp(), offset, replacement.c_str());
+    if (rc < 0) {
+        DString::on_regex_error(rc); }
+
+    return rc;
+}
+/*-------------------------------------------------------------------------------*/
+
 #endif
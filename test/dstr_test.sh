@@ -7,16 +7,18 @@ script_full_name=$(readlink -f $0)
 script_dir=$(dirname $script_full_name)
 pushd $script_dir
 
+CSRCFILES="../src/dstr.c ../src/dstr_conv.c ../src/dstr_codec.c ../src/dstr_utf8.c ../src/dstr_io.c"
+
 for COMP in gcc clang; do
 	echo ">>>> VALGRIND ($COMP) TEST..."
-	$COMP -march=x86-64-v3 -I../include -O0 -Og test_dstr.c ../src/dstr.c -o test_dstr
+	$COMP -march=x86-64-v3 -I../include -pthread -O0 -Og test_dstr.c $CSRCFILES -o test_dstr
 	valgrind --quiet ./test_dstr
 	rm -f test_dstr
 	echo ">>>> OK"
 	echo
 
 	echo ">>>> SANITZE ($COMP) TEST"
-	$COMP -march=x86-64-v3 -I../include -fsanitize=address -O0 -Og test_dstr.c ../src/dstr.c -o test_dstr
+	$COMP -march=x86-64-v3 -I../include -fsanitize=address -pthread -O0 -Og test_dstr.c $CSRCFILES -o test_dstr
 	./test_dstr
 	rm -f test_dstr
 	echo ">>>> OK"
@@ -25,8 +27,8 @@ done
 
 # Test with C++ compilation
 #
-CXXFLAGS="-march=x86-64-v3 -I../include -x c++ -std=c++20 -W -Wall -Wextra"
-SRCFILES="test_dstring.cpp ../src/dstring.cpp ../src/dstr.c"
+CXXFLAGS="-march=x86-64-v3 -I../include -pthread -x c++ -std=c++20 -W -Wall -Wextra"
+SRCFILES="test_dstring.cpp ../src/dstring.cpp $CSRCFILES"
 
 for COMP in g++ clang++; do
 	echo ">>>> VALGRIND ($COMP) TEST..."
@@ -10,6 +10,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <dstr/dstr.h>
 
 
@@ -99,9 +100,14 @@ void test_empty_dstr()
     DSTR s3 = dstrnew_reserve(0);
     DSTR s4 = dstrnew_reserve(100);
     DSTR s5 = dstrnew(NULL);
+#if defined(DSTR_BINARY_SAFE)
+    DSTR s6 = dstrnew_cc('\0', 0);     // NUL bytes are kept in binary safe builds
+    DSTR s8 = dstrnew_bl("", 0);
+#else
     DSTR s6 = dstrnew_cc('\0', 100);
-    DSTR s7 = dstrnew_cc('C', 0);
     DSTR s8 = dstrnew_bl("", 100);
+#endif
+    DSTR s7 = dstrnew_cc('C', 0);
 
     assert(dstrlen(s1) == 0);
     assert(dstrlen(s2) == 0);
@@ -163,8 +169,13 @@ void test_char_ctor()
     assert( dstrgetc(s2, 0) == 'B' );
 
     DSTR s3 = dstrnew_cc('\0', 5);
+#if defined(DSTR_BINARY_SAFE)
+    assert( dstrlen(s3) == 5 );
+    assert( dstr_equal_bl(s3, "\0\0\0\0\0", 5) );
+#else
     assert( dstrlen(s3) == 0 );
     assert( dstreq(s3, "") );
+#endif
 
     dstrfree(s1);
     dstrfree(s2);
@@ -216,10 +227,15 @@ void test_buff_ctor()
     assert(dstrlen(s4) == 0);
     assert(dstreq(s4, ""));
 
-    // failed
-    DSTR s5 = dstrnew_bl("", 10);
+    // only NUL bytes
+    static const char nuls[10] = { 0 };
+    DSTR s5 = dstrnew_bl(nuls, 10);
+#if defined(DSTR_BINARY_SAFE)
+    assert(dstrlen(s5) == 10 && dstr_equal_bl(s5, nuls, 10));
+#else
     assert( dstreq(s5, "") );
     assert(dstrlen(s5) == 0);
+#endif
 
     dstrfree(s1);
     dstrfree(s2);
@@ -376,9 +392,17 @@ void test_append()
     assert( dstreq(s5, "hello"));
 
     dstrcat_c(s5, '\0');
+#if defined(DSTR_BINARY_SAFE)
+    assert( dstr_equal_bl(s5, "hello\0", 6));
+    dstr_chop(s5);
+#endif
     assert( dstreq(s5, "hello"));
 
-    dstrcat_bl(s5, "_ABC\0EFG", 10);
+    dstrcat_bl(s5, "_ABC\0EFG", 9);
+#if defined(DSTR_BINARY_SAFE)
+    assert( dstr_equal_bl(s5, "hello_ABC\0EFG", 14));
+    dstr_resize(s5, 9);
+#endif
     assert( dstreq(s5, "hello_ABC"));
 
     dstrcat_bl(s5, NULL, 10);
@@ -595,7 +619,11 @@ void test_insert()
     dinsert(s1, 4, NULL);
     assert( dstreq(s1, "hellXXoX"));
 
-    dinsert_bl(s1, 0, "XXX", DSTR_NPOS);
+#if defined(DSTR_BINARY_SAFE)
+    dinsert_bl(s1, 0, "XXX", 3);
+#else
+    dinsert_bl(s1, 0, "XXX", DSTR_NPOS);      // up to the NUL
+#endif
     assert( dstreq(s1, "XXXhellXXoX"));
 
     dinsert_bl(s1, 0, NULL, DSTR_NPOS);
@@ -665,6 +693,10 @@ void test_replace()
 
 
     dreplace_cc(s1, 5, 5, '\0', 1);
+#if defined(DSTR_BINARY_SAFE)
+    assert( dstr_equal_bl(s1, "hello\0", 6) );
+    dstr_resize(s1, 5);
+#endif
     assert( dstreq(s1, "hello") );
 
     dreplace(s1, 0, DSTR_NPOS, "world");
@@ -674,11 +706,15 @@ void test_replace()
     dreplace_bl(s1, 0, DSTR_NPOS, NULL, 100);
     assert( dstreq(s1, ""));
 
+#if !defined(DSTR_BINARY_SAFE)
+    // NUL truncates in text builds
+    //
     dreplace_cc(s2, 2, 8,'\0', 100);
     assert( dstreq(s2, "wo"));
 
     dreplace_cc(s2, 0, 2,'\0', 100);
     assert( dstreq(s2, ""));
+#endif
 
     DSTR s3 = dstrnew("H World");
     const char* ps3 = dstrdata(s3) + dstrstr(s3, 0, "World");
@@ -885,6 +921,82 @@ void test_find()
 }
 //-------------------------------------------------
 
+// Search and compare go by length, NUL bytes in a view are ordinary bytes
+//
+void test_binary()
+{
+    TRACE_FN();
+
+    static const char bytes[] = "ab\0cd\0ab\0cd\0\xff";
+
+#if defined(DSTR_BINARY_SAFE)
+    // a view passed as a CDSTR may hold NUL bytes only in binary safe
+    // builds, text builds require length == strlen
+    //
+    DSTR_VIEW v;
+    v.data = bytes;
+    v.length = sizeof(bytes) - 1;
+    CDSTR b = (CDSTR) &v;
+
+    assert(dstr_find_c(b, 0, '\0') == 2);
+    assert(dstr_find_c(b, 3, '\0') == 5);
+    assert(dstr_rfind_c(b, DSTR_NPOS, '\0') == 11);
+    assert(dstr_find_c(b, 0, '\xff') == 12);
+    assert(dstr_find_bl(b, 0, "d\0a", 3) == 4);
+    assert(dstr_find_bl(b, 5, "d\0a", 3) == DSTR_NPOS);
+    assert(dstr_ifind_bl(b, 0, "CD\0", 3) == 3);
+    assert(dstr_rfind_bl(b, DSTR_NPOS, "cd\0", 3) == 9);
+    assert(dstr_irfind_bl(b, 8, "AB\0", 3) == 6);
+    assert(dstr_find_bl(b, 0, "", 0) == 0);
+    assert(dstr_prefix_bl(b, "ab\0c", 4) && !dstr_prefix_bl(b, "ab\0d", 4));
+    assert(dstr_iprefix_bl(b, "AB\0C", 4));
+    assert(dstr_suffix_bl(b, "d\0\xff", 3) && dstr_isuffix_bl(b, "D\0\xff", 3));
+
+    DSTR_VIEW nul;
+    nul.data = "\0";
+    nul.length = 1;
+    assert(dstr_count_ds(b, (CDSTR) &nul) == 4);
+#endif
+
+    // patterns are not read past their length
+    //
+    DSTR s = dstrnew("xxabcxxabcdef");
+    assert(dstr_find_bl(s, 0, "abcdef", 3) == 2);
+    assert(dstr_rfind_bl(s, DSTR_NPOS, "abcdef", 3) == 7);
+    assert(dstr_suffix_bl(s, "defg", 3));
+    assert(dstr_equal_bl(s, "xxabcxxabcdef", 13));
+    assert(dstr_compare_bl(s, "xxabcxxabcdef\0", 14) < 0);
+    assert(dstr_compare_bl(s, "xxabcxxabcdee", 13) > 0);
+    assert(dstr_compare_sz(s, "xxabc") > 0);
+    assert(!dstr_equal_bl(s, "xxabc", 5));
+    assert(dstr_find_bl(s, 0, "abc\0", 4) == DSTR_NPOS);
+
+#if defined(DSTR_BINARY_SAFE)
+    // NUL bytes are kept by builders and file input
+    //
+    dstr_assign_bl(s, bytes, sizeof(bytes) - 1);
+    assert(dstr_equal_bl(s, bytes, sizeof(bytes) - 1));
+    dstr_append_char(s, '\0');
+    assert(dstrlen(s) == sizeof(bytes));
+
+    const char* fname = "dstr_binary_test.tmp";
+    FILE* fp = fopen(fname, "wb");
+    assert(fp);
+    fwrite(bytes, 1, sizeof(bytes), fp);
+    fclose(fp);
+    dstr_clear(s);
+    assert(dstr_assign_fromfile(s, fname) && dstr_equal_bl(s, bytes, sizeof(bytes)));
+    remove(fname);
+#else
+    // text builds stop at the NUL
+    //
+    dstr_assign_bl(s, bytes, sizeof(bytes) - 1);
+    assert(dstreq(s, "ab"));
+#endif
+    dstrfree(s);
+}
+//-------------------------------------------------
+
 void test_rfind()
 {
     TRACE_FN();
@@ -1065,6 +1177,349 @@ void test_fgets()
 }
 //-------------------------------------------------
 
+void test_map_file()
+{
+    TRACE_FN();
+
+    DSTR_VIEW v;
+    DSTR s = dstrnew_slurp(__FILE__);
+    assert(s && dstr_map_file(__FILE__, &v));
+    assert(v.length == dstrlen(s) && memcmp(v.data, dstrdata(s), v.length) == 0);
+    assert(v.data[v.length] == '\0');
+    assert(dstr_find_sz((CDSTR) &v, 0, "test_map_file") == dstr_find_sz(s, 0, "test_map_file"));
+    dstr_unmap_file(&v);
+    assert(v.length == 0);
+
+    // sizes that end exactly on a page boundary are still NUL terminated
+    //
+    const char* fname = "dstr_map_test.tmp";
+    for (size_t size = 4095; size <= 8192; size += (size == 4097) ? 4095 : 1) {
+        FILE* fp = fopen(fname, "wb");
+        assert(fp);
+        for (size_t i = 0; i < size; ++i) {
+            fputc('a' + (int)(i % 26), fp); }
+        fclose(fp);
+
+        assert(dstr_map_file(fname, &v) && v.length == size);
+        assert(v.data[size - 1] == 'a' + (int)((size - 1) % 26) && v.data[size] == '\0');
+        dstr_unmap_file(&v);
+
+        // slurp sized by fstat
+        //
+        dstr_clear(s);
+        assert(dstr_assign_fromfile(s, fname) && dstrlen(s) == size); }
+
+    fclose(fopen(fname, "wb"));
+    assert(dstr_map_file(fname, &v) && v.length == 0 && *v.data == '\0');
+    dstr_unmap_file(&v);
+    remove(fname);
+
+    errno = 0;
+    assert(!dstr_map_file("no/such/file", &v) && errno == ENOENT);
+    dstrfree(s);
+}
+//-------------------------------------------------
+
+void test_slurp_many()
+{
+    TRACE_FN();
+
+    // this file many times (more than one io_uring batch), a missing file,
+    // a directory and an empty file
+    //
+    const char* empty = "dstr_slurp_test.tmp";
+    fclose(fopen(empty, "wb"));
+
+    enum { N = 300 };
+    const char* paths[N];
+    DSTR out[N];
+    int errors[N];
+    for (size_t i = 0; i < N; ++i) {
+        paths[i] = __FILE__;
+        out[i] = dstrnew("old contents"); }
+    paths[7] = "no/such/file";
+    paths[150] = ".";
+    paths[299] = empty;
+
+    DSTR expected = dstrnew_slurp(__FILE__);
+    assert(dstr_slurp_many(paths, N, out, errors) == N - 2);
+    for (size_t i = 0; i < N; ++i) {
+        if (i == 7) {
+            assert(errors[i] == ENOENT && dstrlen(out[i]) == 0); }
+        else if (i == 150) {
+            assert(errors[i] != 0 && dstrlen(out[i]) == 0); }
+        else if (i == 299) {
+            assert(errors[i] == 0 && dstrlen(out[i]) == 0); }
+        else {
+            assert(errors[i] == 0 && dstreq(out[i], dstrdata(expected))); } }
+
+    assert(dstr_slurp_many(paths + 6, 3, out, NULL) == 2);
+
+    for (size_t i = 0; i < N; ++i) {
+        dstrfree(out[i]); }
+    dstrfree(expected);
+    remove(empty);
+}
+//-------------------------------------------------
+
+// Per chunk results of dstr_file_foreach_line_parallel, each chunk is
+// handled by one thread so no locking is needed
+//
+typedef struct {
+    size_t lines[64];
+    size_t bytes[64];
+    size_t last[64];    // number of the previous line in the chunk
+    size_t stop_at;
+} LineCounts;
+
+static int count_line(void* ctx, size_t chunk, const DSTR_VIEW* line)
+{
+    LineCounts* c = (LineCounts*) ctx;
+    assert(chunk < 64);
+
+    size_t number = (size_t) strtoul(line->data, NULL, 10);
+    assert(c->lines[chunk] == 0 || number > c->last[chunk]);
+    c->last[chunk] = number;
+    c->lines[chunk] += 1;
+    c->bytes[chunk] += line->length;
+    return number == c->stop_at;
+}
+
+void test_foreach_line_parallel()
+{
+    TRACE_FN();
+
+    // 5 chunks of numbered lines, one of them covers chunk 1, no final
+    // newline
+    //
+    const char* fname = "dstr_lines_test.tmp";
+    FILE* fp = fopen(fname, "wb");
+    assert(fp);
+    size_t total_lines = 0;
+    size_t total_bytes = 0;
+    for (size_t i = 1; total_bytes < 5 * DSTR_LINE_CHUNK; ++i) {
+        int n = fprintf(fp, "%zu %.*s", i, (int) (i % 97), "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+        if (i == 40000) {
+            for (size_t k = 0; k < 2 * DSTR_LINE_CHUNK; ++k) {
+                fputc('x', fp); }
+            n += 2 * DSTR_LINE_CHUNK; }
+        total_lines += 1;
+        total_bytes += (size_t) n;
+        if (total_bytes < 5 * DSTR_LINE_CHUNK) {
+            fputc('\n', fp);
+            total_bytes += 1; } }
+    fclose(fp);
+
+    static LineCounts c;
+    for (size_t nthreads = 0; nthreads <= 4; ++nthreads) {
+        memset(&c, 0, sizeof(c));
+        assert(dstr_file_foreach_line_parallel(fname, nthreads, count_line, &c));
+
+        size_t lines = 0;
+        size_t bytes = 0;
+        for (size_t k = 0; k < 64; ++k) {
+            lines += c.lines[k];
+            bytes += c.bytes[k]; }
+        assert(lines == total_lines);
+        assert(bytes + total_lines - 1 == total_bytes);
+        assert(c.lines[0] > 0 && c.lines[1] == 0);    // long line starts in chunk 0
+        assert(c.lines[4] > 0 && c.last[4] == total_lines && c.lines[5] == 0); }
+
+    // stop early: chunk 0 ends at the line that stopped the run, how far
+    // other threads got depends on timing
+    //
+    for (size_t nthreads = 1; nthreads <= 4; nthreads += 3) {
+        memset(&c, 0, sizeof(c));
+        c.stop_at = 10;
+        assert(dstr_file_foreach_line_parallel(fname, nthreads, count_line, &c));
+        assert(c.lines[0] == 10 && c.last[0] == 10); }
+
+    fclose(fopen(fname, "wb"));
+    memset(&c, 0, sizeof(c));
+    assert(dstr_file_foreach_line_parallel(fname, 4, count_line, &c) && c.lines[0] == 0);
+    remove(fname);
+
+    errno = 0;
+    assert(!dstr_file_foreach_line_parallel("no/such/file", 4, count_line, &c) && errno == ENOENT);
+}
+//-------------------------------------------------
+
+void test_writev()
+{
+    TRACE_FN();
+
+    // more strings than one writev batch, short and long ones, with
+    // newlines and NULL entries
+    //
+    enum { N = 3000 };
+    CDSTR strs[N];
+    DSTR expected = dstrnew_empty();
+    DSTR got = dstrnew_empty();
+    for (size_t i = 0; i < N; ++i) {
+        DSTR s = dstrnew_empty();
+        if (i % 100 != 99) {
+            dstr_assign_sprintf(s, "line %zu", i); }
+        if (i % 500 == 0) {
+            dstr_append_cc(s, 'y', 1000); }
+        dstr_append_ds(expected, s);
+        dstr_append_char(expected, '\n');
+        strs[i] = s; }
+
+    const char* fname = "dstr_writev_test.tmp";
+    FILE* fp = fopen(fname, "wb");
+    assert(fp);
+    assert(dstr_writev(fileno(fp), strs, N, DSTR_WRITE_NEWLINE));
+    CDSTR nulls[2] = { NULL, strs[1] };
+    assert(dstr_writev(fileno(fp), nulls, 2, 0));
+    fclose(fp);
+    dstr_append_ds(expected, strs[1]);
+    assert(dstr_assign_fromfile(got, fname) && dstreq(got, dstrdata(expected)));
+
+    // writer: views of one buffer (merged), copies and large copies
+    //
+    DSTR_Writer* w = dstr_writer_open(fname, DSTR_WRITE_NEWLINE);
+    assert(w);
+    dstr_clear(expected);
+    for (size_t i = 0; i < N; ++i) {
+        assert(dstr_writer_add_dstr(w, strs[i]));
+        assert(dstr_writer_add(w, dstrdata(strs[i]), dstrlen(strs[i]) ? 2 : 0));
+        char buff[32];
+        int n = sprintf(buff, "#%zu", i);
+        assert(dstr_writer_add_copy(w, buff, (size_t) n));
+        dstr_append_sprintf(expected, "%s\n%.2s\n%s\n", dstrdata(strs[i]), dstrdata(strs[i]), buff); }
+
+    DSTR big = dstrnew_cc('x', 100000);
+    assert(dstr_writer_add_copy(w, dstrdata(big), dstrlen(big)));
+    dstr_append_ds(expected, big);
+    dstr_append_char(expected, '\n');
+    assert(dstr_writer_add(w, dstrdata(big), 1000));
+    dstr_append_cc(expected, 'x', 1000);
+    dstr_append_char(expected, '\n');
+    assert(dstr_writer_add(w, "abc", 3) && dstr_writer_add(w, "abc" + 3, 0));
+    dstr_append_sz(expected, "abc\n\n");
+    assert(dstr_writer_close(w));
+    assert(dstr_assign_fromfile(got, fname) && dstreq(got, dstrdata(expected)));
+    remove(fname);
+
+    // errors stick
+    //
+    errno = 0;
+    assert(!dstr_writev(-1, strs, 1, 0) && errno == EBADF);
+    w = dstr_writer_fdopen(-1, 0);
+    assert(w && dstr_writer_add(w, "abc", 3));
+    assert(!dstr_writer_flush(w) && dstr_writer_error(w) == EBADF);
+    assert(!dstr_writer_add(w, "abc", 3) && !dstr_writer_close(w));
+    assert(!dstr_writer_open("no/such/dir/file", 0) && errno == ENOENT);
+
+    for (size_t i = 0; i < N; ++i) {
+        dstrfree((DSTR) strs[i]); }
+    dstrfree(big);
+    dstrfree(got);
+    dstrfree(expected);
+}
+//-------------------------------------------------
+
+void test_reader()
+{
+    TRACE_FN();
+
+    // same lines as dstr_fgetline
+    //
+    FILE* fp = fopen(__FILE__, "r");
+    DSTR_Reader* r = dstr_reader_open(__FILE__);
+    if (!fp || !r) {
+        fprintf(stderr, "couldn't open %s: %s\n", __FILE__, strerror(errno));
+        return;
+    }
+
+    DSTR s1 = dstrnew_empty();
+    DSTR s2 = dstrnew_empty();
+    int line_count = 0;
+    while (dfgetline(s1, fp) != EOF) {
+        assert(dstr_reader_next(r, s2) == DSTR_SUCCESS);
+        assert(dstreq(s2, dstrdata(s1)));
+        ++line_count;
+    }
+    assert(dstr_reader_next(r, s2) == EOF && dstr_reader_error(r) == 0);
+    dstr_reader_close(r);
+    fclose(fp);
+    printf("dstr_reader: %d lines\n", line_count);
+
+    // CRLF, a line longer than the reader's block and no final newline
+    //
+    fp = tmpfile();
+    assert(fp);
+    fputs("one\r\ntwo\n\r\n", fp);
+    for (int i = 0; i < 200000; ++i) {
+        fputc('a' + i % 26, fp); }
+    fputs("\nlast", fp);
+    rewind(fp);
+
+    DSTR_VIEW v;
+    r = dstr_reader_from_stream(fp);
+    dstr_reader_set_delims(r, "\n", DSTR_READER_CRLF);
+    assert(dstr_reader_next_view(r, &v) && v.length == 3 && memcmp(v.data, "one", 3) == 0);
+    assert(dstr_reader_next_view(r, &v) && v.length == 3 && memcmp(v.data, "two", 3) == 0);
+    assert(dstr_reader_next_view(r, &v) && v.length == 0);
+    assert(dstr_reader_next_view(r, &v) && v.length == 200000);
+    assert(v.data[0] == 'a' && v.data[199999] == 'a' + 199999 % 26);
+    assert(dstr_reader_next(r, s2) && dstreq(s2, "last"));
+    assert(dstr_reader_next_view(r, &v) == EOF);
+    dstr_reader_close(r);
+    fclose(fp);
+
+    // line lengths around the chunk sizes used by dstr_fgetline, read
+    // by both
+    //
+    fp = tmpfile();
+    assert(fp);
+    int step = 0;
+    for (int i = 0; i < 1100; i += step) {
+        for (int k = 0; k < i; ++k) {
+            fputc('0' + (i + k) % 10, fp); }
+        fputc('\n', fp);
+        step = (i < 40 || (i > 490 && i < 530) || i > 1010) ? 1 : 7; }
+    fputs("tail", fp);
+    fflush(fp);
+
+    rewind(fp);
+    r = dstr_reader_from_stream(fp);
+    for (int i = 0; i < 1100; i += step) {
+        assert(dstr_reader_next(r, s2) == DSTR_SUCCESS && dstrlen(s2) == (size_t) i);
+        step = (i < 40 || (i > 490 && i < 530) || i > 1010) ? 1 : 7; }
+    assert(dstr_reader_next(r, s2) && dstreq(s2, "tail"));
+    dstr_reader_close(r);
+
+    rewind(fp);
+    for (int i = 0; i < 1100; i += step) {
+        assert(dfgetline(s1, fp) == DSTR_SUCCESS && dstrlen(s1) == (size_t) i);
+        for (int k = 0; k < i; ++k) {
+            assert(dstrdata(s1)[k] == '0' + (i + k) % 10); }
+        step = (i < 40 || (i > 490 && i < 530) || i > 1010) ? 1 : 7; }
+    assert(dfgetline(s1, fp) == DSTR_SUCCESS && dstreq(s1, "tail"));
+    assert(dfgetline(s1, fp) == EOF);
+    fclose(fp);
+
+    // tokens
+    //
+    fp = tmpfile();
+    assert(fp);
+    fputs("  alpha\tbeta\n\n  gamma  ", fp);
+    rewind(fp);
+    r = dstr_reader_from_stream(fp);
+    dstr_reader_set_delims(r, " \t\r\n", DSTR_READER_SKIP_EMPTY);
+    assert(dstr_reader_next(r, s2) && dstreq(s2, "alpha"));
+    assert(dstr_reader_next(r, s2) && dstreq(s2, "beta"));
+    assert(dstr_reader_next(r, s2) && dstreq(s2, "gamma"));
+    assert(dstr_reader_next(r, s2) == EOF);
+    dstr_reader_close(r);
+    fclose(fp);
+
+    dstrfree(s1);
+    dstrfree(s2);
+}
+//-------------------------------------------------
+
 #define TEST_ASCII_UPPER(before, after) do {                \
         DSTR s = dstrnew(before);                           \
         dstrupper(s);                                       \
@@ -1141,6 +1596,70 @@ void test_swap()
 }
 //-------------------------------------------------
 
+void test_adopt_release()
+{
+    TRACE_FN();
+
+    DSTR s = dstrnew("previous contents");
+
+    // heap sized buffer is taken over as is, the capacity rounded down to
+    // a multiple of DSTR_INITIAL_CAPACITY
+    //
+    size_t cap = 1000;
+    char* buf = (char*) malloc(cap);
+    memset(buf, 'x', 600);
+    assert(dstr_adopt_buffer(s, buf, 600, cap));
+    assert(dstrdata(s) == buf);
+    assert(dstrlen(s) == 600 && dstrcap(s) == 1000 - 1000 % DSTR_INITIAL_CAPACITY);
+    assert(dstrdata(s)[600] == '\0');
+    assert(dstr_append_sz(s, "tail") && dstrlen(s) == 604);
+
+    size_t len = 0;
+    char* out = dstr_release_buffer(s, &len, &cap);
+    assert(len == 604 && cap == 1000 - 1000 % DSTR_INITIAL_CAPACITY);
+    assert(out[0] == 'x' && strcmp(out + 600, "tail") == 0);
+    assert(dstrempty(s) && dstrcap(s) == DSTR_INITIAL_CAPACITY);
+
+    // and can be handed back
+    //
+    assert(dstr_adopt_buffer(s, out, 3, cap));
+    assert(dstreq(s, "xxx") && dstrdata(s) == out);
+
+    // small buffers end up in the SSO area
+    //
+    buf = (char*) malloc(8);
+    memcpy(buf, "abc", 3);
+    assert(dstr_adopt_buffer(s, buf, 3, 8));
+    assert(dstreq(s, "abc") && dstrcap(s) == DSTR_INITIAL_CAPACITY);
+
+    out = dstr_release_buffer(s, NULL, &cap);
+    assert(strcmp(out, "abc") == 0 && cap == 4);
+    assert(dstrempty(s));
+    free(out);
+
+    // rounding down would drop the room for the terminator: grown instead
+    //
+    buf = (char*) malloc(101);
+    memset(buf, 'y', 100);
+    assert(dstr_adopt_buffer(s, buf, 100, 101));
+    assert(dstrlen(s) == 100 && dstrcap(s) > 100);
+    assert(dstrcap(s) % DSTR_INITIAL_CAPACITY == 0 && dstrdata(s)[100] == '\0');
+    assert(dstr_append_sz(s, "z") && dstrdata(s)[100] == 'z');
+    dstr_clear(s);
+
+    // no room for the terminator: refused, caller keeps the buffer
+    //
+    buf = (char*) malloc(64);
+    errno = 0;
+    assert(!dstr_adopt_buffer(s, buf, 64, 64) && errno == EINVAL);
+    assert(!dstr_adopt_buffer(s, NULL, 0, 1));
+    assert(dstrempty(s));
+    free(buf);
+
+    dstrfree(s);
+}
+//-------------------------------------------------
+
 void test_ffo()
 {
     TRACE_FN();
@@ -1406,6 +1925,344 @@ void test_atoi_itos()
 }
 //-------------------------------------------------
 
+static void check_stoll(const char* buf, int base)
+{
+    size_t len = strlen(buf);
+    size_t index;
+    char* endp;
+
+    errno = 0;
+    long long n = dstr_to_llong_bl(buf, len, &index, base);
+    int err = errno;
+
+    errno = 0;
+    long long e = strtoll(buf, &endp, base);
+    assert(n == e && index == (size_t)(endp - buf));
+    assert(err == errno || (errno == 0 && err == EINVAL && index == 0));
+
+    errno = 0;
+    unsigned long long un = dstr_to_ullong_bl(buf, len, &index, base);
+    err = errno;
+
+    errno = 0;
+    unsigned long long ue = strtoull(buf, &endp, base);
+    assert(un == ue && index == (size_t)(endp - buf));
+    assert(err == errno || (errno == 0 && err == EINVAL && index == 0));
+}
+//-------------------------------------------------
+
+void test_parse_integer()
+{
+    TRACE_FN();
+
+    size_t index;
+    DSTR s = dstrnew("  -12345678901234567xyz");
+    assert(dstrtoll(s, &index, 10) == -12345678901234567LL && index == 20);
+
+    dstrcpy(s, "99999999999999999999");
+    errno = 0;
+    assert(dstrtoll(s, &index, 10) == LLONG_MAX && errno == ERANGE);
+    errno = 0;
+    assert(datoll(s) == LLONG_MAX && errno == ERANGE);
+
+    dstrcpy(s, "3000000000");
+    errno = 0;
+    assert(dstrtoi(s, &index, 10) == INT_MAX && errno == ERANGE && index == 10);
+
+    dstrcpy(s, "0xDeadBeefCafeBabe");
+    assert(dstrtoull(s, &index, 16) == 0xDEADBEEFCAFEBABEULL && index == 18);
+    assert(dstrtoull(s, &index, 0) == 0xDEADBEEFCAFEBABEULL && index == 18);
+    assert(datoll(s) == (long long) LLONG_MAX);
+
+    dstrcpy(s, "0b1111000011110000111100001111000011110000");
+    assert(datoll(s) == 0xF0F0F0F0F0LL);
+
+    dstrcpy(s, "0x");
+    assert(dstrtol(s, &index, 0) == 0 && index == 1);
+
+    // length bound: no NUL terminator needed
+    //
+    assert(dstr_to_llong_bl("12345678", 3, &index, 10) == 123 && index == 3);
+    assert(dstr_atoll_bl("0x1234", 4) == 0x12);
+    assert(dstr_atoll_bl("\\777", 3) == 077);
+
+    // lists
+    //
+    long long values[4];
+    dstrcpy(s, "10, 20 ,-30,40,50");
+    assert(dstr_to_llong_list(s, ',', values, 4, &index, 10) == 4);
+    assert(values[0] == 10 && values[1] == 20 && values[2] == -30 && values[3] == 40);
+    assert(index == 15);
+
+    errno = 0;
+    dstrcpy(s, "ff:1g:3");
+    assert(dstr_to_llong_list(s, ':', values, 4, &index, 16) == 1);
+    assert(values[0] == 255 && errno == EINVAL && index == 3);
+
+    dstrfree(s);
+
+    // compare with strtoll/strtoull
+    //
+    static const int bases[] = { 0, 2, 8, 10, 16, 36 };
+    static const char* prefixes[] = { "", " ", "-", "+", "0x", "-0x", "0", "00000000" };
+    static const char digits[] = "0123456789abcdefABCDEFxyz";
+
+    for (int i = 0; i < 100000; ++i) {
+        char buf[128];
+        strcpy(buf, prefixes[rand() % 8]);
+        size_t len = strlen(buf);
+        int ndigits = rand() % 40;
+        for (int k = 0; k < ndigits; ++k) {
+            buf[len++] = (rand() % 8) ? digits[rand() % 10] : digits[rand() % 25]; }
+        buf[len] = '\0';
+        check_stoll(buf, bases[rand() % 6]);
+    }
+}
+//-------------------------------------------------
+
+#define TEST_DTOS(n, result) do {                           \
+        DSTR s = dstrnew_empty();                           \
+        dstr_append_double(s, n);                           \
+        assert( dstreq(s, result) );                        \
+        dstrfree(s);                                        \
+    } while (0)
+
+#define TEST_FIXED(n, prec, result) do {                    \
+        DSTR s = dstrnew_empty();                           \
+        dstr_append_double_fixed(s, n, prec);               \
+        assert( dstreq(s, result) );                        \
+        dstrfree(s);                                        \
+    } while (0)
+//-------------------------------------------------
+
+static double random_double(void)
+{
+    uint64_t bits = 0;
+    for (int i = 0; i < 4; ++i) {
+        bits = (bits << 16) ^ (uint64_t)(rand() & 0xFFFF); }
+
+    double d;
+    memcpy(&d, &bits, sizeof d);
+    return d;
+}
+//-------------------------------------------------
+
+void test_append_double()
+{
+    TRACE_FN();
+
+    TEST_DTOS(0.0, "0");
+    TEST_DTOS(-0.0, "-0");
+    TEST_DTOS(1.0, "1");
+    TEST_DTOS(-1.5, "-1.5");
+    TEST_DTOS(0.1, "0.1");
+    TEST_DTOS(0.3, "0.3");
+    TEST_DTOS(123.456, "123.456");
+    TEST_DTOS(1e-4, "0.0001");
+    TEST_DTOS(1e-5, "1e-05");
+    TEST_DTOS(1e21, "1e+21");
+    TEST_DTOS(123456789012345.0, "123456789012345");
+    TEST_DTOS(1234567890123456.0, "1.234567890123456e+15");
+    TEST_DTOS(5e-324, "5e-324");
+    TEST_DTOS(1.7976931348623157e308, "1.7976931348623157e+308");
+    TEST_DTOS(2.2250738585072014e-308, "2.2250738585072014e-308");
+    TEST_DTOS(3.7588570032210304e+16, "3.75885700322103e+16");
+    TEST_DTOS(1.0 / 0.0, "inf");
+    TEST_DTOS(-1.0 / 0.0, "-inf");
+
+    DSTR str = dstrnew("x=");
+    dstr_append_float(str, 0.1f);
+    assert(dstreq(str, "x=0.1"));
+    dstrcat(str, ",");
+    dstr_append_float(str, 16777216.0f);
+    assert(dstreq(str, "x=0.1,16777216"));
+    dstrfree(str);
+
+    TEST_FIXED(0.0, 2, "0.00");
+    TEST_FIXED(1.005, 2, "1.00");
+    TEST_FIXED(2.5, 0, "2");
+    TEST_FIXED(3.5, 0, "4");
+    TEST_FIXED(-0.001, 2, "-0.00");
+    TEST_FIXED(123.456, -1, "123.456000");
+    TEST_FIXED(1e22, 1, "10000000000000000000000.0");
+
+    // test round trip and compare with printf
+    //
+    DSTR d = dstrnew_empty();
+    for (int i = 0; i < 100000; ++i) {
+        double n = random_double();
+        if (n != n) {
+            continue; }
+
+        dstr_clear(d);
+        dstr_append_double(d, n);
+        assert(strtod(dstrdata(d), NULL) == n);
+
+        float f = (float) n;
+        dstr_clear(d);
+        dstr_append_float(d, f);
+        assert(strtof(dstrdata(d), NULL) == f);
+
+        char buf[512];
+        double m = (double) rand() / (double) rand();
+        int prec = rand() % 12;
+        snprintf(buf, sizeof buf, "%.*f", prec, m);
+        dstr_clear(d);
+        dstr_append_double_fixed(d, m, prec);
+        assert(dstreq(d, buf));
+    }
+    dstrfree(d);
+}
+//-------------------------------------------------
+
+#define TEST_STOD(src, len, expected) do {                  \
+        DSTR s = dstrnew(src);                              \
+        size_t index;                                       \
+        double n = dstrtod(s, &index);                      \
+        double e = (expected);                              \
+        assert( memcmp(&n, &e, sizeof n) == 0 );            \
+        assert( index == (len) );                           \
+        dstrfree(s);                                        \
+    } while (0)
+
+static void check_stod(const char* buf)
+{
+    double n = dstr_to_double_bl(buf, strlen(buf), NULL);
+    double e = strtod(buf, NULL);
+    assert( memcmp(&n, &e, sizeof n) == 0 );
+}
+
+static void check_stof(const char* buf)
+{
+    float n = dstr_to_float_bl(buf, strlen(buf), NULL);
+    float e = strtof(buf, NULL);
+    assert( memcmp(&n, &e, sizeof n) == 0 );
+}
+//-------------------------------------------------
+
+void test_parse_double()
+{
+    TRACE_FN();
+
+    TEST_STOD("0", 1, 0.0);
+    TEST_STOD("-0", 2, -0.0);
+    TEST_STOD("  1.5xyz", 5, 1.5);
+    TEST_STOD("+.5", 3, 0.5);
+    TEST_STOD("5.", 2, 5.0);
+    TEST_STOD("1e", 1, 1.0);
+    TEST_STOD("1e+", 1, 1.0);
+    TEST_STOD("1E-2", 4, 0.01);
+    TEST_STOD("0x", 1, 0.0);
+    TEST_STOD("0x1p4", 5, 16.0);
+    TEST_STOD("-INF", 4, -1.0 / 0.0);
+    TEST_STOD("infinity", 8, 1.0 / 0.0);
+    TEST_STOD("1e23", 4, 1e23);
+    TEST_STOD("9007199254740993", 16, 9007199254740992.0);
+    TEST_STOD("2.2250738585072011e-308", 23, 2.2250738585072011e-308);
+    TEST_STOD("1.7976931348623158e308", 22, 1.7976931348623157e308);
+    TEST_STOD("0.000000000000000000000000000000000000001e39", 44, 1.0);
+    TEST_STOD("123456789012345678901234567890", 30, 123456789012345678901234567890.0);
+
+    size_t index;
+    DSTR s = dstrnew("nan(123)");
+    double n = dstrtod(s, &index);
+    assert(n != n && index == 8);
+
+    errno = 0;
+    dstrcpy(s, "abc");
+    n = dstrtod(s, &index);
+    assert(n == 0 && index == 0 && errno == EINVAL);
+
+    errno = 0;
+    dstrcpy(s, "1e400");
+    n = dstrtod(s, &index);
+    assert(n == 1.0 / 0.0 && index == 5 && errno == ERANGE);
+
+    errno = 0;
+    dstrcpy(s, "1e-400");
+    n = dstrtod(s, &index);
+    assert(n == 0 && errno == ERANGE);
+
+    // subnormal results set ERANGE like strtod
+    //
+    errno = 0;
+    n = dstr_to_double_bl("5e-324", 6, &index);
+    assert(n == 5e-324 && errno == ERANGE);
+
+    errno = 0;
+    assert(dstr_to_float_bl("1e-40", 5, &index) == 1e-40f && errno == ERANGE);
+
+    errno = 0;
+    n = dstr_to_double_bl("2.2250738585072014e-308", 23, &index);
+    assert(n == 2.2250738585072014e-308 && errno == 0);
+
+    errno = 0;
+    dstrcpy(s, "3.25");
+    assert(dstrtof(s, &index) == 3.25f && index == 4 && errno == 0);
+    assert(dstr_atof(s) == 3.25);
+
+    // length bound: no NUL terminator needed
+    //
+    assert(dstr_to_double_bl("12345", 3, &index) == 123.0 && index == 3);
+
+    // lists
+    //
+    double values[4];
+    dstrcpy(s, " 1.5, -2 ,3e2,4,5");
+    assert(dstr_to_double_list(s, ',', values, 4, &index) == 4);
+    assert(values[0] == 1.5 && values[1] == -2 && values[2] == 300 && values[3] == 4);
+    assert(index == 16);
+
+    errno = 0;
+    dstrcpy(s, "1;2;x;4");
+    assert(dstr_to_double_list(s, ';', values, 4, &index) == 2);
+    assert(errno == EINVAL && index == 4);
+
+    // empty fields are rejected in the middle and at the end
+    //
+    errno = 0;
+    assert(dstr_to_double_list_bl("1,,2", 4, ',', values, 4, &index) == 1);
+    assert(errno == EINVAL && index == 2);
+
+    errno = 0;
+    assert(dstr_to_double_list_bl("1,2,", 4, ',', values, 4, &index) == 2);
+    assert(errno == EINVAL && index == 4);
+
+    float fvalues[2];
+    assert(dstr_to_float_list_bl("0.1 0.2\n", 8, ' ', fvalues, 2, &index) == 2);
+    assert(fvalues[0] == 0.1f && fvalues[1] == 0.2f && index == 8);
+
+    dstrfree(s);
+
+    // compare with strtod: shortest, 17 digits and truncated long inputs
+    //
+    DSTR d = dstrnew_empty();
+    for (int i = 0; i < 100000; ++i) {
+        char buf[512];
+        double r = random_double();
+        if (r != r) {
+            continue; }
+
+        dstr_clear(d);
+        dstr_append_double(d, r);
+        assert(dstr_to_double_bl(dstrdata(d), dstrlen(d), NULL) == r);
+
+        snprintf(buf, sizeof buf, "%.17g", r);
+        check_stod(buf);
+        check_stof(buf);
+
+        snprintf(buf, sizeof buf, "%.30e", r);
+        check_stod(buf);
+        check_stof(buf);
+
+        snprintf(buf, sizeof buf, "%.*f", rand() % 25, (double) rand() / (rand() + 1));
+        check_stod(buf);
+        check_stof(buf);
+    }
+    dstrfree(d);
+}
+//-------------------------------------------------
+
 #define TEST_DIGIT(s, result) do {                          \
         DSTR d = dstrnew(s);                                \
         assert( disdigits(d) == result );                   \
@@ -1419,6 +2276,365 @@ void test_atoi_itos()
     } while (0)
 //-------------------------------------------------
 
+#define TEST_BASE64(src, flags, expected) do {                      \
+        DSTR s = dstrnew_empty();                                   \
+        dstr_append_base64(s, src, strlen(src), flags);             \
+        assert( dstreq(s, expected) );                              \
+        dstr_clear(s);                                              \
+        assert( dstr_decode_base64(s, expected, strlen(expected), flags) ); \
+        assert( dstreq(s, src) );                                   \
+        dstrfree(s);                                                \
+    } while (0)
+//-------------------------------------------------
+
+void test_hex_base64()
+{
+    TRACE_FN();
+
+    // RFC 4648 test vectors
+    //
+    TEST_BASE64("", 0, "");
+    TEST_BASE64("f", 0, "Zg==");
+    TEST_BASE64("fo", 0, "Zm8=");
+    TEST_BASE64("foo", 0, "Zm9v");
+    TEST_BASE64("foob", 0, "Zm9vYg==");
+    TEST_BASE64("fooba", 0, "Zm9vYmE=");
+    TEST_BASE64("foobar", 0, "Zm9vYmFy");
+    TEST_BASE64("fooba", DSTR_BASE64_NOPAD, "Zm9vYmE");
+    TEST_BASE64("\xfb\xff", DSTR_BASE64_URL, "-_8=");
+    TEST_BASE64("\xfb\xff", 0, "+/8=");
+
+    DSTR s = dstrnew("x=");
+    dstr_append_hex(s, "\x01\xab\xff", 3, 0);
+    assert(dstreq(s, "x=01abff"));
+    dstr_append_hex(s, "\xcd", 1, DSTR_HEX_UPPER);
+    assert(dstreq(s, "x=01abffCD"));
+
+    dstrcpy(s, "x=");
+    assert(dstr_decode_hex(s, "4142aBcD", 8));
+    assert(dstrlen(s) == 6 && memcmp(dstrdata(s), "x=AB\xab\xcd", 6) == 0);
+
+    // strict validation leaves DEST unchanged
+    //
+    dstrcpy(s, "keep");
+    errno = 0;
+    assert(!dstr_decode_hex(s, "414", 3) && errno == EINVAL);
+    assert(!dstr_decode_hex(s, "41g2", 4));
+    assert(!dstr_decode_base64(s, "Zg=", 3, 0));
+    assert(!dstr_decode_base64(s, "Zh==", 4, 0));
+    assert(!dstr_decode_base64(s, "Z===", 4, 0));
+    assert(!dstr_decode_base64(s, "Zm9v Zm9v", 9, 0));
+    assert(!dstr_decode_base64(s, "Zg==", 4, DSTR_BASE64_NOPAD));
+    assert(!dstr_decode_base64(s, "-_8=", 4, 0));
+    assert(dstreq(s, "keep"));
+
+    // decoded NUL bytes need a binary safe build
+    //
+#if defined(DSTR_BINARY_SAFE)
+    assert(dstr_decode_hex(s, "410042", 6));
+    assert(dstr_decode_base64(s, "QQBC", 4, 0));
+    assert(dstrlen(s) == 10 && memcmp(dstrdata(s), "keepA\0BA\0B", 10) == 0);
+
+    // encoding the string into itself copies all bytes, NUL bytes included
+    //
+    dstr_clear(s);
+    for (int i = 0; i < 100; ++i) {
+        assert(dstr_decode_hex(s, "00", 2)); }
+    assert(dstr_append_hex(s, dstrdata(s), dstrlen(s), 0));
+    assert(dstrlen(s) == 300 && memcmp(dstrdata(s) + 100, "0000", 4) == 0);
+#else
+    errno = 0;
+    assert(!dstr_decode_hex(s, "410042", 6) && errno == EINVAL);
+    assert(!dstr_decode_base64(s, "QQBC", 4, 0));
+    assert(dstreq(s, "keep"));
+#endif
+
+    // random round trips, long enough for the vectorized loops
+    //
+    DSTR enc = dstrnew_empty();
+    DSTR dec = dstrnew_empty();
+    unsigned char data[300];
+    char hex[3];
+
+    for (int i = 0; i < 2000; ++i) {
+        size_t len = (size_t)(rand() % 300);
+        for (size_t k = 0; k < len; ++k) {
+#if defined(DSTR_BINARY_SAFE)
+            data[k] = (unsigned char) rand();
+#else
+            data[k] = (unsigned char)(1 + rand() % 255);
+#endif
+        }
+
+        int flags = rand() % 8;
+        dstr_clear(enc);
+        dstr_append_hex(enc, data, len, flags);
+        assert(dstrlen(enc) == 2 * len);
+        for (size_t k = 0; k < len; ++k) {
+            snprintf(hex, sizeof hex, (flags & DSTR_HEX_UPPER) ? "%02X" : "%02x", data[k]);
+            assert(memcmp(dstrdata(enc) + 2 * k, hex, 2) == 0); }
+
+        dstr_clear(dec);
+        assert(dstr_decode_hex(dec, dstrdata(enc), dstrlen(enc)));
+        assert(dstrlen(dec) == len && memcmp(dstrdata(dec), data, len) == 0);
+
+        dstr_clear(enc);
+        dstr_append_base64(enc, data, len, flags);
+        assert(dstrlen(enc) == dstr_base64_encoded_length(len, flags));
+
+        dstr_clear(dec);
+        assert(dstr_decode_base64(dec, dstrdata(enc), dstrlen(enc), flags));
+        assert(dstrlen(dec) == len && memcmp(dstrdata(dec), data, len) == 0);
+
+        if (len) {
+            size_t pos = (size_t) rand() % dstrlen(enc);
+            dstrputc(enc, pos, '*');
+            assert(!dstr_decode_base64(dec, dstrdata(enc), dstrlen(enc), flags));
+            assert(dstrlen(dec) == len); }
+    }
+    dstrfree(enc);
+    dstrfree(dec);
+
+    dstrcpy(s, "Zm9v");
+    assert(dstr_decode_base64(s, dstrdata(s), dstrlen(s), 0));
+    assert(dstreq(s, "Zm9vfoo"));
+    assert(dstr_append_hex(s, dstrdata(s) + 4, 3, 0));
+    assert(dstreq(s, "Zm9vfoo666f6f"));
+    dstrfree(s);
+}
+//-------------------------------------------------
+
+#define TEST_ESCAPE(src, mode, expected) do {                        \
+        DSTR s = dstrnew_empty();                                   \
+        dstr_append_escaped_bl(s, src, sizeof(src) - 1, mode);      \
+        assert( dstreq(s, expected) );                              \
+        DSTR u = dstrnew_empty();                                   \
+        assert( dstr_append_unescaped(u, s, mode) );                \
+        assert( dstrlen(u) == sizeof(src) - 1 );                    \
+        assert( memcmp(dstrdata(u), src, sizeof(src) - 1) == 0 );   \
+        dstrfree(u);                                                \
+        dstrfree(s);                                                \
+    } while (0)
+//-------------------------------------------------
+
+void test_escape()
+{
+    TRACE_FN();
+
+    TEST_ESCAPE("plain", DSTR_ESC_JSON, "plain");
+    TEST_ESCAPE("a\"b\\c\n\x01\xc3\xa9", DSTR_ESC_JSON, "a\\\"b\\\\c\\n\\u0001\xc3\xa9");
+    TEST_ESCAPE("tab\there\a\x7f\xff", DSTR_ESC_C, "tab\\there\\a\\177\\377");
+    TEST_ESCAPE("a b/c?d=1&e~", DSTR_ESC_URL, "a%20b%2Fc%3Fd%3D1%26e~");
+    TEST_ESCAPE("<a href=\"x\">'&'</a>", DSTR_ESC_HTML,
+                "&lt;a href=&quot;x&quot;&gt;&#39;&amp;&#39;&lt;/a&gt;");
+
+    DSTR s = dstrnew_empty();
+    assert(dstr_append_unescaped_bl(s, "\\u00e9\\ud83d\\ude00\\/", 20, DSTR_ESC_JSON));
+    assert(dstreq(s, "\xc3\xa9\xf0\x9f\x98\x80/"));
+
+    dstr_clear(s);
+    assert(dstr_append_unescaped_bl(s, "\\x41\\101\\7x", 11, DSTR_ESC_C));
+    assert(dstreq(s, "AA\ax"));
+
+    dstr_clear(s);
+    assert(dstr_append_unescaped_bl(s, "&#x41;&#66;&apos;&#128512;", 26, DSTR_ESC_HTML));
+    assert(dstreq(s, "AB'\xf0\x9f\x98\x80"));
+
+    // strict validation leaves DEST unchanged
+    //
+    dstrcpy(s, "keep");
+    errno = 0;
+    assert(!dstr_append_unescaped_bl(s, "abc\\", 4, DSTR_ESC_JSON) && errno == EINVAL);
+    assert(!dstr_append_unescaped_bl(s, "\\q", 2, DSTR_ESC_JSON));
+    assert(!dstr_append_unescaped_bl(s, "\\ud83d", 6, DSTR_ESC_JSON));
+    assert(!dstr_append_unescaped_bl(s, "\\u12G4", 6, DSTR_ESC_JSON));
+    assert(!dstr_append_unescaped_bl(s, "\\z", 2, DSTR_ESC_C));
+    assert(!dstr_append_unescaped_bl(s, "100%", 4, DSTR_ESC_URL));
+    assert(!dstr_append_unescaped_bl(s, "%4G", 3, DSTR_ESC_URL));
+    assert(!dstr_append_unescaped_bl(s, "&nbsp;", 6, DSTR_ESC_HTML));
+    assert(!dstr_append_unescaped_bl(s, "&#xD800;", 8, DSTR_ESC_HTML));
+    assert(!dstr_append_escaped_bl(s, "x", 1, DSTR_ESC_JSON | DSTR_ESC_URL));
+    assert(dstreq(s, "keep"));
+
+    // unescaped NUL bytes need a binary safe build
+    //
+#if defined(DSTR_BINARY_SAFE)
+    assert(dstr_append_unescaped_bl(s, "a\\0", 3, DSTR_ESC_C));
+    assert(dstr_append_unescaped_bl(s, "%00", 3, DSTR_ESC_URL));
+    assert(dstrlen(s) == 7 && memcmp(dstrdata(s), "keepa\0\0", 7) == 0);
+#else
+    errno = 0;
+    assert(!dstr_append_unescaped_bl(s, "a\\0", 3, DSTR_ESC_C) && errno == EINVAL);
+    assert(!dstr_append_unescaped_bl(s, "\\u0000", 6, DSTR_ESC_JSON));
+    assert(!dstr_append_unescaped_bl(s, "%00", 3, DSTR_ESC_URL));
+    assert(!dstr_append_unescaped_bl(s, "&#0;", 4, DSTR_ESC_HTML));
+    assert(dstreq(s, "keep"));
+#endif
+
+    // source and destination may be the same string
+    //
+    dstrcpy(s, "a&b");
+    dstr_append_escaped(s, s, DSTR_ESC_HTML);
+    assert(dstreq(s, "a&ba&amp;b"));
+
+    dstrcpy(s, "a%26b");
+    assert(dstr_append_unescaped(s, s, DSTR_ESC_URL));
+    assert(dstreq(s, "a%26ba&b"));
+
+    // random round trips, long enough for the vectorized scan
+    //
+    static const int modes[] = { DSTR_ESC_JSON, DSTR_ESC_C, DSTR_ESC_URL, DSTR_ESC_HTML };
+    DSTR enc = dstrnew_empty();
+    DSTR dec = dstrnew_empty();
+    char data[300];
+
+    for (int i = 0; i < 4000; ++i) {
+        size_t len = (size_t)(rand() % 300);
+        for (size_t k = 0; k < len; ++k) {
+            data[k] = (rand() % 4) ? (char)(' ' + rand() % 95) : (char) rand();
+#if !defined(DSTR_BINARY_SAFE)
+            if (data[k] == '\0') {
+                data[k] = '\x01'; }
+#endif
+        }
+
+        int mode = modes[rand() % 4];
+        dstr_clear(enc);
+        assert(dstr_append_escaped_bl(enc, data, len, mode));
+
+        dstr_clear(dec);
+        assert(dstr_append_unescaped(dec, enc, mode));
+        assert(dstrlen(dec) == len && memcmp(dstrdata(dec), data, len) == 0);
+    }
+    dstrfree(enc);
+    dstrfree(dec);
+    dstrfree(s);
+}
+//-------------------------------------------------
+
+// Straightforward reference for the vectorized validator
+//
+static size_t ref_utf8_error(const unsigned char* s, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        unsigned c = s[i];
+        size_t n = (c < 0x80) ? 1 : (c >= 0xC2 && c < 0xE0) ? 2 :
+                   (c >= 0xE0 && c < 0xF0) ? 3 : (c >= 0xF0 && c < 0xF5) ? 4 : 0;
+        if (n == 0 || i + n > len) {
+            return i; }
+
+        unsigned long cp = (n == 1) ? c : (c & (0x7F >> n));
+        for (size_t k = 1; k < n; ++k) {
+            if ((s[i + k] & 0xC0) != 0x80) {
+                return i; }
+            cp = (cp << 6) | (s[i + k] & 0x3F); }
+
+        static const unsigned long min_cp[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (cp < min_cp[n] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) {
+            return i; }
+        i += n; }
+
+    return DSTR_NPOS;
+}
+//-------------------------------------------------
+
+void test_utf8()
+{
+    TRACE_FN();
+
+    // "a é € 😀"
+    DSTR s = dstrnew("a\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+    size_t bad = 0;
+    assert(dstr_utf8_validate(s, &bad) && bad == DSTR_NPOS);
+    assert(dstr_utf8_length(s) == 4);
+    assert(dstr_utf8_offset_of(s, 0) == 0);
+    assert(dstr_utf8_offset_of(s, 2) == 3);
+    assert(dstr_utf8_offset_of(s, 3) == 6);
+    assert(dstr_utf8_offset_of(s, 4) == 10);
+    assert(dstr_utf8_offset_of(s, 5) == DSTR_NPOS);
+
+    uint16_t u16[8];
+    uint32_t u32[8];
+    assert(dstr_utf8_to_utf16(s, NULL, 0) == 5);
+    assert(dstr_utf8_to_utf16(s, u16, 8) == 5);
+    assert(u16[1] == 0xE9 && u16[2] == 0x20AC && u16[3] == 0xD83D && u16[4] == 0xDE00);
+    assert(dstr_utf8_to_utf32(s, u32, 8) == 4);
+    assert(u32[0] == 'a' && u32[3] == 0x1F600);
+
+    DSTR r = dstrnew_empty();
+    assert(dstr_append_utf16(r, u16, 5));
+    assert(dstreq(r, dstrdata(s)));
+    dstr_clear(r);
+    assert(dstr_append_utf32(r, u32, 4));
+    assert(dstreq(r, dstrdata(s)));
+
+    // invalid input
+    //
+    static const char* const invalid[] = {
+        "\xc0\xaf", "\xe0\x80\xaf", "\xf0\x80\x80\xaf",     // overlong
+        "\xed\xa0\x80", "\xf4\x90\x80\x80", "\xf5\x80\x80\x80",
+        "ab\x80", "\xc3", "\xe2\x82", "\xe2\x82x" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        dstrcpy(s, invalid[i]);
+        assert(!dstr_utf8_validate(s, &bad));
+        assert(bad == ref_utf8_error((const unsigned char*) dstrdata(s), dstrlen(s)));
+        assert(dstr_utf8_to_utf32(s, NULL, 0) == DSTR_NPOS); }
+
+    static const uint16_t lone[] = { 'a', 0xD800, 'b' };
+    static const uint32_t big[] = { 'a', 0x110000 };
+    dstrcpy(r, "keep");
+    errno = 0;
+    assert(!dstr_append_utf16(r, lone, 3) && errno == EINVAL);
+    assert(!dstr_append_utf32(r, big, 2));
+    assert(dstreq(r, "keep"));
+
+    // random mutations of mixed text cross checked with the reference,
+    // long enough for the 32 byte blocks and their boundaries
+    //
+    static const char* const pieces[] = {
+        "abc", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf", "\xf4\x8f\xbf\xbf" };
+    unsigned char data[200];
+
+    for (int i = 0; i < 20000; ++i) {
+        size_t len = 0;
+        size_t count = 0;
+        while (len < 180) {
+            const char* piece = pieces[rand() % 6];
+            size_t n = strlen(piece);
+            count += (n == 3 && piece[0] == 'a') ? 3 : 1;
+            memcpy(data + len, piece, n);
+            len += n; }
+
+        dstr_assign_bl(s, (const char*) data, len);
+        assert(dstr_utf8_validate(s, NULL));
+        assert(dstr_utf8_length(s) == count);
+        assert(dstr_utf8_to_utf32(s, NULL, 0) == count);
+
+        size_t units = dstr_utf8_to_utf16(s, NULL, 0);
+        uint16_t w[200];
+        assert(units <= 200 && dstr_utf8_to_utf16(s, w, 200) == units);
+        dstr_clear(r);
+        assert(dstr_append_utf16(r, w, units) && dstrlen(r) == len);
+        assert(memcmp(dstrdata(r), data, len) == 0);
+
+        size_t k = (size_t)(rand() % (int) count);
+        size_t off = dstr_utf8_offset_of(s, k);
+        assert(off != DSTR_NPOS && (data[off] & 0xC0) != 0x80);
+
+        int flips = 1 + rand() % 2;
+        while (flips--) {
+            data[rand() % (int) len] = (unsigned char) rand(); }
+        size_t expected = ref_utf8_error(data, len);
+        assert(dstr_utf8_validate_bl((const char*) data, len, &bad) == (expected == DSTR_NPOS));
+        assert(bad == expected);
+    }
+
+    dstrfree(r);
+    dstrfree(s);
+}
+//-------------------------------------------------
+
 void test_isdigit()
 {
     TRACE_FN();
@@ -2074,12 +3290,14 @@ int main()
     test_truncate();
     test_shrink();
     test_find();
+    test_binary();
     test_rfind();
     test_put_get();
     test_put_get_safe();
     test_ascii_upper_lower();
     test_reverse();
     test_swap();
+    test_adopt_release();
     test_ffo();
     test_ffno();
     test_flo();
@@ -2088,7 +3306,18 @@ int main()
     test_suffix();
     test_blank();
     test_fgets();
+    test_reader();
+    test_map_file();
+    test_slurp_many();
+    test_foreach_line_parallel();
+    test_writev();
     test_atoi_itos();
+    test_parse_integer();
+    test_append_double();
+    test_parse_double();
+    test_hex_base64();
+    test_escape();
+    test_utf8();
     test_isdigit();
     test_getline();
     test_center();
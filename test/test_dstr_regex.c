@@ -5,10 +5,14 @@
  * distributed under the GNU GPL v3.0. See LICENSE file for full GPL-3.0 license text.
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 
 #include <dstr/dstr.h>
 
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
 
 #if defined(__BORLANDC__) || (defined(_MSC_VER) && (_MSC_VER <= 1200))
 #define TRACE_FN() printf("%d\n", __LINE__)
@@ -203,6 +207,635 @@ void test_exact_match()
 }
 //--------------------------------------------------------------------------------
 
+void test_utf8_options()
+{
+    TRACE_FN();
+
+    // "ü" is one code point in UTF-8 mode, two bytes otherwise
+    //
+    DSTR p = dstrnew("gr\xc3\xbcn");
+    assert(dre_exact(p, "gr.n", 0));
+    assert(dre_match(p, "^gr.n$", 0, NULL, "u") > 0);
+    assert(dre_match(p, "^gr.n$", 0, NULL, NULL) <= 0);
+
+    // subject validated once, skip the check in the regex engine
+    //
+    assert(dstr_utf8_validate(p, NULL));
+    assert(dre_match(p, "^gr.n$", 0, NULL, "V") > 0);
+
+    dstrcpy(p, "gr\xc3n");
+    assert(!dstr_utf8_validate(p, NULL));
+    assert(dre_match(p, "^gr.n$", 0, NULL, "u") < 0);
+
+    dstrfree(p);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+
+void test_jit()
+{
+    TRACE_FN();
+
+    // Same results with the JIT (default) and the interpreter ('J')
+    //
+    DSTR p = dstrnew("Error 42: disk /dev/sda1 TIMEOUT");
+    DSTR_Regex_Match m1, m2;
+    assert(dre_match(p, "\\d+: \\w+", 0, &m1, "i") > 0);
+    assert(dre_match(p, "\\d+: \\w+", 0, &m2, "iJ") > 0);
+    assert(m1.offset == m2.offset && m1.length == m2.length);
+    assert(m1.offset == 6 && m1.length == 8);
+
+    DSTR q = dstrnew_ds(p);
+    dre_subst(p, "[aeiou]", 0, "_", "gi");
+    dre_subst(q, "[aeiou]", 0, "_", "giJ");
+    assert(dstreq_ds(p, q));
+
+    // Deep backtracking needs more than the default 32K JIT stack,
+    // the interpreter stops at its depth limit. Without JIT support
+    // both runs use the interpreter
+    //
+    uint32_t have_jit = 0;
+    pcre2_config(PCRE2_CONFIG_JIT, &have_jit);
+    if (!have_jit) {
+        dstrfree(q);
+        dstrfree(p);
+        puts("OK (no JIT)");
+        return; }
+
+    dstrcpy(p, "");
+    for (int i = 0; i < 5000; ++i) {
+        dstrcat(p, "ab"); }
+    dstrcat(p, "c");
+    assert(dre_match(p, "^(a|b)*c$", 0, &m1, NULL) > 0);
+    assert(m1.length == 10001);
+    assert(dre_match(p, "^(a|b)*c$", 0, &m1, "J") < 0);
+
+    dstrfree(q);
+    dstrfree(p);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+void test_many_groups()
+{
+    TRACE_FN();
+
+    // More groups than the smallest shared match data block holds,
+    // then back to a small pattern
+    //
+    DSTR pattern = dstrnew_empty();
+    DSTR subject = dstrnew_empty();
+    for (int i = 0; i < 24; ++i) {
+        dstrcat(pattern, "(.)");
+        dstr_append_char(subject, (char)('a' + i)); }
+
+    DSTR_Match_Vector vec;
+    assert(dre_groups(subject, dstrdata(pattern), 0, &vec, NULL) == 25);
+    assert(vec.matches[24].offset == 23 && vec.matches[24].length == 1);
+    dre_mvfree(&vec);
+
+    assert(dre_groups(subject, "(c)(d)", 0, &vec, NULL) == 3);
+    assert(vec.matches[2].offset == 3);
+    dre_mvfree(&vec);
+
+    dre_subst(subject, dstrdata(pattern), 0, "$24$1", NULL);
+    assert(dstreq(subject, "xa"));
+
+    dstrfree(subject);
+    dstrfree(pattern);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+void test_cache()
+{
+    TRACE_FN();
+
+    DSTR s = dstrnew("abc 123 def");
+    DSTR_Regex_Cache_Stats st;
+
+    size_t old_capacity = dstr_regex_cache_set_capacity(3);
+    dstr_regex_cache_stats(&st, true);
+    assert(st.capacity == 3 && st.size <= 3);
+    size_t leftover = st.size;   // from earlier tests, evicted first
+
+    // least recently used goes first
+    //
+    assert(dre_match(s, "a+", 0, NULL, NULL) > 0);
+    assert(dre_match(s, "b+", 0, NULL, NULL) > 0);
+    assert(dre_match(s, "c+", 0, NULL, NULL) > 0);
+    assert(dre_match(s, "a+", 0, NULL, NULL) > 0);   // hit
+    assert(dre_match(s, "d+", 0, NULL, NULL) > 0);   // evicts "b+"
+    assert(dre_match(s, "a+", 0, NULL, NULL) > 0);   // hit
+    assert(dre_match(s, "b+", 0, NULL, NULL) > 0);   // evicts "c+"
+    assert(dre_match(s, "a+", 0, NULL, "i") > 0);    // options are part of the key
+
+    dstr_regex_cache_stats(&st, true);
+    assert(st.hits == 2 && st.misses == 6 && st.evictions == 3 + leftover);
+    assert(st.size == 3);
+
+    // a rule set larger than the default capacity stays compiled
+    //
+    dstr_regex_cache_set_capacity(300);
+    DSTR pattern = dstrnew_empty();
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int i = 0; i < 300; ++i) {
+            dsprintf(pattern, "\\d+ rule%d", i);
+            assert(dre_match(s, dstrdata(pattern), 0, NULL, NULL) == 0); } }
+
+    dstr_regex_cache_stats(&st, true);
+    assert(st.misses == 300 && st.hits == 300);
+    assert(st.evictions == 3);   // the patterns above
+    assert(st.size == 300);
+
+    dstr_regex_cache_set_capacity(old_capacity);
+    dstr_regex_cache_stats(&st, false);
+    assert(st.size == old_capacity && st.evictions == 300 - old_capacity);
+
+    dstrfree(pattern);
+    dstrfree(s);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+void test_compiled_regex()
+{
+    TRACE_FN();
+
+    int err = -1;
+    DSTR_Regex* re = dstr_regex_compile("(\\w+)@(\\w+)\\.com", "i", &err);
+    assert(re && err == 0);
+
+    DSTR s = dstrnew("Mail ALICE@FOO.COM or bob@bar.com");
+    DSTR_Regex_Match m;
+    assert(dstr_regex_match_re(re, s, 0, &m) == 3);
+    assert(m.offset == 5 && m.length == 13);
+    assert(dstr_regex_contains_re(re, s, 18) == 22);
+    assert(!dstr_regex_exact_re(re, s, 0));
+    assert(dstr_regex_exact_re(re, s, 22));
+
+    DSTR_Match_Vector vec;
+    assert(dstr_regex_match_groups_re(re, s, 18, &vec) == 3);
+    assert(vec.matches[2].offset == 26 && vec.matches[2].length == 3);
+    dre_mvfree(&vec);
+
+    assert(dstr_regex_substitute_re(re, s, 0, "<$2>") == 1);
+    assert(dstreq(s, "Mail <FOO> or bob@bar.com"));
+    dstr_regex_free(re);
+
+    re = dstr_regex_compile("o", "g", NULL);
+    assert(dstr_regex_substitute_re(re, s, 0, "0") == 3);
+    assert(dstreq(s, "Mail <FOO> 0r b0b@bar.c0m"));
+    dstr_regex_free(re);
+
+    // errors are reported, not printed
+    //
+    assert(dstr_regex_compile("(a(b|c$", NULL, &err) == NULL);
+    assert(err > 0);
+    dstr_regex_strerror(s, err);
+    assert(dstr_contains_sz(s, "missing closing parenthesis"));
+
+    assert(dstr_regex_match_re(NULL, s, 0, NULL) < 0);
+    dstr_regex_free(NULL);
+
+    dstrfree(s);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+typedef struct Word_Sums {
+    size_t count;
+    size_t total;
+    size_t stop_after;
+} Word_Sums;
+
+static int sum_words(void* ctx, const size_t* groups, size_t n_groups)
+{
+    Word_Sums* ws = (Word_Sums*) ctx;
+    assert(n_groups == 2);
+    ws->total += groups[3] - groups[2];
+    return ++ws->count == ws->stop_after;
+}
+//--------------------------------------------------------------------------------
+
+void test_foreach()
+{
+    TRACE_FN();
+
+    DSTR s = dstrnew("one two three four");
+    Word_Sums ws = { 0, 0, 0 };
+    assert(dstr_regex_foreach(s, "(\\w+)", 0, sum_words, &ws, NULL) == 4);
+    assert(ws.count == 4 && ws.total == 15);
+
+    Word_Sums stop = { 0, 0, 2 };
+    assert(dstr_regex_foreach(s, "(\\w+)", 4, sum_words, &stop, NULL) == 2);
+    assert(stop.total == 8);
+
+    // empty matches advance by one, at every position and the end
+    //
+    DSTR_Regex* re = dstr_regex_compile("x*", NULL, NULL);
+    DSTR_Regex_Iter it;
+    dstr_regex_iter_init(&it, re, s, 14);
+    size_t n = 0;
+    while (dstr_regex_iter_next(&it)) {
+        assert(it.groups[0] == 14 + n && it.groups[1] == it.groups[0]);
+        ++n; }
+    assert(n == 5 && it.rc == 0);
+    dstr_regex_iter_done(&it);
+    dstr_regex_free(re);
+
+    // unset groups are DSTR_NPOS
+    //
+    re = dstr_regex_compile("(o)|(e)", NULL, NULL);
+    dstr_regex_iter_init(&it, re, s, 0);
+    assert(dstr_regex_iter_next(&it) && it.n_groups == 3);
+    assert(it.groups[0] == 0 && it.groups[4] == DSTR_NPOS);
+    assert(dstr_regex_iter_next(&it));
+    assert(it.groups[0] == 2 && it.groups[2] == DSTR_NPOS && it.groups[4] == 2);
+    dstr_regex_iter_done(&it);
+    dstr_regex_free(re);
+
+    // compile errors come negated
+    //
+    int rc = dstr_regex_foreach(s, "(a", 0, sum_words, &ws, NULL);
+    assert(rc < 0);
+    dstr_regex_strerror(s, rc);
+    assert(dstr_contains_sz(s, "missing closing parenthesis"));
+
+    dstrfree(s);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+static int double_number(void* ctx, DSTR out, CDSTR subject,
+                         const size_t* groups, size_t n_groups)
+{
+    int* calls = (int*) ctx;
+    if (++*calls == 99) {
+        return DSTR_FAIL; }
+
+    assert(n_groups == 2);
+    long n = 0;
+    for (size_t i = groups[2]; i < groups[3]; ++i) {
+        n = 10 * n + (dstrdata(subject)[i] - '0'); }
+    return dstr_append_sprintf(out, "%ld", 2 * n);
+}
+//--------------------------------------------------------------------------------
+
+void test_substitute_cb()
+{
+    TRACE_FN();
+
+    int calls = 0;
+    DSTR s = dstrnew("a1 b22 c333");
+    assert(dstr_regex_substitute_cb(s, "(\\d+)", 0, double_number, &calls, "g") == 3);
+    assert(dstreq(s, "a2 b44 c666"));
+
+    assert(dstr_regex_substitute_cb(s, "(\\d+)", 3, double_number, &calls, NULL) == 1);
+    assert(dstreq(s, "a2 b88 c666"));
+
+    assert(dstr_regex_substitute_cb(s, "(x)", 0, double_number, &calls, "g") == 0);
+    assert(dstreq(s, "a2 b88 c666"));
+
+    // a failing callback leaves the subject alone
+    //
+    calls = 97;
+    assert(dstr_regex_substitute_cb(s, "(\\d+)", 0, double_number, &calls, "g") < 0);
+    assert(calls == 99 && dstreq(s, "a2 b88 c666"));
+
+    DSTR_Regex* re = dstr_regex_compile("(\\d)", "g", NULL);
+    calls = 0;
+    assert(dstr_regex_substitute_cb_re(re, s, 0, double_number, &calls) == 6);
+    assert(dstreq(s, "a4 b1616 c121212"));
+    dstr_regex_free(re);
+
+    // templates are expanded straight into the result, however long
+    //
+    dstr_assign_cc(s, 'a', 1000);
+    assert(dstr_regex_substitute(s, "(?<ch>a)", 0, "<${ch}>", "g") == 1000);
+    assert(dstr_length(s) == 3000 && dstr_suffix_sz(s, "<a><a>"));
+
+    // empty matches, character wise in UTF-8 mode
+    //
+    dstr_assign_sz(s, "ab");
+    assert(dstr_regex_substitute(s, "x*", 0, "-", "g") == 3);
+    assert(dstreq(s, "-a-b-"));
+
+    dstr_assign_sz(s, "\xC3\xA9t\xC3\xA9");
+    assert(dstr_regex_substitute(s, "x*", 0, "-", "gu") == 4);
+    assert(dstreq(s, "-\xC3\xA9-t-\xC3\xA9-"));
+
+    dstrfree(s);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+static bool has_bit(const uint64_t* bits, size_t i)
+{
+    return (bits[i / 64] >> (i % 64)) & 1;
+}
+//--------------------------------------------------------------------------------
+
+void test_regex_set()
+{
+    TRACE_FN();
+
+    const char* rules[] = {
+        "ERROR .* timeout",       // indexed by literal
+        "\\buser_id=(\\d+)",      // indexed by literal
+        "(\\w)\\1",               // back reference, matched alone
+        "^\\d{4}-\\d\\d",          // merged
+        "x?y+z",                  // merged
+        "[0-9]+ms" };             // merged
+
+    int err = -1;
+    DSTR_RegexSet* set = dstr_regex_set_compile(rules, 6, NULL, &err, NULL);
+    assert(set && err == 0 && dstr_regex_set_size(set) == 6);
+
+    DSTR s = dstrnew("2025-10 ERROR user_id=42 timeout after 30ms");
+    uint64_t bits[DSTR_REGEX_SET_WORDS(6)];
+    assert(dstr_regex_set_matches(set, s, 0, bits) == 5);
+    assert(has_bit(bits, 0) && has_bit(bits, 1) && has_bit(bits, 2));
+    assert(has_bit(bits, 3) && !has_bit(bits, 4) && has_bit(bits, 5));
+
+    DSTR_Regex_Match m;
+    assert(dstr_regex_set_first(set, s, 0, &m) == 3);
+    assert(m.offset == 0 && m.length == 7);
+    assert(dstr_regex_set_first(set, s, 8, &m) == 0);
+    assert(m.offset == 8 && m.length == 24);
+    assert(dstr_regex_set_first(set, s, 33, &m) == 5 && m.offset == 39);
+
+    assert(dstr_regex_set_matches(set, s, 26, bits) == 1 && has_bit(bits, 5));
+    dstr_assign_sz(s, "nothing here");
+    assert(dstr_regex_set_first(set, s, 0, &m) == -1 && m.offset == DSTR_NPOS);
+    assert(dstr_regex_set_matches(set, s, 0, bits) == 0);
+    dstr_regex_set_free(set);
+
+    // many rules, only those whose literal occurs are tried
+    //
+    const char* many[200];
+    DSTR texts[200];
+    for (size_t i = 0; i < 200; ++i) {
+        texts[i] = dstrnew_empty();
+        dstr_assign_sprintf(texts[i], "svc%zu\\.(err|warn)", i);
+        many[i] = dstrdata(texts[i]); }
+
+    set = dstr_regex_set_compile(many, 200, NULL, NULL, NULL);
+    uint64_t many_bits[DSTR_REGEX_SET_WORDS(200)];
+    dstr_assign_sz(s, "svc17.err svc123.warn svc5.info svc199.err");
+    assert(dstr_regex_set_matches(set, s, 0, many_bits) == 3);
+    assert(has_bit(many_bits, 17) && has_bit(many_bits, 123) && has_bit(many_bits, 199));
+    assert(dstr_regex_set_first(set, s, 1, &m) == 123 && m.offset == 10);
+    dstr_regex_set_free(set);
+
+    for (size_t i = 0; i < 200; ++i) {
+        dstrfree(texts[i]); }
+
+    // extended mode comments end with their pattern
+    //
+    const char* commented[] = { "a b  # the first", "c" };
+    set = dstr_regex_set_compile(commented, 2, "x", NULL, NULL);
+    dstr_assign_sz(s, "abc");
+    assert(dstr_regex_set_matches(set, s, 0, bits) == 2);
+    dstr_regex_set_free(set);
+
+    // literals are only taken where every match has them
+    //
+    const char* tricky[] = { "colou?r", "ab{0,2}cde", "\\.\\d+\\.html", "(?i)hello",
+                             "x{2}yz", "caf\xC3\xA9?s" };
+    set = dstr_regex_set_compile(tricky, 6, "u", NULL, NULL);
+    dstr_assign_sz(s, "color acde 7.12.html HELLO xxyz cafs");
+    assert(dstr_regex_set_matches(set, s, 0, bits) == 6);
+    dstr_regex_set_free(set);
+
+    // an octal escape stays one, whatever groups come before it
+    //
+    const char* octal[] = { "(x)", "(x)", "(x)", "(x)", "(x)", "(x)",
+                            "(x)", "(x)", "(x)", "(x)", "(x)", "a\\11" };
+    set = dstr_regex_set_compile(octal, 12, NULL, NULL, NULL);
+    dstr_assign_sz(s, "a\t");
+    assert(dstr_regex_set_matches(set, s, 0, bits) == 1 && has_bit(bits, 11));
+    assert(dstr_regex_set_first(set, s, 0, NULL) == 11);
+    dstr_regex_set_free(set);
+
+    const char* bad[] = { "ok", "(a(b|c$" };
+    size_t at = 0;
+    assert(dstr_regex_set_compile(bad, 2, NULL, &err, &at) == NULL);
+    assert(err > 0 && at == 1);
+
+    // patterns already compiled alone are freed on a later error
+    //
+    const char* bad_after_alone[] = { "(a)\\1", "(" };
+    assert(dstr_regex_set_compile(bad_after_alone, 2, NULL, &err, &at) == NULL);
+    assert(err > 0 && at == 1);
+
+    dstrfree(s);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+static size_t find_with(const char* pattern, const char* opts, const char* text,
+                        size_t offset)
+{
+    DSTR_Regex* re = dstr_regex_compile(pattern, opts, NULL);
+    assert(re);
+    DSTR s = dstrnew(text);
+    size_t pos = dstr_regex_contains_re(re, s, offset);
+    dstrfree(s);
+    dstr_regex_free(re);
+    return pos;
+}
+//--------------------------------------------------------------------------------
+
+void test_literal_prefilter()
+{
+    TRACE_FN();
+
+    // subjects without the required literal are rejected early, the
+    // others match as before
+    //
+    assert(find_with("\\d+ms slow query", NULL, "done in 12ms", 0) == DSTR_NPOS);
+    assert(find_with("\\d+ms slow query", NULL, "took 812ms slow query", 0) == 5);
+    assert(find_with("ERROR .* timeout", NULL, "ERROR x ERROR y timeout", 2) == 8);
+    assert(find_with("[a-z]+\\.example\\.com", NULL, "at www.example.com", 0) == 3);
+
+    // a leading literal moves the start, assertions before it still hold
+    //
+    assert(find_with("user_id=(\\d+)", NULL, "user_id=1 user_id=22", 1) == 10);
+    assert(find_with("\\bfoo", NULL, "xfoo foo", 0) == 5);
+    assert(find_with("(?<=x)abc", NULL, "yabc xabc", 0) == 6);
+    assert(find_with("^abc", NULL, "xabc", 0) == DSTR_NPOS);
+    assert(find_with("^abc", "m\n", "x\nabc", 0) == 2);
+    assert(find_with("abc", "A", "xabc", 0) == DSTR_NPOS);
+    assert(find_with("abc", "F\n", "x\nabc", 0) == DSTR_NPOS);
+    assert(find_with("abc$", NULL, "xxabc", 3) == DSTR_NPOS);
+
+    // lookarounds and optional items are not part of the literal
+    //
+    assert(find_with("a(?=b)bc", NULL, "xxabc", 0) == 2);
+    assert(find_with("a(?=b)bc", NULL, "xxac", 0) == DSTR_NPOS);
+    assert(find_with("colou?r", NULL, "color", 0) == 0);
+    assert(find_with("caf\xC3\xA9?s", "u", "cafs", 0) == 0);
+    assert(find_with("caf\xC3\xA9?s", "u", "caf\xC3\xA9s", 0) == 0);
+    assert(find_with("ab{2}c", NULL, "abbc", 0) == 0);
+
+    // an offset inside a UTF-8 character is still reported by PCRE2
+    //
+    DSTR s = dstrnew("caf\xC3\xA9 xyz");
+    assert(dre_match(s, "abc", 4, NULL, "u") == PCRE2_ERROR_BADUTFOFFSET);
+    assert(dre_match(s, "xyz", 4, NULL, "u") == PCRE2_ERROR_BADUTFOFFSET);
+    assert(dre_match(s, "xyz", 5, NULL, "u") > 0);
+    dstrfree(s);
+
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
+
+// Input handed out CHUNK bytes per read
+//
+typedef struct Chunks {
+    const char* text;
+    size_t      pos;
+    size_t      chunk;
+} Chunks;
+
+static long read_chunk(void* ctx, char* buf, size_t size)
+{
+    Chunks* c = (Chunks*) ctx;
+    size_t n = strlen(c->text + c->pos);
+    if (n > c->chunk) {
+        n = c->chunk; }
+    if (n > size) {
+        n = size; }
+    memcpy(buf, c->text + c->pos, n);
+    c->pos += n;
+    return (long) n;
+}
+//--------------------------------------------------------------------------------
+
+typedef struct Spans {
+    size_t count;
+    size_t at[128];
+} Spans;
+
+static int add_span(void* ctx, const size_t* groups, size_t n_groups)
+{
+    Spans* sp = (Spans*) ctx;
+    (void) n_groups;
+    sp->at[sp->count++] = groups[0];
+    sp->at[sp->count++] = groups[1];
+    return 0;
+}
+//--------------------------------------------------------------------------------
+
+// Streamed matches of PATTERN in TEXT, read CHUNK bytes at a time, are
+// those found in the whole text
+//
+static void check_stream(const char* pattern, const char* opts, const char* text)
+{
+    DSTR_Regex* re = dstr_regex_compile(pattern, opts, NULL);
+    DSTR s = dstrnew(text);
+    Spans expected = { 0 };
+    dstr_regex_foreach_re(re, s, 0, add_span, &expected);
+
+    for (size_t chunk = 1; chunk <= 9; chunk += 4) {
+        Chunks c = { text, 0, chunk };
+        DSTR_Regex_Stream* st = dstr_regex_stream_new(re, read_chunk, &c, 0);
+        assert(st);
+
+        Spans got = { 0 };
+        DSTR_Regex_Stream_Match m;
+        while (dstr_regex_stream_next(st, &m) == DSTR_SUCCESS) {
+            assert(m.offset == m.base + m.groups[0]);
+            assert(m.text.data == m.data + m.groups[0]);
+            assert(memcmp(m.text.data, text + m.offset, m.text.length) == 0);
+            got.at[got.count++] = (size_t) m.offset;
+            got.at[got.count++] = (size_t) m.offset + m.text.length; }
+
+        assert(dstr_regex_stream_error(st) == 0);
+        assert(got.count == expected.count);
+        assert(memcmp(got.at, expected.at, got.count * sizeof(size_t)) == 0);
+        dstr_regex_stream_close(st); }
+
+    dstrfree(s);
+    dstr_regex_free(re);
+}
+//--------------------------------------------------------------------------------
+
+void test_regex_stream()
+{
+    TRACE_FN();
+
+    // matches across chunk boundaries, assertions at the ends of chunks
+    //
+    const char* text = "abc foo  bar 12 x345\nline one\nline 6789 xyy end";
+    check_stream("foo\\s+bar", NULL, text);
+    check_stream("\\d+", NULL, text);
+    check_stream("\\b\\w+\\b", NULL, text);
+    check_stream("(?<=x)y+", NULL, text);
+    check_stream("^line \\w+", "m\n", text);
+    check_stream("\\Aabc|^abc", NULL, text);
+    check_stream("end$|e$", NULL, text);
+    check_stream("x*", NULL, text);
+    check_stream("caf\xC3\xA9|\xC3\xA9*", "u", "caf\xC3\xA9 \xC3\xA9\xC3\xA9 cafe");
+
+    // a match longer than the window
+    //
+    char big[1001];
+    memset(big, 'a', 1000);
+    big[1000] = '\0';
+
+    DSTR_Regex* re = dstr_regex_compile("a.*z", "s", NULL);
+    Chunks c = { big, 0, 100 };
+    DSTR_Regex_Stream* st = dstr_regex_stream_new(re, read_chunk, &c, 256);
+    DSTR_Regex_Stream_Match m;
+    assert(dstr_regex_stream_next(st, &m) == -48);      // PCRE2_ERROR_NOMEMORY
+    dstr_regex_stream_close(st);
+    dstr_regex_free(re);
+
+    // files, far past the window: offsets are those in the file
+    //
+    re = dstr_regex_compile("needle (\\d+)", NULL, NULL);
+    FILE* fp = tmpfile();
+    assert(fp);
+    for (int i = 0; i < 5000; ++i) {
+        fprintf(fp, "line %d of hay%s\n", i, (i % 1000 == 999) ? " needle 42" : ""); }
+    long size = ftell(fp);
+    rewind(fp);
+
+    DSTR whole = dstrnew_empty();
+    dstr_slurp_stream(whole, fp);
+    assert((long) dstr_length(whole) == size);
+    rewind(fp);
+
+    st = dstr_regex_stream_from_stream(re, fp, 4096);
+    dstr_regex_free(re);              // the stream has its own copy
+
+    size_t count = 0;
+    while (dstr_regex_stream_next(st, &m) == DSTR_SUCCESS) {
+        assert(m.n_groups == 2 && m.groups[3] - m.groups[2] == 2);
+        assert(m.base + m.groups[2] == m.offset + 7);
+        assert(memcmp(dstr_cstr(whole) + m.offset, "needle 42\n", 10) == 0);
+        ++count; }
+    assert(count == 5 && dstr_regex_stream_error(st) == 0);
+    dstr_regex_stream_close(st);
+
+    re = dstr_regex_compile("hay needle", NULL, NULL);
+    rewind(fp);
+    st = dstr_regex_stream_fdopen(re, fileno(fp), 0);
+    for (count = 0; dstr_regex_stream_next(st, &m) == DSTR_SUCCESS; ++count) {}
+    assert(count == 5);
+    dstr_regex_stream_close(st);
+    fclose(fp);
+
+    assert(dstr_regex_stream_open(re, "/no/such/file", 0) == NULL && errno == ENOENT);
+    dstr_regex_free(re);
+
+    dstrfree(whole);
+    puts("OK");
+}
+//--------------------------------------------------------------------------------
 
 int main()
 {
@@ -211,5 +844,15 @@ int main()
     test_dstr_group_patterns();
     test_dstr_group_extract();
     test_exact_match();
+    test_utf8_options();
+    test_jit();
+    test_many_groups();
+    test_cache();
+    test_compiled_regex();
+    test_foreach();
+    test_substitute_cb();
+    test_regex_set();
+    test_literal_prefilter();
+    test_regex_stream();
 }
 //--------------------------------------------------------------------------------
@@ -12,6 +12,7 @@
 #include <vector>
 #include <algorithm>
 #include <chrono>
+#include <iomanip>
 
 #include <assert.h>
 #include <string.h>
@@ -94,9 +95,14 @@ void test_empty_dstr()
     DString s1;
     DString s2((char*)nullptr, size_t(0));
     DString s5(nullptr);
+#if defined(DSTR_BINARY_SAFE)
+    DString s6('\0', 0);        // NUL bytes are kept in binary safe builds
+    DString s8("", size_t(0));
+#else
     DString s6('\0', 100);
-    DString s7('C', 0);
     DString s8("", 100);
+#endif
+    DString s7('C', 0);
 
     assert(s1.length() == 0);
     assert(s2.length() == 0);
@@ -197,9 +203,14 @@ void test_buff_ctor()
     assert(s4.length() == 0);
     assert(s4 == "");
 
-    DString s5("", 10);
+    static const char nuls[10] = { 0 };
+    DString s5(nuls, 10);
+#if defined(DSTR_BINARY_SAFE)
+    assert(s5.length() == 10 && s5 == DStringView(nuls, 10));
+#else
     assert(s5 == "");
     assert(s5.length() == 0);
+#endif
 }
 //-------------------------------------------------
 
@@ -370,9 +381,17 @@ void test_append()
     assert(s5 == "hello");
 
     s5.append('\0');
+#if defined(DSTR_BINARY_SAFE)
+    assert(s5 == DStringView("hello\0", 6));
+    s5.pop_back();
+#endif
     assert(s5 == "hello");
 
-    s5.append("_ABC\0EFG", 10);
+    s5.append("_ABC\0EFG", 9);
+#if defined(DSTR_BINARY_SAFE)
+    assert(s5 == DStringView("hello_ABC\0EFG", 14));
+    s5.resize(9);
+#endif
     assert(s5 == "hello_ABC");
 
     s5.append((char*)nullptr, 10);
@@ -634,7 +653,11 @@ void test_insert()
     s1.insert(4, nullptr);
     assert(s1 == "hellXXoX");
 
-    s1.insert(0, "XXX", DString::NPOS);
+#if defined(DSTR_BINARY_SAFE)
+    s1.insert(0, "XXX", 3);
+#else
+    s1.insert(0, "XXX", DString::NPOS);      // up to the NUL
+#endif
     assert( s1 == "XXXhellXXoX");
 
     s1.insert(0, (char*)nullptr, DString::NPOS);
@@ -698,6 +721,10 @@ void test_replace()
     assert( s1 == "hellohello");
 
     s1.replace(5, 5, '\0', 1);
+#if defined(DSTR_BINARY_SAFE)
+    assert( s1 == DStringView("hello\0", 6) );
+    s1.resize(5);
+#endif
     assert( s1 == "hello" );
 
     s1.replace(0, DString::NPOS, "world");
@@ -707,11 +734,15 @@ void test_replace()
     s1.replace(0, DString::NPOS, (char*)nullptr, 100);
     assert(s1 == "");
 
+#if !defined(DSTR_BINARY_SAFE)
+    // NUL truncates in text builds
+    //
     s2.replace(2, 8,'\0', 100);
     assert(s2 == "wo");
 
     s2.replace(0, 2,'\0', 100);
     assert(s2 == "");
+#endif
 
     DString s3("H World");
     const char* ps3 = s3.c_str() + s3.find("World");
@@ -798,6 +829,98 @@ void test_getline()
 }
 //-------------------------------------------------
 
+// Compare 'operator>>' and 'io_getline' on DString to the same
+// operations on std::string, over buffered and unbuffered streambufs
+//
+struct UnbufferedIn : std::streambuf {
+    const char* p;
+    const char* e;
+    UnbufferedIn(const char* s, size_t n) : p(s), e(s + n) {}
+    int_type underflow() { return p == e ? traits_type::eof() : traits_type::to_int_type(*p); }
+    int_type uflow() { return p == e ? traits_type::eof() : traits_type::to_int_type(*p++); }
+};
+
+void test_istream()
+{
+    std::string text;
+    for (int i = 0; i < 2000; ++i) {
+        text += "  word";
+        text += std::to_string(i);
+        text += (i % 7 == 0) ? "\n\n" : (i % 3 == 0) ? "\t;" : " ;";
+    }
+    text += "tail";
+
+    // words
+    {
+        istringstream in1(text);
+        istringstream in2(text);
+        DString d;
+        std::string s;
+        for (;;) {
+            bool r1 = bool(in1 >> d);
+            bool r2 = bool(in2 >> s);
+            assert(r1 == r2);
+            if (!r1)
+                break;
+            assert(d == s.c_str());
+        }
+        assert(in1.eof() && in1.fail());
+    }
+
+    // lines, default and custom delimiter
+    for (char delim : { '\n', ';', 'x' }) {
+        istringstream in1(text);
+        istringstream in2(text);
+        DString d;
+        std::string s;
+        for (;;) {
+            bool r1 = bool(getline(in1, d, delim));
+            bool r2 = bool(std::getline(in2, s, delim));
+            assert(r1 == r2);
+            assert(in1.eof() == in2.eof());
+            if (!r1)
+                break;
+            assert(d == s.c_str());
+        }
+    }
+
+    // unbuffered streambuf takes the per-character path
+    {
+        UnbufferedIn ub(text.data(), text.size());
+        istream in1(&ub);
+        istringstream in2(text);
+        DString d;
+        std::string s;
+        while (io_getline(in1, d, ';')) {
+            assert(std::getline(in2, s, ';'));
+            assert(d == s.c_str());
+        }
+        assert(!std::getline(in2, s, ';'));
+
+        UnbufferedIn ub2(" ab  cd\n", 8);
+        istream in3(&ub2);
+        assert(in3 >> d && d == "ab");
+        assert(in3 >> d && d == "cd");
+        assert(!(in3 >> d));
+    }
+
+    // width limits operator>>, empty lines extract the delimiter only
+    {
+        istringstream in("abcdef\n\nx");
+        DString d;
+        in >> setw(4) >> d;
+        assert(d == "abcd");
+        assert(in.width() == 0);
+        assert(io_getline(in, d) && d == "ef");
+        assert(io_getline(in, d) && d.empty());
+        assert(io_getline(in, d) && d == "x" && in.eof());
+        assert(!io_getline(in, d));
+    }
+
+    cout << __func__ << ": Good! stream extraction matches std::string" << endl;
+}
+//-------------------------------------------------
+
 // Compare to 'dstr_getline' to 'std::getline(in, str)' must be equal
 //
 std::string file_slurp(const char* fname)
@@ -1183,6 +1306,34 @@ void test_swap()
 }
 //-------------------------------------------------
 
+void test_adopt_release()
+{
+    TRACE_FN();
+
+    char* buf = (char*) malloc(256);
+    memset(buf, 'y', 100);
+
+    DString s("old");
+    s.adopt(buf, 100, 256);
+    assert(s.size() == 100 && s.data() == buf && s.capacity() == 256);
+
+    DString moved(std::move(s));
+    assert(moved.data() == buf && s.empty());
+
+    size_t len, cap;
+    char* out = moved.release(&len, &cap);
+    assert(out == buf && len == 100 && cap == 256 && moved.empty());
+
+    bool thrown = false;
+    try {
+        moved.adopt(out, 256, 256); }
+    catch (const DStringError&) {
+        thrown = true; }
+    assert(thrown && moved.empty());
+    free(out);
+}
+//-------------------------------------------------
+
 void test_ffo()
 {
     TRACE_FN();
@@ -1666,6 +1817,48 @@ void test_conversion()
 
     int n = s.stoi(&index);
     printf("%d, %zu\n", n, index);
+
+    assert(DString::to_string(0.1) == "0.1");
+    assert(DString::to_string(0.1f) == "0.1");
+    assert(DString::to_string(1e100) == "1e+100");
+    assert(DString::to_string(3.0f) == "3");
+    assert(DString::to_string(2.5L) == "2.5");
+    assert(DString::to_string(1e300L).stold() == 1e300L);
+
+    DString d("pi=");
+    d.append_double(3.14159265358979).append(", ").append_double(3.14159265358979, 2);
+    assert(d == "pi=3.14159265358979, 3.14");
+
+    std::vector<double> values;
+    DString csv("1.25, 2e3 ,-0.5");
+    assert(csv.stod_list(values) == 3);
+    assert(values[0] == 1.25 && values[1] == 2000 && values[2] == -0.5);
+    assert(DStringView("7|x|9").stod_list(values, '|', &index) == 1 && index == 2);
+
+    std::vector<long long> ints;
+    assert(DString("1,2, 0x10").stoll_list(ints, ',', &index, 0) == 3);
+    assert(ints[2] == 16 && index == 9);
+
+    DString enc;
+    enc.append_hex(DStringView("hi!")).append(' ').append_base64("hi!", 3, DSTR_BASE64_URL);
+    assert(enc == "686921 aGkh");
+
+    DString dec;
+    assert(dec.decode_base64("aGkh") && dec == "hi!");
+    assert(!dec.decode_hex("6g") && dec == "hi!");
+
+    DString json("{\"msg\":\"");
+    json.append_escaped("say \"hi\"\n", DSTR_ESC_JSON).append("\"}");
+    assert(json == "{\"msg\":\"say \\\"hi\\\"\\n\"}");
+
+    DString plain;
+    assert(plain.append_unescaped("a%20b", DSTR_ESC_URL) && plain == "a b");
+
+    DString u;
+    assert(u.append_utf16(u"caf\u00e9", 4) && u.append_utf32(U"\U0001F600", 1));
+    assert(u == "caf\xc3\xa9\xf0\x9f\x98\x80");
+    assert(u.utf8_valid() && u.utf8_length() == 5 && u.utf8_offset_of(4) == 5);
+    assert(DStringView(u).utf8_offset_of(6) == DString::NPOS);
 }
 //-------------------------------------------------
 
@@ -2224,6 +2417,51 @@ void test_dstringstream(void)
     DString s = out.str();
     assert(s == "Hello World");
 
+    // writes go into the spare capacity, committed by str()
+    //
+    out.reset();
+    std::string expected;
+    for (int i = 0; i < 2000; ++i) {
+        out << i << ',' << 0.5 * i << ' ';
+        expected += std::to_string(i) + "," + DString::c_format("%g", 0.5 * i).c_str() + " ";
+        if (i % 500 == 0) {
+            assert(out.str().size() == expected.size()); } }
+    assert(out.str() == expected.c_str());
+    assert(out.str().capacity() > out.str().size());
+
+    // pooled streams come back reset
+    //
+    {
+        DStringOutPool::Lease l1 = DStringOutPool::acquire();
+        *l1 << std::hex << 255 << "abc";
+        assert(l1->str() == "ffabc");
+        DStringOutPool::Lease l2 = DStringOutPool::acquire();
+        assert(&*l1 != &*l2 && l2->str().empty());
+    }
+    {
+        DStringOutPool::Lease l1 = DStringOutPool::acquire();
+        *l1 << 255;
+        assert(l1->str() == "255");
+    }
+    assert(to_dstring(3.5) == "3.5");
+
+    // zero copy input
+    //
+    DString text("12 abc 3.25\nsecond line\n");
+    DStringIn din(text);
+    int ival = 0;
+    double dval = 0;
+    std::string word, line;
+    din >> ival >> word >> dval;
+    assert(ival == 12 && word == "abc" && dval == 3.25);
+    din.ignore(1);
+    std::getline(din, line);
+    assert(line == "second line");
+    assert(din.tellg() == (std::streampos) text.size());
+    din.seekg(3);
+    din >> word;
+    assert(word == "abc" && din.view() == text);
+
     // Slurp this file in two methods and compare
     //
     std::ifstream in(__FILE__);
@@ -2233,15 +2471,53 @@ void test_dstringstream(void)
     DString content2 = DString::from_file(__FILE__);
     assert(content2 == dsout.str());
 
+    DMappedFile mapped(__FILE__);
+    assert(mapped.view() == content2 && mapped.size() == content2.size());
+    DMappedFile moved(std::move(mapped));
+    assert(mapped.empty() && moved.view().find("DMappedFile") != DString::NPOS);
+
+    std::vector<DString> files(20, DString(__FILE__));
+    std::vector<DString> contents = DString::from_files_async(files).get();
+    assert(contents.size() == 20 && contents[19] == content2);
+
+    files.push_back("no/such/file");
+    bool thrown = false;
+    try {
+        DString::from_files_async(files).get(); }
+    catch (const DStringError&) {
+        thrown = true; }
+    assert(thrown);
+
+    {
+        DStringWriter writer("dstring_writer_test.tmp", DSTR_WRITE_NEWLINE);
+        for (size_t i = 0; i < files.size(); ++i) {
+            writer.write(files[i]); }
+        writer.write_copy(DString::to_string(42)).write(DStringView("end"));
+        writer.close();
+
+        DString written = DStringView("\n").join(files) + "\n42\nend\n";
+        assert(DString::from_file("dstring_writer_test.tmp") == written);
+        remove("dstring_writer_test.tmp");
+
+        thrown = false;
+        try {
+            DStringWriter bad("no/such/dir/file"); }
+        catch (const DStringError&) {
+            thrown = true; }
+        assert(thrown);
+    }
+
     // to_dstring is a template that uses operator <<
     //
     for (int i = -100; i < 100; ++i) {
         assert(to_dstring(i) == DString::to_string(i)); }
 
-    // to_dstring is a template that uses operator <<
+    // to_dstring is a template that uses operator << (same as "%g")
+    // while DString::to_string() is the shortest round-trip string
     //
     for (double d = -100.0; d < 100.0; d += 3.14159) {
-        assert(to_dstring(d) == DString::to_string(d)); }
+        assert(to_dstring(d) == DString::c_format("%g", d));
+        assert(DString::to_string(d).stod() == d); }
 #endif
 }
 //-------------------------------------------------
@@ -2535,6 +2811,7 @@ int main()
     test_replace();
     test_replace1();
     test_getline();
+    test_istream();
     test_fgets();
     test_fromfile();
     test_substr();
@@ -2547,6 +2824,7 @@ int main()
     test_ascii_upper_lower();
     test_reverse();
     test_swap();
+    test_adopt_release();
     test_ffo();
     test_ffno();
     test_flo();
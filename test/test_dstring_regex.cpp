@@ -12,6 +12,9 @@
 #include <functional>
 #include <unordered_map>
 #include <thread>
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 #include <dstr/dstring.hpp>
 
@@ -449,10 +452,295 @@ void test_re_split()
 
     DString("aaabcdaaa").re_split("", res);
     cout << res << endl;
+
+    // An empty match in UTF-8 mode skips a whole character, no piece
+    // starts in the middle of one
+    //
+    DString utf("a\xc3\xa9" "b");
+    utf.re_split("x*", 0, res, "u");
+    assert(res.size() == 5);
+    for (const auto& piece: res) {
+        assert(piece.empty()); }
+
+    utf.re_split(DRegex("(?=b)|x*", "u"), res);
+    assert(res.size() == 5);
+    for (const auto& piece: res) {
+        assert(piece.empty() || (piece[0] & 0xC0) != 0x80); }
+
+    utf.re_split("x*", 0, res);
+    assert(res.size() == 6);
 }
 //--------------------------------------------------------------------------------
 
 
+void test_dregex()
+{
+    TRACE_FN();
+
+    DRegex date("(?<year>\\d{4})-(?<month>\\d{2})");
+    DString subject = "Today is 2025-10-29 and tomorrow is 2025-10-30";
+
+    DString::Match m;
+    assert(subject.match(date, m) > 0);
+    assert(m.offset == 9 && m.length == 7);
+    assert(subject.match_contains(date, 16) == 36);
+    assert(subject.capture(date) == "2025-10");
+    assert(!subject.match(date) && DString("2025-10").match(date));
+
+    std::vector<DString> parts;
+    assert(subject.capture(date, 20, parts) == 3);
+    assert(parts.size() == 3 && parts[1] == "2025" && parts[2] == "10");
+
+    DString::MatchVector groups;
+    assert(subject.match_groups(date, groups) == 3);
+    assert(groups[1].name && dstreq(groups[1].name, "year"));
+
+    subject.re_split(DRegex("\\s*(and|is)\\s*"), parts);
+    assert(parts.size() == 7 && parts[0] == "Today" && parts[4] == "tomorrow");
+
+    // options are fixed at compile time
+    //
+    DRegex vowels("[AEIOU]", "gi");
+    assert(DString("hello world").subst(vowels, "*") == "h*ll* w*rld");
+
+    DString s("banana");
+    assert(s.subst_inplace(DRegex("an"), "AN") == 1 && s == "bANana");
+
+    // a moved from DRegex reports an error
+    //
+    DRegex moved(std::move(vowels));
+    assert(DStringView("axe").match_contains(moved) == 0);
+
+    bool thrown = false;
+    try {
+        s.subst_inplace(vowels, "*"); }
+    catch (const DStringError&) {
+        thrown = true; }
+    assert(thrown);
+
+    thrown = false;
+    try {
+        DRegex bad("(a(b|c$"); }
+    catch (const DStringError& ex) {
+        thrown = true;
+        cerr << "Exception caught as expected: " << ex.what() << endl; }
+    assert(thrown);
+}
+//--------------------------------------------------------------------------------
+
+#if __cplusplus >= 202002L
+static_assert(std::ranges::input_range<DRegexMatches>);
+#endif
+
+void test_find_all()
+{
+    TRACE_FN();
+
+    DRegex pair("(\\w+)=(\\d+)?");
+    DString line("a=1, bb=, ccc=333");
+
+    std::vector<DString> keys;
+    size_t digits = 0;
+    for (const DRegexMatch& m : line.find_all(pair)) {
+        assert(m.size() == 3);
+        keys.push_back(m[1]);
+        digits += m.length(2);
+        cout << m.offset() << ": " << m.str() << endl; }
+
+    assert(keys.size() == 3 && keys[1] == "bb" && keys[2] == "ccc");
+    assert(digits == 4);
+
+    // views are slices of the subject
+    //
+    auto matches = DStringView(line).find_all(pair, 5);
+    auto it = matches.begin();
+    assert(it != matches.end() && it->offset() == 5 && it->str() == "bb=");
+    assert(!it->matched(2) && it->offset(2) == DString::NPOS && it->length(2) == 0);
+    assert((*it)[2].empty());
+    assert((*it)[1].data() == line.data() + 5);
+    ++it;
+    assert(it->str() == "ccc=333" && (*it)[2] == "333");
+    ++it;
+    assert(it == matches.end());
+
+    // empty matches step over every position
+    //
+    DRegex none("x*");
+    size_t n = 0;
+    for (const auto& m : DStringView("abc").find_all(none)) {
+        assert(m.offset() == n++ && m.length() == 0); }
+    assert(n == 4);
+
+    // re_split keeps a slot for every group
+    //
+    std::vector<DString> parts;
+    DString("1a2b3").re_split("(a)|(b)", parts);
+    assert(parts.size() == 7 && parts[1] == "a" && parts[2] == "" && parts[6] == "3");
+}
+//--------------------------------------------------------------------------------
+
+void test_subst_fn()
+{
+    TRACE_FN();
+
+    std::unordered_map<std::string, std::string> env = {
+        { "HOME", "/home/me" }, { "USER", "me" } };
+
+    DString line("cd $HOME; echo $USER $NONE");
+    DRegex var("\\$(\\w+)", "g");
+    int rc = line.subst_inplace_fn(var, [&](const DRegexMatch& m) {
+        auto it = env.find(std::string(m[1].data(), m[1].size()));
+        return it == env.end() ? "" : it->second.c_str(); });
+
+    assert(rc == 3 && line == "cd /home/me; echo me ");
+
+    // replacements may be computed into a DString
+    //
+    DString prices("apple 3, pear 12");
+    prices.subst_inplace_fn("\\d+", 0, [](const DRegexMatch& m) {
+        DString d;
+        d.sprintf("%d", 100 * atoi(m.str().data()));
+        return d; }, "g");
+    assert(prices == "apple 300, pear 1200");
+
+    // exceptions thrown by the function come through, the string is kept
+    //
+    bool thrown = false;
+    try {
+        prices.subst_inplace_fn(var, [](const DRegexMatch&) -> DStringView {
+            throw std::runtime_error("no"); }); }
+    catch (const std::runtime_error&) {
+        thrown = true; }
+    assert(!thrown);   // no $ in prices, never called
+
+    try {
+        line.subst_inplace_fn(DRegex("\\w+"), [](const DRegexMatch&) -> DStringView {
+            throw std::runtime_error("no"); }); }
+    catch (const std::runtime_error&) {
+        thrown = true; }
+    assert(thrown && line == "cd /home/me; echo me ");
+}
+//--------------------------------------------------------------------------------
+
+void test_regex_set()
+{
+    TRACE_FN();
+
+    DRegexSet rules({ "ERROR .* timeout", "\\buser_id=(\\d+)", "^\\d{4}-\\d\\d", "(\\w)\\1" });
+    assert(rules.size() == 4);
+
+    DString line("2025-10 ERROR user_id=42 timeout");
+    std::vector<uint64_t> bits;
+    assert(rules.matches(line, bits) == 4 && DRegexSet::test(bits, 2));
+    assert(rules.which(line, 8) == std::vector<size_t>({ 0, 1, 3 }));
+
+    DString::Match m;
+    assert(rules.first(line, 8, &m) == 0 && m.offset == 8);
+    assert(rules.first("no match") == -1);
+
+    bool thrown = false;
+    try {
+        DRegexSet bad({ "ok", "(a(b|c$" }); }
+    catch (const DStringError& ex) {
+        thrown = true;
+        cerr << "Exception caught as expected: " << ex.what() << endl; }
+    assert(thrown);
+}
+//--------------------------------------------------------------------------------
+
+void test_regex_stream()
+{
+    TRACE_FN();
+
+    FILE* fp = tmpfile();
+    assert(fp);
+    for (int i = 0; i < 2000; ++i) {
+        fprintf(fp, "%d: %s\n", i, (i % 500 == 0) ? "key=\nvalue" : "nothing"); }
+    rewind(fp);
+
+    // matches span lines, and reads with the small window; the temporary
+    // DRegex is not needed after construction
+    //
+    DRegexStream st(DRegex("key=\\s*(\\w+)"), fp, 1024);
+    std::vector<uint64_t> offsets;
+    while (st.next()) {
+        assert(st.str() == "key=\nvalue" && st[1] == "value");
+        assert(st.offset(1) == st.offset() + 5 && st.length(1) == 5);
+        offsets.push_back(st.offset()); }
+    assert(offsets.size() == 4 && st.error() == 0);
+    assert(offsets[0] == 3);
+    fclose(fp);
+
+    bool thrown = false;
+    try {
+        DRegexStream missing(DRegex("x"), "/no/such/file"); }
+    catch (const DStringError& ex) {
+        thrown = true;
+        cerr << "Exception caught as expected: " << ex.what() << endl; }
+    assert(thrown);
+}
+//--------------------------------------------------------------------------------
+
+// With the process wide cache each pattern is compiled once, however
+// many threads use it
+//
+void test_shared_cache()
+{
+    TRACE_FN();
+
+    const int n_threads = 8;
+    const int n_patterns = 50;
+
+    dstr_regex_shared_cache(256);
+
+    std::vector<size_t> compiled(n_threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; ++t) {
+        threads.emplace_back([t, &compiled] {
+            DSTR_Regex_Cache_Stats st;
+            dstr_regex_cache_set_capacity(64);
+            dstr_regex_cache_stats(&st, true);
+
+            DString line("id=42 rule");
+            for (int round = 0; round < 3; ++round) {
+                for (int i = 0; i < n_patterns; ++i) {
+                    DString pattern;
+                    pattern.sprintf("id=(\\d+)|shared%d", i);
+                    assert(line.match_contains(pattern) == 0); } }
+
+            dstr_regex_cache_stats(&st, false);
+            assert(st.misses == (size_t) n_patterns);
+            assert(st.hits == 2 * (size_t) n_patterns);
+            compiled[t] = st.misses - st.shared_hits; }); }
+
+    for (auto& t : threads)
+        t.join();
+
+    size_t total = 0;
+    for (size_t n : compiled)
+        total += n;
+
+    // Threads racing on a miss may compile the same pattern, only one
+    // copy is kept
+    //
+    cout << "compiled " << total << " for " << n_patterns << " patterns" << endl;
+    assert(total >= (size_t) n_patterns && total < (size_t) (n_patterns * n_threads));
+
+    // and a later thread compiles nothing
+    //
+    std::thread late([] {
+        DSTR_Regex_Cache_Stats st;
+        dstr_regex_cache_stats(&st, true);
+        DString line("id=42 rule");
+        assert(line.match_contains("id=(\\d+)|shared7") == 0);
+        dstr_regex_cache_stats(&st, false);
+        assert(st.misses == 1 && st.shared_hits == 1); });
+    late.join();
+
+    assert(dstr_regex_shared_cache(0) == 256);
+}
+//--------------------------------------------------------------------------------
+
 // To check that REGEX cache behaves nicely from different threads
 //
 void test_within_threads()
@@ -491,6 +779,12 @@ int main()
         test_pattern();
         test_dstring_replace_all();
         test_re_split();
+        test_dregex();
+        test_find_all();
+        test_subst_fn();
+        test_regex_set();
+        test_regex_stream();
+        test_shared_cache();
         test_within_threads();
     }
     catch (const std::exception& ex) {